@@ -53,7 +53,7 @@ class AstFormatter : Expr.Visitor<String>, Stmt.Visitor<String> {
     override fun visitClassStmt(stmt: Stmt.Class): String =
         node(
             "Stmt.Class ${stmt.name.lexeme}" + (stmt.superclass?.let { " < ${it.name.lexeme}" } ?: ""),
-            *stmt.methods.toTypedArray()
+            *(stmt.fields + stmt.methods).toTypedArray()
         )
 
     override fun visitExpressionStmt(stmt: Stmt.Expression): String =
@@ -63,12 +63,14 @@ class AstFormatter : Expr.Visitor<String>, Stmt.Visitor<String> {
         buildString {
             val name = stmt.name.lexeme
             append("Stmt.Function \"$name\"")
+            stmt.returnType?.let { append(" : ${it.lexeme}") }
 
             // Always show parameters as separate lines (if any)
             stmt.params.forEachIndexed { i, param ->
                 val isLastParam = i == stmt.params.lastIndex && stmt.body.isEmpty()
                 val prefix = if (isLastParam) "└─ " else "├─ "
-                append("\n   $prefix param: \"${param.lexeme}\"")
+                val type = stmt.paramTypes[i]?.let { " : ${it.lexeme}" } ?: ""
+                append("\n   $prefix param: \"${param.lexeme}\"$type")
             }
 
             // Always show body, even if empty
@@ -103,7 +105,7 @@ class AstFormatter : Expr.Visitor<String>, Stmt.Visitor<String> {
         if (stmt.value == null) leaf("Stmt.Return") else node("Stmt.Return", stmt.value)
 
     override fun visitVarStmt(stmt: Stmt.Var): String =
-        node("Stmt.Var ${stmt.name.lexeme}", stmt.initializer)
+        node("Stmt.Var ${stmt.name.lexeme}" + (stmt.type?.let { " : ${it.lexeme}" } ?: ""), stmt.initializer)
 
     override fun visitWhileStmt(stmt: Stmt.While): String =
         node("Stmt.While", stmt.condition, stmt.body)
@@ -0,0 +1,561 @@
+﻿package lox
+
+import java.util.IdentityHashMap
+
+/**
+ * Emits plain C against lox_runtime_c.h. Every Lox function becomes a static C
+ * function taking an explicit closure; variables captured by inner functions
+ * live in heap cells that closures reference, everything else stays a C local.
+ */
+class CCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
+    private class FunctionInfo(val parent: FunctionInfo?) {
+        val cells = LinkedHashSet<Decl>()
+    }
+
+    private class Decl(val cName: String, val function: FunctionInfo?) {
+        var captured = false
+        // The annotation of the declaration the analyzer last reached.
+        var type: String? = null
+    }
+
+    private class CFunction(val signature: String, val info: FunctionInfo) {
+        val body = StringBuilder()
+        val temps = mutableListOf<String>()
+        var indentLevel = 1
+        var initializerThis: Decl? = null
+        var returnType: String? = null
+    }
+
+    private val scriptInfo = FunctionInfo(null)
+    private val globals = linkedMapOf<String, Decl>()
+    private val hiddenGlobals = mutableListOf<Decl>()
+    private val nativeInits = mutableListOf<String>()
+    private val declOf = IdentityHashMap<Any, Decl>()
+    private val thisOf = IdentityHashMap<Any, Decl>()
+    private val refOf = IdentityHashMap<Expr, Decl>()
+    private val assignmentTypes = IdentityHashMap<Expr.Assign, String>()
+    private val functionOf = IdentityHashMap<Stmt.Function, FunctionInfo>()
+
+    private val functions = ArrayDeque<CFunction>()
+    private val functionDefs = StringBuilder()
+    private val literalNames = mutableMapOf<String, String>()
+    private val literalInits = mutableListOf<String>()
+    private val nameCounter = mutableMapOf<String, Int>()
+    private var tempId = 0
+
+    fun generate(statements: List<Stmt>): String {
+        Analyzer().run(statements)
+
+        val main = CFunction("int main(void)", scriptInfo)
+        functions.addLast(main)
+        statements.forEach { it.accept(this) }
+        line("return 0;")
+        functions.removeLast()
+
+        val out = StringBuilder()
+        out.appendLine("#include \"lox_runtime_c.h\"")
+        out.appendLine("#include <stddef.h>")
+        out.appendLine()
+        (globals.values + hiddenGlobals).forEach { out.appendLine("static Value ${it.cName};") }
+        literalNames.values.forEach { out.appendLine("static Value $it;") }
+        out.appendLine()
+        out.append(functionDefs)
+        out.append(render(main, nativeInits + literalInits))
+        return out.toString()
+    }
+
+    override fun visitAssignExpr(expr: Expr.Assign): String {
+        val value = expr.value.accept(this)
+        val decl = refOf[expr] ?: throw IllegalStateException("Undefined variable ${expr.name.lexeme}")
+        return "(${access(decl)} = ${checked(assignmentTypes[expr], value)})"
+    }
+
+    override fun visitBinaryExpr(expr: Expr.Binary): String {
+        val left = expr.left.accept(this)
+        val right = expr.right.accept(this)
+        val function = when (expr.operator.type) {
+            TokenType.PLUS -> "lox_add"
+            TokenType.MINUS -> "lox_subtract"
+            TokenType.STAR -> "lox_multiply"
+            TokenType.SLASH -> "lox_divide"
+            TokenType.GREATER -> "lox_greater"
+            TokenType.GREATER_EQUAL -> "lox_greater_equal"
+            TokenType.LESS -> "lox_less"
+            TokenType.LESS_EQUAL -> "lox_less_equal"
+            TokenType.BANG_EQUAL -> "lox_not_equal"
+            TokenType.EQUAL_EQUAL -> "lox_equal"
+            else -> throw IllegalStateException("Unsupported binary operator: ${expr.operator.type}")
+        }
+        return "$function($left, $right)"
+    }
+
+    override fun visitCallExpr(expr: Expr.Call): String {
+        val args = expr.arguments.map { it.accept(this) }
+        val argv = if (args.isEmpty()) "NULL" else "(Value[]){${args.joinToString(", ")}}"
+
+        return when (val callee = expr.callee) {
+            is Expr.Get -> {
+                val receiver = callee.obj.accept(this)
+                "lox_invoke($receiver, \"${callee.name.lexeme}\", ${args.size}, $argv)"
+            }
+
+            is Expr.Super -> {
+                val superclass = access(refOf[callee] ?: throw IllegalStateException("superclass missing"))
+                val receiver = access(thisOf[callee] ?: throw IllegalStateException("this missing"))
+                "lox_super_invoke($superclass, \"${callee.method.lexeme}\", $receiver, ${args.size}, $argv)"
+            }
+
+            else -> "lox_call(${callee.accept(this)}, ${args.size}, $argv)"
+        }
+    }
+
+    override fun visitGetExpr(expr: Expr.Get): String =
+        "lox_get_property(${expr.obj.accept(this)}, \"${expr.name.lexeme}\")"
+
+    override fun visitGroupingExpr(expr: Expr.Grouping): String = "(${expr.expression.accept(this)})"
+
+    override fun visitLiteralExpr(expr: Expr.Literal): String {
+        return when (val value = expr.value) {
+            is Number -> "lox_number(${value.toDouble()})"
+            is String -> literal(value)
+            true -> "lox_bool(true)"
+            false -> "lox_bool(false)"
+            null -> "lox_nil()"
+            else -> throw IllegalStateException("Unsupported literal: $value")
+        }
+    }
+
+    override fun visitLogicalExpr(expr: Expr.Logical): String {
+        val left = expr.left.accept(this)
+        val right = expr.right.accept(this)
+        val temp = freshTemp()
+        return when (expr.operator.type) {
+            TokenType.OR -> "($temp = $left, lox_is_truthy($temp) ? $temp : $right)"
+            TokenType.AND -> "($temp = $left, lox_is_truthy($temp) ? $right : $temp)"
+            else -> throw IllegalStateException("Unsupported logical")
+        }
+    }
+
+    override fun visitSetExpr(expr: Expr.Set): String {
+        val receiver = expr.obj.accept(this)
+        val value = expr.value.accept(this)
+        return "lox_set_property($receiver, \"${expr.name.lexeme}\", $value)"
+    }
+
+    override fun visitSuperExpr(expr: Expr.Super): String {
+        val superclass = access(refOf[expr] ?: throw IllegalStateException("superclass missing"))
+        val receiver = access(thisOf[expr] ?: throw IllegalStateException("this missing"))
+        return "lox_super_bind($superclass, \"${expr.method.lexeme}\", $receiver)"
+    }
+
+    override fun visitThisExpr(expr: Expr.This): String =
+        access(refOf[expr] ?: throw IllegalStateException("this missing"))
+
+    override fun visitUnaryExpr(expr: Expr.Unary): String {
+        val right = expr.right.accept(this)
+        return when (expr.operator.type) {
+            TokenType.MINUS -> "lox_negate($right)"
+            TokenType.BANG -> "lox_not($right)"
+            else -> throw IllegalStateException("Unsupported unary: ${expr.operator.type}")
+        }
+    }
+
+    override fun visitVariableExpr(expr: Expr.Variable): String =
+        access(refOf[expr] ?: throw IllegalStateException("Undefined variable ${expr.name.lexeme}"))
+
+    override fun visitBlockStmt(stmt: Stmt.Block) {
+        line("{")
+        withIndent { stmt.statements.forEach { it.accept(this) } }
+        line("}")
+    }
+
+    override fun visitClassStmt(stmt: Stmt.Class) {
+        val classDecl = declOf[stmt] ?: throw IllegalStateException("class decl missing")
+        declare(classDecl, "lox_nil()")
+
+        var superRef = "lox_nil()"
+        if (stmt.superclass != null) {
+            val superDecl = declOf[stmt.superclass] ?: throw IllegalStateException("superclass decl missing")
+            declare(superDecl, stmt.superclass.accept(this))
+            superRef = access(superDecl)
+        }
+
+        val klass = access(classDecl)
+        line("$klass = lox_new_class(\"${stmt.name.lexeme}\", $superRef);")
+        stmt.fields.forEach { field ->
+            val type = field.type?.let { "\"${it.lexeme}\"" } ?: "NULL"
+            line("lox_class_add_field($klass, \"${field.name.lexeme}\", $type);")
+        }
+        stmt.methods.forEach { method ->
+            val info = functionOf[method] ?: throw IllegalStateException("method info missing")
+            val fnName = emitFunction(method, info, isMethod = true)
+            line("lox_class_add_method($klass, \"${method.name.lexeme}\", ${closure(method, info, fnName)});")
+        }
+    }
+
+    override fun visitExpressionStmt(stmt: Stmt.Expression) {
+        line("${stmt.expression.accept(this)};")
+    }
+
+    override fun visitFunctionStmt(stmt: Stmt.Function) {
+        val decl = declOf[stmt] ?: throw IllegalStateException("function decl missing")
+        val info = functionOf[stmt] ?: throw IllegalStateException("function info missing")
+        val fnName = emitFunction(stmt, info, isMethod = false)
+
+        // A captured function may refer to itself, so its cell has to exist
+        // before the closure that points at it is created.
+        if (decl.function != null && decl.captured) {
+            declare(decl, "lox_nil()")
+            line("${access(decl)} = ${closure(stmt, info, fnName)};")
+        } else {
+            declare(decl, closure(stmt, info, fnName))
+        }
+    }
+
+    override fun visitIfStmt(stmt: Stmt.If) {
+        line("if (lox_is_truthy(${stmt.condition.accept(this)})) {")
+        withIndent { stmt.thenBranch.accept(this) }
+        if (stmt.elseBranch != null) {
+            line("} else {")
+            withIndent { stmt.elseBranch.accept(this) }
+        }
+        line("}")
+    }
+
+    override fun visitPrintStmt(stmt: Stmt.Print) {
+        line("lox_print(${stmt.expression.accept(this)});")
+    }
+
+    override fun visitReturnStmt(stmt: Stmt.Return) {
+        val initializerThis = current().initializerThis
+        when {
+            initializerThis != null -> line("return ${access(initializerThis)};")
+            stmt.value == null -> line("return ${checked(current().returnType, "lox_nil()")};")
+            else -> line("return ${checked(current().returnType, stmt.value.accept(this))};")
+        }
+    }
+
+    override fun visitVarStmt(stmt: Stmt.Var) {
+        val init = checked(stmt.type?.lexeme, stmt.initializer.accept(this))
+        declare(declOf[stmt] ?: throw IllegalStateException("var decl missing"), init)
+    }
+
+    override fun visitWhileStmt(stmt: Stmt.While) {
+        line("while (lox_is_truthy(${stmt.condition.accept(this)})) {")
+        withIndent { stmt.body.accept(this) }
+        line("}")
+    }
+
+    // ---------- Helpers ----------
+    private fun emitFunction(stmt: Stmt.Function, info: FunctionInfo, isMethod: Boolean): String {
+        val fnName = "lox_fn_${stmt.name.lexeme}_${nextId(stmt.name.lexeme)}"
+        val fn = CFunction("static Value $fnName(LoxClosure *closure, int argc, Value *args)", info)
+        fn.returnType = stmt.returnType?.lexeme
+        functions.addLast(fn)
+
+        line("(void)closure;")
+        line("(void)argc;")
+
+        val offset = if (isMethod) 1 else 0
+        val thisDecl = thisOf[stmt]
+        if (thisDecl != null) declare(thisDecl, "args[0]")
+        if (isMethod && stmt.name.lexeme == "init") fn.initializerThis = thisDecl
+
+        stmt.params.forEachIndexed { i, param ->
+            val arg = checked(stmt.paramTypes[i]?.lexeme, "args[${i + offset}]")
+            declare(declOf[param] ?: throw IllegalStateException("param decl missing"), arg)
+        }
+        stmt.body.forEach { it.accept(this) }
+
+        val initializerThis = fn.initializerThis
+        line(if (initializerThis != null) "return ${access(initializerThis)};" else "return ${checked(fn.returnType, "lox_nil()")};")
+
+        functions.removeLast()
+        functionDefs.append(render(fn)).appendLine()
+        return fnName
+    }
+
+    private fun closure(stmt: Stmt.Function, info: FunctionInfo, fnName: String): String {
+        val name = stmt.name.lexeme
+        val arity = stmt.params.size
+        if (info.cells.isEmpty()) return "lox_new_closure($fnName, $arity, \"$name\", 0, NULL)"
+        val cells = info.cells.joinToString(", ") { cellPointer(it) }
+        return "lox_new_closure($fnName, $arity, \"$name\", ${info.cells.size}, (Value *[]){$cells})"
+    }
+
+    private fun checked(type: String?, value: String): String =
+        if (type == null) value else "lox_check_type($value, \"$type\")"
+
+    private fun declare(decl: Decl, init: String) {
+        when {
+            decl.function == null -> line("${decl.cName} = $init;")
+            decl.captured -> line("Value *${decl.cName} = lox_new_cell($init);")
+            else -> line("Value ${decl.cName} = $init;")
+        }
+    }
+
+    private fun access(decl: Decl): String {
+        val fn = current()
+        return when {
+            decl.function == null -> decl.cName
+            decl.function === fn.info -> if (decl.captured) "(*${decl.cName})" else decl.cName
+            else -> "(*closure->cells[${fn.info.cells.indexOf(decl)}])"
+        }
+    }
+
+    private fun cellPointer(decl: Decl): String {
+        val fn = current()
+        return if (decl.function === fn.info) decl.cName else "closure->cells[${fn.info.cells.indexOf(decl)}]"
+    }
+
+    private fun literal(value: String): String {
+        return literalNames.getOrPut(value) {
+            val name = "lox_lit_${literalNames.size + 1}"
+            val bytes = value.toByteArray(Charsets.UTF_8)
+            literalInits += "$name = lox_copy_string(${cString(bytes)}, ${bytes.size});"
+            name
+        }
+    }
+
+    private fun cString(bytes: ByteArray): String {
+        val sb = StringBuilder("\"")
+        for (b in bytes) {
+            val c = b.toInt() and 0xFF
+            when {
+                c == '"'.code -> sb.append("\\\"")
+                c == '\\'.code -> sb.append("\\\\")
+                c in 0x20..0x7E -> sb.append(c.toChar())
+                else -> sb.append("\\").append(Integer.toOctalString(c).padStart(3, '0'))
+            }
+        }
+        return sb.append("\"").toString()
+    }
+
+    private fun render(fn: CFunction, prologue: List<String> = emptyList()): String {
+        val out = StringBuilder()
+        out.appendLine("${fn.signature} {")
+        if (fn.temps.isNotEmpty()) out.appendLine("  Value ${fn.temps.joinToString(", ")};")
+        prologue.forEach { out.appendLine("  $it") }
+        out.append(fn.body)
+        out.appendLine("}")
+        return out.toString()
+    }
+
+    private fun current(): CFunction = functions.last()
+
+    private fun line(text: String) {
+        val fn = current()
+        fn.body.append("  ".repeat(fn.indentLevel)).appendLine(text)
+    }
+
+    private inline fun withIndent(block: () -> Unit) {
+        current().indentLevel++
+        try { block() } finally { current().indentLevel-- }
+    }
+
+    private fun freshTemp(): String {
+        tempId++
+        val name = "lox_tmp_$tempId"
+        current().temps += name
+        return name
+    }
+
+    private fun nextId(name: String): Int {
+        val count = (nameCounter[name] ?: 0) + 1
+        nameCounter[name] = count
+        return count
+    }
+
+    private fun localName(name: String): String = "${name}_${nextId(name)}"
+
+    /** Resolves every variable to its declaration and records which ones closures capture. */
+    private inner class Analyzer : Expr.Visitor<Unit>, Stmt.Visitor<Unit> {
+        private val scopes = ArrayDeque<MutableMap<String, Decl>>()
+        private var function = scriptInfo
+
+        fun run(statements: List<Stmt>) {
+            statements.forEach { stmt ->
+                when (stmt) {
+                    is Stmt.Var -> declareGlobal(stmt.name.lexeme)
+                    is Stmt.Function -> declareGlobal(stmt.name.lexeme)
+                    is Stmt.Class -> declareGlobal(stmt.name.lexeme)
+                    else -> {}
+                }
+            }
+            statements.forEach { it.accept(this) }
+        }
+
+        private fun declareGlobal(name: String): Decl =
+            globals.getOrPut(name) { Decl("lox_g_$name", null) }
+
+        private fun declare(name: String, key: Any): Decl {
+            val decl = if (scopes.isEmpty()) {
+                declareGlobal(name)
+            } else {
+                Decl(localName(name), function).also { scopes.last()[name] = it }
+            }
+            declOf[key] = decl
+            return decl
+        }
+
+        private fun resolve(name: String): Decl? {
+            for (i in scopes.indices.reversed()) {
+                val decl = scopes[i][name] ?: continue
+                capture(decl)
+                return decl
+            }
+            return globals[name] ?: nativeGlobal(name)
+        }
+
+        private fun nativeGlobal(name: String): Decl? {
+            val factory = when (name) {
+                in MathNatives.arities, in ConversionNatives.arities, in StringNatives.arities,
+                in SerializationNatives.arities, in TableNatives.arities, in HashNatives.arities -> "lox_native_function"
+                in RandomNatives.classNames, in ListNatives.classNames, in CsvNatives.classNames,
+                in TableNatives.classNames, in ColumnNatives.classNames -> "lox_native_class"
+                else -> return null
+            }
+            return declareGlobal(name).also { nativeInits += "${it.cName} = $factory(\"$name\");" }
+        }
+
+        private fun capture(decl: Decl) {
+            if (decl.function == null || decl.function === function) return
+            decl.captured = true
+            var f: FunctionInfo? = function
+            while (f != null && f !== decl.function) {
+                f.cells += decl
+                f = f.parent
+            }
+        }
+
+        private fun analyzeFunction(stmt: Stmt.Function, isMethod: Boolean) {
+            val enclosing = function
+            val info = FunctionInfo(enclosing)
+            functionOf[stmt] = info
+            function = info
+            scopes.addLast(mutableMapOf())
+
+            if (isMethod) {
+                val thisDecl = Decl(localName("this"), info)
+                scopes.last()["this"] = thisDecl
+                thisOf[stmt] = thisDecl
+            }
+            stmt.params.forEachIndexed { i, param -> declare(param.lexeme, param).type = stmt.paramTypes[i]?.lexeme }
+            stmt.body.forEach { it.accept(this) }
+
+            scopes.removeLast()
+            function = enclosing
+        }
+
+        override fun visitAssignExpr(expr: Expr.Assign) {
+            expr.value.accept(this)
+            resolve(expr.name.lexeme)?.let { decl ->
+                refOf[expr] = decl
+                decl.type?.let { assignmentTypes[expr] = it }
+            }
+        }
+
+        override fun visitBinaryExpr(expr: Expr.Binary) {
+            expr.left.accept(this)
+            expr.right.accept(this)
+        }
+
+        override fun visitCallExpr(expr: Expr.Call) {
+            expr.callee.accept(this)
+            expr.arguments.forEach { it.accept(this) }
+        }
+
+        override fun visitGetExpr(expr: Expr.Get) {
+            expr.obj.accept(this)
+        }
+
+        override fun visitGroupingExpr(expr: Expr.Grouping) {
+            expr.expression.accept(this)
+        }
+
+        override fun visitLiteralExpr(expr: Expr.Literal) {}
+
+        override fun visitLogicalExpr(expr: Expr.Logical) {
+            expr.left.accept(this)
+            expr.right.accept(this)
+        }
+
+        override fun visitSetExpr(expr: Expr.Set) {
+            expr.obj.accept(this)
+            expr.value.accept(this)
+        }
+
+        override fun visitSuperExpr(expr: Expr.Super) {
+            refOf[expr] = resolve("super") ?: throw IllegalStateException("super outside subclass")
+            thisOf[expr] = resolve("this") ?: throw IllegalStateException("this outside class")
+        }
+
+        override fun visitThisExpr(expr: Expr.This) {
+            refOf[expr] = resolve("this") ?: throw IllegalStateException("this outside class")
+        }
+
+        override fun visitUnaryExpr(expr: Expr.Unary) {
+            expr.right.accept(this)
+        }
+
+        override fun visitVariableExpr(expr: Expr.Variable) {
+            resolve(expr.name.lexeme)?.let { refOf[expr] = it }
+        }
+
+        override fun visitBlockStmt(stmt: Stmt.Block) {
+            scopes.addLast(mutableMapOf())
+            stmt.statements.forEach { it.accept(this) }
+            scopes.removeLast()
+        }
+
+        override fun visitClassStmt(stmt: Stmt.Class) {
+            val isGlobal = scopes.isEmpty()
+            declare(stmt.name.lexeme, stmt).type = null
+
+            if (stmt.superclass != null) {
+                stmt.superclass.accept(this)
+                val superDecl = Decl(localName("super"), if (isGlobal) null else function)
+                if (isGlobal) hiddenGlobals += superDecl
+                declOf[stmt.superclass] = superDecl
+                scopes.addLast(mutableMapOf("super" to superDecl))
+            }
+
+            stmt.methods.forEach { analyzeFunction(it, isMethod = true) }
+
+            if (stmt.superclass != null) scopes.removeLast()
+        }
+
+        override fun visitExpressionStmt(stmt: Stmt.Expression) {
+            stmt.expression.accept(this)
+        }
+
+        override fun visitFunctionStmt(stmt: Stmt.Function) {
+            declare(stmt.name.lexeme, stmt).type = null
+            analyzeFunction(stmt, isMethod = false)
+        }
+
+        override fun visitIfStmt(stmt: Stmt.If) {
+            stmt.condition.accept(this)
+            stmt.thenBranch.accept(this)
+            stmt.elseBranch?.accept(this)
+        }
+
+        override fun visitPrintStmt(stmt: Stmt.Print) {
+            stmt.expression.accept(this)
+        }
+
+        override fun visitReturnStmt(stmt: Stmt.Return) {
+            stmt.value?.accept(this)
+        }
+
+        override fun visitVarStmt(stmt: Stmt.Var) {
+            stmt.initializer.accept(this)
+            declare(stmt.name.lexeme, stmt).type = stmt.type?.lexeme
+        }
+
+        override fun visitWhileStmt(stmt: Stmt.While) {
+            stmt.condition.accept(this)
+            stmt.body.accept(this)
+        }
+    }
+}
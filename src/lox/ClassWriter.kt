@@ -0,0 +1,402 @@
+﻿package lox
+
+import java.io.ByteArrayOutputStream
+import java.io.DataOutputStream
+import java.io.UTFDataFormatException
+
+/**
+ * A minimal class-file writer for [JvmCompiler]: a constant pool, fields and
+ * methods whose bytecode [Code] assembles. Classes are written as version 49
+ * (Java 5), whose verifier infers stack frames itself, so no StackMapTable
+ * has to be computed.
+ */
+class ClassWriter(private val name: String, private val superName: String, private val interfaces: List<String>) {
+    private class Member(val access: Int, val name: Int, val descriptor: Int, val code: Code?)
+
+    private val pool = ByteArrayOutputStream()
+    private val poolOut = DataOutputStream(pool)
+    private val constants = HashMap<String, Int>()
+    private var poolSize = 1
+    private val fields = mutableListOf<Member>()
+    private val methods = mutableListOf<Member>()
+
+    fun field(access: Int, name: String, descriptor: String) {
+        fields += Member(access, utf8(name), utf8(descriptor), null)
+    }
+
+    /** A method whose parameters, and `this` unless static, fill the first [argSlots] locals. */
+    fun method(access: Int, name: String, descriptor: String, argSlots: Int): Code {
+        val code = Code(this, argSlots)
+        methods += Member(access, utf8(name), utf8(descriptor), code)
+        return code
+    }
+
+    fun toByteArray(): ByteArray {
+        val thisClass = classRef(name)
+        val superClass = classRef(superName)
+        val interfaceRefs = interfaces.map(::classRef)
+        val codeName = utf8("Code")
+        val bodies = methods.map { it.code!!.finish() }
+
+        val bytes = ByteArrayOutputStream()
+        DataOutputStream(bytes).run {
+            writeInt(0xCAFEBABE.toInt())
+            writeShort(0)
+            writeShort(49)
+            writeShort(poolSize)
+            poolOut.flush()
+            pool.writeTo(this)
+            writeShort(ACC_PUBLIC or ACC_SUPER)
+            writeShort(thisClass)
+            writeShort(superClass)
+            writeShort(interfaceRefs.size)
+            interfaceRefs.forEach(::writeShort)
+
+            writeShort(fields.size)
+            for (field in fields) {
+                writeShort(field.access)
+                writeShort(field.name)
+                writeShort(field.descriptor)
+                writeShort(0)
+            }
+
+            writeShort(methods.size)
+            methods.zip(bodies).forEach { (method, body) ->
+                val code = method.code!!
+                writeShort(method.access)
+                writeShort(method.name)
+                writeShort(method.descriptor)
+                writeShort(1)
+                writeShort(codeName)
+                writeInt(12 + body.size)
+                writeShort(code.maxStack)
+                writeShort(code.maxLocals)
+                writeInt(body.size)
+                write(body)
+                writeShort(0)
+                writeShort(0)
+            }
+            writeShort(0)
+        }
+        return bytes.toByteArray()
+    }
+
+    // ---------- Constant pool ----------
+
+    // Nested entries are added before the entry that refers to them, so the
+    // pool is written in one pass.
+    private fun constant(key: String, entry: DataOutputStream.() -> Unit): Int =
+        constants.getOrPut(key) {
+            val index = poolSize
+            poolOut.entry()
+            poolSize++
+            if (poolSize > 0xFFFF) throw TooLarge()
+            index
+        }
+
+    fun utf8(value: String): Int = constant("U$value") {
+        writeByte(1)
+        try {
+            writeUTF(value)
+        } catch (error: UTFDataFormatException) {
+            throw TooLarge()
+        }
+    }
+
+    fun classRef(internalName: String): Int {
+        val nameIndex = utf8(internalName)
+        return constant("C$internalName") {
+            writeByte(7)
+            writeShort(nameIndex)
+        }
+    }
+
+    fun string(value: String): Int {
+        val index = utf8(value)
+        return constant("S$value") {
+            writeByte(8)
+            writeShort(index)
+        }
+    }
+
+    fun integer(value: Int): Int = constant("I$value") {
+        writeByte(3)
+        writeInt(value)
+    }
+
+    fun member(tag: Int, owner: String, name: String, descriptor: String): Int {
+        val ownerIndex = classRef(owner)
+        val nameIndex = utf8(name)
+        val descriptorIndex = utf8(descriptor)
+        val nameAndType = constant("N$name:$descriptor") {
+            writeByte(12)
+            writeShort(nameIndex)
+            writeShort(descriptorIndex)
+        }
+        return constant("$tag$owner.$name:$descriptor") {
+            writeByte(tag)
+            writeShort(ownerIndex)
+            writeShort(nameAndType)
+        }
+    }
+
+    /** A method, constant pool or jump that doesn't fit the class-file format. */
+    class TooLarge: RuntimeException("Program too large for a class file.")
+
+    companion object {
+        const val ACC_PUBLIC = 0x0001
+        const val ACC_STATIC = 0x0008
+        const val ACC_SUPER = 0x0020
+
+        const val FIELDREF = 9
+        const val METHODREF = 10
+        const val INTERFACE_METHODREF = 11
+    }
+}
+
+/** A jump target; its stack depth is fixed by the first jump to it or by where it is marked. */
+class Label {
+    var position = -1
+    var stack = -1
+}
+
+/**
+ * Bytecode for one method. Every instruction updates the tracked operand
+ * stack depth, so [maxStack] and [maxLocals] come out of assembly.
+ */
+class Code(private val writer: ClassWriter, argSlots: Int) {
+    private class Fixup(val from: Int, val at: Int, val label: Label, val wide: Boolean)
+
+    private var bytes = ByteArray(256)
+    private var size = 0
+    private var stack = 0
+    private val fixups = mutableListOf<Fixup>()
+
+    var maxStack = 0
+        private set
+    var maxLocals = argSlots
+        private set
+
+    fun finish(): ByteArray {
+        for (fixup in fixups) {
+            check(fixup.label.position >= 0) { "Unmarked label" }
+            val offset = fixup.label.position - fixup.from
+            if (fixup.wide) {
+                put(fixup.at, offset shr 24)
+                put(fixup.at + 1, offset shr 16)
+                put(fixup.at + 2, offset shr 8)
+                put(fixup.at + 3, offset)
+            } else {
+                if (offset !in Short.MIN_VALUE..Short.MAX_VALUE) throw ClassWriter.TooLarge()
+                put(fixup.at, offset shr 8)
+                put(fixup.at + 1, offset)
+            }
+        }
+        if (size > 0xFFFF) throw ClassWriter.TooLarge()
+        return bytes.copyOf(size)
+    }
+
+    // ---------- Encoding ----------
+
+    private fun put(at: Int, value: Int) {
+        bytes[at] = value.toByte()
+    }
+
+    private fun u1(value: Int) {
+        if (size == bytes.size) bytes = bytes.copyOf(size * 2)
+        bytes[size++] = value.toByte()
+    }
+
+    private fun u2(value: Int) {
+        u1(value shr 8)
+        u1(value)
+    }
+
+    private fun u4(value: Int) {
+        u2(value shr 16)
+        u2(value)
+    }
+
+    private fun adjust(delta: Int) {
+        stack += delta
+        check(stack >= 0) { "Operand stack underflow" }
+        if (stack > maxStack) maxStack = stack
+    }
+
+    fun op(opcode: Int, delta: Int) {
+        u1(opcode)
+        adjust(delta)
+    }
+
+    private fun local(short: Int, long: Int, slot: Int, delta: Int) {
+        if (slot + 1 > maxLocals) maxLocals = slot + 1
+        when {
+            slot <= 3 -> u1(short + slot)
+            slot <= 0xFF -> {
+                u1(long)
+                u1(slot)
+            }
+            else -> {
+                u1(WIDE)
+                u1(long)
+                u2(slot)
+            }
+        }
+        adjust(delta)
+    }
+
+    // ---------- Instructions ----------
+
+    fun aload(slot: Int) = local(ALOAD_0, ALOAD, slot, 1)
+    fun astore(slot: Int) = local(ASTORE_0, ASTORE, slot, -1)
+    fun iload(slot: Int) = local(ILOAD_0, ILOAD, slot, 1)
+
+    fun iconst(value: Int) {
+        when (value) {
+            in -1..5 -> op(ICONST_0 + value, 1)
+            in Byte.MIN_VALUE..Byte.MAX_VALUE -> {
+                op(BIPUSH, 1)
+                u1(value)
+            }
+            in Short.MIN_VALUE..Short.MAX_VALUE -> {
+                op(SIPUSH, 1)
+                u2(value)
+            }
+            else -> ldc(writer.integer(value))
+        }
+    }
+
+    fun ldcString(value: String) = ldc(writer.string(value))
+
+    private fun ldc(index: Int) {
+        op(LDC_W, 1)
+        u2(index)
+    }
+
+    fun getstatic(owner: String, name: String, descriptor: String) {
+        op(GETSTATIC, 1)
+        u2(writer.member(ClassWriter.FIELDREF, owner, name, descriptor))
+    }
+
+    fun putstatic(owner: String, name: String, descriptor: String) {
+        op(PUTSTATIC, -1)
+        u2(writer.member(ClassWriter.FIELDREF, owner, name, descriptor))
+    }
+
+    fun invokestatic(owner: String, name: String, descriptor: String) =
+        invoke(INVOKESTATIC, owner, name, descriptor, receiver = 0)
+
+    fun invokevirtual(owner: String, name: String, descriptor: String) =
+        invoke(INVOKEVIRTUAL, owner, name, descriptor, receiver = 1)
+
+    fun invokespecial(owner: String, name: String, descriptor: String) =
+        invoke(INVOKESPECIAL, owner, name, descriptor, receiver = 1)
+
+    fun invokeinterface(owner: String, name: String, descriptor: String) {
+        val (args, result) = slots(descriptor)
+        op(INVOKEINTERFACE, result - args - 1)
+        u2(writer.member(ClassWriter.INTERFACE_METHODREF, owner, name, descriptor))
+        u1(args + 1)
+        u1(0)
+    }
+
+    private fun invoke(opcode: Int, owner: String, name: String, descriptor: String, receiver: Int) {
+        val (args, result) = slots(descriptor)
+        op(opcode, result - args - receiver)
+        u2(writer.member(ClassWriter.METHODREF, owner, name, descriptor))
+    }
+
+    fun anewarray(internalName: String) {
+        op(ANEWARRAY, 0)
+        u2(writer.classRef(internalName))
+    }
+
+    fun checkcast(internalName: String) {
+        op(CHECKCAST, 0)
+        u2(writer.classRef(internalName))
+    }
+
+    /** A branch; IFEQ and IFNE pop the int they test. */
+    fun jump(opcode: Int, label: Label) {
+        val from = size
+        op(opcode, if (opcode == GOTO) 0 else -1)
+        if (label.stack < 0) label.stack = stack
+        fixups += Fixup(from, size, label, wide = false)
+        u2(0)
+    }
+
+    fun mark(label: Label) {
+        label.position = size
+        if (label.stack >= 0) stack = label.stack else label.stack = stack
+    }
+
+    /** Jumps to `cases[key - low]`, or to [default] when the key is out of range. */
+    fun tableswitch(low: Int, cases: List<Label>, default: Label) {
+        val from = size
+        op(TABLESWITCH, -1)
+        while (size % 4 != 0) u1(0)
+        (listOf(default) + cases).forEachIndexed { i, label ->
+            if (label.stack < 0) label.stack = stack
+            fixups += Fixup(from, size, label, wide = true)
+            u4(0)
+            if (i == 0) {
+                u4(low)
+                u4(low + cases.size - 1)
+            }
+        }
+    }
+
+    companion object {
+        const val ACONST_NULL = 0x01
+        const val ICONST_0 = 0x03
+        const val BIPUSH = 0x10
+        const val SIPUSH = 0x11
+        const val LDC_W = 0x13
+        const val ILOAD = 0x15
+        const val ALOAD = 0x19
+        const val ILOAD_0 = 0x1a
+        const val ALOAD_0 = 0x2a
+        const val AALOAD = 0x32
+        const val ASTORE = 0x3a
+        const val ASTORE_0 = 0x4b
+        const val AASTORE = 0x53
+        const val POP = 0x57
+        const val DUP = 0x59
+        const val DUP_X2 = 0x5b
+        const val SWAP = 0x5f
+        const val IXOR = 0x82
+        const val IFEQ = 0x99
+        const val IFNE = 0x9a
+        const val GOTO = 0xa7
+        const val TABLESWITCH = 0xaa
+        const val ARETURN = 0xb0
+        const val RETURN = 0xb1
+        const val GETSTATIC = 0xb2
+        const val PUTSTATIC = 0xb3
+        const val INVOKEVIRTUAL = 0xb6
+        const val INVOKESPECIAL = 0xb7
+        const val INVOKESTATIC = 0xb8
+        const val INVOKEINTERFACE = 0xb9
+        const val ANEWARRAY = 0xbd
+        const val CHECKCAST = 0xc0
+        const val WIDE = 0xc4
+
+        /** Argument and result slots of a method descriptor; long and double take two. */
+        fun slots(descriptor: String): Pair<Int, Int> {
+            var args = 0
+            var i = 1
+            while (descriptor[i] != ')') {
+                val start = i
+                while (descriptor[i] == '[') i++
+                args += if (i == start && (descriptor[i] == 'J' || descriptor[i] == 'D')) 2 else 1
+                i = if (descriptor[i] == 'L') descriptor.indexOf(';', i) + 1 else i + 1
+            }
+            val result = when (descriptor[i + 1]) {
+                'V' -> 0
+                'J', 'D' -> 2
+                else -> 1
+            }
+            return args to result
+        }
+    }
+}
@@ -4,18 +4,21 @@ import kotlin.system.exitProcess
 
 enum class Target {
     cppEmitter,
-    X86_64
+    X86_64,
+    C
 }
 
 sealed class Command {
-    class Run(val file: String, val printAst: Boolean = false) : Command()
+    class Run(val file: String, val printAst: Boolean = false, val compiled: Boolean = false) : Command()
     data object Repl : Command() {
         var printAst: Boolean = false
+        var native: Boolean = false
     }
     class Compile(
         val file: String,
         val target: Target,
         val outputCppFile: String,
+        val outputCFile: String,
         val outputExecutable: String
     ) : Command()
     data object Help : Command()
@@ -53,29 +56,36 @@ object Cli {
             first == "repl" -> parseRepl(rest, printAstFlag)
             first == "compile" -> parseCompile(rest)
             first.endsWith(EXTENSION) -> {
-                if (rest.isNotEmpty()) {
+                if (rest.any { it != "--compiled" }) {
                     usageError("Direct file execution does not accept additional positional arguments")
                 }
-                Command.Run(first, printAstFlag)
+                parseRun(positional.toTypedArray(), printAstFlag)
             }
             else -> usageError("Unknown command or invalid file: $first")
         }
     }
 
     private fun parseRun(args: Array<String>, printAstFlag: Boolean): Command.Run {
-        if (args.size != 1) {
-            usageError("Usage: run <file.lx> [--print-ast]")
+        val compiled = "--compiled" in args
+        val files = args.filter { it != "--compiled" }
+        if (files.size != 1) {
+            usageError("Usage: run <file.lx> [--compiled] [--print-ast]")
         }
-        val file = args[0]
+        val file = files[0]
         requireExtension(file)
-        return Command.Run(file, printAstFlag)
+        return Command.Run(file, printAstFlag, compiled)
     }
 
     private fun parseRepl(args: Array<String>, printAstFlag: Boolean): Command.Repl {
-        if (args.isNotEmpty()) {
-            usageError("repl command takes no arguments")
+        var native = false
+        for (arg in args) {
+            when (arg) {
+                "--native" -> native = true
+                else -> usageError("Unknown repl option: $arg")
+            }
         }
         Command.Repl.printAst = printAstFlag
+        Command.Repl.native = native
         return Command.Repl
     }
 
@@ -86,11 +96,13 @@ object Cli {
         var file: String? = null
         var target = Target.cppEmitter
         var outputCppFile: String? = null
+        var outputCFile: String? = null
         var outputExecutable: String? = null
 
         val projectDir = System.getProperty("user.dir")
         val defaultBuildDir = "$projectDir/build"
         val defaultCppFile = "$defaultBuildDir/out.cpp"
+        val defaultCFile = "$defaultBuildDir/out.c"
         val defaultExeFile = "$defaultBuildDir/out${if (System.getProperty("os.name").startsWith("Windows")) ".exe" else ""}"
 
 
@@ -103,20 +115,22 @@ object Cli {
                         usageError("Missing target name after --target")
                     }
                     val targetName = positionalAndOptions[i]
-                    target = try {
-                        Target.valueOf(targetName.uppercase())
-                    } catch (_: IllegalArgumentException) {
-                        usageError(
+                    target = Target.entries.firstOrNull { it.name.equals(targetName, ignoreCase = true) }
+                        ?: usageError(
                             "Invalid target: $targetName\n" +
                                     "Available targets: ${Target.entries.joinToString(", ") { it.name.lowercase() }}"
                         )
-                    }
                 }
                 "--cpp-file" -> {
                     i++
                     if (i >= positionalAndOptions.size) usageError("Missing path after --cpp-file")
                     outputCppFile = positionalAndOptions[i]
                 }
+                "--c-file" -> {
+                    i++
+                    if (i >= positionalAndOptions.size) usageError("Missing path after --c-file")
+                    outputCFile = positionalAndOptions[i]
+                }
                 "--exe-file" -> {
                     i++
                     if (i >= positionalAndOptions.size) usageError("Missing path after --exe-file")
@@ -139,6 +153,7 @@ object Cli {
             file,
             target,
             outputCppFile ?: defaultCppFile,
+            outputCFile ?: defaultCFile,
             outputExecutable ?: defaultExeFile
         )
     }
@@ -183,7 +198,9 @@ object Cli {
               ${Ansi.cyan("kloX")}                          ${Ansi.dim("# Start interactive REPL")}
               ${Ansi.cyan("kloX")} <file.lx>                ${Ansi.dim("# Run a script directly")}
               ${Ansi.cyan("kloX")} run <file.lx>            ${Ansi.dim("# Explicitly run a script")}
+              ${Ansi.cyan("kloX")} run <file.lx> --compiled ${Ansi.dim("# Run as JVM bytecode")}
               ${Ansi.cyan("kloX")} repl                     ${Ansi.dim("# Start REPL")}
+              ${Ansi.cyan("kloX")} repl --native            ${Ansi.dim("# Start REPL backed by compiled C++")}
               ${Ansi.cyan("kloX")} compile <file.lx>        ${Ansi.dim("# Compile to C++ or native")}
 
             ${Ansi.bold("Commands")}:
@@ -195,9 +212,18 @@ object Cli {
               --print-ast          Print the parsed AST (useful for debugging)
               --help, -h           Show this help message
 
+            ${Ansi.bold("Run Options")}:
+              --compiled           Compile the script to a JVM class at load time and
+                                   run it as bytecode instead of walking the AST
+
+            ${Ansi.bold("Repl Options")}:
+              --native             Compile each input to a shared object and run it in a
+                                   long-lived native host (requires g++)
+
             ${Ansi.bold("Compile Options")}:
               --target <name>      Target backend: ${Target.entries.joinToString(", ") { Ansi.cyan(it.name.lowercase()) }} (default: cppemitter)
               --cpp-file <path>    Output C++ source file (default: build/out.cpp)
+              --c-file <path>      Output C source file for the c target (default: build/out.c)
               --exe-file <path>    Output executable path (default: build/out[.exe])
 
             ${Ansi.bold("Examples")}:
@@ -205,6 +231,7 @@ object Cli {
               kloX run script.lx --print-ast
               kloX compile script.lx --target cppemitter --cpp-file myprog.cpp
               kloX compile script.lx --target x86_64 --exe-file bin/myapp
+              CC=tcc kloX compile script.lx --target c
 
             Source: https://github.com/erfan4323/KloX
         """.trimIndent()
@@ -0,0 +1,149 @@
+﻿package lox
+
+/**
+ * `Columns(klass)` keeps rows of a class with declared fields as one column
+ * per field instead of one instance per row; `num` fields are plain double
+ * arrays. `add()` appends a row of initial values and `push(instance)` a copy
+ * of an instance's fields. `add()` and `get(i)` return a proxy of the class
+ * whose fields read and write the row in place, while `sum`, `fill`, `scale`
+ * and `addScaled` sweep whole columns without touching an instance.
+ */
+object ColumnNatives {
+    val classNames = setOf("Columns")
+
+    private class Column(val name: String, val type: Token?) {
+        val numeric = type?.lexeme == "num"
+        var numbers = DoubleArray(0)
+        val values = mutableListOf<Any?>()
+
+        operator fun get(row: Int): Any? = if (numeric) numbers[row] else values[row]
+
+        operator fun set(row: Int, value: Any?) {
+            if (numeric) numbers[row] = value as Double else values[row] = value
+        }
+    }
+
+    private class ColumnsInstance(klass: LoxClass, val rowClass: LoxClass, val columns: List<Column>): LoxInstance(klass) {
+        var length = 0
+
+        fun column(name: String): Column? = columns.firstOrNull { it.name == name }
+
+        fun append(): Int {
+            for (column in columns) {
+                if (!column.numeric) column.values.add(Types.initial(column.type))
+                else if (length == column.numbers.size) column.numbers = column.numbers.copyOf(maxOf(8, length * 2))
+            }
+            return length++
+        }
+
+        fun row(row: Int): LoxInstance = LoxInstance(rowClass, RowFields(this, row))
+    }
+
+    // A proxy's fields. LoxInstance.set has checked the annotation already.
+    private class RowFields(val owner: ColumnsInstance, val row: Int): AbstractMutableMap<String, Any?>() {
+        override fun containsKey(key: String): Boolean = owner.column(key) != null
+
+        override fun get(key: String): Any? = owner.column(key)?.get(row)
+
+        override fun put(key: String, value: Any?): Any? {
+            val column = owner.column(key) ?: throw NativeError("Undefined field '$key'.")
+            return column[row].also { column[row] = value }
+        }
+
+        override val entries: MutableSet<MutableMap.MutableEntry<String, Any?>>
+            get() = owner.columns.mapTo(LinkedHashSet()) { Cell(it, row) }
+    }
+
+    private class Cell(val column: Column, val row: Int): MutableMap.MutableEntry<String, Any?> {
+        override val key: String get() = column.name
+        override val value: Any? get() = column[row]
+        override fun setValue(newValue: Any?): Any? = value.also { column[row] = newValue }
+    }
+
+    fun define(globals: Environment) {
+        globals.define("Columns", NativeClass("Columns", 1, mapOf(
+            "length" to NativeMethod(0) { self, _ -> (self as ColumnsInstance).length.toDouble() },
+            "add" to NativeMethod(0) { self, _ ->
+                val columns = self as ColumnsInstance
+                columns.row(columns.append())
+            },
+            "push" to NativeMethod(1) { self, args ->
+                push(self as ColumnsInstance, args[0])
+                null
+            },
+            "get" to NativeMethod(1) { self, args ->
+                val columns = self as ColumnsInstance
+                columns.row(index(args[0], columns.length))
+            },
+            "sum" to NativeMethod(1) { self, args ->
+                val columns = self as ColumnsInstance
+                val numbers = numbers(columns, args[0])
+                var total = 0.0
+                for (i in 0 until columns.length) total += numbers[i]
+                total
+            },
+            "fill" to NativeMethod(2) { self, args ->
+                fill(self as ColumnsInstance, args[0], args[1])
+                null
+            },
+            "scale" to NativeMethod(2) { self, args ->
+                val columns = self as ColumnsInstance
+                val numbers = numbers(columns, args[0])
+                val k = number(args[1])
+                for (i in 0 until columns.length) numbers[i] *= k
+                null
+            },
+            "addScaled" to NativeMethod(3) { self, args ->
+                val columns = self as ColumnsInstance
+                val target = numbers(columns, args[0])
+                val k = number(args[1])
+                val source = numbers(columns, args[2])
+                for (i in 0 until columns.length) target[i] += k * source[i]
+                null
+            }
+        )) { klass, args -> open(klass, args[0]) })
+    }
+
+    private fun open(klass: LoxClass, rowClass: Any?): ColumnsInstance {
+        val row = rowClass as? LoxClass
+        val layout = row?.layout
+        if (row == null || layout == null) throw NativeError("Columns needs a class with declared fields.")
+        return ColumnsInstance(klass, row, layout.map { (name, type) -> Column(name, type) })
+    }
+
+    private fun push(columns: ColumnsInstance, value: Any?) {
+        val instance = value as? LoxInstance
+        if (instance == null || generateSequence(instance.klass) { it.superclass }.none { it === columns.rowClass }) {
+            throw NativeError("Argument must be a ${columns.rowClass.name} instance.")
+        }
+        val row = columns.append()
+        columns.columns.forEach { it[row] = instance.fields[it.name] }
+    }
+
+    private fun fill(columns: ColumnsInstance, name: Any?, value: Any?) {
+        val column = column(columns, name)
+        column.type?.let { type ->
+            if (!Types.matches(type.lexeme, value)) throw NativeError("Expected ${type.lexeme} but got ${Types.describe(value)}.")
+        }
+        for (i in 0 until columns.length) column[i] = value
+    }
+
+    private fun column(columns: ColumnsInstance, name: Any?): Column {
+        val field = name as? String ?: throw NativeError("Operand must be a string.")
+        return columns.column(field) ?: throw NativeError("Undefined field '$field'.")
+    }
+
+    private fun numbers(columns: ColumnsInstance, name: Any?): DoubleArray {
+        val column = column(columns, name)
+        if (!column.numeric) throw NativeError("Field '${column.name}' is not declared num.")
+        return column.numbers
+    }
+
+    private fun number(value: Any?): Double = value as? Double ?: throw NativeError("Operand must be a number.")
+
+    private fun index(value: Any?, size: Int): Int {
+        val i = number(value)
+        if (i < 0 || i >= size || i % 1.0 != 0.0) throw NativeError("Columns index out of range.")
+        return i.toInt()
+    }
+}
@@ -0,0 +1,50 @@
+﻿package lox
+
+import java.math.BigDecimal
+import kotlin.math.abs
+
+/**
+ * `parseNumber(text)` and `toString(number)`. Numbers format as integers when
+ * integral, otherwise as the shortest round-trip digits in whichever of fixed
+ * or scientific notation is shorter, the way std::to_chars writes them.
+ */
+object ConversionNatives {
+    val arities = mapOf("parseNumber" to 1, "toString" to 1)
+
+    private val DECIMAL = Regex("""-?(\d+\.?\d*|\.\d+)([eE][+-]?\d+)?""")
+    private const val MAX_EXACT_INT = 9007199254740992.0
+
+    fun define(globals: Environment) {
+        globals.define("parseNumber", native { argument ->
+            parse(argument as? String ?: throw NativeError("Operand must be a string."))
+        })
+        globals.define("toString", native { argument ->
+            format(argument as? Double ?: throw NativeError("Operand must be a number."))
+        })
+    }
+
+    /** The number [text] spells as a plain decimal, or null. */
+    fun parse(text: String): Double? = if (DECIMAL.matches(text)) text.toDouble() else null
+
+    fun format(value: Double): String {
+        if (value.isNaN()) return "nan"
+        if (value.isInfinite()) return if (value < 0) "-inf" else "inf"
+        if (value % 1.0 == 0.0 && abs(value) <= MAX_EXACT_INT) return value.toLong().toString()
+
+        val decimal = BigDecimal(value.toString()).stripTrailingZeros()
+        val digits = decimal.unscaledValue().abs().toString()
+        val exponent = digits.length - 1 - decimal.scale()
+        val sign = if (value < 0) "-" else ""
+
+        val fixed = sign + decimal.abs().toPlainString()
+        val mantissa = if (digits.length > 1) "${digits[0]}.${digits.substring(1)}" else digits
+        val scientific = "$sign${mantissa}e${if (exponent < 0) "-" else "+"}${abs(exponent).toString().padStart(2, '0')}"
+        return if (fixed.length <= scientific.length) fixed else scientific
+    }
+
+    private fun native(body: (Any?) -> Any?): LoxCallable = object: LoxCallable {
+        override fun arity(): Int = 1
+        override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? = body(arguments[0])
+        override fun toString(): String = "<native fn>"
+    }
+}
@@ -1,41 +1,176 @@
 ﻿package lox
 
+import java.util.Collections
+import java.util.IdentityHashMap
+import kotlin.math.abs
+
 class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     private val code = StringBuilder()
     private var indentLevel = 0
     private val locals: ArrayDeque<MutableMap<String, String>> = ArrayDeque()
     private var currentClass: ClassType = ClassType.NONE
     private var superclassVar: String? = null
+    private var superclassMethods: ClassMethods? = null
     private val varCounter = mutableMapOf<String, Int>()
     private var tempId = 0
+    private val classVars = mutableSetOf<String>()
+
+    // Parameter counts of the `fun` declarations, by C++ name. Function
+    // variables can't be reassigned in the emitted code, so a call through
+    // one always reaches that function.
+    private val functionArities = mutableMapOf<String, Int>()
+
+    // Unboxed clones of top-level functions, and the clone behind each
+    // function variable that has one.
+    private var specializer: Specializer? = null
+    private val specializedVars = mutableMapOf<String, Specializer.Specialization>()
+
+    // Locals held in a plain Value, which loops may speculate are numbers.
+    // Speculation is off inside the fallback of a speculated loop.
+    private val valueVars = mutableSetOf<String>()
+    private var speculating = true
+
+    // Locals held unboxed because of their annotation, by C++ name: num and
+    // bool as double and bool, str as the LoxString and a class as the
+    // instance pointer, named like INSTANCE's. Values cross into them through
+    // one check; REPL globals stay Values and are checked the same way.
+    private val typedVars = mutableMapOf<String, String>()
+    private val checkedVars = mutableMapOf<String, String>()
+    private var returnType: String? = null
+    private val typedLocals = object : Specializer.Bindings {
+        override fun variable(name: String): String? = null
+        override fun typed(name: String): Pair<String, Specializer.Type>? = typedLocal(name)
+        override fun field(get: Expr.Get): Pair<String, Specializer.Type>? = typedField(get)
+        override fun clone(name: String): Specializer.Specialization? = lookupVar(name)?.let { specializedVars[it] }
+        override fun isNative(name: String): Boolean = lookupVar(name) == null
+    }
+
+    // The one class declaring each method name, where only one does, and the
+    // C++ variable of each class emitted so far; calls to such a method
+    // guess the receiver is that class.
+    private val methodOwners = mutableMapOf<String, Stmt.Class?>()
+    private val classStmtVars = IdentityHashMap<Stmt.Class, String>()
+
+    // The methods of each class declared in this unit, by C++ name, so that
+    // `super` calls can go straight to the inherited method's function.
+    private val classMethods = mutableMapOf<String, ClassMethods>()
+
+    // Classes with declared fields, by C++ name; a subclass declaring none
+    // shares its superclass's entry. Their structs go at namespace scope,
+    // ahead of main or of every REPL unit. `this` in their methods and locals
+    // a constructor call initialized reach the fields as members.
+    private val fieldLayouts = mutableMapOf<String, FieldLayout>()
+    private val fieldStructs = StringBuilder()
+    private var currentLayout: FieldLayout? = null
+    private val instanceLayouts = mutableMapOf<String, FieldLayout>()
+    // Classes whose methods may run on a Columns row proxy, which has no
+    // struct behind it, so `this` in them takes the by-name path: those the
+    // program binds with `Columns(Name)` and their superclasses. Null when
+    // any class could be bound, as in REPL units, which can't see later ones.
+    private var columnClasses: Set<String>? = null
+
+    // Reads after which a function's local is dead; see LastUse.
+    private val moves: MutableSet<Expr.Variable> = Collections.newSetFromMap(IdentityHashMap())
+
+    // DFA functions for literal `match` patterns, emitted ahead of the code
+    // that calls them.
+    private val matchers = LinkedHashMap<String, String>()
+    private val matcherCode = StringBuilder()
+
+    // REPL units: top-level declarations become namespace-scope symbols that
+    // later units reach through `extern`, so state outlives each unit's entry.
+    private var replMode = false
+    private val replGlobals = mutableListOf<Pair<String, String>>()
+    private val replUnitGlobals = mutableListOf<Pair<String, String>>()
+    private var replCheckpoint: Map<String, String> = emptyMap()
 
     init {
         locals.addLast(mutableMapOf())
     }
 
-    fun generate(statements: List<Stmt>): String {
+    fun generate(statements: List<Stmt>, snapshot: HeapSnapshot? = null): String {
         code.clear()
+        resetMatchers()
         emitHeaders()
+        val prologueEnd = code.length
+
 
+        val program = snapshot?.suffix ?: DeadCode.prune(statements)
+        val clones = Specializer.analyze(program)
+        specializer = clones
+        methodOwners.clear()
+        collectMethodOwners(program)
+        columnClasses = columnClasses(statements)
 
         appendIndentedLine("int main() {")
         withIndent {
-            statements.forEach { it.accept(this@CppCodeGenerator) }
+            snapshot?.let { emitSnapshot(it) }
+            program.forEach { it.accept(this@CppCodeGenerator) }
             appendIndentedLine("return 0;")
         }
         appendIndentedLine("}")
 
+        code.insert(prologueEnd, fieldStructs.toString() + matcherCode.toString() + clones.code())
+        return code.toString()
+    }
+
+    fun generateReplUnit(statements: List<Stmt>, entrySymbol: String): String {
+        replMode = true
+        replCheckpoint = locals.first().toMap()
+        replUnitGlobals.clear()
+        resetMatchers()
+        // Earlier units' method variables were locals of their entry points.
+        classMethods.clear()
+        specializer = null
+
+        code.clear()
+        withIndent { statements.forEach { it.accept(this@CppCodeGenerator) } }
+        val body = code.toString()
+
+        code.clear()
+        emitHeaders()
+        code.append(fieldStructs)
+        code.append(matcherCode)
+        replGlobals.forEach { (type, name) -> appendLine("extern $type $name;") }
+        replUnitGlobals.forEach { (type, name) -> appendLine("$type $name;") }
+        appendLine("")
+        appendLine("extern \"C\" void $entrySymbol() {")
+        code.append(body)
+        appendLine("}")
 
         return code.toString()
     }
 
+    fun commitReplUnit() {
+        replGlobals += replUnitGlobals
+        replUnitGlobals.clear()
+    }
+
+    fun rollbackReplUnit() {
+        while (locals.size > 1) locals.removeLast()
+        locals.first().clear()
+        locals.first().putAll(replCheckpoint)
+        replUnitGlobals.clear()
+    }
+
     override fun visitAssignExpr(expr: Expr.Assign): String {
+        typedVars[resolveVar(expr.name.lexeme)]?.let { type ->
+            val assignment = "${resolveVar(expr.name.lexeme)} = ${unboxed(type, expr.value)}"
+            return if (type in Types.BUILTIN) "Value($assignment)" else "($assignment)"
+        }
         val value = expr.value.accept(this)
         val name = resolveVar(expr.name.lexeme)
-        return "$name = $value"
+        checkedVars[name]?.let { type -> return "$name = Value(${expect(type, value)})" }
+        return "$name = ${consume(expr.value, value)}"
     }
 
     override fun visitBinaryExpr(expr: Expr.Binary): String {
+        typedValue(expr)?.let { return it }
+        if (expr.operator.type == TokenType.PLUS) {
+            lowerStringConcat(expr)?.let { return it }
+            lowerNumberConcat(expr)?.let { return it }
+        }
+
         val left = expr.left.accept(this)
         val right = expr.right.accept(this)
         return when (expr.operator.type) {
@@ -54,12 +189,17 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitCallExpr(expr: Expr.Call): String {
-        val argsCode = expr.arguments.joinToString(", ") { it.accept(this) }
+        val args = expr.arguments.map { it.accept(this) }
+        val argsCode = expr.arguments.zip(args).joinToString(", ") { (arg, code) -> consume(arg, code) }
 
         return when (val callee = expr.callee) {
             is Expr.Get -> {
                 val objCode = callee.obj.accept(this)
-                val instPtr = valueToInstancePtr(objCode)
+                val instPtr = valueToInstancePtr(objCode, borrow = callee.obj is Expr.Variable)
+                speculateReceiver(callee.name.lexeme, args.size)?.let { (classVar, function) ->
+                    val receiverArgs = if (argsCode.isEmpty()) instPtr else "$instPtr, $argsCode"
+                    return "invokeMethod(\"${callee.name.lexeme}\", $classVar.get(), *$function, {$receiverArgs})"
+                }
                 "CALL_METHOD($instPtr, ${callee.name.lexeme}${if (argsCode.isEmpty()) "" else ", $argsCode"})"
             }
 
@@ -67,21 +207,37 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
                 if (currentClass != ClassType.SUBCLASS) throw RuntimeException("Cannot use 'super' outside a subclass.")
                 val superClassVar = superclassVar ?: throw IllegalStateException("superclass missing")
                 val methodName = callee.method.lexeme
-                val boundVar = freshTemp("super_bound")
-                appendIndentedLine("auto $boundVar = std::make_shared<LoxBoundMethod>($superClassVar->methods[\"$methodName\"], self);")
-                "$boundVar->call({$argsCode});"
+                superclassMethods?.find(methodName)?.let { (function, arity) ->
+                    if (arity == args.size) return "$function->invoke({self${if (argsCode.isEmpty()) "" else ", $argsCode"}})"
+                    compileError(expr.paren, "Expected $arity arguments but got ${args.size}.")
+                }
+                "bindSuper($superClassVar, \"$methodName\", self)->call({$argsCode})"
             }
 
             else -> {
+                if (callee is Expr.Variable) {
+                    lowerLiteralMatch(callee.name.lexeme, expr.arguments, args)?.let { return it }
+                    lowerNativeCall(callee.name.lexeme, args)?.let { return it }
+                }
                 val calleeCode = callee.accept(this)
+                functionArities[calleeCode]?.let { arity ->
+                    if (arity == args.size) {
+                        specializedVars[calleeCode]?.let { spec ->
+                            cloneArguments(spec, expr.arguments, args)?.let { return "Value(${spec.name}($it))" }
+                        }
+                        return "$calleeCode->invoke({$argsCode})"
+                    }
+                    compileError(expr.paren, "Expected $arity arguments but got ${args.size}.")
+                }
                 "$calleeCode->call({$argsCode})"
             }
         }
     }
 
     override fun visitGetExpr(expr: Expr.Get): String {
+        fieldMember(expr.obj, expr.name.lexeme)?.let { (member, annotation) -> return fieldValue(member, annotation) }
         val objCode = expr.obj.accept(this)
-        val instPtr = valueToInstancePtr(objCode)
+        val instPtr = valueToInstancePtr(objCode, borrow = expr.obj is Expr.Variable)
         return "GET_FIELD($instPtr, ${expr.name.lexeme})"
     }
 
@@ -91,8 +247,8 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
 
     override fun visitLiteralExpr(expr: Expr.Literal): String {
         return when (val value = expr.value) {
-            is Number -> value.toString()
-            is String -> "\"${value.replace("\"", "\\\"")}\""
+            is Double -> numberLiteral(value)
+            is String -> cppString(value)
             true -> "true"
             false -> "false"
             null -> "nullptr"
@@ -111,8 +267,13 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitSetExpr(expr: Expr.Set): String {
+        fieldMember(expr.obj, expr.name.lexeme)?.let { (member, annotation) ->
+            val value = if (annotation == null) consume(expr.value, expr.value.accept(this)) else unboxed(annotation, expr.value)
+            appendIndentedLine("$member = $value;")
+            return fieldValue(member, annotation)
+        }
         val objCode = expr.obj.accept(this)
-        val instPtr = valueToInstancePtr(objCode)
+        val instPtr = valueToInstancePtr(objCode, borrow = expr.obj is Expr.Variable && isPureOperand(expr.value))
         val value = expr.value.accept(this)
         appendIndentedLine("SET_FIELD($instPtr, ${expr.name.lexeme}, $value);")
         return value
@@ -122,7 +283,10 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
         if (currentClass != ClassType.SUBCLASS) throw IllegalStateException("super outside subclass")
         val superVar = superclassVar ?: throw IllegalStateException("superclass missing")
         val methodName = expr.method.lexeme
-        return "std::make_shared<LoxBoundMethod>($superVar->methods[\"$methodName\"], self)"
+        superclassMethods?.find(methodName)?.let { (function, _) ->
+            return "std::make_shared<LoxBoundMethod>($function, self)"
+        }
+        return "bindSuper($superVar, \"$methodName\", self)"
     }
 
     override fun visitThisExpr(expr: Expr.This): String {
@@ -130,6 +294,7 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitUnaryExpr(expr: Expr.Unary): String {
+        typedValue(expr)?.let { return it }
         val right = expr.right.accept(this)
         return when (expr.operator.type) {
             TokenType.MINUS -> "negate($right)"
@@ -139,7 +304,19 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitVariableExpr(expr: Expr.Variable): String {
-        return resolveVar(expr.name.lexeme)
+        val name = expr.name.lexeme
+        if (lookupVar(name) == null &&
+            (name in MathNatives.arities || name in ConversionNatives.arities || name in StringNatives.arities ||
+                name in SerializationNatives.arities || name in TableNatives.arities || name in HashNatives.arities)) {
+            return "nativeFunction(\"$name\")"
+        }
+        if (lookupVar(name) == null &&
+            (name in RandomNatives.classNames || name in ListNatives.classNames || name in CsvNatives.classNames ||
+                name in TableNatives.classNames || name in ColumnNatives.classNames)) {
+            return "nativeClass(\"$name\")"
+        }
+        val cppName = resolveVar(name)
+        return if (typedVars[cppName]?.let { it in Types.BUILTIN } == true) "Value($cppName)" else cppName
     }
 
     override fun visitBlockStmt(stmt: Stmt.Block) {
@@ -151,30 +328,59 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitClassStmt(stmt: Stmt.Class) {
+        val isReplGlobal = isReplGlobalScope()
         val previousClass = currentClass
+        val previousSuperclass = superclassVar
+        val previousSuperclassMethods = superclassMethods
+        val previousLayout = currentLayout
         currentClass = if (stmt.superclass != null) ClassType.SUBCLASS else ClassType.CLASS
         superclassVar = stmt.superclass?.let { resolveVar(it.name.lexeme) }
+        superclassMethods = superclassVar?.let { classMethods[it] }
 
         try {
             val className = declareCountedVar(stmt.name.lexeme)
+            classVars += className
+            classStmtVars[stmt] = className
+            currentLayout = declareLayout(stmt, className)?.takeIf { columnClasses?.contains(stmt.name.lexeme) == false }
+            val methods = ClassMethods(superclassMethods)
             appendIndentedLine("std::unordered_map<std::string, std::shared_ptr<LoxCallable>> ${className}_methods;")
 
+            beginScope()
             stmt.methods.forEach { method ->
                 method.accept(this)
                 val funcVar = currentScope()[method.name.lexeme] ?: throw IllegalStateException("method var missing")
                 appendIndentedLine("${className}_methods[\"${method.name.lexeme}\"] = $funcVar;")
+                methods.functions[method.name.lexeme] = funcVar to method.params.size
             }
+            endScope()
+            classMethods[className] = methods
 
             val superRef = superclassVar ?: "nullptr"
-            appendIndentedLine("DEFINE_CLASS($className, $superRef);")
+            val struct = fieldLayouts[className]?.struct?.takeIf { stmt.fields.isNotEmpty() }
+            if (isReplGlobal) {
+                val klass = if (struct == null) "LoxClass" else "LoxFixedClass<$struct>"
+                replUnitGlobals += "std::shared_ptr<LoxClass>" to className
+                appendIndentedLine("$className = std::make_shared<$klass>(\"${stmt.name.lexeme}\", $superRef, ${className}_methods);")
+            } else if (struct != null) {
+                appendIndentedLine("DEFINE_FIXED_CLASS($className, \"${stmt.name.lexeme}\", $superRef, $struct);")
+            } else {
+                appendIndentedLine("DEFINE_CLASS($className, \"${stmt.name.lexeme}\", $superRef);")
+            }
         } finally {
+            currentLayout = previousLayout
             currentClass = previousClass
-            superclassVar = null
+            superclassVar = previousSuperclass
+            superclassMethods = previousSuperclassMethods
         }
     }
 
     override fun visitExpressionStmt(stmt: Stmt.Expression) {
-        val exprCode = stmt.expression.accept(this)
+        val expression = stmt.expression
+        if (expression is Expr.Set && fieldMember(expression.obj, expression.name.lexeme) != null) {
+            expression.accept(this)
+            return
+        }
+        val exprCode = expression.accept(this)
 
         if (exprCode == "nullptr") return
         if (stmt.expression is Expr.Literal || stmt.expression is Expr.Variable || stmt.expression is Expr.Binary) return
@@ -183,36 +389,62 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitFunctionStmt(stmt: Stmt.Function) {
+        val isReplGlobal = isReplGlobalScope()
         val funcName = declareCountedVar(stmt.name.lexeme)
         val isMethod = currentClass != ClassType.NONE
         val arity = if (isMethod) stmt.params.size + 1 else stmt.params.size
+        val assigned = LastUse.assigned(stmt.body)
+        if (!isMethod) functionArities[funcName] = stmt.params.size
+        val specialization = if (isMethod) null else specializer?.specialization(stmt)
+        specialization?.let { specializedVars[funcName] = it }
+        moves += LastUse.moves(stmt)
+        val enclosingReturnType = returnType
+        returnType = stmt.returnType?.lexeme
 
         beginScope()
         if (isMethod) currentScope()["this"] = "self"
 
-        appendIndentedLine("DEFINE_METHOD($funcName, $arity, [&](const std::vector<Value>& args) mutable -> Value {")
+        if (isReplGlobal) {
+            replUnitGlobals += "std::shared_ptr<LoxFunction>" to funcName
+            appendIndentedLine("$funcName = std::make_shared<LoxFunction>($arity, [&](const std::vector<Value>& args) mutable -> Value {")
+        } else {
+            appendIndentedLine("DEFINE_METHOD($funcName, $arity, [&](const std::vector<Value>& args) mutable -> Value {")
+        }
         withIndent {
-            if (isMethod) {
-                appendIndentedLine("CHECK_ARITY(${stmt.params.size + 1});")
-                appendIndentedLine("auto self = SELF;")
-            } else {
-                appendIndentedLine("CHECK_ARITY(${stmt.params.size});")
-            }
+            // LoxFunction::call checks the argument count; calls that skip it
+            // through invoke() were checked here.
+            if (isMethod) appendIndentedLine("const auto &self = SELF;")
 
+            // Parameters the body never assigns borrow the caller's argument;
+            // annotated ones are checked and unboxed on entry.
             stmt.params.forEachIndexed { i, param ->
                 val paramName = declareCountedVar(param.lexeme)
-                val argIndex = if (isMethod) i + 1 else i
-                appendIndentedLine("Value $paramName = args[$argIndex];")
+                val arg = "args[${if (isMethod) i + 1 else i}]"
+                val annotation = stmt.paramTypes[i]?.lexeme
+                if (annotation != null) {
+                    declareTyped(param.lexeme, paramName, annotation, expect(annotation, arg))
+                } else {
+                    val type = if (param.lexeme in assigned) "Value " else "const Value &"
+                    appendIndentedLine("$type$paramName = $arg;")
+                    valueVars += paramName
+                }
+            }
+            specialization?.let { spec ->
+                val params = stmt.params.map { resolveVar(it.lexeme) }
+                val call = "${spec.name}(${params.withIndex().joinToString(", ") { (i, p) -> if (spec.annotated[i]) p else "asNumber($p)" }})"
+                val checks = params.filterIndexed { i, _ -> !spec.annotated[i] }.joinToString(" && ") { "isNumber($it)" }
+                appendIndentedLine(if (checks.isEmpty()) "return Value($call);" else "if ($checks) return Value($call);")
             }
 
             stmt.body.forEach { it.accept(this) }
 
-            val returnExpr = if (isMethod && stmt.name.lexeme == "init") "self" else "nullptr"
+            val returnExpr = if (isMethod && stmt.name.lexeme == "init") "self" else returnValue(null)
             appendIndentedLine("return $returnExpr;")
         }
         appendIndentedLine("});")
 
         endScope()
+        returnType = enclosingReturnType
     }
 
     override fun visitIfStmt(stmt: Stmt.If) {
@@ -227,44 +459,385 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
     }
 
     override fun visitPrintStmt(stmt: Stmt.Print) {
-        appendIndentedLine("PRINT(${stmt.expression.accept(this)});")
+        appendIndentedLine("print(${stmt.expression.accept(this)});")
     }
 
     override fun visitReturnStmt(stmt: Stmt.Return) {
-        if (stmt.value == null) {
-            appendIndentedLine("return nullptr;")
-        } else {
-            val valueCode = stmt.value.accept(this)
-            appendIndentedLine("return Value($valueCode);")
-        }
+        appendIndentedLine("return ${returnValue(stmt.value)};")
     }
 
     override fun visitVarStmt(stmt: Stmt.Var) {
-        if (stmt.initializer is Expr.Call && stmt.initializer.callee is Expr.Variable) {
-            emitClassInstantiation(stmt.initializer, stmt.name.lexeme)
+        val annotation = stmt.type?.lexeme
+        if (isReplGlobalScope()) {
+            val init = stmt.initializer.accept(this)
+            val name = declareCountedVar(stmt.name.lexeme)
+            replUnitGlobals += "Value" to name
+            if (annotation != null) checkedVars[name] = annotation
+            appendIndentedLine("$name = ${if (annotation == null) init else "Value(${expect(annotation, init)})"};")
             return
         }
 
-        val init = stmt.initializer.accept(this)
+        // An instance of the annotated class itself needs no check.
+        if (stmt.initializer is Expr.Call && stmt.initializer.callee is Expr.Variable &&
+            lookupVar(stmt.initializer.callee.name.lexeme)?.let { it in classVars } == true &&
+            (annotation == null || annotation == stmt.initializer.callee.name.lexeme)) {
+            val valueVar = emitClassInstantiation(stmt.initializer, stmt.name.lexeme)
+            if (annotation != null) typedVars["${valueVar}_inst"] = annotation
+            else fieldLayouts[resolveVar(stmt.initializer.callee.name.lexeme)]?.let { instanceLayouts["${valueVar}_inst"] = it }
+            return
+        }
+
+        if (annotation != null) {
+            val init = unboxed(annotation, stmt.initializer)
+            declareTyped(stmt.name.lexeme, declareCountedVar(stmt.name.lexeme), annotation, init)
+            return
+        }
+
+        val init = consume(stmt.initializer, stmt.initializer.accept(this))
         val name = declareCountedVar(stmt.name.lexeme)
         appendIndentedLine("Value $name = $init;")
+        valueVars += name
         currentScope()[stmt.name.lexeme] = name
     }
 
     override fun visitWhileStmt(stmt: Stmt.While) {
+        val loop = speculateLoop(stmt)
+        if (loop == null) {
+            emitWhile(stmt)
+            return
+        }
+        if (loop.variables.isEmpty()) {
+            // Every outer local the loop uses is annotated, so nothing is guessed.
+            loop.lines.forEach(::appendIndentedLine)
+            return
+        }
+
+        // Unboxed copy of the loop behind one type check on entry; the
+        // generic loop runs when any local it uses isn't a number.
+        appendIndentedLine("if (${loop.variables.keys.joinToString(" && ") { "isNumber($it)" }}) {")
+        withIndent {
+            loop.variables.forEach { (value, number) -> appendIndentedLine("double $number = asNumber($value);") }
+            loop.lines.forEach(::appendIndentedLine)
+            loop.written.forEach { appendIndentedLine("$it = Value(${loop.variables.getValue(it)});") }
+        }
+        appendIndentedLine("} else {")
+        speculating = false
+        try {
+            withIndent { emitWhile(stmt) }
+        } finally {
+            speculating = true
+        }
+        appendIndentedLine("}")
+    }
+
+    private fun emitWhile(stmt: Stmt.While) {
         val condition = stmt.condition.accept(this)
         appendIndentedLine("while (isTruthy($condition)) {")
         withIndent { stmt.body.accept(this) }
         appendIndentedLine("}")
     }
 
+    // Nothing but the runtime's own print runs inside a speculated loop, so
+    // its unboxed copies can't be observed before they are stored back.
+    private fun speculateLoop(stmt: Stmt.While): Specializer.SpeculatedLoop? {
+        if (replMode || !speculating) return null
+        val clones = specializer ?: return null
+        return clones.speculateLoop(stmt, object : Specializer.Bindings {
+            override fun variable(name: String): String? = lookupVar(name)?.takeIf { it in valueVars }
+            override fun typed(name: String): Pair<String, Specializer.Type>? = typedLocal(name)
+            override fun field(get: Expr.Get): Pair<String, Specializer.Type>? = typedField(get)
+            override val returnType: String? get() = this@CppCodeGenerator.returnType
+            override fun clone(name: String): Specializer.Specialization? = lookupVar(name)?.let { specializedVars[it] }
+            override fun isNative(name: String): Boolean = lookupVar(name) == null
+        })
+    }
+
+    private fun speculateReceiver(method: String, argCount: Int): Pair<String, String>? {
+        val owner = methodOwners[method] ?: return null
+        val classVar = classStmtVars[owner] ?: return null
+        if (lookupVar(owner.name.lexeme) != classVar) return null
+        val (function, arity) = classMethods[classVar]?.functions?.get(method) ?: return null
+        return if (arity == argCount) classVar to function else null
+    }
+
+    private fun columnClasses(statements: List<Stmt>): Set<String>? {
+        val superclasses = HashMap<String, String?>()
+        val bound = HashSet<String>()
+        var anyClass = false
+        fun visit(expr: Expr) {
+            val callee = (expr as? Expr.Call)?.callee
+            if (expr is Expr.Call && callee is Expr.Variable && callee.name.lexeme in ColumnNatives.classNames) {
+                val klass = expr.arguments.singleOrNull()
+                if (klass is Expr.Variable) bound += klass.name.lexeme else anyClass = true
+                expr.arguments.forEach(::visit)
+                return
+            }
+            if (expr is Expr.Variable && expr.name.lexeme in ColumnNatives.classNames) anyClass = true
+            LastUse.children(expr).forEach(::visit)
+        }
+        fun visit(stmt: Stmt) {
+            when (stmt) {
+                is Stmt.Class -> {
+                    superclasses[stmt.name.lexeme] = stmt.superclass?.name?.lexeme
+                    stmt.methods.forEach(::visit)
+                }
+                is Stmt.Function -> stmt.body.forEach(::visit)
+                else -> {
+                    LastUse.expressions(stmt).forEach(::visit)
+                    LastUse.statements(stmt).forEach(::visit)
+                }
+            }
+        }
+        statements.forEach(::visit)
+        if (anyClass) return null
+
+        val classes = HashSet<String>()
+        for (name in bound) {
+            var klass: String? = name
+            while (klass != null && classes.add(klass)) klass = superclasses[klass]
+        }
+        return classes
+    }
+
+    private fun collectMethodOwners(statements: List<Stmt>) {
+        for (stmt in statements) {
+            when (stmt) {
+                is Stmt.Block -> collectMethodOwners(stmt.statements)
+                is Stmt.Class -> {
+                    for (method in stmt.methods) {
+                        val name = method.name.lexeme
+                        methodOwners[name] = if (name in methodOwners) null else stmt
+                        collectMethodOwners(method.body)
+                    }
+                }
+                is Stmt.Function -> collectMethodOwners(stmt.body)
+                is Stmt.If -> collectMethodOwners(listOfNotNull(stmt.thenBranch, stmt.elseBranch))
+                is Stmt.While -> collectMethodOwners(listOf(stmt.body))
+                else -> {}
+            }
+        }
+    }
+
+    // ---------- Snapshot ----------
+
+    // Declarations from the prefix are emitted as code; everything else the
+    // prefix computed is rebuilt from the captured heap. Instances, lists and
+    // buffers are numbered and their contents written as static SnapshotEntry
+    // tables that the runtime loads in a loop, so a big lookup table adds
+    // data to the binary rather than a statement per element. Everything is
+    // allocated before anything is stored, so cycles and shared instances
+    // survive.
+    private fun emitSnapshot(snapshot: HeapSnapshot) {
+        if (snapshot.output.isNotEmpty()) {
+            appendIndentedLine("std::cout << ${cppString(snapshot.output)};")
+        }
+
+        val dataGlobals = snapshot.globals.filterValues { it !is LoxClass && !(it is LoxFunction && !isBoundMethod(it)) }
+        val dataVars = dataGlobals.keys.associateWith { name ->
+            declareCountedVar(name).also { appendIndentedLine("Value $it = nullptr;") }
+        }
+
+        val symbols = SnapshotSymbols(snapshot, freshTemp("snapshot"))
+        snapshot.prefix.forEach { stmt ->
+            when (stmt) {
+                is Stmt.Function -> {
+                    stmt.accept(this)
+                    symbols.functions[stmt] = currentScope().getValue(stmt.name.lexeme)
+                }
+                is Stmt.Class -> {
+                    stmt.accept(this)
+                    symbols.classes[stmt] = currentScope().getValue(stmt.name.lexeme)
+                }
+                else -> {}
+            }
+        }
+        dataVars.forEach { (name, cppName) -> currentScope()[name] = cppName }
+
+        collectInstances(snapshot.globals.values, symbols)
+        if (symbols.instanceOrder.isNotEmpty()) emitSnapshotHeap(symbols)
+
+        snapshot.globals.forEach { (name, value) ->
+            val dataVar = dataVars[name]
+            if (dataVar != null) {
+                appendIndentedLine("$dataVar = ${snapshotValue(value, symbols)};")
+            } else {
+                currentScope()[name] = when (value) {
+                    is LoxClass -> snapshotClass(value, symbols)
+                    else -> snapshotFunction(value as LoxFunction, symbols)
+                }
+            }
+        }
+    }
+
+    private class SnapshotSymbols(val snapshot: HeapSnapshot, val objects: String) {
+        val functions = IdentityHashMap<Stmt.Function, String>()
+        val classes = IdentityHashMap<Stmt.Class, String>()
+        val instances = IdentityHashMap<LoxInstance, Int>()
+        val instanceOrder = mutableListOf<LoxInstance>()
+        // Values an entry can't spell as data, by the expression that builds them.
+        val refs = LinkedHashMap<String, Int>()
+
+        fun instance(value: LoxInstance): String = "$objects[${instances.getValue(value)}]"
+    }
+
+    // Numbers every instance reachable from `roots`. A worklist rather than
+    // recursion, so long chains of instances don't exhaust the stack.
+    private fun collectInstances(roots: Collection<Any?>, symbols: SnapshotSymbols) {
+        val pending = ArrayDeque(roots)
+        while (pending.isNotEmpty()) {
+            val value = pending.removeLast()
+            val instance = when (value) {
+                is LoxInstance -> value
+                is LoxFunction -> if (isBoundMethod(value)) value.closure.getAt(0, "this") as LoxInstance else continue
+                else -> continue
+            }
+            if (instance in symbols.instances) continue
+
+            symbols.instances[instance] = symbols.instanceOrder.size
+            symbols.instanceOrder += instance
+            snapshotContents(instance).forEach { (_, item) -> pending.addLast(item) }
+        }
+    }
+
+    // Fields by name, or List items and Buffer numbers with a null name.
+    private fun snapshotContents(instance: LoxInstance): List<Pair<String?, Any?>> =
+        when (instance) {
+            is ListNatives.ListInstance -> instance.items.map { null to it }
+            is RandomNatives.BufferInstance -> instance.data.map { null to it }
+            else -> instance.fields.map { (field, value) -> field to value }
+        }
+
+    private fun emitSnapshotHeap(symbols: SnapshotSymbols) {
+        val classes = LinkedHashMap<String, Int>()
+        val kinds = symbols.instanceOrder.map { instance ->
+            val klass = when (instance) {
+                is ListNatives.ListInstance -> "nativeClass(\"List\")"
+                is RandomNatives.BufferInstance -> "nativeClass(\"Buffer\")"
+                else -> snapshotClass(instance.klass, symbols)
+            }
+            classes.getOrPut(klass) { classes.size }
+        }
+        val kindsVar = freshTemp("snapshot")
+        emitStaticTable("static const std::uint32_t $kindsVar[]", kinds.map { it.toString() }, perLine = 16)
+        appendIndentedLine("auto ${symbols.objects} = allocateSnapshot({${classes.keys.joinToString(", ")}}, $kindsVar, ${kinds.size});")
+
+        val entries = symbols.instanceOrder.flatMap { instance ->
+            val index = symbols.instances.getValue(instance)
+            snapshotContents(instance).map { (field, value) -> snapshotEntry(index, field, value, symbols) }
+        }
+        if (entries.isEmpty()) return
+
+        val refsVar = freshTemp("snapshot")
+        val entriesVar = freshTemp("snapshot")
+        appendIndentedLine("const std::vector<Value> $refsVar = {${symbols.refs.keys.joinToString(", ")}};")
+        emitStaticTable("static const SnapshotEntry $entriesVar[]", entries, perLine = 1)
+        appendIndentedLine("loadSnapshot(${symbols.objects}, $refsVar, $entriesVar, ${entries.size});")
+    }
+
+    private fun emitStaticTable(declaration: String, items: List<String>, perLine: Int) {
+        appendIndentedLine("$declaration = {")
+        items.chunked(perLine).forEach { line -> appendIndentedLine(" ${line.joinToString(", ")},") }
+        appendIndentedLine("};")
+    }
+
+    private fun snapshotEntry(index: Int, field: String?, value: Any?, symbols: SnapshotSymbols): String {
+        var text: String? = null
+        val (kind, number) = when (value) {
+            null -> 'n' to "0"
+            is Boolean -> 'b' to if (value) "1" else "0"
+            is Double -> if (isExactInt(value)) 'i' to value.toLong().toString() else 'd' to doubleLiteral(value)
+            is String -> {
+                text = value
+                's' to "0"
+            }
+            is LoxInstance -> 'o' to symbols.instances.getValue(value).toString()
+            else -> {
+                val ref = snapshotValue(value, symbols)
+                'r' to symbols.refs.getOrPut(ref) { symbols.refs.size }.toString()
+            }
+        }
+        val name = field?.let(::cppString) ?: "nullptr"
+        val length = text?.toByteArray(Charsets.UTF_8)?.size ?: 0
+        return "{$index, $name, '$kind', $number, ${text?.let(::cppString) ?: "nullptr"}, $length}"
+    }
+
+    private fun snapshotValue(value: Any?, symbols: SnapshotSymbols): String =
+        when (value) {
+            null -> "nullptr"
+            is Boolean -> value.toString()
+            is Double -> if (value.isNaN() || value.isInfinite()) doubleLiteral(value) else numberLiteral(value)
+            is String -> cppString(value)
+            is LoxInstance -> symbols.instance(value)
+            is LoxClass -> snapshotClass(value, symbols)
+            is LoxFunction -> "std::static_pointer_cast<LoxCallable>(${snapshotFunction(value, symbols)})"
+            else -> snapshotError(symbols, "Cannot snapshot value '$value'.")
+        }
+
+    private fun snapshotClass(klass: LoxClass, symbols: SnapshotSymbols): String {
+        val declaration = symbols.snapshot.classes[klass]
+            ?: snapshotError(symbols, "Cannot snapshot class '${klass.name}': only top-level classes declared before snapshot() are supported.")
+        return symbols.classes.getValue(declaration)
+    }
+
+    private fun snapshotFunction(function: LoxFunction, symbols: SnapshotSymbols): String {
+        val name = function.declaration.name.lexeme
+        if (!isBoundMethod(function)) {
+            return symbols.functions[function.declaration]
+                ?: snapshotError(symbols, "Cannot snapshot closure '$name': only top-level functions declared before snapshot() are supported.")
+        }
+
+        val instance = function.closure.getAt(0, "this") as LoxInstance
+        val owner = symbols.snapshot.classes.keys.firstOrNull { klass ->
+            (klass.methods[name] as? LoxFunction)?.declaration === function.declaration
+        } ?: snapshotError(symbols, "Cannot snapshot method '$name': its class is not declared at the top level.")
+        return "std::make_shared<LoxBoundMethod>(${snapshotClass(owner, symbols)}->methods.at(${cppString(name)}), ${symbols.instance(instance)})"
+    }
+
+    private fun isBoundMethod(function: LoxFunction): Boolean =
+        function.closure.getAt(0, "this") is LoxInstance
+
+    private fun snapshotError(symbols: SnapshotSymbols, message: String): Nothing =
+        throw RunTimeError(symbols.snapshot.marker, message)
+
+    // Integral literals start on the runtime's small-integer path; it promotes
+    // to double on overflow, so only the representation changes.
+    private fun numberLiteral(value: Double): String =
+        if (isExactInt(value)) "std::int64_t(${value.toLong()})" else value.toString()
+
+    private fun isExactInt(value: Double): Boolean =
+        value % 1.0 == 0.0 && abs(value) <= MAX_EXACT_INT && !(value == 0.0 && 1.0 / value < 0)
+
+    private fun doubleLiteral(value: Double): String =
+        when {
+            value.isNaN() -> "std::numeric_limits<double>::quiet_NaN()"
+            value.isInfinite() -> "${if (value < 0) "-" else ""}std::numeric_limits<double>::infinity()"
+            else -> value.toString()
+        }
+
+    private fun cppString(value: String): String {
+        val escaped = StringBuilder()
+        for (c in value) {
+            when {
+                c == '\\' -> escaped.append("\\\\")
+                c == '"' -> escaped.append("\\\"")
+                c == '\n' -> escaped.append("\\n")
+                c == '\t' -> escaped.append("\\t")
+                c < ' ' -> escaped.append("\\%03o".format(c.code))
+                else -> escaped.append(c)
+            }
+        }
+        return "\"$escaped\""
+    }
+
     // ---------- Helpers ----------
     private fun emitHeaders() {
         val headers = listOf(
             "#include \"lox_runtime.h\"",
             "#include <iostream>",
             "#include <memory>",
+            "#include <cmath>",
             "#include <functional>",
+            "#include <limits>",
             "#include <variant>",
             ""
         )
@@ -291,6 +864,9 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
 
     private fun currentScope(): MutableMap<String, String> = locals.last()
 
+    private fun isReplGlobalScope(): Boolean =
+        replMode && locals.size == 1 && currentClass == ClassType.NONE
+
     private fun beginScope() {
         locals.addLast(mutableMapOf())
     }
@@ -312,32 +888,302 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
         return scopedName
     }
 
-    private fun resolveVar(name: String): String {
-        val scopes = locals.toList()
-        for (i in scopes.indices.reversed()) {
-            scopes[i][name]?.let { return it }
+    private fun resolveVar(name: String): String =
+        lookupVar(name) ?: throw IllegalStateException("Undefined variable $name")
+
+    private fun lookupVar(name: String): String? {
+        for (i in locals.indices.reversed()) {
+            locals[i][name]?.let { return it }
         }
-        throw IllegalStateException("Undefined variable $name")
+        return null
     }
 
-    private fun valueToInstancePtr(valueCode: String): String {
-        if (valueCode == "self" || valueCode.endsWith("_inst")) return valueCode
+    // Unshadowed calls to the native globals go straight to <cmath> or the
+    // runtime's conversion, string and hash functions. A wrong argument count
+    // falls back to the callable so it fails at runtime, as in the interpreter.
+    private fun lowerNativeCall(name: String, args: List<String>): String? {
+        if (lookupVar(name) != null) return null
+        MATH_INTRINSICS[name]?.let { function ->
+            if (MathNatives.arities[name] != args.size) return null
+            return "Value($function(${args.joinToString(", ") { "asNumber($it)" }}))"
+        }
+        CONVERSION_FUNCTIONS[name]?.let { function ->
+            if (ConversionNatives.arities[name] != args.size) return null
+            return "$function(${args.single()})"
+        }
+        STRING_FUNCTIONS[name]?.let { function ->
+            if (StringNatives.arities[name] != args.size) return null
+            return "$function(${args.joinToString(", ")})"
+        }
+        if (HashNatives.arities[name] == args.size) return "Value(hashValue(${args.single()}))"
+        return null
+    }
 
+    // A `+` chain with a string literal anywhere in it can only succeed if
+    // every operand is a string, so `a + ":" + b + ":" + c` becomes a single
+    // concatStrings call that sizes the result, allocates it once and copies
+    // each piece once. Operands are limited to literals, variables and
+    // toString of those, so evaluating them all before the checks is
+    // unobservable.
+    private fun lowerStringConcat(expr: Expr.Binary): String? {
+        val operands = mutableListOf<Expr>()
+        collectConcatOperands(expr, operands)
+        if (operands.size < 3 || operands.none { it is Expr.Literal && it.value is String }) return null
+        if (!operands.all { isPureOperand(toStringArgument(it) ?: it) }) return null
+
+        val pieces = operands.map { operand ->
+            toStringArgument(operand)?.let { "numberPiece(${it.accept(this)})" } ?: operand.accept(this)
+        }
+        return "concatStrings({${pieces.joinToString(", ")}})"
+    }
+
+    private fun collectConcatOperands(expr: Expr, operands: MutableList<Expr>) {
+        if (expr is Expr.Binary && expr.operator.type == TokenType.PLUS) {
+            collectConcatOperands(expr.left, operands)
+            operands += expr.right
+        } else {
+            operands += expr
+        }
+    }
+
+    private fun isPureOperand(expr: Expr): Boolean = when (expr) {
+        is Expr.Literal, is Expr.Variable -> true
+        is Expr.Grouping -> isPureOperand(expr.expression)
+        else -> false
+    }
+
+    // `match("literal", s)` runs a DFA compiled here and emitted as goto-based
+    // C++. Invalid patterns fall back to matchPattern, which reports them at
+    // runtime as the interpreter does.
+    private fun lowerLiteralMatch(name: String, arguments: List<Expr>, args: List<String>): String? {
+        if (name != "match" || lookupVar(name) != null || args.size != 2) return null
+        val pattern = (arguments[0] as? Expr.Literal)?.value as? String ?: return null
+        val function = matchers[pattern] ?: try {
+            val dfa = RegexDfa.compile(pattern)
+            "lox_match_${matchers.size}".also {
+                matcherCode.append(dfa.toCpp(it)).appendLine()
+                matchers[pattern] = it
+            }
+        } catch (e: NativeError) {
+            return null
+        }
+        return "Value($function(asString(${args[1]}).view()))"
+    }
+
+    private fun resetMatchers() {
+        matchers.clear()
+        matcherCode.clear()
+    }
+
+    // `s + toString(n)` formats n straight into the concatenated string.
+    private fun lowerNumberConcat(expr: Expr.Binary): String? {
+        toStringArgument(expr.right)?.let { number ->
+            val left = expr.left.accept(this)
+            return "concatNumber($left, ${number.accept(this)})"
+        }
+        val number = toStringArgument(expr.left) ?: return null
+        val numberCode = number.accept(this)
+        return "numberConcat($numberCode, ${expr.right.accept(this)})"
+    }
+
+    private fun toStringArgument(expr: Expr): Expr? {
+        val call = expr as? Expr.Call ?: return null
+        val callee = call.callee as? Expr.Variable ?: return null
+        if (callee.name.lexeme != "toString" || call.arguments.size != 1 || lookupVar("toString") != null) return null
+        return call.arguments[0]
+    }
+
+    // With `borrow`, the receiver is a variable and its instance is read in
+    // place where it is used; callers clear it when code that runs between
+    // reading the pointer and using it could reassign the variable. Any other
+    // receiver is materialized once and its pointer referenced.
+    private fun valueToInstancePtr(valueCode: String, borrow: Boolean): String {
+        if (valueCode == "self" || valueCode.endsWith("_inst")) return valueCode
+        if (borrow && IDENTIFIER.matches(valueCode)) return "asInstance($valueCode)"
 
-        val tmpVal = freshTemp("val")
         val tmpInst = freshTemp("inst")
+        val tmpVal = freshTemp("val")
         appendIndentedLine("Value $tmpVal = $valueCode;")
-        appendIndentedLine("auto $tmpInst = std::get<std::shared_ptr<LoxInstance>>($tmpVal);")
+        appendIndentedLine("const auto &$tmpInst = asInstance($tmpVal);")
         return tmpInst
     }
 
+    // ---------- Type annotations ----------
+
+    private fun declareTyped(name: String, cppName: String, annotation: String, init: String) {
+        val local = if (annotation in Types.BUILTIN) cppName else "${cppName}_inst"
+        val storage = when (annotation) {
+            "num" -> "double"
+            "bool" -> "bool"
+            "str" -> "LoxString"
+            else -> "std::shared_ptr<LoxInstance>"
+        }
+        appendIndentedLine("$storage $local = $init;")
+        typedVars[local] = annotation
+        currentScope()[name] = local
+    }
+
+    private fun typedLocal(name: String): Pair<String, Specializer.Type>? {
+        val cppName = lookupVar(name) ?: return null
+        return Specializer.Type.of(typedVars[cppName])?.let { cppName to it }
+    }
+
+    private fun typedExpression(expr: Expr): Pair<String, Specializer.Type>? =
+        specializer?.typedExpression(expr, typedLocals)
+
+    // The Value `value` unboxed for a slot annotated `annotation`, or a
+    // runtime error.
+    private fun expect(annotation: String, value: String): String = when (annotation) {
+        "num" -> "expectNumber($value)"
+        "bool" -> "expectBool($value)"
+        "str" -> "expectString($value)"
+        else -> "expectInstance($value, \"$annotation\")"
+    }
+
+    // `expr` as an annotated slot holds it: code typed the same way or a
+    // local with the same annotation goes in as is, anything else is
+    // checked here, at the boundary with untyped code.
+    private fun unboxed(annotation: String, expr: Expr): String {
+        if (expr is Expr.Variable) lookupVar(expr.name.lexeme)?.let { if (typedVars[it] == annotation) return it }
+        typedExpression(expr)?.let { (code, type) -> if (type.annotation == annotation) return code }
+        return expect(annotation, expr.accept(this))
+    }
+
+    private fun returnValue(value: Expr?): String {
+        val annotation = returnType ?: return value?.accept(this) ?: "nullptr"
+        return "Value(${if (value == null) expect(annotation, "nullptr") else unboxed(annotation, value)})"
+    }
+
+    // Arithmetic and comparisons over annotated locals run unboxed.
+    private fun typedValue(expr: Expr): String? {
+        if (!mentionsTyped(expr)) return null
+        return typedExpression(expr)?.let { "Value(${it.first})" }
+    }
+
+    private fun mentionsTyped(expr: Expr): Boolean = when (expr) {
+        is Expr.Variable -> typedLocal(expr.name.lexeme) != null
+        is Expr.Get -> typedField(expr) != null
+        is Expr.Binary -> mentionsTyped(expr.left) || mentionsTyped(expr.right)
+        is Expr.Logical -> mentionsTyped(expr.left) || mentionsTyped(expr.right)
+        is Expr.Unary -> mentionsTyped(expr.right)
+        is Expr.Grouping -> mentionsTyped(expr.expression)
+        is Expr.Call -> expr.arguments.any(::mentionsTyped)
+        else -> false
+    }
+
+    // ---------- Declared fields ----------
+
+    // Emits the struct behind instances of a class that declares fields: a
+    // member per field, extending its superclass's struct, with the by-name
+    // access the runtime falls back on. Returns the layout its methods see.
+    private fun declareLayout(stmt: Stmt.Class, className: String): FieldLayout? {
+        val inherited = superclassVar?.let { fieldLayouts[it] }
+        if (stmt.fields.isEmpty()) return inherited?.also { fieldLayouts[className] = it }
+        if (stmt.superclass != null && inherited == null) {
+            compileError(stmt.superclass.name, "Superclass of a class with declared fields must be a class declaring its fields.")
+            return null
+        }
+        stmt.fields.firstOrNull { inherited?.fields?.containsKey(it.name.lexeme) == true }?.let {
+            compileError(it.name, "Field '${it.name.lexeme}' is already declared by a superclass.")
+            return null
+        }
+
+        val struct = "${className}_fields"
+        val base = inherited?.struct ?: "LoxInstance"
+        val fields = stmt.fields.map { it.name.lexeme to it.type?.lexeme }
+        val out = StringBuilder()
+        fun line(text: String) = out.appendLine(text)
+        line("struct $struct : $base {")
+        fields.forEach { (name, annotation) ->
+            line(" " + when (annotation) {
+                "num" -> "double f_$name = 0;"
+                "bool" -> "bool f_$name = false;"
+                "str" -> "LoxString f_$name;"
+                else -> "Value f_$name = nullptr;"
+            })
+        }
+        line(" using $base::$base;")
+        line(" bool getSlot(const std::string &name, Value &out) const override {")
+        fields.forEach { (name, _) -> line("  if (name == \"$name\") { out = f_$name; return true; }") }
+        line("  return $base::getSlot(name, out);")
+        line(" }")
+        line(" bool setSlot(const std::string &name, const Value &value) override {")
+        fields.forEach { (name, annotation) ->
+            val value = if (annotation == null) "value" else expect(annotation, "value")
+            line("  if (name == \"$name\") { f_$name = $value; return true; }")
+        }
+        line("  return $base::setSlot(name, value);")
+        line(" }")
+        line(" void slots(std::vector<std::pair<std::string, Value>> &out) const override {")
+        line("  $base::slots(out);")
+        fields.forEach { (name, _) -> line("  out.emplace_back(\"$name\", f_$name);") }
+        line(" }")
+        line("};")
+        fieldStructs.append(out).appendLine()
+
+        val layout = FieldLayout(struct, (inherited?.fields ?: emptyMap()) + fields)
+        fieldLayouts[className] = layout
+        return layout
+    }
+
+    // `obj.name` as a struct member and the field's annotation. Locals
+    // annotated with a class aren't used: their check admits any class of
+    // that name, so only a constructor call pins down the struct.
+    private fun fieldMember(obj: Expr, name: String): Pair<String, String?>? {
+        val (receiver, layout) = when (obj) {
+            is Expr.This -> "self" to (currentLayout ?: return null)
+            is Expr.Variable -> {
+                val local = lookupVar(obj.name.lexeme) ?: return null
+                local to (instanceLayouts[local] ?: return null)
+            }
+            else -> return null
+        }
+        if (!layout.fields.containsKey(name)) return null
+        return "FIELDS($receiver, ${layout.struct})->f_$name" to layout.fields[name]
+    }
+
+    private fun fieldValue(member: String, annotation: String?): String =
+        if (annotation?.let { it in Types.BUILTIN } == true) "Value($member)" else member
+
+    private fun typedField(get: Expr.Get): Pair<String, Specializer.Type>? {
+        val (member, annotation) = fieldMember(get.obj, get.name.lexeme) ?: return null
+        return Specializer.Type.of(annotation)?.let { member to it }
+    }
+
+    // Arguments of a direct call to a clone: code typed as the parameter,
+    // or, for a parameter the function annotates, a variable or literal
+    // checked here as its body would. At most one is checked, so C++'s
+    // unspecified argument order can't change which error is reported.
+    private fun cloneArguments(spec: Specializer.Specialization, arguments: List<Expr>, args: List<String>): String? {
+        var checked = 0
+        val codes = mutableListOf<String>()
+        for ((i, argument) in arguments.withIndex()) {
+            val typed = typedExpression(argument)?.takeIf { it.second == spec.params[i] }
+            if (typed == null && (!spec.annotated[i] || !isPureOperand(argument) || ++checked > 1)) return null
+            codes += typed?.first ?: expect(spec.params[i].annotation, args[i])
+        }
+        return codes.joinToString(", ")
+    }
+
+    // Code that can never run, such as a call whose argument count can't
+    // match. The REPL reports it like its other generator errors; a compiled
+    // script fails with a compile error.
+    private fun compileError(token: Token, message: String) {
+        if (replMode) throw RuntimeException(message)
+        Lox.error(token, message)
+    }
+
+    // A local's last read hands its Value over instead of copying it.
+    private fun consume(expr: Expr, code: String): String =
+        if (expr is Expr.Variable && expr in moves && IDENTIFIER.matches(code) && !code.endsWith("_inst")) "std::move($code)" else code
+
     private fun emitClassInstantiation(callExpr: Expr.Call, assignTo: String? = null): String {
         require(callExpr.callee is Expr.Variable) { "Expected class name variable" }
 
         val classVar = resolveVar(callExpr.callee.name.lexeme)
         val valueVar = declareCountedVar(assignTo ?: "instance")
 
-        val argsCode = callExpr.arguments.joinToString(", ") { it.accept(this) }
+        val argsCode = callExpr.arguments.joinToString(", ") { consume(it, it.accept(this)) }
         appendIndentedLine("INSTANCE($valueVar, $classVar${if (argsCode.isEmpty()) "" else ", $argsCode"});")
 
         if (assignTo != null) {
@@ -347,4 +1193,33 @@ class CppCodeGenerator : Expr.Visitor<String>, Stmt.Visitor<Unit> {
 
         return valueVar
     }
+
+    // The struct behind a class's instances and every field it declares or
+    // inherits, with its annotation.
+    private class FieldLayout(val struct: String, val fields: Map<String, String?>)
+
+    // A class's own methods as (C++ variable, parameter count), falling back
+    // to its superclass's when that was declared in the same unit.
+    private class ClassMethods(val superclass: ClassMethods?) {
+        val functions = mutableMapOf<String, Pair<String, Int>>()
+
+        fun find(name: String): Pair<String, Int>? = functions[name] ?: superclass?.find(name)
+    }
+
+    companion object {
+        internal val MATH_INTRINSICS = mapOf(
+            "sqrt" to "std::sqrt", "floor" to "std::floor", "ceil" to "std::ceil", "abs" to "std::fabs",
+            "min" to "std::fmin", "max" to "std::fmax", "pow" to "std::pow", "exp" to "std::exp",
+            "log" to "std::log", "sin" to "std::sin", "cos" to "std::cos", "atan2" to "std::atan2",
+            "fma" to "std::fma"
+        )
+        private val CONVERSION_FUNCTIONS = mapOf("parseNumber" to "parseNumber", "toString" to "numberToString")
+        private val STRING_FUNCTIONS = mapOf(
+            "len" to "stringLength", "indexOf" to "stringIndexOf", "startsWith" to "stringStartsWith",
+            "substring" to "stringSubstring", "trim" to "stringTrim", "charAt" to "stringCharAt",
+            "split" to "stringSplit", "match" to "matchPattern"
+        )
+        private val IDENTIFIER = Regex("[A-Za-z_][A-Za-z0-9_]*")
+        private const val MAX_EXACT_INT = 9007199254740992.0 // 2^53, LOX_MAX_EXACT_INT in the runtime
+    }
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+﻿package lox
+
+import java.io.IOException
+import java.nio.MappedByteBuffer
+import java.nio.channels.FileChannel
+import java.nio.file.Paths
+import java.nio.file.StandardOpenOption
+
+/**
+ * `CsvReader(path, columns)`: `next()` returns the next record as a `List` of
+ * the requested column indices in the order given (every column when
+ * `columns` is nil), or nil at the end of the file. Unquoted fields that read
+ * as plain decimals become numbers; everything else, including every quoted
+ * field, stays a string. Blank lines are skipped.
+ */
+object CsvNatives {
+    val classNames = setOf("CsvReader")
+
+    private const val COMMA = ','.code.toByte()
+    private const val QUOTE = '"'.code.toByte()
+    private const val LF = '\n'.code.toByte()
+    private const val CR = '\r'.code.toByte()
+
+    /** `slots[column]` is the column's position in a record, or -1 to skip it; empty reads them all. */
+    private class ReaderInstance(
+        klass: LoxClass,
+        val bytes: MappedByteBuffer,
+        val slots: IntArray,
+        val width: Int
+    ): LoxInstance(klass) {
+        var offset = 0
+    }
+
+    fun define(globals: Environment) {
+        globals.define("CsvReader", NativeClass("CsvReader", 2, mapOf(
+            "next" to NativeMethod(0) { self, _ -> next(self as ReaderInstance) }
+        )) { klass, args -> open(klass, args[0], args[1]) })
+    }
+
+    private fun open(klass: LoxClass, path: Any?, columns: Any?): ReaderInstance {
+        val slots = mutableListOf<Int>()
+        var width = 0
+        if (columns != null) {
+            val list = columns as? ListNatives.ListInstance ?: throw NativeError("Columns must be a List or nil.")
+            width = list.items.size
+            for ((i, item) in list.items.withIndex()) {
+                val column = item as? Double ?: throw NativeError("Operand must be a number.")
+                if (column < 0 || column % 1.0 != 0.0 || column > 1e6) {
+                    throw NativeError("Column index must be a non-negative integer.")
+                }
+                val index = column.toInt()
+                while (slots.size <= index) slots.add(-1)
+                if (slots[index] >= 0) throw NativeError("Duplicate column index.")
+                slots[index] = i
+            }
+        }
+
+        val file = path as? String ?: throw NativeError("Operand must be a string.")
+        val bytes = try {
+            FileChannel.open(Paths.get(file), StandardOpenOption.READ).use { it.map(FileChannel.MapMode.READ_ONLY, 0, it.size()) }
+        } catch (e: IOException) {
+            throw NativeError("Could not open file '$file'.")
+        }
+        return ReaderInstance(klass, bytes, slots.toIntArray(), width)
+    }
+
+    private fun next(reader: ReaderInstance): Any? {
+        val bytes = reader.bytes
+        val end = bytes.limit()
+        var p = reader.offset
+        while (p < end && (bytes[p] == LF || bytes[p] == CR)) p++
+        if (p == end) {
+            reader.offset = end
+            return null
+        }
+
+        val items = MutableList<Any?>(reader.width) { null }
+        var column = 0
+        while (true) {
+            val slot = if (column < reader.slots.size) reader.slots[column] else -1
+            val wanted = reader.slots.isEmpty() || slot >= 0
+            var value: Any? = null
+            if (p < end && bytes[p] == QUOTE) {
+                val start = p + 1
+                var close = start
+                var escaped = false
+                p = start
+                while (true) {
+                    while (p < end && bytes[p] != QUOTE) p++
+                    if (p == end) throw NativeError("Unterminated quoted field.")
+                    close = p
+                    p++
+                    if (p == end || bytes[p] != QUOTE) break
+                    escaped = true
+                    p++
+                }
+                while (p < end && bytes[p] != COMMA && bytes[p] != LF && bytes[p] != CR) p++
+                if (wanted) {
+                    val text = decode(bytes, start, close)
+                    value = if (escaped) text.replace("\"\"", "\"") else text
+                }
+            } else {
+                val start = p
+                while (p < end && bytes[p] != COMMA && bytes[p] != LF && bytes[p] != CR) p++
+                if (wanted) {
+                    val text = decode(bytes, start, p)
+                    value = ConversionNatives.parse(text) ?: text
+                }
+            }
+            if (reader.slots.isEmpty()) items.add(value) else if (slot >= 0) items[slot] = value
+            column++
+            if (p == end || bytes[p] != COMMA) break
+            p++
+        }
+        if (p < end && bytes[p] == CR) p++
+        if (p < end && bytes[p] == LF) p++
+        reader.offset = p
+        return ListNatives.of(items)
+    }
+
+    private fun decode(bytes: MappedByteBuffer, from: Int, to: Int): String {
+        val chars = ByteArray(to - from)
+        for (i in chars.indices) chars[i] = bytes[from + i]
+        return String(chars, Charsets.UTF_8)
+    }
+}
@@ -0,0 +1,157 @@
+﻿package lox
+
+import java.util.Collections
+import java.util.IdentityHashMap
+
+/**
+ * Drops function, class and method declarations that the program can never
+ * reach, and statements that follow a `return` in the same block, before the
+ * C++ emitter sees them.
+ *
+ * Reachability is by name, which is conservative: a declaration is kept if
+ * anything live mentions its name, whatever scope that mention resolves to,
+ * and a method is kept if any live code reads or calls a property with its
+ * name on any object. A class's `init`, `equals` and `hash` always survive
+ * with the class, since the runtime calls them implicitly, and every class
+ * survives once `readValue` is live, since it rebuilds instances by class
+ * name.
+ */
+object DeadCode {
+    private val runtimeMethods = setOf("init", "equals", "hash")
+
+    fun prune(statements: List<Stmt>): List<Stmt> {
+        val liveness = Liveness().apply { scan(statements) }
+        return liveness.prune(statements)
+    }
+
+    private fun reachable(statements: List<Stmt>): List<Stmt> {
+        val end = statements.indexOfFirst { it is Stmt.Return }
+        return if (end < 0) statements else statements.subList(0, end + 1)
+    }
+
+    private class Liveness {
+        private val names = HashSet<String>()
+        private val properties = HashSet<String>()
+        private val live: MutableSet<Stmt> = Collections.newSetFromMap(IdentityHashMap())
+        private val pendingDecls = HashMap<String, MutableList<Stmt>>()
+        private val pendingMethods = HashMap<String, MutableList<Stmt.Function>>()
+        private var keepClasses = false
+
+        fun scan(statements: List<Stmt>) {
+            reachable(statements).forEach(::scan)
+        }
+
+        private fun scan(stmt: Stmt) {
+            when (stmt) {
+                is Stmt.Block -> scan(stmt.statements)
+                is Stmt.Class -> declare(stmt.name.lexeme, stmt)
+                is Stmt.Expression -> scan(stmt.expression)
+                is Stmt.Function -> declare(stmt.name.lexeme, stmt)
+                is Stmt.If -> {
+                    scan(stmt.condition)
+                    scan(stmt.thenBranch)
+                    stmt.elseBranch?.let(::scan)
+                }
+                is Stmt.Print -> scan(stmt.expression)
+                is Stmt.Return -> stmt.value?.let(::scan)
+                is Stmt.Var -> scan(stmt.initializer)
+                is Stmt.While -> {
+                    scan(stmt.condition)
+                    scan(stmt.body)
+                }
+            }
+        }
+
+        private fun scan(expr: Expr) {
+            when (expr) {
+                is Expr.Assign -> {
+                    useName(expr.name.lexeme)
+                    scan(expr.value)
+                }
+                is Expr.Binary -> {
+                    scan(expr.left)
+                    scan(expr.right)
+                }
+                is Expr.Call -> {
+                    scan(expr.callee)
+                    expr.arguments.forEach(::scan)
+                }
+                is Expr.Get -> {
+                    scan(expr.obj)
+                    useProperty(expr.name.lexeme)
+                }
+                is Expr.Grouping -> scan(expr.expression)
+                is Expr.Literal, is Expr.This -> {}
+                is Expr.Logical -> {
+                    scan(expr.left)
+                    scan(expr.right)
+                }
+                is Expr.Set -> {
+                    scan(expr.obj)
+                    scan(expr.value)
+                }
+                is Expr.Super -> useProperty(expr.method.lexeme)
+                is Expr.Unary -> scan(expr.right)
+                is Expr.Variable -> useName(expr.name.lexeme)
+            }
+        }
+
+        private fun declare(name: String, stmt: Stmt) {
+            if (name in names || (keepClasses && stmt is Stmt.Class)) {
+                activate(stmt)
+            } else {
+                pendingDecls.getOrPut(name) { mutableListOf() } += stmt
+            }
+        }
+
+        private fun useName(name: String) {
+            if (!names.add(name)) return
+            pendingDecls.remove(name)?.forEach(::activate)
+            if (name == "readValue") {
+                keepClasses = true
+                val classes = pendingDecls.values.flatten().filterIsInstance<Stmt.Class>()
+                pendingDecls.values.forEach { it.removeAll(classes) }
+                classes.forEach(::activate)
+            }
+        }
+
+        private fun useProperty(name: String) {
+            if (!properties.add(name)) return
+            pendingMethods.remove(name)?.forEach(::activate)
+        }
+
+        private fun activate(stmt: Stmt) {
+            if (!live.add(stmt)) return
+            when (stmt) {
+                is Stmt.Function -> scan(stmt.body)
+                is Stmt.Class -> {
+                    stmt.superclass?.let { useName(it.name.lexeme) }
+                    for (method in stmt.methods) {
+                        val name = method.name.lexeme
+                        if (name in properties || name in runtimeMethods) {
+                            activate(method)
+                        } else {
+                            pendingMethods.getOrPut(name) { mutableListOf() } += method
+                        }
+                    }
+                }
+                else -> {}
+            }
+        }
+
+        fun prune(statements: List<Stmt>): List<Stmt> =
+            reachable(statements).mapNotNull(::prune)
+
+        private fun prune(stmt: Stmt): Stmt? = when (stmt) {
+            is Stmt.Block -> Stmt.Block(prune(stmt.statements))
+            is Stmt.Class -> if (stmt in live) {
+                stmt.copy(methods = stmt.methods.filter { it in live }.map { it.copy(body = prune(it.body)) })
+            } else null
+            is Stmt.Function -> if (stmt in live) stmt.copy(body = prune(stmt.body)) else null
+            is Stmt.If -> Stmt.If(stmt.condition, prune(stmt.thenBranch) ?: Stmt.Block(emptyList()),
+                stmt.elseBranch?.let { prune(it) ?: Stmt.Block(emptyList()) })
+            is Stmt.While -> Stmt.While(stmt.condition, prune(stmt.body) ?: Stmt.Block(emptyList()))
+            else -> stmt
+        }
+    }
+}
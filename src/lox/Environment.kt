@@ -34,6 +34,8 @@ class Environment(val enclosing: Environment? = null) {
         throw RunTimeError(name, "Undefined variable '${name.lexeme}'.")
     }
 
+    fun entries(): Map<String, Any?> = values
+
     fun getAt(distance: Int, name: String): Any? {
         return ancestor(distance).values[name];
     }
@@ -0,0 +1,43 @@
+﻿package lox
+
+/**
+ * `hash(value)`, consistent with `==`: numbers by value, strings by content,
+ * instances of a class defining `hash` by whatever that returns, and other
+ * objects by identity. The result is a non-negative integer below 2^53.
+ */
+object HashNatives {
+    val arities = mapOf("hash" to 1)
+
+    private const val MASK = (1L shl 53) - 1
+
+    fun define(globals: Environment) {
+        globals.define("hash", object: LoxCallable {
+            override fun arity(): Int = 1
+            override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? = hash(interpreter, arguments[0])
+            override fun toString(): String = "<native fn>"
+        })
+    }
+
+    fun hash(interpreter: Interpreter, value: Any?): Double {
+        val h = when (value) {
+            null -> 0L
+            is Boolean -> if (value) 1L else 2L
+            // 0.0 for -0.0, which compares equal to it.
+            is Double -> mix((value + 0.0).toRawBits())
+            // Strings cache their hashCode.
+            is String -> mix(value.hashCode().toLong())
+            is LoxInstance -> value.klass.hashMethod?.let { method ->
+                return hash(interpreter, method.bind(value).call(interpreter, mutableListOf()))
+            } ?: mix(System.identityHashCode(value).toLong())
+            else -> mix(System.identityHashCode(value).toLong())
+        }
+        return (h and MASK).toDouble()
+    }
+
+    // The splitmix64 finalizer, so nearby inputs land far apart.
+    private fun mix(x: Long): Long {
+        var h = (x xor (x ushr 30)) * -0x40a7b892e31b1a47L
+        h = (h xor (h ushr 27)) * -0x6b2fb644ecceee15L
+        return h xor (h ushr 31)
+    }
+}
@@ -0,0 +1,80 @@
+﻿package lox
+
+import java.io.ByteArrayOutputStream
+import java.io.PrintStream
+import java.util.IdentityHashMap
+
+/**
+ * A program split at its top-level `snapshot()` marker. The prefix is run by
+ * the interpreter at compile time and the resulting heap is handed to the code
+ * generator, so the compiled program starts from that state instead of
+ * rebuilding it.
+ */
+class HeapSnapshot private constructor(
+    val marker: Token,
+    val prefix: List<Stmt>,
+    val suffix: List<Stmt>
+) {
+    /** Everything the prefix printed; replayed verbatim at startup. */
+    var output: String = ""
+        private set
+
+    /** Top-level names declared by the prefix, with their values at the marker. */
+    val globals = LinkedHashMap<String, Any?>()
+
+    /** Classes created by the prefix's top-level class declarations. */
+    val classes = IdentityHashMap<LoxClass, Stmt.Class>()
+
+    fun capture(interpreter: Interpreter): Boolean {
+        val buffer = ByteArrayOutputStream()
+        val stdout = System.out
+        System.setOut(PrintStream(buffer, true, Charsets.UTF_8))
+
+        try {
+            for (stmt in prefix) {
+                interpreter.executeBlock(listOf(stmt), interpreter.globals)
+                if (stmt is Stmt.Class) {
+                    (interpreter.globals.entries()[stmt.name.lexeme] as? LoxClass)?.let { classes[it] = stmt }
+                }
+            }
+        } catch (error: RunTimeError) {
+            Lox.runtimeError(error)
+            return false
+        } finally {
+            System.out.flush()
+            System.setOut(stdout)
+            output = buffer.toString(Charsets.UTF_8)
+        }
+
+        val values = interpreter.globals.entries()
+        prefix.mapNotNull(::declaredName).forEach { globals[it] = values[it] }
+        return true
+    }
+
+    companion object {
+        fun split(statements: List<Stmt>): HeapSnapshot? {
+            val index = statements.indexOfFirst(::isMarker)
+            if (index < 0) return null
+
+            val call = (statements[index] as Stmt.Expression).expression as Expr.Call
+            return HeapSnapshot(call.paren, statements.subList(0, index), statements.subList(index + 1, statements.size))
+        }
+
+        /** For backends without snapshot support; the marker is a no-op at runtime. */
+        fun strip(statements: List<Stmt>): List<Stmt> = statements.filterNot(::isMarker)
+
+        private fun isMarker(stmt: Stmt): Boolean {
+            val call = (stmt as? Stmt.Expression)?.expression as? Expr.Call ?: return false
+            val callee = call.callee as? Expr.Variable ?: return false
+            return callee.name.lexeme == "snapshot" && call.arguments.isEmpty()
+        }
+
+        private fun declaredName(stmt: Stmt): String? =
+            when (stmt) {
+                is Stmt.Var -> stmt.name.lexeme
+                is Stmt.Function -> stmt.name.lexeme
+                is Stmt.Class -> stmt.name.lexeme
+                else -> null
+            }
+    }
+}
@@ -1,10 +1,21 @@
 ﻿package lox
 
+import java.util.IdentityHashMap
+
 class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
     val globals = Environment()
     private var environment: Environment = globals
     private val locals = HashMap<Expr, Int>()
 
+    // Type annotations, as the Resolver found them: the annotated variable
+    // each assignment stores into, plus the class names and global
+    // annotations it has seen, which later REPL lines still refer to.
+    private val assignmentTypes = IdentityHashMap<Expr.Assign, Token>()
+    val classNames = mutableSetOf<String>().apply {
+        addAll(RandomNatives.classNames + ListNatives.classNames + CsvNatives.classNames + TableNatives.classNames + ColumnNatives.classNames)
+    }
+    val globalTypes = mutableMapOf<String, Token?>()
+
     init {
         globals.define("clock", object: LoxCallable {
             override fun arity(): Int = 0
@@ -13,6 +24,24 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
             }
             override fun toString(): String = "<native fn>"
         })
+
+        MathNatives.define(globals)
+        RandomNatives.define(globals)
+        ConversionNatives.define(globals)
+        ListNatives.define(globals)
+        StringNatives.define(globals)
+        CsvNatives.define(globals)
+        SerializationNatives.define(globals)
+        TableNatives.define(globals)
+        HashNatives.define(globals)
+        ColumnNatives.define(globals)
+
+        // Marks where `compile` snapshots the heap; nothing to do when interpreting.
+        globals.define("snapshot", object: LoxCallable {
+            override fun arity(): Int = 0
+            override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? = null
+            override fun toString(): String = "<native fn>"
+        })
     }
 
     fun interpret(statements: List<Stmt>) {
@@ -27,6 +56,12 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
         locals[expr] = depth
     }
 
+    fun annotate(expr: Expr.Assign, type: Token) {
+        assignmentTypes[expr] = type
+    }
+
+    fun annotation(expr: Expr.Assign): Token? = assignmentTypes[expr]
+
     override fun visitBlockStmt(stmt: Stmt.Block) {
         executeBlock(stmt.statements, Environment(environment))
     }
@@ -36,6 +71,8 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
             evaluate(it) as? LoxClass ?: throw RunTimeError(it.name, "Superclass must be a class.")
         }
 
+        if (stmt.fields.isNotEmpty() && superclass != null) checkLayout(stmt, superclass)
+
         environment.define(stmt.name.lexeme, null)
 
         val previousEnv = environment
@@ -47,7 +84,7 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
             method.name.lexeme to LoxFunction(method, environment, method.name.lexeme == "init")
         }.toMutableMap()
 
-        val klass = LoxClass(stmt.name.lexeme, superclass, methods)
+        val klass = LoxClass(stmt.name.lexeme, superclass, methods, stmt.fields)
 
         if (superclass != null) {
             environment = previousEnv
@@ -56,6 +93,16 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
         environment.assign(stmt.name, klass)
     }
 
+    // A class that declares its fields extends the layout of a superclass
+    // that declared its own, so every inherited method finds its fields.
+    fun checkLayout(stmt: Stmt.Class, superclass: LoxClass) {
+        val layout = superclass.layout
+            ?: throw RunTimeError(stmt.superclass!!.name, "Superclass of a class with declared fields must declare its fields.")
+        stmt.fields.firstOrNull { it.name.lexeme in layout }?.let {
+            throw RunTimeError(it.name, "Field '${it.name.lexeme}' is already declared by a superclass.")
+        }
+    }
+
     fun executeBlock(statements: List<Stmt>, environment: Environment) {
         val previous = this.environment
         try {
@@ -96,7 +143,7 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
     }
 
     override fun visitVarStmt(stmt: Stmt.Var) {
-        val value: Any? = evaluate(stmt.initializer)
+        val value: Any? = Types.check(stmt.type, evaluate(stmt.initializer), stmt.name)
         environment.define(stmt.name.lexeme, value)
     }
 
@@ -107,7 +154,7 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
     }
 
     override fun visitAssignExpr(expr: Expr.Assign): Any? {
-        val value = evaluate(expr.value)
+        val value = Types.check(assignmentTypes[expr], evaluate(expr.value), expr.name)
         val distance = locals[expr]
         if (distance != null) {
             environment.assignAt(distance, expr.name, value)
@@ -136,8 +183,8 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
             TokenType.GREATER_EQUAL -> (left asDouble expr.operator) >= (right asDouble expr.operator)
             TokenType.LESS -> (left asDouble expr.operator) < (right asDouble expr.operator)
             TokenType.LESS_EQUAL -> (left asDouble expr.operator) <= (right asDouble expr.operator)
-            TokenType.BANG_EQUAL -> left != right
-            TokenType.EQUAL_EQUAL -> left == right
+            TokenType.BANG_EQUAL -> !isEqual(left, right)
+            TokenType.EQUAL_EQUAL -> isEqual(left, right)
             else -> null
         }
     }
@@ -162,7 +209,11 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
                 "Expected ${function.arity()} arguments but got ${arguments.size}.")
         }
 
-        return function.call(this, arguments)
+        try {
+            return function.call(this, arguments)
+        } catch (error: NativeError) {
+            throw RunTimeError(expr.paren, error.message!!)
+        }
     }
 
     override fun visitGetExpr(expr: Expr.Get): Any? {
@@ -235,6 +286,12 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
         }
     }
 
+    /** `==`: the class of an instance on the left may define `equals`; otherwise by value, or identity for objects. */
+    fun isEqual(left: Any?, right: Any?): Boolean {
+        val equals = (left as? LoxInstance)?.klass?.equalsMethod ?: return left == right
+        return isTruthy(equals.bind(left as LoxInstance).call(this, mutableListOf(right)))
+    }
+
     private fun isTruthy(obj: Any?): Boolean =
         when (obj) {
             null -> false
@@ -246,7 +303,7 @@ class Interpreter: Expr.Visitor<Any?>, Stmt.Visitor<Unit> {
 
     private fun evaluate(expr: Expr): Any? = expr.accept(this)
 
-    private fun stringify(value: Any?) =
+    fun stringify(value: Any?) =
         when (value) {
             null -> "nil"
             is Double -> value.toString().removeSuffix(".0")
@@ -0,0 +1,578 @@
+﻿package lox
+
+/**
+ * Compiles the resolved AST to a JVM class at load time and runs it, so
+ * HotSpot profiles and JIT-compiles Lox functions like any other bytecode.
+ * Each function becomes a static method taking its closure and arguments,
+ * and each global a static field. Locals live in JVM locals unless a nested
+ * function or class could capture them; such scopes get a heap frame, an
+ * `Object[]` whose slot 0 links to the enclosing frame. Operations with Lox
+ * semantics call into [JvmRuntime]. Semantics match [Interpreter].
+ */
+class JvmCompiler(private val interpreter: Interpreter) {
+    // A scope's variables, as JVM local slots or, for a heap scope, indices
+    // into its frame.
+    private class Scope(val parent: Scope?, val heap: Boolean) {
+        val slots = HashMap<String, Int>()
+    }
+
+    // The method being generated. [env] holds its innermost heap frame.
+    private class Method(val code: Code, val env: Int, var nextSlot: Int, val function: Stmt.Function?, val isInitializer: Boolean)
+
+    private val writer = ClassWriter(PROGRAM, "java/lang/Object", listOf("lox/JvmProgram"))
+    private val tokens = HashMap<Token, Int>()
+    private val globals = LinkedHashMap<String, String>()
+    private val constants = LinkedHashMap<Double, String>()
+    private val functions = mutableListOf<Stmt.Function>()
+    private val functionMethods = mutableListOf<Pair<String, String>>()
+    private val classes = mutableListOf<Pair<Stmt.Class, List<Int>>>()
+
+    private var scope: Scope? = null
+    private lateinit var method: Method
+    private val code get() = method.code
+
+    fun execute(statements: List<Stmt>) {
+        // A method or constant pool past the class-file limits runs on the
+        // tree walker instead.
+        val program = try {
+            load(compile(statements))
+        } catch (error: ClassWriter.TooLarge) {
+            interpreter.interpret(statements)
+            return
+        }
+
+        try {
+            program.run()
+        } catch (error: RunTimeError) {
+            Lox.runtimeError(error)
+        }
+    }
+
+    private fun compile(statements: List<Stmt>): ByteArray {
+        val run = writer.method(ClassWriter.ACC_PUBLIC, "run", "()V", 1)
+        method = Method(run, env = 1, nextSlot = 2, function = null, isInitializer = false)
+        run.op(Code.ACONST_NULL, 1)
+        run.astore(1)
+        statements.forEach { compile(it) }
+        run.op(Code.RETURN, 0)
+
+        compileInvoke()
+        val init = writer.method(ClassWriter.ACC_PUBLIC, "<init>", "()V", 1)
+        init.aload(0)
+        init.invokespecial("java/lang/Object", "<init>", "()V")
+        init.op(Code.RETURN, 0)
+
+        val static = ClassWriter.ACC_PUBLIC or ClassWriter.ACC_STATIC
+        writer.field(static, "rt", RUNTIME_TYPE)
+        (globals.values + constants.values).forEach { writer.field(static, it, OBJECT) }
+        return writer.toByteArray()
+    }
+
+    private fun load(bytes: ByteArray): JvmProgram {
+        val type = Loader(JvmCompiler::class.java.classLoader).define(PROGRAM.replace('/', '.'), bytes)
+        val runtime = JvmRuntime(
+            interpreter,
+            tokens.entries.sortedBy { it.value }.map { it.key }.toTypedArray(),
+            functions.toTypedArray(),
+            classes.toTypedArray()
+        )
+        type.getField("rt").set(null, runtime)
+
+        val natives = interpreter.globals.entries()
+        globals.forEach { (name, field) ->
+            type.getField(field).set(null, if (name in natives) natives[name] else JvmRuntime.UNDEFINED)
+        }
+        constants.forEach { (value, field) -> type.getField(field).set(null, value) }
+
+        val program = type.getDeclaredConstructor().newInstance() as JvmProgram
+        runtime.program = program
+        return program
+    }
+
+    private class Loader(parent: ClassLoader): ClassLoader(parent) {
+        fun define(name: String, bytes: ByteArray): Class<*> = defineClass(name, bytes, 0, bytes.size)
+    }
+
+    // invoke(id, closure, arguments) dispatches to the static method of
+    // function `id`, unpacking the argument list.
+    private fun compileInvoke() {
+        val invoke = writer.method(ClassWriter.ACC_PUBLIC, "invoke", "(I${FRAME}Ljava/util/List;)$OBJECT", 4)
+        if (functions.isEmpty()) {
+            invoke.op(Code.ACONST_NULL, 1)
+            invoke.op(Code.ARETURN, -1)
+            return
+        }
+
+        val cases = functions.map { Label() }
+        val default = Label()
+        invoke.iload(1)
+        invoke.tableswitch(0, cases, default)
+        functionMethods.forEachIndexed { id, (name, descriptor) ->
+            invoke.mark(cases[id])
+            invoke.aload(2)
+            repeat(functions[id].params.size) { i ->
+                invoke.aload(3)
+                invoke.iconst(i)
+                invoke.invokeinterface("java/util/List", "get", "(I)$OBJECT")
+            }
+            invoke.invokestatic(PROGRAM, name, descriptor)
+            invoke.op(Code.ARETURN, -1)
+        }
+        invoke.mark(default)
+        invoke.op(Code.ACONST_NULL, 1)
+        invoke.op(Code.ARETURN, -1)
+    }
+
+    // ---------- Statements ----------
+
+    private fun compile(stmt: Stmt) {
+        when (stmt) {
+            is Stmt.Block -> compileBlock(stmt.statements)
+            is Stmt.Class -> compileClass(stmt)
+            is Stmt.Expression -> {
+                compile(stmt.expression)
+                code.op(Code.POP, -1)
+            }
+            is Stmt.Function -> {
+                val slot = declare(stmt.name)
+                runtime()
+                code.iconst(compileFunction(stmt, isInitializer = false))
+                code.aload(method.env)
+                invokeRuntime("function", "(I$FRAME)$OBJECT")
+                store(stmt.name, slot)
+            }
+            is Stmt.If -> {
+                val elseLabel = Label()
+                condition(stmt.condition)
+                code.jump(Code.IFEQ, elseLabel)
+                compile(stmt.thenBranch)
+                if (stmt.elseBranch == null) {
+                    code.mark(elseLabel)
+                } else {
+                    val end = Label()
+                    code.jump(Code.GOTO, end)
+                    code.mark(elseLabel)
+                    compile(stmt.elseBranch)
+                    code.mark(end)
+                }
+            }
+            is Stmt.Print -> {
+                runtime()
+                compile(stmt.expression)
+                invokeRuntime("print", "($OBJECT)V")
+            }
+            is Stmt.Return -> compileReturn(stmt.value)
+            is Stmt.Var -> {
+                checked(stmt.type, stmt.name) { compile(stmt.initializer) }
+                store(stmt.name, declare(stmt.name))
+            }
+            is Stmt.While -> {
+                val start = Label()
+                val end = Label()
+                code.mark(start)
+                condition(stmt.condition)
+                code.jump(Code.IFEQ, end)
+                compile(stmt.body)
+                code.jump(Code.GOTO, start)
+                code.mark(end)
+            }
+        }
+    }
+
+    private fun compileBlock(statements: List<Stmt>) {
+        val size = declarations(statements)
+        if (size == 0) {
+            statements.forEach { compile(it) }
+            return
+        }
+
+        val blockScope = Scope(scope, captures(statements))
+        val nextSlot = method.nextSlot
+        if (blockScope.heap) {
+            newFrame(size + 1, method.env)
+            code.astore(method.env)
+        }
+        withScope(blockScope) { statements.forEach { compile(it) } }
+        if (blockScope.heap) {
+            code.aload(method.env)
+            code.iconst(0)
+            code.op(Code.AALOAD, -1)
+            code.checkcast(FRAME)
+            code.astore(method.env)
+        }
+        method.nextSlot = nextSlot
+    }
+
+    private fun compileClass(stmt: Stmt.Class) {
+        val slot = declare(stmt.name)
+
+        val superScope = if (stmt.superclass != null) Scope(scope, heap = true).apply { slots["super"] = 1 } else null
+        val thisScope = Scope(superScope ?: scope, heap = true).apply { slots["this"] = 1 }
+        val methodIds = withScope(thisScope) {
+            stmt.methods.map { compileFunction(it, it.name.lexeme == "init") }
+        }
+        classes += stmt to methodIds
+
+        runtime()
+        code.iconst(classes.size - 1)
+        if (stmt.superclass != null) compile(stmt.superclass) else code.op(Code.ACONST_NULL, 1)
+        code.aload(method.env)
+        invokeRuntime("makeClass", "(I$OBJECT$FRAME)$OBJECT")
+        store(stmt.name, slot)
+    }
+
+    /** Generates the static method for [stmt] and returns its id. */
+    private fun compileFunction(stmt: Stmt.Function, isInitializer: Boolean): Int {
+        val arity = stmt.params.size
+        if (arity > 254) throw ClassWriter.TooLarge()
+
+        val id = functions.size
+        val name = "fn${id}_${stmt.name.lexeme}"
+        val descriptor = "($FRAME${OBJECT.repeat(arity)})$OBJECT"
+        functions += stmt
+        functionMethods += name to descriptor
+
+        val heap = captures(stmt.body)
+        val functionScope = Scope(scope, heap)
+        stmt.params.forEachIndexed { i, param -> functionScope.slots[param.lexeme] = i + 1 }
+
+        val enclosing = method
+        val env = if (heap) arity + 1 else 0
+        method = Method(writer.method(ClassWriter.ACC_PUBLIC or ClassWriter.ACC_STATIC, name, descriptor, arity + 1),
+            env, if (heap) env + 1 else arity + 1, stmt, isInitializer)
+
+        stmt.paramTypes.forEachIndexed { i, type ->
+            if (type == null) return@forEachIndexed
+            checked(type, stmt.params[i]) { code.aload(i + 1) }
+            code.op(Code.POP, -1)
+        }
+        if (heap) {
+            newFrame(arity + declarations(stmt.body) + 1, 0)
+            for (i in 1..arity) {
+                code.op(Code.DUP, 1)
+                code.iconst(i)
+                code.aload(i)
+                code.op(Code.AASTORE, -3)
+            }
+            code.astore(env)
+        }
+
+        withScope(functionScope) { stmt.body.forEach { compile(it) } }
+        compileReturn(null)
+
+        method = enclosing
+        return id
+    }
+
+    private fun compileReturn(value: Expr?) {
+        val function = method.function!!
+        if (method.isInitializer) {
+            code.aload(0)
+            code.iconst(1)
+            code.op(Code.AALOAD, -1)
+        } else {
+            checked(function.returnType, function.returnType) {
+                if (value != null) compile(value) else code.op(Code.ACONST_NULL, 1)
+            }
+        }
+        code.op(Code.ARETURN, -1)
+    }
+
+    // ---------- Expressions ----------
+
+    private fun compile(expr: Expr) {
+        when (expr) {
+            is Expr.Assign -> compileAssign(expr)
+            is Expr.Binary -> when (expr.operator.type) {
+                TokenType.MINUS -> arithmetic(expr, "subtract")
+                TokenType.SLASH -> arithmetic(expr, "divide")
+                TokenType.STAR -> arithmetic(expr, "multiply")
+                TokenType.PLUS -> arithmetic(expr, "add")
+                else -> boxed(expr)
+            }
+            is Expr.Call -> {
+                runtime()
+                compile(expr.callee)
+                code.iconst(expr.arguments.size)
+                code.anewarray("java/lang/Object")
+                expr.arguments.forEachIndexed { i, argument ->
+                    code.op(Code.DUP, 1)
+                    code.iconst(i)
+                    compile(argument)
+                    code.op(Code.AASTORE, -3)
+                }
+                token(expr.paren)
+                invokeRuntime("call", "($OBJECT${FRAME}I)$OBJECT")
+            }
+            is Expr.Get -> {
+                runtime()
+                compile(expr.obj)
+                token(expr.name)
+                invokeRuntime("get", "(${OBJECT}I)$OBJECT")
+            }
+            is Expr.Grouping -> compile(expr.expression)
+            is Expr.Literal -> when (val value = expr.value) {
+                null -> code.op(Code.ACONST_NULL, 1)
+                is Boolean -> code.getstatic("java/lang/Boolean", if (value) "TRUE" else "FALSE", "Ljava/lang/Boolean;")
+                is String -> code.ldcString(value)
+                is Double -> code.getstatic(PROGRAM, constants.getOrPut(value) { "k${constants.size}" }, OBJECT)
+                else -> error("Unexpected literal $value")
+            }
+            is Expr.Logical -> {
+                val end = Label()
+                compile(expr.left)
+                code.op(Code.DUP, 1)
+                code.invokestatic(RUNTIME, "truthy", "($OBJECT)Z")
+                code.jump(if (expr.operator.type == TokenType.OR) Code.IFNE else Code.IFEQ, end)
+                code.op(Code.POP, -1)
+                compile(expr.right)
+                code.mark(end)
+            }
+            is Expr.Set -> {
+                runtime()
+                runtime()
+                compile(expr.obj)
+                token(expr.name)
+                invokeRuntime("target", "(${OBJECT}I)$OBJECT")
+                compile(expr.value)
+                token(expr.name)
+                invokeRuntime("set", "($OBJECT${OBJECT}I)$OBJECT")
+            }
+            is Expr.Super -> {
+                runtime()
+                load(expr.keyword)
+                load(expr.keyword.copy(lexeme = "this"))
+                token(expr.method)
+                invokeRuntime("superMethod", "($OBJECT${OBJECT}I)$OBJECT")
+            }
+            is Expr.This -> load(expr.keyword)
+            is Expr.Unary -> when (expr.operator.type) {
+                TokenType.MINUS -> {
+                    runtime()
+                    compile(expr.right)
+                    token(expr.operator)
+                    invokeRuntime("negate", "(${OBJECT}I)$OBJECT")
+                }
+                else -> boxed(expr)
+            }
+            is Expr.Variable -> load(expr.name)
+        }
+    }
+
+    private fun arithmetic(expr: Expr.Binary, operation: String) {
+        runtime()
+        compile(expr.left)
+        compile(expr.right)
+        token(expr.operator)
+        invokeRuntime(operation, "($OBJECT${OBJECT}I)$OBJECT")
+    }
+
+    // Comparisons, equality and `!` as a Boolean value.
+    private fun boxed(expr: Expr) {
+        condition(expr)
+        code.invokestatic("java/lang/Boolean", "valueOf", "(Z)Ljava/lang/Boolean;")
+    }
+
+    /** Leaves the truthiness of [expr] on the stack as an int, without boxing comparisons. */
+    private fun condition(expr: Expr) {
+        when {
+            expr is Expr.Grouping -> condition(expr.expression)
+            expr is Expr.Unary && expr.operator.type == TokenType.BANG -> {
+                condition(expr.right)
+                not()
+            }
+            expr is Expr.Binary && expr.operator.type in COMPARISONS -> {
+                runtime()
+                compile(expr.left)
+                compile(expr.right)
+                token(expr.operator)
+                invokeRuntime(COMPARISONS.getValue(expr.operator.type), "($OBJECT${OBJECT}I)Z")
+            }
+            expr is Expr.Binary && expr.operator.type in listOf(TokenType.EQUAL_EQUAL, TokenType.BANG_EQUAL) -> {
+                runtime()
+                compile(expr.left)
+                compile(expr.right)
+                invokeRuntime("equal", "($OBJECT$OBJECT)Z")
+                if (expr.operator.type == TokenType.BANG_EQUAL) not()
+            }
+            else -> {
+                compile(expr)
+                code.invokestatic(RUNTIME, "truthy", "($OBJECT)Z")
+            }
+        }
+    }
+
+    private fun not() {
+        code.iconst(1)
+        code.op(Code.IXOR, -1)
+    }
+
+    private fun compileAssign(expr: Expr.Assign) {
+        val value = { checked(interpreter.annotation(expr), expr.name) { compile(expr.value) } }
+        val resolved = resolve(expr.name.lexeme)
+        if (resolved == null) {
+            val field = global(expr.name.lexeme)
+            runtime()
+            code.getstatic(PROGRAM, field, OBJECT)
+            value()
+            token(expr.name)
+            invokeRuntime("assignGlobal", "($OBJECT${OBJECT}I)$OBJECT")
+            code.op(Code.DUP, 1)
+            code.putstatic(PROGRAM, field, OBJECT)
+            return
+        }
+
+        val (target, slot, hops) = resolved
+        if (!target.heap) {
+            value()
+            code.op(Code.DUP, 1)
+            code.astore(slot)
+        } else {
+            frame(hops)
+            code.iconst(slot)
+            value()
+            code.op(Code.DUP_X2, 1)
+            code.op(Code.AASTORE, -3)
+        }
+    }
+
+    // ---------- Variables ----------
+
+    /** Reserves a slot for [name] in the current scope, or null for a global. */
+    private fun declare(name: Token): Int? {
+        val current = scope ?: return null
+        val slot = if (current.heap) current.slots.size + 1 else method.nextSlot++
+        current.slots[name.lexeme] = slot
+        return slot
+    }
+
+    /** Stores the value on the stack into [name], at the slot [declare] returned. */
+    private fun store(name: Token, slot: Int?) {
+        when {
+            slot == null -> code.putstatic(PROGRAM, global(name.lexeme), OBJECT)
+            scope!!.heap -> {
+                code.aload(method.env)
+                code.op(Code.SWAP, 0)
+                code.iconst(slot)
+                code.op(Code.SWAP, 0)
+                code.op(Code.AASTORE, -3)
+            }
+            else -> code.astore(slot)
+        }
+    }
+
+    private fun load(name: Token) {
+        val resolved = resolve(name.lexeme)
+        if (resolved == null) {
+            runtime()
+            code.getstatic(PROGRAM, global(name.lexeme), OBJECT)
+            token(name)
+            invokeRuntime("global", "(${OBJECT}I)$OBJECT")
+            return
+        }
+
+        val (target, slot, hops) = resolved
+        if (!target.heap) {
+            code.aload(slot)
+        } else {
+            frame(hops)
+            code.iconst(slot)
+            code.op(Code.AALOAD, -1)
+        }
+    }
+
+    // The scope declaring [name], its slot, and how many heap frames out
+    // from the current one it lives.
+    private fun resolve(name: String): Triple<Scope, Int, Int>? {
+        var hops = 0
+        var current = scope
+        while (current != null) {
+            val slot = current.slots[name]
+            if (slot != null) return Triple(current, slot, hops)
+            if (current.heap) hops++
+            current = current.parent
+        }
+        return null
+    }
+
+    private fun frame(hops: Int) {
+        code.aload(method.env)
+        repeat(hops) {
+            code.iconst(0)
+            code.op(Code.AALOAD, -1)
+            code.checkcast(FRAME)
+        }
+    }
+
+    private fun newFrame(size: Int, enclosing: Int) {
+        code.iconst(size)
+        code.anewarray("java/lang/Object")
+        code.op(Code.DUP, 1)
+        code.iconst(0)
+        code.aload(enclosing)
+        code.op(Code.AASTORE, -3)
+    }
+
+    private fun global(name: String): String = globals.getOrPut(name) { "g${globals.size}" }
+
+    // ---------- Helpers ----------
+
+    /** Emits [value], checked against [type] when the declaration has one. */
+    private inline fun checked(type: Token?, at: Token?, value: () -> Unit) {
+        if (type == null) {
+            value()
+            return
+        }
+        runtime()
+        value()
+        token(type)
+        token(at ?: type)
+        invokeRuntime("check", "(${OBJECT}II)$OBJECT")
+    }
+
+    private fun runtime() = code.getstatic(PROGRAM, "rt", RUNTIME_TYPE)
+
+    private fun invokeRuntime(name: String, descriptor: String) = code.invokevirtual(RUNTIME, name, descriptor)
+
+    private fun token(token: Token) = code.iconst(tokens.getOrPut(token) { tokens.size })
+
+    private inline fun <T> withScope(newScope: Scope, block: () -> T): T {
+        val previous = scope
+        scope = newScope
+        try {
+            return block()
+        } finally {
+            scope = previous
+        }
+    }
+
+    private fun declarations(statements: List<Stmt>): Int =
+        statements.count { it is Stmt.Var || it is Stmt.Function || it is Stmt.Class }
+
+    // Whether a function or class declared somewhere in [statements] could
+    // capture their variables.
+    private fun captures(statements: List<Stmt>): Boolean = statements.any { stmt ->
+        when (stmt) {
+            is Stmt.Function, is Stmt.Class -> true
+            is Stmt.Block -> captures(stmt.statements)
+            is Stmt.If -> captures(listOfNotNull(stmt.thenBranch, stmt.elseBranch))
+            is Stmt.While -> captures(listOf(stmt.body))
+            else -> false
+        }
+    }
+
+    companion object {
+        private const val PROGRAM = "lox/gen/Program"
+        private const val RUNTIME = "lox/JvmRuntime"
+        private const val RUNTIME_TYPE = "Llox/JvmRuntime;"
+        private const val OBJECT = "Ljava/lang/Object;"
+        private const val FRAME = "[Ljava/lang/Object;"
+
+        private val COMPARISONS = mapOf(
+            TokenType.GREATER to "greater",
+            TokenType.GREATER_EQUAL to "greaterEqual",
+            TokenType.LESS to "less",
+            TokenType.LESS_EQUAL to "lessEqual"
+        )
+    }
+}
@@ -0,0 +1,156 @@
+﻿package lox
+
+/** The class [JvmCompiler] generates: top-level code and one static method per function. */
+interface JvmProgram {
+    fun run()
+    fun invoke(id: Int, closure: Array<Any?>?, arguments: List<Any?>): Any?
+}
+
+/** A function compiled to static method [id] of [program], closed over the heap frame [closure]. */
+class JvmFunction(
+    private val program: JvmProgram,
+    private val id: Int,
+    private val name: String,
+    private val paramCount: Int,
+    private val closure: Array<Any?>?
+): LoxMethod {
+    override fun arity(): Int = paramCount
+
+    override fun call(
+        interpreter: Interpreter,
+        arguments: MutableList<Any?>
+    ): Any? = program.invoke(id, closure, arguments)
+
+    // Methods were compiled inside a scope that holds `this` at slot 1.
+    override fun bind(instance: LoxInstance): JvmFunction =
+        JvmFunction(program, id, name, paramCount, arrayOf(closure, instance))
+
+    override fun toString(): String = "<fn $name>"
+}
+
+/**
+ * The operations generated code calls for anything with Lox semantics.
+ * Tokens for error messages are passed as indices into [tokens], and
+ * functions and classes as indices into the tables [JvmCompiler] built.
+ */
+class JvmRuntime(
+    private val interpreter: Interpreter,
+    private val tokens: Array<Token>,
+    private val functions: Array<Stmt.Function>,
+    private val classes: Array<Pair<Stmt.Class, List<Int>>>
+) {
+    lateinit var program: JvmProgram
+
+    // ---------- Variables ----------
+
+    fun global(value: Any?, name: Int): Any? {
+        if (value === UNDEFINED) throw undefined(tokens[name])
+        return value
+    }
+
+    fun assignGlobal(current: Any?, value: Any?, name: Int): Any? {
+        if (current === UNDEFINED) throw undefined(tokens[name])
+        return value
+    }
+
+    fun check(value: Any?, type: Int, at: Int): Any? = Types.check(tokens[type], value, tokens[at])
+
+    private fun undefined(name: Token) = RunTimeError(name, "Undefined variable '${name.lexeme}'.")
+
+    // ---------- Operators ----------
+
+    fun add(left: Any?, right: Any?, operator: Int): Any? =
+        if (left is Double && right is Double) left + right
+        else if (left is String && right is String) left + right
+        else throw RunTimeError(tokens[operator], "Operands must be two numbers or two strings.")
+
+    fun subtract(left: Any?, right: Any?, operator: Int): Any? = number(left, operator) - number(right, operator)
+    fun multiply(left: Any?, right: Any?, operator: Int): Any? = number(left, operator) * number(right, operator)
+    fun divide(left: Any?, right: Any?, operator: Int): Any? = number(left, operator) / number(right, operator)
+    fun negate(value: Any?, operator: Int): Any? = -number(value, operator)
+
+    fun greater(left: Any?, right: Any?, operator: Int): Boolean = number(left, operator) > number(right, operator)
+    fun greaterEqual(left: Any?, right: Any?, operator: Int): Boolean = number(left, operator) >= number(right, operator)
+    fun less(left: Any?, right: Any?, operator: Int): Boolean = number(left, operator) < number(right, operator)
+    fun lessEqual(left: Any?, right: Any?, operator: Int): Boolean = number(left, operator) <= number(right, operator)
+
+    fun equal(left: Any?, right: Any?): Boolean = interpreter.isEqual(left, right)
+
+    private fun number(value: Any?, operator: Int): Double = value as? Double
+        ?: throw RunTimeError(tokens[operator], "Operand must be a number.")
+
+    fun print(value: Any?) = println(interpreter.stringify(value))
+
+    // ---------- Calls and objects ----------
+
+    fun call(callee: Any?, arguments: Array<Any?>, paren: Int): Any? {
+        if (callee !is LoxCallable) {
+            throw RunTimeError(tokens[paren], "Can only call functions and classes.")
+        }
+        if (arguments.size != callee.arity()) {
+            throw RunTimeError(tokens[paren], "Expected ${callee.arity()} arguments but got ${arguments.size}.")
+        }
+        try {
+            return callee.call(interpreter, arguments.toMutableList())
+        } catch (error: NativeError) {
+            throw RunTimeError(tokens[paren], error.message!!)
+        }
+    }
+
+    fun get(obj: Any?, name: Int): Any? =
+        if (obj is LoxInstance) obj.get(tokens[name])
+        else throw RunTimeError(tokens[name], "Only instances have properties.")
+
+    /** The object of a property assignment, checked before the value is evaluated. */
+    fun target(obj: Any?, name: Int): Any? =
+        obj as? LoxInstance ?: throw RunTimeError(tokens[name], "Only instances have fields.")
+
+    fun set(obj: Any?, value: Any?, name: Int): Any? {
+        (obj as LoxInstance).set(tokens[name], value)
+        return value
+    }
+
+    fun superMethod(superclass: Any?, instance: Any?, method: Int): Any? {
+        val name = tokens[method]
+        val found = (superclass as LoxClass).findMethod(name.lexeme)
+            ?: throw RunTimeError(name, "Undefined property '${name.lexeme}'.")
+        return found.bind(instance as LoxInstance)
+    }
+
+    fun function(id: Int, closure: Array<Any?>?): Any? {
+        val declaration = functions[id]
+        return JvmFunction(program, id, declaration.name.lexeme, declaration.params.size, closure)
+    }
+
+    // Methods close over a frame holding the superclass, as `super` resolves
+    // one scope outside `this`, when the class has one.
+    fun makeClass(index: Int, superclass: Any?, env: Array<Any?>?): Any? {
+        val (stmt, methodIds) = classes[index]
+        var closure = env
+        var parent: LoxClass? = null
+        if (stmt.superclass != null) {
+            parent = superclass as? LoxClass ?: throw RunTimeError(stmt.superclass.name, "Superclass must be a class.")
+            if (stmt.fields.isNotEmpty()) interpreter.checkLayout(stmt, parent)
+            closure = arrayOf(env, parent)
+        }
+
+        val methods = methodIds.associate { id ->
+            val declaration = functions[id]
+            declaration.name.lexeme to JvmFunction(program, id, declaration.name.lexeme, declaration.params.size, closure)
+        }
+        return LoxClass(stmt.name.lexeme, parent, methods, stmt.fields)
+    }
+
+    companion object {
+        /** What a global's static field holds until the script defines it. */
+        val UNDEFINED = Any()
+
+        @JvmStatic
+        fun truthy(value: Any?): Boolean =
+            when (value) {
+                null -> false
+                is Boolean -> value
+                else -> true
+            }
+    }
+}
@@ -0,0 +1,182 @@
+﻿package lox
+
+import java.util.Collections
+import java.util.IdentityHashMap
+
+/**
+ * Finds the reads in a function body after which a local is dead, so the C++
+ * emitter can move its Value out instead of copying it.
+ *
+ * Only `var` locals of the function itself qualify, and only when no nested
+ * function or class mentions them (closures capture by reference). A read is
+ * a last use when nothing after it in source order mentions the variable and
+ * no loop encloses it that doesn't also enclose the declaration. The left
+ * operand of `and`/`or` is emitted twice, so nothing in it is ever moved.
+ */
+object LastUse {
+    fun moves(function: Stmt.Function): Set<Expr.Variable> =
+        Walker().apply { walk(function.body) }.lastReads()
+
+    /** Every name assigned anywhere in `body`, nested functions included. */
+    fun assigned(body: List<Stmt>): Set<String> {
+        val names = HashSet<String>()
+        fun visit(expr: Expr) {
+            if (expr is Expr.Assign) names += expr.name.lexeme
+            children(expr).forEach(::visit)
+        }
+        fun visit(stmt: Stmt) {
+            when (stmt) {
+                is Stmt.Class -> stmt.methods.forEach(::visit)
+                is Stmt.Function -> stmt.body.forEach(::visit)
+                else -> {
+                    expressions(stmt).forEach(::visit)
+                    statements(stmt).forEach(::visit)
+                }
+            }
+        }
+        body.forEach(::visit)
+        return names
+    }
+
+    private class Local(val loopDepth: Int) {
+        var captured = false
+        var last: Expr? = null
+        var lastLoopDepth = 0
+    }
+
+    private class Walker {
+        private val scopes = ArrayDeque<MutableMap<String, Local>>().apply { addLast(mutableMapOf()) }
+        private val locals = mutableListOf<Local>()
+        private var loopDepth = 0
+        private var repeated = 0
+
+        fun lastReads(): Set<Expr.Variable> {
+            val reads: MutableSet<Expr.Variable> = Collections.newSetFromMap(IdentityHashMap())
+            for (local in locals) {
+                val last = local.last
+                if (!local.captured && last is Expr.Variable && local.lastLoopDepth == local.loopDepth) reads += last
+            }
+            return reads
+        }
+
+        fun walk(statements: List<Stmt>) = statements.forEach(::walk)
+
+        private fun walk(stmt: Stmt) {
+            when (stmt) {
+                is Stmt.Block -> {
+                    scopes.addLast(mutableMapOf())
+                    walk(stmt.statements)
+                    scopes.removeLast()
+                }
+                is Stmt.Class -> {
+                    stmt.superclass?.let(::walk)
+                    stmt.methods.forEach(::capture)
+                }
+                is Stmt.Function -> capture(stmt)
+                is Stmt.Var -> {
+                    walk(stmt.initializer)
+                    scopes.last()[stmt.name.lexeme] = Local(loopDepth).also { locals += it }
+                }
+                is Stmt.While -> {
+                    loopDepth++
+                    walk(stmt.condition)
+                    walk(stmt.body)
+                    loopDepth--
+                }
+                else -> {
+                    expressions(stmt).forEach(::walk)
+                    statements(stmt).forEach(::walk)
+                }
+            }
+        }
+
+        private fun walk(expr: Expr) {
+            if (expr is Expr.Logical) {
+                repeated++
+                walk(expr.left)
+                repeated--
+                walk(expr.right)
+                return
+            }
+            children(expr).forEach(::walk)
+            when (expr) {
+                is Expr.Variable -> mention(expr.name.lexeme, expr)
+                is Expr.Assign -> mention(expr.name.lexeme, expr)
+                else -> {}
+            }
+        }
+
+        private fun mention(name: String, expr: Expr) {
+            val local = resolve(name) ?: return
+            local.last = expr
+            local.lastLoopDepth = if (repeated > 0) -1 else loopDepth
+        }
+
+        // Any local a nested declaration mentions is shared with it.
+        private fun capture(function: Stmt.Function) {
+            val mentioned = HashSet<String>()
+            fun visit(expr: Expr) {
+                when (expr) {
+                    is Expr.Variable -> mentioned += expr.name.lexeme
+                    is Expr.Assign -> mentioned += expr.name.lexeme
+                    else -> {}
+                }
+                children(expr).forEach(::visit)
+            }
+            fun visit(stmt: Stmt) {
+                when (stmt) {
+                    is Stmt.Class -> {
+                        stmt.superclass?.let(::visit)
+                        stmt.methods.forEach { method -> method.body.forEach(::visit) }
+                    }
+                    is Stmt.Function -> stmt.body.forEach(::visit)
+                    else -> {
+                        expressions(stmt).forEach(::visit)
+                        statements(stmt).forEach(::visit)
+                    }
+                }
+            }
+            function.body.forEach(::visit)
+            mentioned.forEach { name -> resolve(name)?.captured = true }
+        }
+
+        private fun resolve(name: String): Local? {
+            for (i in scopes.indices.reversed()) {
+                scopes[i][name]?.let { return it }
+            }
+            return null
+        }
+    }
+
+    /** A statement's own expressions, in evaluation order. */
+    internal fun expressions(stmt: Stmt): List<Expr> = when (stmt) {
+        is Stmt.Expression -> listOf(stmt.expression)
+        is Stmt.If -> listOf(stmt.condition)
+        is Stmt.Print -> listOf(stmt.expression)
+        is Stmt.Return -> listOfNotNull(stmt.value)
+        is Stmt.Var -> listOf(stmt.initializer)
+        is Stmt.While -> listOf(stmt.condition)
+        is Stmt.Class -> listOfNotNull(stmt.superclass)
+        is Stmt.Block, is Stmt.Function -> emptyList()
+    }
+
+    internal fun statements(stmt: Stmt): List<Stmt> = when (stmt) {
+        is Stmt.Block -> stmt.statements
+        is Stmt.If -> listOfNotNull(stmt.thenBranch, stmt.elseBranch)
+        is Stmt.While -> listOf(stmt.body)
+        else -> emptyList()
+    }
+
+    /** An expression's operands, in evaluation order. */
+    internal fun children(expr: Expr): List<Expr> = when (expr) {
+        is Expr.Assign -> listOf(expr.value)
+        is Expr.Binary -> listOf(expr.left, expr.right)
+        is Expr.Call -> listOf(expr.callee) + expr.arguments
+        is Expr.Get -> listOf(expr.obj)
+        is Expr.Grouping -> listOf(expr.expression)
+        is Expr.Logical -> listOf(expr.left, expr.right)
+        is Expr.Set -> listOf(expr.obj, expr.value)
+        is Expr.Unary -> listOf(expr.right)
+        is Expr.Literal, is Expr.Super, is Expr.This, is Expr.Variable -> emptyList()
+    }
+}
@@ -0,0 +1,37 @@
+﻿package lox
+
+/** `List()`, a growable array of Lox values; `split` returns one of these. */
+object ListNatives {
+    val classNames = setOf("List")
+
+    class ListInstance(klass: LoxClass, val items: MutableList<Any?>): LoxInstance(klass)
+
+    private val listClass = NativeClass("List", 0, mapOf(
+        "length" to NativeMethod(0) { self, _ -> (self as ListInstance).items.size.toDouble() },
+        "push" to NativeMethod(1) { self, args ->
+            (self as ListInstance).items.add(args[0])
+            null
+        },
+        "get" to NativeMethod(1) { self, args ->
+            val items = (self as ListInstance).items
+            items[index(args[0], items.size)]
+        },
+        "set" to NativeMethod(2) { self, args ->
+            val items = (self as ListInstance).items
+            items[index(args[0], items.size)] = args[1]
+            null
+        }
+    )) { klass, _ -> ListInstance(klass, mutableListOf()) }
+
+    fun define(globals: Environment) {
+        globals.define("List", listClass)
+    }
+
+    fun of(items: MutableList<Any?>): ListInstance = ListInstance(listClass, items)
+
+    private fun index(value: Any?, size: Int): Int {
+        val i = value as? Double ?: throw NativeError("Operand must be a number.")
+        if (i < 0 || i >= size || i % 1.0 != 0.0) throw NativeError("List index out of range.")
+        return i.toInt()
+    }
+}
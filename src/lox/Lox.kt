@@ -10,14 +10,14 @@ class Lox {
 
     fun runMain(args: Array<String>) {
         when (val command = Cli.parseArgs(args)) {
-            is Command.Run -> runFile(command.file, command.printAst)
-            is Command.Repl -> runPrompt(Command.Repl.printAst)
-            is Command.Compile -> compile(command.file, command.target, command.outputCppFile, command.outputExecutable)
+            is Command.Run -> runFile(command.file, command.printAst, command.compiled)
+            is Command.Repl -> runPrompt(Command.Repl.printAst, Command.Repl.native)
+            is Command.Compile -> compile(command.file, command.target, command.outputCppFile, command.outputCFile, command.outputExecutable)
             is Command.Help -> Cli.printHelp()
         }
     }
 
-    private fun compile(path: String, target: Target, outputCppFile: String, outputExecutable: String) {
+    private fun compile(path: String, target: Target, outputCppFile: String, outputCFile: String, outputExecutable: String) {
         val source = File(path).readText(Charsets.UTF_8).trimStart('\uFEFF')
         val tokens = Scanner(source).scanTokens()
         val statements = Parser(tokens).parse()
@@ -26,7 +26,27 @@ class Lox {
         Resolver(interpreter).apply { resolve(statements) }
         if (hadError) exitProcess(65)
 
-        val cppCode = CppCodeGenerator().generate(statements)
+        if (target == Target.C) {
+            val cCode = CCodeGenerator().generate(HeapSnapshot.strip(statements))
+            val outputFile = File(outputCFile).apply { parentFile?.mkdirs() }
+            outputFile.writeText(cCode)
+
+            val outputDir = outputFile.parentFile ?: File(".")
+            copyRuntimeFiles(outputDir, listOf("lox_runtime_c.c", "lox_runtime_c.h"))
+            compileC(outputCFile, outputExecutable, outputDir)
+            return
+        }
+
+        val snapshot = HeapSnapshot.split(statements)
+        if (snapshot != null && !snapshot.capture(interpreter)) exitProcess(70)
+
+        val cppCode = try {
+            CppCodeGenerator().generate(statements, snapshot)
+        } catch (error: RunTimeError) {
+            runtimeError(error)
+            exitProcess(70)
+        }
+        if (hadError) exitProcess(65)
         val outputFile = File(outputCppFile).apply { parentFile?.mkdirs() }
         outputFile.writeText(cppCode)
 
@@ -34,9 +54,9 @@ class Lox {
         compileCpp(outputCppFile, outputExecutable, outputFile.parentFile ?: File("."))
     }
 
-    private fun copyRuntimeFiles(outputDir: File) {
+    internal fun copyRuntimeFiles(outputDir: File, fileNames: List<String> = listOf("lox_runtime.cpp", "lox_runtime.h")) {
         val projectDir = System.getProperty("user.dir")
-        listOf("lox_runtime.cpp", "lox_runtime.h").forEach { fileName ->
+        fileNames.forEach { fileName ->
             File("$projectDir/src/runtime/src/$fileName").copyTo(File(outputDir, fileName), overwrite = true)
         }
     }
@@ -54,6 +74,20 @@ class Lox {
         }
     }
 
+    private fun compileC(outputCFile: String, outputExecutable: String, outputDir: File) {
+        val compiler = System.getenv("CC") ?: "cc"
+        val compileCmd = listOf(
+            compiler, "-O2",
+            outputCFile, File(outputDir, "lox_runtime_c.c").absolutePath,
+            "-o", outputExecutable, "-lm"
+        )
+        val exitCode = runCmd(compileCmd)
+        if (exitCode != 0) {
+            println("C compilation failed with code $exitCode")
+            hadError = true
+        }
+    }
+
     fun runCmd(cmd: List<String>, workingDir: File? = null, inheritIO: Boolean = true, env: Map<String, String> = emptyMap()): Int {
         println("command: ${cmd.joinToString(" ")}")
         return ProcessBuilder(cmd).apply {
@@ -63,8 +97,9 @@ class Lox {
         }.start().waitFor()
     }
 
-    private fun runPrompt(printAst: Boolean) {
+    private fun runPrompt(printAst: Boolean, native: Boolean) {
         val reader = BufferedReader(InputStreamReader(System.`in`))
+        val nativeRepl = if (native) startNativeRepl() else null
         printWelcome()
 
         val history = mutableListOf<Pair<String, Boolean>>()
@@ -81,7 +116,7 @@ class Lox {
                 else -> {
                     hadError = false
                     hadRuntimeError = false
-                    run(line, printAst)
+                    if (nativeRepl != null) runNative(nativeRepl, line, printAst) else run(line, printAst)
                     history.add(line to !(hadError || hadRuntimeError))
                     pendingPrompt = !(hadError || hadRuntimeError)
                 }
@@ -90,6 +125,17 @@ class Lox {
             hadError = false
             hadRuntimeError = false
         }
+
+        nativeRepl?.stop()
+    }
+
+    private fun startNativeRepl(): NativeRepl? {
+        val workDir = File(System.getProperty("user.dir"), "build/repl")
+        val repl = NativeRepl(this, workDir)
+        if (repl.start()) return repl
+
+        eprintln(Ansi.yellow("Native REPL unavailable, falling back to the interpreter."))
+        return null
     }
 
     private fun printWelcome() {
@@ -137,14 +183,27 @@ class Lox {
         }
     }
 
-    private fun runFile(path: String, printAst: Boolean) {
+    private fun runFile(path: String, printAst: Boolean, compiled: Boolean = false) {
         val source = File(path).readText(Charsets.UTF_8).trimStart('\uFEFF')
-        run(source, printAst)
+        run(source, printAst, compiled)
         if (hadError) exitProcess(65)
         if (hadRuntimeError) exitProcess(70)
     }
 
-    private fun run(source: String, printAst: Boolean) {
+    private fun run(source: String, printAst: Boolean, compiled: Boolean = false) {
+        val tokens = Scanner(source).scanTokens()
+        val statements = Parser(tokens).parse()
+        if (hadError) return
+
+        Resolver(interpreter).resolve(statements)
+        if (hadError) return
+
+        if (compiled) JvmCompiler(interpreter).execute(statements)
+        else interpreter.interpret(statements)
+        if (printAst) printAst(statements)
+    }
+
+    private fun runNative(repl: NativeRepl, source: String, printAst: Boolean) {
         val tokens = Scanner(source).scanTokens()
         val statements = Parser(tokens).parse()
         if (hadError) return
@@ -152,7 +211,7 @@ class Lox {
         Resolver(interpreter).resolve(statements)
         if (hadError) return
 
-        interpreter.interpret(statements)
+        if (!repl.execute(statements)) hadRuntimeError = true
         if (printAst) printAst(statements)
     }
 
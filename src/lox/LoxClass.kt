@@ -1,6 +1,28 @@
 ﻿package lox
 
-class LoxClass(val name: String, val superclass: LoxClass?, val methods: MutableMap<String, LoxFunction>): LoxCallable {
+open class LoxClass(
+    val name: String,
+    val superclass: LoxClass?,
+    val methods: Map<String, LoxMethod>,
+    fields: List<Stmt.Var> = emptyList()
+): LoxCallable {
+    /**
+     * The declared fields and their annotations, inherited ones first, or
+     * null if instances take whatever fields are assigned. A subclass that
+     * declares none keeps its superclass's.
+     */
+    val layout: Map<String, Token?>? =
+        if (fields.isEmpty()) superclass?.layout
+        else LinkedHashMap(superclass?.layout ?: emptyMap()).apply { fields.forEach { put(it.name.lexeme, it.type) } }
+
+    /** `equals` and `hash`, defined here or inherited, for `==` and `hash()`. */
+    val equalsMethod: LoxMethod? = findMethod("equals")
+    val hashMethod: LoxMethod? = findMethod("hash")
+
+    init {
+        registry[name] = this
+    }
+
     override fun arity(): Int {
         val initializer = findMethod("init") ?: return 0
         return initializer.arity()
@@ -10,7 +32,7 @@ class LoxClass(val name: String, val superclass: LoxClass?, val methods: Mutable
         interpreter: Interpreter,
         arguments: MutableList<Any?>
     ): Any {
-        val instance = LoxInstance(this)
+        val instance = instantiate(arguments)
 
         val initializer = findMethod("init")
         initializer?.bind(instance)?.call(interpreter, arguments)
@@ -18,7 +40,9 @@ class LoxClass(val name: String, val superclass: LoxClass?, val methods: Mutable
         return instance
     }
 
-    fun findMethod(name: String): LoxFunction? {
+    open fun instantiate(arguments: MutableList<Any?>): LoxInstance = LoxInstance(this)
+
+    fun findMethod(name: String): LoxMethod? {
         if (methods.containsKey(name)) {
             return methods[name]
         }
@@ -31,4 +55,11 @@ class LoxClass(val name: String, val superclass: LoxClass?, val methods: Mutable
     }
 
     override fun toString(): String = name
+
+    companion object {
+        private val registry = HashMap<String, LoxClass>()
+
+        /** The most recently defined class called [name], for `readValue`. */
+        fun named(name: String): LoxClass? = registry[name]
+    }
 }
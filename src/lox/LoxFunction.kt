@@ -1,6 +1,6 @@
 ﻿package lox
 
-class LoxFunction(val declaration: Stmt.Function, val closure: Environment, val isInitializer: Boolean): LoxCallable {
+class LoxFunction(val declaration: Stmt.Function, val closure: Environment, val isInitializer: Boolean): LoxMethod {
     override fun arity(): Int = declaration.params.size
 
     override fun call(
@@ -11,7 +11,7 @@ class LoxFunction(val declaration: Stmt.Function, val closure: Environment, val
 
         for (i in declaration.params.indices) {
             val paramName = declaration.params[i].lexeme
-            val argumentValue = arguments[i]
+            val argumentValue = Types.check(declaration.paramTypes[i], arguments[i], declaration.params[i])
             environment.define(paramName, argumentValue)
         }
 
@@ -20,15 +20,15 @@ class LoxFunction(val declaration: Stmt.Function, val closure: Environment, val
         }
         catch (returnValue: Return) {
             if (isInitializer) return closure.getAt(0, "this")
-            return returnValue.value
+            return Types.check(declaration.returnType, returnValue.value, declaration.returnType)
         }
 
         if (isInitializer) return closure.getAt(0, "this")
 
-        return null
+        return Types.check(declaration.returnType, null, declaration.returnType)
     }
 
-    fun bind(instance: LoxInstance): LoxFunction {
+    override fun bind(instance: LoxInstance): LoxFunction {
         val environment = Environment(closure)
         environment.define("this", instance)
         return LoxFunction(declaration, environment, isInitializer)
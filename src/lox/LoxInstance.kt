@@ -1,11 +1,14 @@
 ﻿package lox
 
-class LoxInstance(val klass: LoxClass) {
-    val fields = mutableMapOf<String, Any?>()
+/** An instance of [klass]; [fields] holds its state, which natives may keep elsewhere. */
+open class LoxInstance(val klass: LoxClass, val fields: MutableMap<String, Any?>) {
+    constructor(klass: LoxClass): this(klass, mutableMapOf<String, Any?>().apply {
+        klass.layout?.forEach { (name, type) -> put(name, Types.initial(type)) }
+    })
 
-    fun get(name: Token): Any
+    fun get(name: Token): Any?
     {
-        fields[name.lexeme]?.let { return it }
+        if (name.lexeme in fields) return fields[name.lexeme]
 
         klass.findMethod(name.lexeme)?.let { method ->
             return method.bind(this)
@@ -15,6 +18,10 @@ class LoxInstance(val klass: LoxClass) {
     }
 
     fun set(name: Token, value: Any?) {
+        klass.layout?.let { layout ->
+            if (name.lexeme !in layout) throw RunTimeError(name, "Undefined field '${name.lexeme}'.")
+            Types.check(layout[name.lexeme], value, name)
+        }
         fields[name.lexeme] = value
     }
 
@@ -0,0 +1,5 @@
+﻿package lox
+
+interface LoxMethod : LoxCallable {
+    fun bind(instance: LoxInstance): LoxMethod
+}
@@ -0,0 +1,49 @@
+﻿package lox
+
+import kotlin.math.atan2
+import kotlin.math.ceil
+import kotlin.math.cos
+import kotlin.math.exp
+import kotlin.math.floor
+import kotlin.math.ln
+import kotlin.math.pow
+import kotlin.math.sin
+import kotlin.math.sqrt
+
+/** Math functions every backend defines as globals. The C++ emitter lowers unshadowed calls to <cmath>. */
+object MathNatives {
+    private class Native(val arity: Int, val body: (DoubleArray) -> Double)
+
+    private val natives = mapOf(
+        "sqrt" to Native(1) { sqrt(it[0]) },
+        "floor" to Native(1) { floor(it[0]) },
+        "ceil" to Native(1) { ceil(it[0]) },
+        "abs" to Native(1) { kotlin.math.abs(it[0]) },
+        "min" to Native(2) { kotlin.math.min(it[0], it[1]) },
+        "max" to Native(2) { kotlin.math.max(it[0], it[1]) },
+        "pow" to Native(2) { it[0].pow(it[1]) },
+        "exp" to Native(1) { exp(it[0]) },
+        "log" to Native(1) { ln(it[0]) },
+        "sin" to Native(1) { sin(it[0]) },
+        "cos" to Native(1) { cos(it[0]) },
+        "atan2" to Native(2) { atan2(it[0], it[1]) },
+        "fma" to Native(3) { Math.fma(it[0], it[1], it[2]) }
+    )
+
+    val arities: Map<String, Int> = natives.mapValues { it.value.arity }
+
+    fun define(globals: Environment) {
+        natives.forEach { (name, native) ->
+            globals.define(name, object: LoxCallable {
+                override fun arity(): Int = native.arity
+                override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? {
+                    val operands = DoubleArray(native.arity) { i ->
+                        arguments[i] as? Double ?: throw NativeError("Operand must be a number.")
+                    }
+                    return native.body(operands)
+                }
+                override fun toString(): String = "<native fn>"
+            })
+        }
+    }
+}
@@ -0,0 +1,30 @@
+﻿package lox
+
+/** A class implemented in Kotlin whose instances carry native state built by [factory]. */
+class NativeClass(
+    name: String,
+    private val paramCount: Int,
+    methods: Map<String, LoxMethod>,
+    private val factory: (NativeClass, MutableList<Any?>) -> LoxInstance
+): LoxClass(name, null, methods) {
+    override fun arity(): Int = paramCount
+
+    override fun instantiate(arguments: MutableList<Any?>): LoxInstance = factory(this, arguments)
+}
+
+/** A method implemented in Kotlin; binds to its receiver like a Lox method. */
+class NativeMethod private constructor(
+    private val paramCount: Int,
+    private val receiver: LoxInstance?,
+    private val body: (LoxInstance, MutableList<Any?>) -> Any?
+): LoxMethod {
+    constructor(paramCount: Int, body: (LoxInstance, MutableList<Any?>) -> Any?): this(paramCount, null, body)
+
+    override fun arity(): Int = paramCount
+
+    override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? = body(receiver!!, arguments)
+
+    override fun bind(instance: LoxInstance): NativeMethod = NativeMethod(paramCount, instance, body)
+
+    override fun toString(): String = "<native fn>"
+}
@@ -0,0 +1,116 @@
+﻿package lox
+
+import java.io.BufferedInputStream
+import java.io.File
+import java.io.IOException
+import java.io.InputStream
+import java.io.OutputStreamWriter
+
+class NativeRepl(private val lox: Lox, private val workDir: File) {
+    private val generator = CppCodeGenerator()
+    private var host: Process? = null
+    private var hostInput: OutputStreamWriter? = null
+    private var hostOutput: InputStream? = null
+    private var unitId = 0
+
+    fun start(): Boolean {
+        workDir.mkdirs()
+        lox.copyRuntimeFiles(workDir, listOf("lox_runtime.cpp", "lox_runtime.h", "repl_host.cpp"))
+
+        val hostExe = File(workDir, "repl_host")
+        val buildCmd = listOf(
+            "g++", "-O2", "-std=c++17", "-rdynamic",
+            File(workDir, "repl_host.cpp").absolutePath,
+            File(workDir, "lox_runtime.cpp").absolutePath,
+            "-o", hostExe.absolutePath, "-ldl"
+        )
+        if (compile(buildCmd) != 0) return false
+
+        val process = ProcessBuilder(hostExe.absolutePath)
+            .directory(workDir)
+            .redirectError(ProcessBuilder.Redirect.INHERIT)
+            .start()
+        host = process
+        hostInput = OutputStreamWriter(process.outputStream, Charsets.UTF_8)
+        hostOutput = BufferedInputStream(process.inputStream)
+        return true
+    }
+
+    fun execute(statements: List<Stmt>): Boolean {
+        unitId++
+        val entrySymbol = "lox_repl_unit_$unitId"
+        val source = File(workDir, "unit_$unitId.cpp")
+        val library = File(workDir, "unit_$unitId.so")
+
+        val cppCode = try {
+            generator.generateReplUnit(statements, entrySymbol)
+        } catch (e: RuntimeException) {
+            generator.rollbackReplUnit()
+            System.err.println(Ansi.red("Error: ${e.message}"))
+            return false
+        }
+        source.writeText(cppCode)
+
+        val compileCmd = listOf(
+            "g++", "-O2", "-std=c++17", "-fPIC", "-shared",
+            source.absolutePath, "-o", library.absolutePath
+        )
+        if (compile(compileCmd) != 0) {
+            generator.rollbackReplUnit()
+            System.err.println(Ansi.red("C++ compilation failed for REPL unit $unitId"))
+            return false
+        }
+
+        // Once the unit is loaded its globals exist in the host, even if the
+        // entry later throws, so later units may refer to them.
+        generator.commitReplUnit()
+
+        val writer = hostInput ?: return false
+        writer.write("${library.absolutePath}\t$entrySymbol\n")
+        writer.flush()
+
+        val status = awaitUnit()
+        if (status == null) {
+            System.err.println(Ansi.red("Native REPL host exited unexpectedly."))
+            return false
+        }
+        if (status.startsWith("error:")) {
+            System.err.println(Ansi.red("Runtime Error: ${status.removePrefix("error:")}"))
+            return false
+        }
+        return true
+    }
+
+    fun stop() {
+        hostInput?.close()
+        host?.waitFor()
+    }
+
+    private fun awaitUnit(): String? {
+        val input = hostOutput ?: return null
+
+        while (true) {
+            val b = input.read()
+            if (b == -1) return null
+            if (b == 0) break
+            System.out.write(b)
+        }
+        System.out.flush()
+
+        val status = StringBuilder()
+        while (true) {
+            val b = input.read()
+            if (b == -1 || b == '\n'.code) break
+            status.append(b.toChar())
+        }
+        return status.toString()
+    }
+
+    private fun compile(cmd: List<String>): Int =
+        try {
+            ProcessBuilder(cmd).directory(workDir).inheritIO().start().waitFor()
+        } catch (e: IOException) {
+            System.err.println(Ansi.red("Could not run ${cmd.first()}: ${e.message}"))
+            -1
+        }
+}
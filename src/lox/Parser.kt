@@ -41,19 +41,32 @@ class Parser(val tokens: List<Token>) {
 
         consume(TokenType.LEFT_BRACE, "Expect '{' before class body.")
 
+        val fields = mutableListOf<Stmt.Var>()
         val methods = mutableListOf<Stmt.Function>()
         while (!check(TokenType.RIGHT_BRACE) && !isAtEnd()) {
-            methods += function("method")
+            if (match(TokenType.VAR)) fields += field()
+            else methods += function("method")
         }
         consume(TokenType.RIGHT_BRACE, "Expect '}' after class body.")
 
-        return Stmt.Class(name, superclass, methods)
+        return Stmt.Class(name, superclass, fields, methods)
+    }
+
+    // `var name;` or `var name: type;` in a class body. Declared fields start
+    // out as nil, or as 0, false or "" when annotated num, bool or str.
+    private fun field(): Stmt.Var {
+        val name = consume(TokenType.IDENTIFIER, "Expect field name.")
+        val type = typeAnnotation()
+        if (check(TokenType.EQUAL)) throw error(peek(), "Fields can't have initializers.")
+        consume(TokenType.SEMICOLON, "Expect ';' after field declaration.")
+        return Stmt.Var(name, type, Expr.Literal(null))
     }
 
     private fun function(kind: String): Stmt.Function {
         val name = consume(TokenType.IDENTIFIER, "Expect $kind name.")
         consume(TokenType.LEFT_PAREN, "Expect '(' after $kind name.")
         val parameters = mutableListOf<Token>()
+        val parameterTypes = mutableListOf<Token?>()
 
         if (!check(TokenType.RIGHT_PAREN)) {
             do {
@@ -61,24 +74,31 @@ class Parser(val tokens: List<Token>) {
                     error(peek(), "Can't have more than 255 parameters.");
                 }
                 parameters += consume(TokenType.IDENTIFIER, "Expect parameter name.")
+                parameterTypes += typeAnnotation()
             } while (match(TokenType.COMMA))
         }
         consume(TokenType.RIGHT_PAREN, "Expect ')' after parameters.")
+        val returnType = typeAnnotation()
         consume(TokenType.LEFT_BRACE, "Expect '{' before $kind body.")
 
         val body = block()
-        return Stmt.Function(name, parameters, body)
+        return Stmt.Function(name, parameters, parameterTypes, returnType, body)
     }
 
     private fun varDeclaration(): Stmt {
         val name = consume(TokenType.IDENTIFIER, "Expect variable name.")
+        val type = typeAnnotation()
 
         val initializer = if (match(TokenType.EQUAL)) expression() else throw ParseError()
 
         consume(TokenType.SEMICOLON, "Expect ';' after variable declaration.")
-        return Stmt.Var(name, initializer)
+        return Stmt.Var(name, type, initializer)
     }
 
+    // `: num`, `: bool`, `: str` or `: ClassName`; the Resolver checks the name.
+    private fun typeAnnotation(): Token? =
+        if (match(TokenType.COLON)) consume(TokenType.IDENTIFIER, "Expect type name after ':'.") else null
+
     private fun statement(): Stmt {
         return when {
             match(TokenType.IF) -> ifStatement()
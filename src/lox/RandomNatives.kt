@@ -0,0 +1,124 @@
+﻿package lox
+
+import java.lang.Long.rotateLeft
+
+/**
+ * `Random(seed)` generators and the `Buffer(length)` numeric arrays they fill.
+ * A generator interleaves four xoshiro256** lanes, so the native runtimes can
+ * fill buffers four samples at a time with SIMD and still produce exactly the
+ * sequence that repeated `next()` calls do. Every backend seeds and steps the
+ * lanes identically, so a seed gives the same stream everywhere.
+ */
+object RandomNatives {
+    val classNames = setOf("Random", "Buffer")
+
+    private const val LANES = 4
+
+    private val JUMP = longArrayOf(
+        0x180ec6d33cfd0abaL, 0xd5a61266f0c9392cuL.toLong(),
+        0xa9582618e03fc9aauL.toLong(), 0x39abdc4529b1661cL
+    )
+
+    /** Lane `l` keeps word `w` of its state at `state[w * LANES + l]`. */
+    private class RandomInstance(klass: LoxClass, val state: LongArray, var lane: Int): LoxInstance(klass)
+
+    class BufferInstance(klass: LoxClass, val data: DoubleArray): LoxInstance(klass)
+
+    fun define(globals: Environment) {
+        globals.define("Random", NativeClass("Random", 1, mapOf(
+            "next" to NativeMethod(0) { self, _ -> next(self as RandomInstance) },
+            "split" to NativeMethod(0) { self, _ -> split(self as RandomInstance) },
+            "fill" to NativeMethod(1) { self, args ->
+                val buffer = args[0] as? BufferInstance ?: throw NativeError("Argument must be a Buffer.")
+                val random = self as RandomInstance
+                for (i in buffer.data.indices) buffer.data[i] = next(random)
+                null
+            }
+        )) { klass, args -> seeded(klass, number(args[0]).toLong()) })
+
+        globals.define("Buffer", NativeClass("Buffer", 1, mapOf(
+            "length" to NativeMethod(0) { self, _ -> (self as BufferInstance).data.size.toDouble() },
+            "get" to NativeMethod(1) { self, args ->
+                val data = (self as BufferInstance).data
+                data[index(args[0], data.size)]
+            },
+            "set" to NativeMethod(2) { self, args ->
+                val data = (self as BufferInstance).data
+                data[index(args[0], data.size)] = number(args[1])
+                null
+            }
+        )) { klass, args ->
+            val length = number(args[0])
+            if (length < 0 || length % 1.0 != 0.0) throw NativeError("Buffer length must be a non-negative integer.")
+            BufferInstance(klass, DoubleArray(length.toInt()))
+        })
+    }
+
+    private fun seeded(klass: LoxClass, seed: Long): RandomInstance {
+        // splitmix64 expands the seed into lane 0's four words, then lane 1's, ...
+        var x = seed
+        val state = LongArray(4 * LANES)
+        for (lane in 0 until LANES) {
+            for (word in 0 until 4) {
+                x += 0x9e3779b97f4a7c15uL.toLong()
+                var z = x
+                z = (z xor (z ushr 30)) * 0xbf58476d1ce4e5b9uL.toLong()
+                z = (z xor (z ushr 27)) * 0x94d049bb133111ebuL.toLong()
+                state[word * LANES + lane] = z xor (z ushr 31)
+            }
+        }
+        return RandomInstance(klass, state, 0)
+    }
+
+    private fun next(random: RandomInstance): Double {
+        val bits = step(random.state, random.lane)
+        random.lane = (random.lane + 1) % LANES
+        // 52 random mantissa bits under the exponent of 1.0 give [1, 2).
+        return java.lang.Double.longBitsToDouble((bits ushr 12) or 0x3ff0000000000000L) - 1.0
+    }
+
+    private fun step(s: LongArray, lane: Int): Long {
+        val s0 = s[lane]
+        val s1 = s[LANES + lane]
+        val s2 = s[2 * LANES + lane]
+        val s3 = s[3 * LANES + lane]
+        val result = rotateLeft(s1 * 5, 7) * 9
+        val t = s1 shl 17
+
+        val n2 = s2 xor s0
+        val n3 = s3 xor s1
+        s[LANES + lane] = s1 xor n2
+        s[lane] = s0 xor n3
+        s[2 * LANES + lane] = n2 xor t
+        s[3 * LANES + lane] = rotateLeft(n3, 45)
+        return result
+    }
+
+    /** The child continues this stream; this generator jumps 2^128 steps ahead on every lane. */
+    private fun split(random: RandomInstance): RandomInstance {
+        val child = RandomInstance(random.klass, random.state.copyOf(), random.lane)
+
+        val s = random.state
+        for (lane in 0 until LANES) {
+            val jumped = LongArray(4)
+            for (word in JUMP) {
+                for (bit in 0 until 64) {
+                    if (word and (1L shl bit) != 0L) {
+                        for (w in 0 until 4) jumped[w] = jumped[w] xor s[w * LANES + lane]
+                    }
+                    step(s, lane)
+                }
+            }
+            for (w in 0 until 4) s[w * LANES + lane] = jumped[w]
+        }
+        return child
+    }
+
+    private fun number(value: Any?): Double = value as? Double ?: throw NativeError("Operand must be a number.")
+
+    private fun index(value: Any?, size: Int): Int {
+        val i = number(value)
+        if (i < 0 || i >= size || i % 1.0 != 0.0) throw NativeError("Buffer index out of range.")
+        return i.toInt()
+    }
+}
@@ -0,0 +1,315 @@
+﻿package lox
+
+import java.util.BitSet
+
+/**
+ * The patterns accepted by `match(pattern, text)`, compiled to a DFA over
+ * UTF-8 bytes. Patterns have literals, `.` (any byte but a newline),
+ * classes such as `[a-z_]` and `[^,]`, the escapes `\d \w \s` and their
+ * negations, `*`, `+`, `?`, `|` and groups. A leading `^` or trailing `$`
+ * anchors the match; otherwise it may occur anywhere in the text, and the
+ * search stops at the first match. The C++ emitter turns literal patterns
+ * into state machine code with [toCpp]; the native runtimes build the same
+ * automaton from dynamic patterns.
+ */
+class RegexDfa private constructor(
+    /** `transitions[state * 256 + byte]` is the next state, or -1 when no match is possible. */
+    private val transitions: IntArray,
+    private val accepting: BooleanArray,
+    private val anchoredEnd: Boolean
+) {
+    fun matches(text: String): Boolean {
+        var state = 0
+        for (byte in text.toByteArray(Charsets.UTF_8)) {
+            if (accepting[state] && !anchoredEnd) return true
+            state = transitions[state * 256 + (byte.toInt() and 0xff)]
+            if (state < 0) return false
+        }
+        return accepting[state]
+    }
+
+    /** A C++ function `bool name(std::string_view)` that runs this DFA with gotos. */
+    fun toCpp(name: String): String = buildString {
+        appendLine("static bool $name(std::string_view text) {")
+        appendLine("  auto p = reinterpret_cast<const unsigned char *>(text.data());")
+        appendLine("  auto end = p + text.size();")
+        appendLine("  unsigned char c;")
+        for (state in accepting.indices) {
+            appendLine("s$state:")
+            if (accepting[state] && !anchoredEnd) {
+                appendLine("  return true;")
+                continue
+            }
+            appendLine("  if (p == end)")
+            appendLine("    return ${accepting[state]};")
+            appendLine("  c = *p++;")
+            var low = 0
+            while (low < 256) {
+                val target = transitions[state * 256 + low]
+                var high = low
+                while (high < 255 && transitions[state * 256 + high + 1] == target) high++
+                val action = if (target < 0) "return false;" else "goto s$target;"
+                appendLine(if (high == 255) "  $action" else "  if (c <= $high)\n    $action")
+                low = high + 1
+            }
+        }
+        appendLine("}")
+    }
+
+    companion object {
+        private const val MAX_STATES = 4096
+
+        fun compile(pattern: String): RegexDfa {
+            val bytes = pattern.toByteArray(Charsets.UTF_8)
+            var from = 0
+            var to = bytes.size
+            val anchoredStart = to > 0 && bytes[0] == '^'.code.toByte()
+            if (anchoredStart) from++
+            val anchoredEnd = to > from && bytes[to - 1] == '$'.code.toByte() && !escaped(bytes, from, to - 1)
+            if (anchoredEnd) to--
+
+            val nfa = Nfa()
+            val parser = Parser(bytes, from, to, nfa)
+            val fragment = parser.alternation()
+            if (parser.pos != to) throw NativeError("Invalid pattern.")
+            return determinize(nfa, fragment, anchoredStart, anchoredEnd)
+        }
+
+        /** Whether the byte at [index] follows an odd run of backslashes. */
+        private fun escaped(bytes: ByteArray, from: Int, index: Int): Boolean {
+            var count = 0
+            while (index - count - 1 >= from && bytes[index - count - 1] == '\\'.code.toByte()) count++
+            return count % 2 == 1
+        }
+
+        private fun determinize(nfa: Nfa, fragment: Fragment, anchoredStart: Boolean, anchoredEnd: Boolean): RegexDfa {
+            val start = nfa.closure(BitSet().apply { set(fragment.start) })
+            val sets = mutableListOf(start)
+            val index = hashMapOf(start to 0)
+            val transitions = ArrayList<Int>()
+            val accepting = ArrayList<Boolean>()
+
+            var current = 0
+            while (current < sets.size) {
+                val set = sets[current++]
+                val accepts = set[fragment.end]
+                accepting += accepts
+                for (byte in 0 until 256) {
+                    if (accepts && !anchoredEnd) {
+                        transitions += -1
+                        continue
+                    }
+                    val moved = BitSet()
+                    var s = set.nextSetBit(0)
+                    while (s >= 0) {
+                        if (nfa.bytes[s]?.get(byte) == true) moved.set(nfa.next[s])
+                        s = set.nextSetBit(s + 1)
+                    }
+                    val target = nfa.closure(moved)
+                    if (!anchoredStart) target.or(start)
+                    if (target.isEmpty) {
+                        transitions += -1
+                        continue
+                    }
+                    transitions += index.getOrPut(target) {
+                        if (sets.size == MAX_STATES) throw NativeError("Pattern is too complex.")
+                        sets += target
+                        sets.size - 1
+                    }
+                }
+            }
+            return RegexDfa(transitions.toIntArray(), accepting.toBooleanArray(), anchoredEnd)
+        }
+    }
+
+    private class Fragment(val start: Int, val end: Int)
+
+    /** Thompson NFA: each state has epsilon edges and at most one byte-set edge to [next]. */
+    private class Nfa {
+        val bytes = ArrayList<BitSet?>()
+        val next = ArrayList<Int>()
+        val epsilons = ArrayList<MutableList<Int>>()
+
+        fun state(): Int {
+            bytes += null
+            next += -1
+            epsilons += mutableListOf<Int>()
+            return bytes.size - 1
+        }
+
+        fun empty(): Fragment = state().let { Fragment(it, it) }
+
+        fun set(set: BitSet): Fragment {
+            val start = state()
+            val end = state()
+            bytes[start] = set
+            next[start] = end
+            return Fragment(start, end)
+        }
+
+        fun concat(a: Fragment, b: Fragment): Fragment {
+            epsilons[a.end].add(b.start)
+            return Fragment(a.start, b.end)
+        }
+
+        fun alternate(a: Fragment, b: Fragment): Fragment {
+            val start = state()
+            val end = state()
+            epsilons[start].addAll(listOf(a.start, b.start))
+            epsilons[a.end].add(end)
+            epsilons[b.end].add(end)
+            return Fragment(start, end)
+        }
+
+        fun star(a: Fragment): Fragment {
+            val start = state()
+            val end = state()
+            epsilons[start].addAll(listOf(a.start, end))
+            epsilons[a.end].addAll(listOf(a.start, end))
+            return Fragment(start, end)
+        }
+
+        fun plus(a: Fragment): Fragment {
+            val end = state()
+            epsilons[a.end].addAll(listOf(a.start, end))
+            return Fragment(a.start, end)
+        }
+
+        fun optional(a: Fragment): Fragment {
+            val start = state()
+            val end = state()
+            epsilons[start].addAll(listOf(a.start, end))
+            epsilons[a.end].add(end)
+            return Fragment(start, end)
+        }
+
+        fun closure(states: BitSet): BitSet {
+            val result = states.clone() as BitSet
+            val stack = ArrayDeque<Int>()
+            var s = states.nextSetBit(0)
+            while (s >= 0) {
+                stack.addLast(s)
+                s = states.nextSetBit(s + 1)
+            }
+            while (stack.isNotEmpty()) {
+                for (target in epsilons[stack.removeLast()]) {
+                    if (!result[target]) {
+                        result.set(target)
+                        stack.addLast(target)
+                    }
+                }
+            }
+            return result
+        }
+    }
+
+    private class Parser(val pattern: ByteArray, var pos: Int, val end: Int, val nfa: Nfa) {
+        fun alternation(): Fragment {
+            var fragment = concatenation()
+            while (peek('|')) {
+                pos++
+                fragment = nfa.alternate(fragment, concatenation())
+            }
+            return fragment
+        }
+
+        private fun concatenation(): Fragment {
+            var fragment: Fragment? = null
+            while (pos < end && !peek('|') && !peek(')')) {
+                val next = repetition()
+                fragment = fragment?.let { nfa.concat(it, next) } ?: next
+            }
+            return fragment ?: nfa.empty()
+        }
+
+        private fun repetition(): Fragment {
+            var fragment = atom()
+            while (true) {
+                fragment = when {
+                    peek('*') -> nfa.star(fragment)
+                    peek('+') -> nfa.plus(fragment)
+                    peek('?') -> nfa.optional(fragment)
+                    else -> return fragment
+                }
+                pos++
+            }
+        }
+
+        private fun atom(): Fragment {
+            val c = pattern[pos++].toInt() and 0xff
+            return when (c.toChar()) {
+                '(' -> {
+                    val inner = alternation()
+                    if (!peek(')')) throw NativeError("Invalid pattern.")
+                    pos++
+                    inner
+                }
+                '[' -> nfa.set(charClass())
+                '.' -> nfa.set(BitSet().apply { set(0, 256); clear('\n'.code) })
+                '\\' -> nfa.set(escape())
+                '*', '+', '?' -> throw NativeError("Invalid pattern.")
+                else -> nfa.set(BitSet().apply { set(c) })
+            }
+        }
+
+        private fun charClass(): BitSet {
+            val set = BitSet()
+            val negated = peek('^')
+            if (negated) pos++
+            var first = true
+            while (true) {
+                if (pos >= end) throw NativeError("Invalid pattern.")
+                if (peek(']') && !first) break
+                first = false
+                if (peek('\\')) {
+                    pos++
+                    set.or(escape())
+                    continue
+                }
+                val low = pattern[pos++].toInt() and 0xff
+                if (peek('-') && pos + 1 < end && pattern[pos + 1] != ']'.code.toByte()) {
+                    val high = pattern[pos + 1].toInt() and 0xff
+                    if (high < low) throw NativeError("Invalid pattern.")
+                    set.set(low, high + 1)
+                    pos += 2
+                } else {
+                    set.set(low)
+                }
+            }
+            pos++
+            if (negated) set.flip(0, 256)
+            return set
+        }
+
+        private fun escape(): BitSet {
+            if (pos >= end) throw NativeError("Invalid pattern.")
+            val c = pattern[pos++].toInt() and 0xff
+            val set = BitSet()
+            when (c.toChar().lowercaseChar()) {
+                'd' -> set.set('0'.code, '9'.code + 1)
+                'w' -> {
+                    set.set('a'.code, 'z'.code + 1)
+                    set.set('A'.code, 'Z'.code + 1)
+                    set.set('0'.code, '9'.code + 1)
+                    set.set('_'.code)
+                }
+                's' -> {
+                    set.set(' '.code)
+                    set.set('\t'.code, '\r'.code + 1)
+                }
+                else -> {
+                    set.set(when (c.toChar()) {
+                        'n' -> '\n'.code
+                        't' -> '\t'.code
+                        else -> c
+                    })
+                    return set
+                }
+            }
+            if (c.toChar().isUpperCase()) set.flip(0, 256)
+            return set
+        }
+
+        private fun peek(c: Char): Boolean = pos < end && pattern[pos] == c.code.toByte()
+    }
+}
@@ -4,10 +4,18 @@ import java.util.*
 
 class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<Unit> {
     private val scopes = Stack<MutableMap<String, Boolean>>()
+    private val types = Stack<MutableMap<String, Token?>>()
     private var currentFunction = FunctionType.NONE
     private var currentClass = ClassType.NONE
-
-    fun resolve(statements: List<Stmt>) = statements.forEach { resolve(it) }
+    private var currentReturnType: Token? = null
+    private val layouts = mutableMapOf<String, Layout?>()
+    private var currentLayout: Layout? = null
+
+    fun resolve(statements: List<Stmt>) {
+        // Annotations may name classes declared further down.
+        if (scopes.isEmpty()) collectClassNames(statements)
+        statements.forEach { resolve(it) }
+    }
 
     fun resolve(stmt: Stmt) = stmt.accept(this)
 
@@ -16,6 +24,10 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
     override fun visitAssignExpr(expr: Expr.Assign) {
         resolve(expr.value)
         resolveLocal(expr, expr.name)
+        typeOf(expr.name.lexeme)?.let { type ->
+            checkValue(type, expr.value, expr.name)
+            interpreter.annotate(expr, type)
+        }
     }
 
     override fun visitBinaryExpr(expr: Expr.Binary) {
@@ -50,6 +62,11 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
     override fun visitSetExpr(expr: Expr.Set) {
         resolve(expr.value)
         resolve(expr.obj)
+        // Methods of a class with declared fields only assign those.
+        val layout = currentLayout ?: return
+        if (expr.obj !is Expr.This) return
+        if (expr.name.lexeme !in layout.fields) Lox.error(expr.name, "Undefined field '${expr.name.lexeme}'.")
+        else checkValue(layout.fields[expr.name.lexeme], expr.value, expr.name)
     }
 
     override fun visitSuperExpr(expr: Expr.Super) {
@@ -89,10 +106,14 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
 
     override fun visitClassStmt(stmt: Stmt.Class) {
         val enclosingClass = currentClass
+        val enclosingLayout = currentLayout
         currentClass = ClassType.CLASS
+        checkFields(stmt)
+        currentLayout = layoutOf(stmt)
 
         declare(stmt.name)
         define(stmt.name)
+        annotate(stmt.name, null)
 
         if (stmt.superclass != null && stmt.name.lexeme == stmt.superclass.name.lexeme) {
             Lox.error(stmt.superclass.name, "A class can't inherit from itself.")
@@ -118,6 +139,12 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
                 else
                     FunctionType.METHOD
 
+            // `==` and hash() call these with a fixed number of arguments.
+            if (method.name.lexeme == "equals" && method.params.size != 1)
+                Lox.error(method.name, "An 'equals' method must take exactly one parameter.")
+            if (method.name.lexeme == "hash" && method.params.isNotEmpty())
+                Lox.error(method.name, "A 'hash' method can't take parameters.")
+
             resolveFunction(method, declaration)
         }
 
@@ -128,6 +155,8 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
         }
 
         currentClass = enclosingClass
+        layouts[stmt.name.lexeme] = currentLayout
+        currentLayout = enclosingLayout
     }
 
     override fun visitExpressionStmt(stmt: Stmt.Expression) {
@@ -137,6 +166,7 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
     override fun visitFunctionStmt(stmt: Stmt.Function) {
         declare(stmt.name)
         define(stmt.name)
+        annotate(stmt.name, null)
         resolveFunction(stmt, FunctionType.FUNCTION)
     }
 
@@ -161,12 +191,16 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
             }
             resolve(it)
         }
+        checkValue(currentReturnType, stmt.value ?: Expr.Literal(null), stmt.keyword)
     }
 
     override fun visitVarStmt(stmt: Stmt.Var) {
         declare(stmt.name)
+        checkTypeName(stmt.type)
         resolve(stmt.initializer)
+        checkValue(stmt.type, stmt.initializer, stmt.name)
         define(stmt.name)
+        annotate(stmt.name, stmt.type)
     }
 
     override fun visitWhileStmt(stmt: Stmt.While) {
@@ -189,10 +223,15 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
         scope[name.lexeme] = true
     }
 
-    private fun beginScope() = scopes.push(HashMap<String, Boolean>())
-
+    private fun beginScope() {
+        scopes.push(HashMap<String, Boolean>())
+        types.push(HashMap<String, Token?>())
+    }
 
-    private fun endScope() = scopes.pop()
+    private fun endScope() {
+        scopes.pop()
+        types.pop()
+    }
 
     private fun resolveLocal(expr: Expr, name: Token) {
         for (i in scopes.indices.reversed()) {
@@ -204,17 +243,127 @@ class Resolver(val interpreter: Interpreter): Expr.Visitor<Unit>, Stmt.Visitor<U
 
     private fun resolveFunction(function: Stmt.Function, type: FunctionType) {
         val enclosingFunction = currentFunction
+        val enclosingReturnType = currentReturnType
         currentFunction = type
+        currentReturnType = function.returnType
+
+        if (type == FunctionType.INITIALIZER && function.returnType != null) {
+            Lox.error(function.returnType, "Can't annotate the return type of an initializer.")
+        }
+        checkTypeName(function.returnType)
 
         beginScope()
-        for (param in function.params) {
+        function.params.forEachIndexed { i, param ->
             declare(param)
             define(param)
+            checkTypeName(function.paramTypes[i])
+            annotate(param, function.paramTypes[i])
         }
         resolve(function.body)
         endScope()
 
         currentFunction = enclosingFunction
+        currentReturnType = enclosingReturnType
+    }
+
+    // ---------- Declared fields ----------
+
+    // The fields a class declares, inherited ones included, and the methods
+    // it has, for a class whose superclasses were all resolved here. Classes
+    // without declared fields have none.
+    private class Layout(val fields: Map<String, Token?>, val methods: Set<String>)
+
+    private fun layoutOf(stmt: Stmt.Class): Layout? {
+        val superLayout = stmt.superclass?.let { layouts[it.name.lexeme] ?: return null }
+        if (stmt.fields.isEmpty() && superLayout == null) return null
+        return Layout(
+            (superLayout?.fields ?: emptyMap()) + stmt.fields.associate { it.name.lexeme to it.type },
+            (superLayout?.methods ?: emptySet()) + stmt.methods.map { it.name.lexeme }
+        )
+    }
+
+    // Compiled code calls a method straight away when the receiver's class
+    // has it, so a declared field can't also be the name of a method.
+    private fun checkFields(stmt: Stmt.Class) {
+        val superLayout = stmt.superclass?.let { layouts[it.name.lexeme] }
+        val inherited = superLayout?.fields ?: emptyMap()
+        val methods = stmt.methods.map { it.name.lexeme }.toSet() + (superLayout?.methods ?: emptySet())
+        val seen = mutableSetOf<String>()
+        for (field in stmt.fields) {
+            checkTypeName(field.type)
+            when {
+                !seen.add(field.name.lexeme) -> Lox.error(field.name, "Already a field with this name in this class.")
+                field.name.lexeme in inherited -> Lox.error(field.name, "Field '${field.name.lexeme}' is already declared by a superclass.")
+                field.name.lexeme in methods -> Lox.error(field.name, "A field can't share its name with a method.")
+            }
+        }
+        stmt.methods.filter { it.name.lexeme in inherited }.forEach {
+            Lox.error(it.name, "A field can't share its name with a method.")
+        }
+    }
+
+    // ---------- Type annotations ----------
+
+    private fun collectClassNames(statements: List<Stmt>) {
+        for (stmt in statements) {
+            when (stmt) {
+                is Stmt.Class -> {
+                    interpreter.classNames += stmt.name.lexeme
+                    stmt.methods.forEach { collectClassNames(it.body) }
+                }
+                is Stmt.Block -> collectClassNames(stmt.statements)
+                is Stmt.Function -> collectClassNames(stmt.body)
+                is Stmt.If -> collectClassNames(listOfNotNull(stmt.thenBranch, stmt.elseBranch))
+                is Stmt.While -> collectClassNames(listOf(stmt.body))
+                else -> {}
+            }
+        }
+    }
+
+    private fun checkTypeName(type: Token?) {
+        if (type == null || type.lexeme in Types.BUILTIN || type.lexeme in interpreter.classNames) return
+        Lox.error(type, "Unknown type '${type.lexeme}'.")
+    }
+
+    private fun annotate(name: Token, type: Token?) {
+        if (scopes.isEmpty()) interpreter.globalTypes[name.lexeme] = type
+        else types.peek()[name.lexeme] = type
+    }
+
+    private fun typeOf(name: String): Token? {
+        for (i in scopes.indices.reversed()) {
+            if (scopes[i].containsKey(name)) return types[i][name]
+        }
+        return interpreter.globalTypes[name]
+    }
+
+    // Reports a value that can never match its annotation. Only types
+    // evident from the expression itself are compared; a class can't be told
+    // apart from its subclasses here, so the runtime checks the rest.
+    private fun checkValue(type: Token?, value: Expr, at: Token) {
+        if (type == null) return
+        val actual = staticType(value) ?: return
+        if (actual == type.lexeme || (actual !in Types.BUILTIN && actual != "nil" && type.lexeme !in Types.BUILTIN)) return
+        Lox.error(at, "Expected ${type.lexeme} but got $actual.")
+    }
+
+    private fun staticType(expr: Expr): String? = when (expr) {
+        is Expr.Literal -> when (expr.value) {
+            null -> "nil"
+            is Double -> "num"
+            is Boolean -> "bool"
+            is String -> "str"
+            else -> null
+        }
+        is Expr.Grouping -> staticType(expr.expression)
+        is Expr.Variable -> typeOf(expr.name.lexeme)?.lexeme
+        is Expr.Unary -> if (expr.operator.type == TokenType.BANG) "bool" else "num"
+        is Expr.Binary -> when (expr.operator.type) {
+            TokenType.MINUS, TokenType.STAR, TokenType.SLASH -> "num"
+            TokenType.PLUS -> staticType(expr.left)?.takeIf { it == "num" || it == "str" }?.takeIf { it == staticType(expr.right) }
+            else -> "bool"
+        }
+        else -> null
     }
 }
 
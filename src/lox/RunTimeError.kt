@@ -1,3 +1,6 @@
 ﻿package lox
 
-class RunTimeError(val token: Token, message: String): RuntimeException(message)
\ No newline at end of file
+class RunTimeError(val token: Token, message: String): RuntimeException(message)
+
+/** Thrown by natives, which have no token; the call site rethrows it as a [RunTimeError]. */
+class NativeError(message: String): RuntimeException(message)
\ No newline at end of file
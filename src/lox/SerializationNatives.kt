@@ -0,0 +1,303 @@
+﻿package lox
+
+import java.io.ByteArrayOutputStream
+import java.io.File
+import java.io.IOException
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.channels.FileChannel
+import java.nio.file.Paths
+import java.nio.file.StandardOpenOption
+import java.util.IdentityHashMap
+import kotlin.math.abs
+
+/**
+ * `writeValue(path, value)` stores a value and every instance reachable from
+ * it, keeping shared references and cycles, and `readValue(path)` loads it
+ * back, finding classes by name. The byte format is the one described in
+ * lox_runtime.cpp, so files move freely between backends. Both directions
+ * keep their own stack, so long linked structures don't overflow the JVM's.
+ */
+object SerializationNatives {
+    val arities = mapOf("writeValue" to 2, "readValue" to 1)
+
+    private val MAGIC = byteArrayOf('L'.code.toByte(), 'O'.code.toByte(), 'X'.code.toByte(), 'V'.code.toByte(), 1)
+    private const val MAX_EXACT_INT = 9007199254740992.0
+
+    private const val NIL = 0
+    private const val FALSE = 1
+    private const val TRUE = 2
+    private const val DOUBLE = 3
+    private const val INTEGER = 4
+    private const val STRING = 5
+    private const val INSTANCE = 6
+    private const val LIST = 7
+    private const val BUFFER = 8
+    private const val CLASS = 9
+    private const val REFERENCE = 10
+
+    fun define(globals: Environment) {
+        globals.define("writeValue", native(2) { args ->
+            val path = args[0] as? String ?: throw NativeError("Operand must be a string.")
+            val bytes = Writer().apply { write(args[1]) }.out.toByteArray()
+            try {
+                File(path).writeBytes(bytes)
+            } catch (e: IOException) {
+                throw NativeError("Could not write file '$path'.")
+            }
+            null
+        })
+        globals.define("readValue", native(1) { args ->
+            val path = args[0] as? String ?: throw NativeError("Operand must be a string.")
+            val bytes = try {
+                FileChannel.open(Paths.get(path), StandardOpenOption.READ).use { it.map(FileChannel.MapMode.READ_ONLY, 0, it.size()) }
+            } catch (e: IOException) {
+                throw NativeError("Could not open file '$path'.")
+            }
+            Reader(bytes.order(ByteOrder.LITTLE_ENDIAN)).readFile()
+        })
+    }
+
+    private class Writer {
+        val out = ByteArrayOutputStream().apply { write(MAGIC) }
+
+        /** A value still to write, preceded by its field name inside an instance. */
+        private class Pending(val value: Any?, val field: String?)
+
+        private val pending = ArrayList<Pending>()
+        private val objects = IdentityHashMap<LoxInstance, Int>()
+        private val symbols = HashMap<String, Int>()
+
+        fun write(root: Any?) {
+            pending.add(Pending(root, null))
+            while (pending.isNotEmpty()) {
+                val next = pending.removeAt(pending.size - 1)
+                next.field?.let { symbol(it) }
+                writeOne(next.value)
+            }
+        }
+
+        private fun writeOne(value: Any?) {
+            when (value) {
+                null -> out.write(NIL)
+                is Boolean -> out.write(if (value) TRUE else FALSE)
+                is Double -> {
+                    if (value % 1.0 == 0.0 && abs(value) <= MAX_EXACT_INT && !(value == 0.0 && 1.0 / value < 0)) {
+                        val n = value.toLong()
+                        out.write(INTEGER)
+                        varint((n shl 1) xor (n shr 63))
+                    } else {
+                        out.write(DOUBLE)
+                        double(value)
+                    }
+                }
+                is String -> {
+                    val bytes = value.toByteArray(Charsets.UTF_8)
+                    out.write(STRING)
+                    varint(bytes.size.toLong())
+                    out.write(bytes)
+                }
+                is LoxInstance -> instance(value)
+                is LoxClass -> {
+                    out.write(CLASS)
+                    symbol(value.name)
+                }
+                else -> throw NativeError("Cannot serialize a function.")
+            }
+        }
+
+        private fun instance(instance: LoxInstance) {
+            objects[instance]?.let {
+                out.write(REFERENCE)
+                varint(it.toLong())
+                return
+            }
+            objects[instance] = objects.size
+            when {
+                instance is ListNatives.ListInstance -> {
+                    out.write(LIST)
+                    varint(instance.items.size.toLong())
+                    for (i in instance.items.indices.reversed()) pending.add(Pending(instance.items[i], null))
+                }
+                instance is RandomNatives.BufferInstance -> {
+                    out.write(BUFFER)
+                    varint(instance.data.size.toLong())
+                    for (d in instance.data) double(d)
+                }
+                instance.klass is NativeClass -> throw NativeError("Cannot serialize a ${instance.klass.name} instance.")
+                else -> {
+                    out.write(INSTANCE)
+                    symbol(instance.klass.name)
+                    varint(instance.fields.size.toLong())
+                    for ((name, field) in instance.fields) pending.add(Pending(field, name))
+                }
+            }
+        }
+
+        private fun symbol(symbol: String) {
+            symbols[symbol]?.let {
+                varint(it.toLong() shl 1)
+                return
+            }
+            symbols[symbol] = symbols.size
+            val bytes = symbol.toByteArray(Charsets.UTF_8)
+            varint((bytes.size.toLong() shl 1) or 1)
+            out.write(bytes)
+        }
+
+        private fun varint(value: Long) {
+            var n = value
+            while (n.toULong() >= 0x80uL) {
+                out.write((n.toInt() and 0x7f) or 0x80)
+                n = n ushr 7
+            }
+            out.write(n.toInt())
+        }
+
+        private fun double(d: Double) {
+            val bits = d.toRawBits()
+            for (i in 0 until 8) out.write((bits ushr (8 * i)).toInt() and 0xff)
+        }
+    }
+
+    private class Reader(private val bytes: ByteBuffer) {
+        /** An instance or `List` whose contents are still being read. */
+        private class Frame(val instance: LoxInstance, var remaining: Int)
+
+        private val frames = ArrayList<Frame>()
+        private val objects = ArrayList<LoxInstance>()
+        private val symbols = ArrayList<String>()
+        private val classes = HashMap<Int, LoxClass>()
+
+        fun readFile(): Any? {
+            if (bytes.remaining() < MAGIC.size) malformed()
+            for (b in MAGIC) if (bytes.get() != b) malformed()
+
+            var root: Any? = null
+            do {
+                val parent = frames.lastOrNull()
+                val field = if (parent != null && parent.instance !is ListNatives.ListInstance) readSymbol() else 0
+                var child: Frame? = null
+                val value = readOne { child = it }
+                if (parent == null) {
+                    root = value
+                } else {
+                    parent.remaining--
+                    if (parent.instance is ListNatives.ListInstance) parent.instance.items.add(value)
+                    else parent.instance.fields[symbols[field]] = value
+                }
+                child?.let { if (it.remaining > 0) frames.add(it) }
+                while (frames.isNotEmpty() && frames.last().remaining == 0) frames.removeAt(frames.size - 1)
+            } while (frames.isNotEmpty())
+
+            if (bytes.hasRemaining()) malformed()
+            return root
+        }
+
+        private fun malformed(): Nothing = throw NativeError("Malformed value file.")
+
+        private fun byte(): Int {
+            if (!bytes.hasRemaining()) malformed()
+            return bytes.get().toInt() and 0xff
+        }
+
+        private fun varint(): Long {
+            var n = 0L
+            var shift = 0
+            while (shift < 64) {
+                val b = byte()
+                n = n or ((b and 0x7f).toLong() shl shift)
+                if (b and 0x80 == 0) return n
+                shift += 7
+            }
+            malformed()
+        }
+
+        /** A count of items that each take at least [itemSize] more bytes. */
+        private fun count(itemSize: Int): Int {
+            val n = varint()
+            if (n < 0 || n > bytes.remaining() / itemSize) malformed()
+            return n.toInt()
+        }
+
+        private fun double(): Double {
+            if (bytes.remaining() < 8) malformed()
+            return bytes.getDouble()
+        }
+
+        private fun text(size: Int): String {
+            val chars = ByteArray(size)
+            bytes.get(chars)
+            return String(chars, Charsets.UTF_8)
+        }
+
+        /** The index of the symbol read into [symbols]. */
+        private fun readSymbol(): Int {
+            val n = varint()
+            if (n and 1L == 0L) {
+                if (n < 0 || (n ushr 1) >= symbols.size) malformed()
+                return (n ushr 1).toInt()
+            }
+            val size = n ushr 1
+            if (size > bytes.remaining()) malformed()
+            symbols.add(text(size.toInt()))
+            return symbols.size - 1
+        }
+
+        private fun readClass(): LoxClass {
+            val symbol = readSymbol()
+            return classes.getOrPut(symbol) {
+                LoxClass.named(symbols[symbol]) ?: throw NativeError("Undefined class '${symbols[symbol]}'.")
+            }
+        }
+
+        /** Reads one value; instances and `List`s come back empty and are handed to [child] to fill. */
+        private fun readOne(child: (Frame) -> Unit): Any? = when (byte()) {
+            NIL -> null
+            FALSE -> false
+            TRUE -> true
+            DOUBLE -> double()
+            INTEGER -> {
+                val n = varint()
+                val i = (n ushr 1) xor -(n and 1)
+                if (abs(i.toDouble()) > MAX_EXACT_INT) malformed()
+                i.toDouble()
+            }
+            STRING -> text(count(1))
+            CLASS -> readClass()
+            INSTANCE -> {
+                val klass = readClass()
+                if (klass is NativeClass) malformed()
+                val instance = LoxInstance(klass)
+                objects.add(instance)
+                // Each field takes at least a symbol byte and a tag byte.
+                child(Frame(instance, count(2)))
+                instance
+            }
+            LIST -> {
+                val list = ListNatives.of(mutableListOf())
+                objects.add(list)
+                child(Frame(list, count(1)))
+                list
+            }
+            BUFFER -> {
+                val klass = LoxClass.named("Buffer") ?: malformed()
+                val buffer = RandomNatives.BufferInstance(klass, DoubleArray(count(8)) { double() })
+                objects.add(buffer)
+                buffer
+            }
+            REFERENCE -> {
+                val index = varint()
+                if (index < 0 || index >= objects.size) malformed()
+                objects[index.toInt()]
+            }
+            else -> malformed()
+        }
+    }
+
+    private fun native(arity: Int, body: (MutableList<Any?>) -> Any?): LoxCallable = object: LoxCallable {
+        override fun arity(): Int = arity
+        override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? = body(arguments)
+        override fun toString(): String = "<native fn>"
+    }
+}
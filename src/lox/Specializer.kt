@@ -0,0 +1,396 @@
+﻿package lox
+
+import java.util.IdentityHashMap
+
+/**
+ * Clones top-level functions into plain C++ functions over `double` for the
+ * case where every argument is a number, so numeric helpers run unboxed and
+ * call each other directly. The generic body stays as the fallback and
+ * checks its arguments on entry to forward to the clone.
+ *
+ * A function qualifies when its body types entirely as numbers and booleans
+ * given number parameters: it may use its own parameters and locals,
+ * arithmetic, comparisons, `and`/`or`, unshadowed math natives and calls to
+ * other qualifying functions, and must return a value of one type on every
+ * path. It may not touch globals, print or nest declarations, and
+ * assignments must be whole statements, so C++'s unsequenced operand
+ * evaluation can't be observed.
+ *
+ * The same typing speculates on `while` loops in generic code: if a loop
+ * types with the outer locals it mentions taken as numbers, the emitter
+ * guards a copy of it over unboxed doubles behind one check on entry.
+ *
+ * Type annotations settle what inference would guess: `num` and `bool`
+ * parameters fix the clone's signature, an annotated return fixes its
+ * result, and locals the emitter already holds unboxed because of their
+ * annotation need no guard at all. Reads of annotated declared fields are
+ * typed the same way.
+ */
+class Specializer private constructor(statements: List<Stmt>) {
+    enum class Type(val cpp: String, val annotation: String) {
+        NUM("double", "num"),
+        BOOL("bool", "bool");
+
+        companion object {
+            fun of(annotation: String?): Type? = values().firstOrNull { it.annotation == annotation }
+        }
+    }
+
+    /** `annotated` marks the parameters the generic body has already checked. */
+    class Specialization(
+        val name: String,
+        val params: List<Type>,
+        val annotated: List<Boolean>,
+        var returns: Type,
+        val fixedReturn: Boolean
+    ) {
+        val arity: Int get() = params.size
+        var code = ""
+    }
+
+    /** How a loop's free names resolve at the point the emitter reaches it. */
+    interface Bindings {
+        /** The C++ `Value` local a name refers to, if it may be speculated on. */
+        fun variable(name: String): String?
+
+        /** The unboxed C++ local an annotated name refers to. */
+        fun typed(name: String): Pair<String, Type>? = null
+
+        /** The struct member a read of a declared `num` or `bool` field is. */
+        fun field(get: Expr.Get): Pair<String, Type>? = null
+
+        /** The annotated return type of the function the loop is in. */
+        val returnType: String? get() = null
+
+        /** The clone a call through `name` would reach. */
+        fun clone(name: String): Specialization?
+
+        /** Whether `name` still means the math native. */
+        fun isNative(name: String): Boolean
+    }
+
+    /**
+     * A loop over unboxed copies of the outer locals in `variables` (C++ name
+     * to unboxed name); those in `written` must be stored back afterwards.
+     */
+    class SpeculatedLoop(val variables: Map<String, String>, val written: Set<String>, val lines: List<String>)
+
+    private val candidates = IdentityHashMap<Stmt.Function, Specialization>()
+    private val byName = LinkedHashMap<String, Pair<Stmt.Function, Specialization>>()
+    private val topLevelNames: Set<String>
+
+    // Clones see only their own locals, other clones and unshadowed natives.
+    private val topLevel = object : Bindings {
+        override fun variable(name: String): String? = null
+        override fun clone(name: String): Specialization? = byName[name]?.second
+        override fun isNative(name: String): Boolean = name !in topLevelNames
+    }
+
+    init {
+        val counts = mutableMapOf<String, Int>()
+        for (stmt in statements) {
+            val name = when (stmt) {
+                is Stmt.Function -> stmt.name.lexeme
+                is Stmt.Class -> stmt.name.lexeme
+                is Stmt.Var -> stmt.name.lexeme
+                else -> continue
+            }
+            counts[name] = (counts[name] ?: 0) + 1
+        }
+        topLevelNames = counts.keys
+        for (stmt in statements) {
+            if (stmt !is Stmt.Function || counts[stmt.name.lexeme] != 1) continue
+            val params = stmt.paramTypes.map { if (it == null) Type.NUM else Type.of(it.lexeme) }
+            if (params.any { it == null }) continue
+            val returns = if (stmt.returnType == null) Type.NUM else Type.of(stmt.returnType.lexeme) ?: continue
+            val annotated = stmt.paramTypes.map { it != null }
+            val spec = Specialization("lox_${stmt.name.lexeme}_num", params.filterNotNull(), annotated, returns, stmt.returnType != null)
+            candidates[stmt] = spec
+            byName[stmt.name.lexeme] = stmt to spec
+        }
+        resolve()
+    }
+
+    /** The clone of a top-level function declaration, if it has one. */
+    fun specialization(function: Stmt.Function): Specialization? = candidates[function]
+
+    /** Forward declarations and definitions of every clone. */
+    fun code(): String {
+        if (candidates.isEmpty()) return ""
+        val out = StringBuilder()
+        val specs = byName.values.map { it.second }
+        specs.forEach { out.appendLine("static ${signature(it)};") }
+        out.appendLine()
+        specs.forEach { out.append(it.code).appendLine() }
+        return out.toString()
+    }
+
+    /** `loop` over unboxed outer locals, or null if it doesn't type that way. */
+    fun speculateLoop(loop: Stmt.While, bindings: Bindings): SpeculatedLoop? = try {
+        FunctionEmitter(null, bindings).loop(loop)
+    } catch (e: Unsupported) {
+        null
+    }
+
+    /**
+     * `expr` as a typed C++ expression if it is built from literals and the
+     * annotated locals `bindings` exposes, as for the argument of `fib(30)`
+     * at a call site in generic code. Its `variable` must not speculate.
+     */
+    fun typedExpression(expr: Expr, bindings: Bindings): Pair<String, Type>? = try {
+        FunctionEmitter(null, bindings).expression(expr)
+    } catch (e: Unsupported) {
+        null
+    }
+
+    // Drops candidates that don't type until the rest agree, settling each
+    // clone's return type along the way: everything starts out returning a
+    // number and may switch to bool once.
+    private fun resolve() {
+        val switched = mutableSetOf<Specialization>()
+        do {
+            var changed = false
+            for ((function, spec) in byName.values.toList()) {
+                val returns = try {
+                    FunctionEmitter(spec).function(function)
+                } catch (e: Unsupported) {
+                    null
+                }
+                if (returns == null || (returns != spec.returns && (spec.fixedReturn || !switched.add(spec)))) {
+                    candidates.remove(function)
+                    byName.remove(function.name.lexeme)
+                    changed = true
+                } else if (returns != spec.returns) {
+                    spec.returns = returns
+                    changed = true
+                }
+            }
+        } while (changed)
+    }
+
+    private fun signature(spec: Specialization): String {
+        val params = spec.params.withIndex().joinToString(", ") { (i, type) -> "${type.cpp} p$i" }
+        return "${spec.returns.cpp} ${spec.name}($params)"
+    }
+
+    private class Unsupported : RuntimeException()
+
+    private inner class FunctionEmitter(private val spec: Specialization?, private val bindings: Bindings = topLevel) {
+        private val code = StringBuilder()
+        private var indentLevel = 1
+        private val outer = LinkedHashMap<String, String>()
+        private val written = mutableSetOf<String>()
+        private val inLoop: Boolean get() = bindings !== topLevel
+        private val scopes = ArrayDeque<MutableMap<String, Pair<String, Type>>>().apply { addLast(mutableMapOf()) }
+        private var localId = 0
+        private val returns = mutableSetOf<Type>()
+        private var usesTyped = false
+
+        /** Emits the clone into `spec.code` and returns what its body returns. */
+        fun function(function: Stmt.Function): Type {
+            function.params.forEachIndexed { i, param -> scopes.last()[param.lexeme] = "p$i" to spec!!.params[i] }
+            function.body.forEach(::statement)
+            if (!definitelyReturns(function.body) || returns.size != 1) throw Unsupported()
+            spec!!.code = "static ${signature(spec)} {\n$code}\n"
+            return returns.single()
+        }
+
+        fun loop(loop: Stmt.While): SpeculatedLoop? {
+            indentLevel = 0
+            statement(loop)
+            if (outer.isEmpty() && !usesTyped) return null
+            return SpeculatedLoop(outer, written, code.lines().dropLast(1))
+        }
+
+        private fun statement(stmt: Stmt) {
+            when (stmt) {
+                is Stmt.Block -> {
+                    line("{")
+                    scopes.addLast(mutableMapOf())
+                    indentLevel++
+                    stmt.statements.forEach(::statement)
+                    indentLevel--
+                    scopes.removeLast()
+                    line("}")
+                }
+                is Stmt.Expression -> {
+                    val expr = stmt.expression
+                    line("${if (expr is Expr.Assign) assignment(expr) else expression(expr).first};")
+                }
+                is Stmt.If -> {
+                    line("if (${condition(stmt.condition)}) {")
+                    nested(stmt.thenBranch)
+                    stmt.elseBranch?.let {
+                        line("} else {")
+                        nested(it)
+                    }
+                    line("}")
+                }
+                is Stmt.Return -> {
+                    val returnType = bindings.returnType
+                    if (inLoop && returnType == null) {
+                        line("return ${stmt.value?.let { boxed(it) } ?: "nullptr"};")
+                    } else if (inLoop) {
+                        // The generic code would check the value against the annotation.
+                        val (value, type) = expression(stmt.value ?: throw Unsupported())
+                        if (type.annotation != returnType) throw Unsupported()
+                        line("return Value($value);")
+                    } else {
+                        val (value, type) = expression(stmt.value ?: throw Unsupported())
+                        returns += type
+                        line("return $value;")
+                    }
+                }
+                // Statements are sequenced, so a loop may print.
+                is Stmt.Print -> if (inLoop) line("print(${boxed(stmt.expression)});") else throw Unsupported()
+                is Stmt.Var -> {
+                    val (value, type) = if (stmt.initializer is Expr.Assign) {
+                        assignment(stmt.initializer) to local(stmt.initializer.name.lexeme).second
+                    } else {
+                        expression(stmt.initializer)
+                    }
+                    if (stmt.type != null && stmt.type.lexeme != type.annotation) throw Unsupported()
+                    val name = "${stmt.name.lexeme}_${++localId}"
+                    line("${type.cpp} $name = $value;")
+                    scopes.last()[stmt.name.lexeme] = name to type
+                }
+                is Stmt.While -> {
+                    line("while (${condition(stmt.condition)}) {")
+                    nested(stmt.body)
+                    line("}")
+                }
+                is Stmt.Class, is Stmt.Function -> throw Unsupported()
+            }
+        }
+
+        private fun nested(stmt: Stmt) {
+            indentLevel++
+            statement(stmt)
+            indentLevel--
+        }
+
+        // Numbers are always truthy, but the condition still runs.
+        private fun condition(expr: Expr): String {
+            val (value, type) = expression(expr)
+            return if (type == Type.BOOL) value else "((void)$value, true)"
+        }
+
+        private fun boxed(expr: Expr): String = "Value(${expression(expr).first})"
+
+        private fun assignment(expr: Expr.Assign): String {
+            if (lookup(expr.name.lexeme) == null) bindings.variable(expr.name.lexeme)?.let { written += it }
+            val (name, type) = local(expr.name.lexeme)
+            val (value, valueType) = expression(expr.value)
+            if (valueType != type) throw Unsupported()
+            return "$name = $value"
+        }
+
+        fun expression(expr: Expr): Pair<String, Type> = when (expr) {
+            is Expr.Literal -> when (val value = expr.value) {
+                is Double -> (if (value % 1.0 == 0.0 && value < 1e15) "${value.toLong()}.0" else value.toString()) to Type.NUM
+                is Boolean -> value.toString() to Type.BOOL
+                else -> throw Unsupported()
+            }
+            is Expr.Grouping -> expression(expr.expression).let { (value, type) -> "($value)" to type }
+            is Expr.Variable -> local(expr.name.lexeme)
+            is Expr.Unary -> {
+                val (value, type) = expression(expr.right)
+                when {
+                    expr.operator.type == TokenType.MINUS && type == Type.NUM -> "(-$value)" to Type.NUM
+                    expr.operator.type == TokenType.BANG && type == Type.BOOL -> "(!$value)" to Type.BOOL
+                    else -> throw Unsupported()
+                }
+            }
+            is Expr.Binary -> binary(expr)
+            is Expr.Logical -> {
+                val (left, leftType) = expression(expr.left)
+                val (right, rightType) = expression(expr.right)
+                when {
+                    leftType != rightType -> throw Unsupported()
+                    leftType == Type.BOOL -> "($left ${if (expr.operator.type == TokenType.AND) "&&" else "||"} $right)" to Type.BOOL
+                    // A number is truthy: `or` yields it, `and` yields the right operand.
+                    expr.operator.type == TokenType.OR -> left to Type.NUM
+                    else -> "((void)$left, $right)" to Type.NUM
+                }
+            }
+            is Expr.Call -> call(expr)
+            // Nothing a speculated loop runs can assign a field.
+            is Expr.Get -> bindings.field(expr)?.also { usesTyped = true } ?: throw Unsupported()
+            is Expr.Assign, is Expr.Set, is Expr.Super, is Expr.This -> throw Unsupported()
+        }
+
+        private fun binary(expr: Expr.Binary): Pair<String, Type> {
+            val (left, leftType) = expression(expr.left)
+            val (right, rightType) = expression(expr.right)
+            if (leftType != rightType) throw Unsupported()
+            return when (expr.operator.type) {
+                TokenType.EQUAL_EQUAL -> "($left == $right)" to Type.BOOL
+                TokenType.BANG_EQUAL -> "($left != $right)" to Type.BOOL
+                else -> {
+                    if (leftType != Type.NUM) throw Unsupported()
+                    when (expr.operator.type) {
+                        TokenType.PLUS -> "($left + $right)" to Type.NUM
+                        TokenType.MINUS -> "($left - $right)" to Type.NUM
+                        TokenType.STAR -> "($left * $right)" to Type.NUM
+                        TokenType.SLASH -> "divideNumbers($left, $right)" to Type.NUM
+                        TokenType.GREATER -> "($left > $right)" to Type.BOOL
+                        TokenType.GREATER_EQUAL -> "($left >= $right)" to Type.BOOL
+                        TokenType.LESS -> "($left < $right)" to Type.BOOL
+                        TokenType.LESS_EQUAL -> "($left <= $right)" to Type.BOOL
+                        else -> throw Unsupported()
+                    }
+                }
+            }
+        }
+
+        private fun call(expr: Expr.Call): Pair<String, Type> {
+            val name = (expr.callee as? Expr.Variable)?.name?.lexeme ?: throw Unsupported()
+            if (lookup(name) != null) throw Unsupported()
+            val arguments = expr.arguments.map { expression(it) }
+            val args = arguments.map { it.first }
+            bindings.clone(name)?.let { callee ->
+                if (arguments.map { it.second } != callee.params) throw Unsupported()
+                return "${callee.name}(${args.joinToString(", ")})" to callee.returns
+            }
+            if (arguments.any { it.second != Type.NUM }) throw Unsupported()
+            val function = CppCodeGenerator.MATH_INTRINSICS[name]
+            if (function == null || !bindings.isNative(name) || MathNatives.arities[name] != args.size) throw Unsupported()
+            return "$function(${args.joinToString(", ")})" to Type.NUM
+        }
+
+        // A name the loop doesn't declare is one of the speculated outer locals.
+        private fun local(name: String): Pair<String, Type> {
+            lookup(name)?.let { return it }
+            bindings.typed(name)?.let {
+                usesTyped = true
+                return it
+            }
+            val variable = bindings.variable(name) ?: throw Unsupported()
+            return outer.getOrPut(variable) { "${variable}_num" } to Type.NUM
+        }
+
+        private fun lookup(name: String): Pair<String, Type>? {
+            for (i in scopes.indices.reversed()) {
+                scopes[i][name]?.let { return it }
+            }
+            return null
+        }
+
+        private fun line(text: String) {
+            code.append("  ".repeat(indentLevel)).appendLine(text)
+        }
+    }
+
+    companion object {
+        fun analyze(statements: List<Stmt>): Specializer = Specializer(statements)
+
+        private fun definitelyReturns(statements: List<Stmt>): Boolean = statements.any(::definitelyReturns)
+
+        private fun definitelyReturns(stmt: Stmt): Boolean = when (stmt) {
+            is Stmt.Return -> true
+            is Stmt.Block -> definitelyReturns(stmt.statements)
+            is Stmt.If -> stmt.elseBranch != null && definitelyReturns(stmt.thenBranch) && definitelyReturns(stmt.elseBranch)
+            else -> false
+        }
+    }
+}
@@ -1,4 +1,4 @@
-package lox
+﻿package lox
 
 sealed class Stmt {
     interface Visitor<R> {
@@ -23,6 +23,7 @@ sealed class Stmt {
     data class Class(
         val name: Token,
         val superclass: Expr.Variable?,
+        val fields: List<Stmt.Var>,
         val methods: List<Stmt.Function>
     ) : Stmt() {
         override fun <R> accept(visitor: Visitor<R>): R =
@@ -39,6 +40,8 @@ sealed class Stmt {
     data class Function(
         val name: Token,
         val params: List<Token>,
+        val paramTypes: List<Token?>,
+        val returnType: Token?,
         val body: List<Stmt>
     ) : Stmt() {
         override fun <R> accept(visitor: Visitor<R>): R =
@@ -71,6 +74,7 @@ sealed class Stmt {
 
     data class Var(
         val name: Token,
+        val type: Token?,
         val initializer: Expr
     ) : Stmt() {
         override fun <R> accept(visitor: Visitor<R>): R =
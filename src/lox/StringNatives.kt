@@ -0,0 +1,68 @@
+﻿package lox
+
+/**
+ * `len`, `indexOf`, `startsWith`, `substring`, `trim`, `charAt`, `split` and
+ * `match`. Lengths and indices count UTF-8 bytes from 0, as the native
+ * runtimes do, so a slice can split a multi-byte character; the interpreter
+ * decodes such partial bytes as U+FFFD. `indexOf` gives -1 when the needle is
+ * missing, and `trim` strips ASCII whitespace. The C++ runtime returns slices
+ * of the original string instead of copies. `match` takes the patterns
+ * described in [RegexDfa].
+ */
+object StringNatives {
+    val arities = mapOf(
+        "len" to 1, "indexOf" to 2, "startsWith" to 2, "substring" to 3,
+        "trim" to 1, "charAt" to 2, "split" to 2, "match" to 2
+    )
+
+    private val patterns = HashMap<String, RegexDfa>()
+
+    fun define(globals: Environment) {
+        globals.define("len", native(1) { args -> utf8(args[0]).size.toDouble() })
+        globals.define("indexOf", native(2) { args ->
+            val text = string(args[0])
+            val at = text.indexOf(string(args[1]))
+            if (at < 0) -1.0 else text.substring(0, at).toByteArray(Charsets.UTF_8).size.toDouble()
+        })
+        globals.define("startsWith", native(2) { args -> string(args[0]).startsWith(string(args[1])) })
+        globals.define("substring", native(3) { args ->
+            val bytes = utf8(args[0])
+            val end = index(args[2], bytes.size)
+            val start = index(args[1], end)
+            String(bytes, start, end - start, Charsets.UTF_8)
+        })
+        globals.define("trim", native(1) { args -> string(args[0]).trim { it == ' ' || it in '\t'..'\r' } })
+        globals.define("charAt", native(2) { args ->
+            val bytes = utf8(args[0])
+            if (bytes.isEmpty()) throw NativeError("String index out of range.")
+            String(bytes, index(args[1], bytes.size - 1), 1, Charsets.UTF_8)
+        })
+        globals.define("split", native(2) { args ->
+            val separator = string(args[1])
+            if (separator.isEmpty()) throw NativeError("Separator must not be empty.")
+            ListNatives.of(string(args[0]).split(separator).toMutableList<Any?>())
+        })
+        globals.define("match", native(2) { args ->
+            val pattern = string(args[0])
+            val text = string(args[1])
+            patterns.getOrPut(pattern) { RegexDfa.compile(pattern) }.matches(text)
+        })
+    }
+
+    private fun string(value: Any?): String = value as? String ?: throw NativeError("Operand must be a string.")
+
+    private fun utf8(value: Any?): ByteArray = string(value).toByteArray(Charsets.UTF_8)
+
+    /** A string index in [0, limit]. */
+    private fun index(value: Any?, limit: Int): Int {
+        val i = value as? Double ?: throw NativeError("Operand must be a number.")
+        if (i < 0 || i > limit || i % 1.0 != 0.0) throw NativeError("String index out of range.")
+        return i.toInt()
+    }
+
+    private fun native(arity: Int, body: (MutableList<Any?>) -> Any?): LoxCallable = object: LoxCallable {
+        override fun arity(): Int = arity
+        override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? = body(arguments)
+        override fun toString(): String = "<native fn>"
+    }
+}
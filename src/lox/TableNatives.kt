@@ -0,0 +1,195 @@
+﻿package lox
+
+import java.io.ByteArrayOutputStream
+import java.io.File
+import java.io.IOException
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.channels.FileChannel
+import java.nio.file.Paths
+import java.nio.file.StandardOpenOption
+
+/**
+ * `buildTable(path, keys, values)` writes a read-only string-keyed hash table
+ * and `Table(path)` opens one with `get(key)` (nil if missing), `has(key)` and
+ * `length()`. Opening only maps the file, so it costs the same at any size;
+ * the layout is documented in lox_runtime.cpp and shared by every backend.
+ */
+object TableNatives {
+    val arities = mapOf("buildTable" to 3)
+    val classNames = setOf("Table")
+
+    private const val HEADER = 24
+    private const val NIL = 0
+    private const val FALSE = 1
+    private const val TRUE = 2
+    private const val DOUBLE = 3
+    private const val STRING = 5
+
+    private class TableInstance(klass: LoxClass, val bytes: ByteBuffer, val count: Long, val mask: Long): LoxInstance(klass)
+
+    fun define(globals: Environment) {
+        globals.define("buildTable", object: LoxCallable {
+            override fun arity(): Int = 3
+            override fun call(interpreter: Interpreter, arguments: MutableList<Any?>): Any? {
+                build(arguments[0], arguments[1], arguments[2])
+                return null
+            }
+            override fun toString(): String = "<native fn>"
+        })
+        globals.define("Table", NativeClass("Table", 1, mapOf(
+            "get" to NativeMethod(1) { self, args -> get(self as TableInstance, args[0]) },
+            "has" to NativeMethod(1) { self, args -> find(self as TableInstance, args[0]) >= 0 },
+            "length" to NativeMethod(0) { self, _ -> (self as TableInstance).count.toDouble() }
+        )) { klass, args -> open(klass, args[0]) })
+    }
+
+    private fun fnv1a(bytes: ByteArray): Long {
+        var hash = -0x340d631b7bdddcdbL
+        for (b in bytes) {
+            hash = hash xor (b.toLong() and 0xff)
+            hash *= 0x100000001b3L
+        }
+        return hash
+    }
+
+    private fun build(path: Any?, keys: Any?, values: Any?) {
+        val file = path as? String ?: throw NativeError("Operand must be a string.")
+        val keyList = keys as? ListNatives.ListInstance
+        val valueList = values as? ListNatives.ListInstance
+        if (keyList == null || valueList == null || keyList.items.size != valueList.items.size) {
+            throw NativeError("Keys and values must be Lists of the same length.")
+        }
+
+        var slots = 2
+        while (slots < keyList.items.size * 2) slots *= 2
+        val hashes = LongArray(slots)
+        val offsets = LongArray(slots)
+        val entries = ByteArrayOutputStream()
+        val entriesStart = HEADER + slots * 16L
+        var count = 0L
+        val keyBytes = arrayOfNulls<ByteArray>(slots)
+
+        for ((k, item) in keyList.items.withIndex()) {
+            val key = (item as? String ?: throw NativeError("Table keys must be strings.")).toByteArray(Charsets.UTF_8)
+            val offset = entriesStart + entries.size()
+            entries.write(int32(key.size))
+            entries.write(key)
+            when (val value = valueList.items[k]) {
+                null -> entries.write(NIL)
+                false -> entries.write(FALSE)
+                true -> entries.write(TRUE)
+                is Double -> {
+                    entries.write(DOUBLE)
+                    entries.write(int64(value.toRawBits()))
+                }
+                is String -> {
+                    val text = value.toByteArray(Charsets.UTF_8)
+                    entries.write(STRING)
+                    entries.write(int32(text.size))
+                    entries.write(text)
+                }
+                else -> throw NativeError("Table values must be strings, numbers, booleans or nil.")
+            }
+
+            // A repeated key points its slot at the newer entry.
+            val hash = fnv1a(key)
+            var i = (hash and (slots - 1).toLong()).toInt()
+            while (offsets[i] != 0L && !(hashes[i] == hash && keyBytes[i].contentEquals(key))) i = (i + 1) and (slots - 1)
+            if (offsets[i] == 0L) count++
+            keyBytes[i] = key
+            hashes[i] = hash
+            offsets[i] = offset
+        }
+
+        val header = ByteBuffer.allocate(HEADER + slots * 16).order(ByteOrder.LITTLE_ENDIAN)
+        header.put("LOXT".toByteArray(Charsets.US_ASCII)).putInt(1).putLong(count).putLong(slots.toLong())
+        for (i in 0 until slots) header.putLong(hashes[i]).putLong(offsets[i])
+        try {
+            File(file).outputStream().use {
+                it.write(header.array())
+                entries.writeTo(it)
+            }
+        } catch (e: IOException) {
+            throw NativeError("Could not write file '$file'.")
+        }
+    }
+
+    private fun int32(n: Int) = ByteBuffer.allocate(4).order(ByteOrder.LITTLE_ENDIAN).putInt(n).array()
+
+    private fun int64(n: Long) = ByteBuffer.allocate(8).order(ByteOrder.LITTLE_ENDIAN).putLong(n).array()
+
+    private fun malformed(): Nothing = throw NativeError("Malformed table file.")
+
+    private fun open(klass: LoxClass, path: Any?): TableInstance {
+        val file = path as? String ?: throw NativeError("Operand must be a string.")
+        val bytes = try {
+            FileChannel.open(Paths.get(file), StandardOpenOption.READ).use { it.map(FileChannel.MapMode.READ_ONLY, 0, it.size()) }
+        } catch (e: IOException) {
+            throw NativeError("Could not open file '$file'.")
+        }
+        bytes.order(ByteOrder.LITTLE_ENDIAN)
+        val size = bytes.limit().toLong()
+        if (size < HEADER || bytes.get(0) != 'L'.code.toByte() || bytes.get(1) != 'O'.code.toByte() ||
+            bytes.get(2) != 'X'.code.toByte() || bytes.get(3) != 'T'.code.toByte() || bytes.getInt(4) != 1) {
+            malformed()
+        }
+        val count = bytes.getLong(8)
+        val slots = bytes.getLong(16)
+        if (slots <= 0 || (slots and (slots - 1)) != 0L || count < 0 || count >= slots || slots > (size - HEADER) / 16) {
+            malformed()
+        }
+        return TableInstance(klass, bytes, count, slots - 1)
+    }
+
+    /** The position of the entry's value tag for `key`, or -1 if it isn't in the table. */
+    private fun find(table: TableInstance, key: Any?): Int {
+        val text = (key as? String ?: throw NativeError("Operand must be a string.")).toByteArray(Charsets.UTF_8)
+        val bytes = table.bytes
+        val size = bytes.limit().toLong()
+        val hash = fnv1a(text)
+        var i = hash and table.mask
+        // Bounded, so a corrupt file with no empty slot still terminates.
+        repeat((table.mask + 1).toInt()) {
+            val slot = (HEADER + i * 16).toInt()
+            val offset = bytes.getLong(slot + 8)
+            if (offset == 0L) return -1
+            if (bytes.getLong(slot) == hash) {
+                if (offset < 0 || offset > size - 4) malformed()
+                val length = bytes.getInt(offset.toInt()).toLong() and 0xffffffffL
+                if (length > size - offset - 4) malformed()
+                if (length == text.size.toLong() && (0 until text.size).all { bytes.get(offset.toInt() + 4 + it) == text[it] }) {
+                    return (offset + 4 + length).toInt()
+                }
+            }
+            i = (i + 1) and table.mask
+        }
+        return -1
+    }
+
+    private fun get(table: TableInstance, key: Any?): Any? {
+        val at = find(table, key)
+        if (at < 0) return null
+        val bytes = table.bytes
+        val end = bytes.limit()
+        if (at >= end) malformed()
+        return when (bytes.get(at).toInt()) {
+            NIL -> null
+            FALSE -> false
+            TRUE -> true
+            DOUBLE -> {
+                if (end - at < 9) malformed()
+                bytes.getDouble(at + 1)
+            }
+            STRING -> {
+                if (end - at < 5) malformed()
+                val length = bytes.getInt(at + 1).toLong() and 0xffffffffL
+                if (length > end - at - 5) malformed()
+                val text = ByteArray(length.toInt())
+                bytes.duplicate().position(at + 5).let { (it as ByteBuffer).get(text) }
+                String(text, Charsets.UTF_8)
+            }
+            else -> malformed()
+        }
+    }
+}
@@ -0,0 +1,44 @@
+﻿package lox
+
+/**
+ * Optional type annotations: `num`, `bool`, `str` or a class name, which
+ * also admits instances of its subclasses. `nil` matches none of them. The
+ * interpreters check annotated parameters, returns and variables whenever a
+ * value is stored into them.
+ */
+object Types {
+    val BUILTIN = setOf("num", "bool", "str")
+
+    fun matches(type: String, value: Any?): Boolean = when (type) {
+        "num" -> value is Double
+        "bool" -> value is Boolean
+        "str" -> value is String
+        else -> value is LoxInstance && generateSequence(value.klass) { it.superclass }.any { it.name == type }
+    }
+
+    /** `value`, or a [RunTimeError] at `at` if `type` is set and doesn't admit it. */
+    fun check(type: Token?, value: Any?, at: Token?): Any? {
+        if (type != null && !matches(type.lexeme, value)) {
+            throw RunTimeError(at ?: type, "Expected ${type.lexeme} but got ${describe(value)}.")
+        }
+        return value
+    }
+
+    /** What a declared field annotated `type` holds before its first assignment. */
+    fun initial(type: Token?): Any? = when (type?.lexeme) {
+        "num" -> 0.0
+        "bool" -> false
+        "str" -> ""
+        else -> null
+    }
+
+    fun describe(value: Any?): String = when (value) {
+        null -> "nil"
+        is Double -> "num"
+        is Boolean -> "bool"
+        is String -> "str"
+        is LoxInstance -> "${value.klass.name} instance"
+        is LoxClass -> "class"
+        else -> "function"
+    }
+}
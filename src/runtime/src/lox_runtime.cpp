@@ -1,15 +1,50 @@
 #include "lox_runtime.h"
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <bitset>
 #include <cwchar>
+#include <deque>
+#include <map>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOX_HAVE_MMAP 1
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static bool fitsExact(std::int64_t v) {
+  return v >= -LOX_MAX_EXACT_INT && v <= LOX_MAX_EXACT_INT;
+}
+
+static bool bothInts(const Value &a, const Value &b) {
+  return is<std::int64_t>(a) && is<std::int64_t>(b);
+}
+
+bool isNumber(const Value &v) { return is<double>(v) || is<std::int64_t>(v); }
 
 double asNumber(const Value &v) {
   if (is<double>(v))
     return std::get<double>(v);
+  if (is<std::int64_t>(v))
+    return static_cast<double>(std::get<std::int64_t>(v));
   throw std::runtime_error("Operand must be a number.");
 }
 
-std::string asString(const Value &v) {
-  if (is<std::string>(v))
-    return std::get<std::string>(v);
+const LoxString &asString(const Value &v) {
+  if (is<LoxString>(v))
+    return std::get<LoxString>(v);
   throw std::runtime_error("Operand must be a string.");
 }
 
@@ -29,28 +64,90 @@ bool isTruthy(const Value &v) {
   return true;
 }
 
+void annotationError(const char *type, const Value &v) {
+  std::string got;
+  if (isNil(v))
+    got = "nil";
+  else if (isNumber(v))
+    got = "num";
+  else if (is<bool>(v))
+    got = "bool";
+  else if (is<LoxString>(v))
+    got = "str";
+  else if (is<std::shared_ptr<LoxInstance>>(v))
+    got = asInstance(v)->klass->name + " instance";
+  else if (is<std::shared_ptr<LoxClass>>(v))
+    got = "class";
+  else
+    got = "function";
+  throw std::runtime_error(std::string("Expected ") + type + " but got " + got +
+                           ".");
+}
+
+std::shared_ptr<LoxInstance> expectInstance(const Value &v,
+                                            const char *className) {
+  if (is<std::shared_ptr<LoxInstance>>(v)) {
+    const auto &instance = asInstance(v);
+    for (const LoxClass *klass = instance->klass.get(); klass;
+         klass = klass->superclass.get()) {
+      if (klass->name == className)
+        return instance;
+    }
+  }
+  annotationError(className, v);
+}
+
 Value add(const Value &a, const Value &b) {
-  if (is<double>(a) && is<double>(b))
+  if (bothInts(a, b)) {
+    std::int64_t sum = std::get<std::int64_t>(a) + std::get<std::int64_t>(b);
+    if (fitsExact(sum))
+      return sum;
+    return static_cast<double>(sum);
+  }
+  if (isNumber(a) && isNumber(b))
     return asNumber(a) + asNumber(b);
-  if (is<std::string>(a) && is<std::string>(b))
-    return asString(a) + asString(b);
+  if (is<LoxString>(a) && is<LoxString>(b))
+    return LoxString::concat(std::get<LoxString>(a).view(),
+                             std::get<LoxString>(b).view());
   throw std::runtime_error("Operands must be two numbers or two strings.");
 }
 
 Value subtract(const Value &a, const Value &b) {
-  if (is<double>(a) && is<double>(b))
+  if (bothInts(a, b)) {
+    std::int64_t difference =
+        std::get<std::int64_t>(a) - std::get<std::int64_t>(b);
+    if (fitsExact(difference))
+      return difference;
+    return static_cast<double>(difference);
+  }
+  if (isNumber(a) && isNumber(b))
     return asNumber(a) - asNumber(b);
   throw std::runtime_error("Operands must be two numbers or two strings.");
 }
 
 Value multiply(const Value &a, const Value &b) {
-  if (is<double>(a) && is<double>(b))
+  if (bothInts(a, b)) {
+    std::int64_t x = std::get<std::int64_t>(a);
+    std::int64_t y = std::get<std::int64_t>(b);
+    std::int64_t product;
+    // A zero product with a negative operand is -0.0 in double arithmetic.
+    if (!__builtin_mul_overflow(x, y, &product) && fitsExact(product) &&
+        (product != 0 || (x >= 0 && y >= 0)))
+      return product;
+  }
+  if (isNumber(a) && isNumber(b))
     return asNumber(a) * asNumber(b);
   throw std::runtime_error("Operands must be two numbers or two strings.");
 }
 
 Value divide(const Value &a, const Value &b) {
-  if (is<double>(a) && is<double>(b)) {
+  if (bothInts(a, b)) {
+    std::int64_t x = std::get<std::int64_t>(a);
+    std::int64_t y = std::get<std::int64_t>(b);
+    if (y != 0 && x % y == 0 && (x != 0 || y > 0))
+      return x / y;
+  }
+  if (isNumber(a) && isNumber(b)) {
     double divisor = asNumber(b);
     if (divisor == 0)
       throw std::runtime_error("Division by zero.");
@@ -59,46 +156,119 @@ Value divide(const Value &a, const Value &b) {
   throw std::runtime_error("Operands must be two numbers or two strings.");
 }
 
-Value negate(const Value &v) { return -asNumber(v); }
+Value negate(const Value &v) {
+  if (is<std::int64_t>(v) && std::get<std::int64_t>(v) != 0)
+    return -std::get<std::int64_t>(v);
+  return -asNumber(v);
+}
 
 Value notOp(const Value &v) { return !isTruthy(v); }
 
 bool equal(const Value &a, const Value &b) {
+  if (bothInts(a, b))
+    return std::get<std::int64_t>(a) == std::get<std::int64_t>(b);
+  if (isNumber(a) && isNumber(b))
+    return asNumber(a) == asNumber(b);
+  auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&a);
+  if (instance && (*instance)->klass->equalsMethod)
+    return isTruthy((*instance)->klass->equalsMethod->call({a, b}));
   if (a.index() != b.index())
     return false;
-  if (is<double>(a))
-    return asNumber(a) == asNumber(b);
-  if (is<std::string>(a))
+  if (is<LoxString>(a))
     return asString(a) == asString(b);
   if (is<bool>(a))
     return asBool(a) == asBool(b);
   if (isNil(a))
     return true;
+  if (instance)
+    return *instance == std::get<std::shared_ptr<LoxInstance>>(b);
+  if (is<std::shared_ptr<LoxClass>>(a))
+    return std::get<std::shared_ptr<LoxClass>>(a) ==
+           std::get<std::shared_ptr<LoxClass>>(b);
+  return std::get<std::shared_ptr<LoxCallable>>(a) ==
+         std::get<std::shared_ptr<LoxCallable>>(b);
+}
 
-  return false;
+// The splitmix64 finalizer, so nearby inputs land far apart.
+static std::uint64_t mixHash(std::uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return h ^ (h >> 31);
+}
+
+size_t LoxString::hash() const {
+  if (isSmall()) {
+    std::uint64_t words[kSmall / 8];
+    std::memcpy(words, small_, kSmall);
+    return mixHash(words[0] ^ mixHash(words[1] ^ mixHash(words[2] ^ size_)));
+  }
+  if (ref_.hash == 0) {
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : view())
+      h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    ref_.hash = mixHash(h) | 1;
+  }
+  return ref_.hash;
+}
+
+std::int64_t hashValue(const Value &v) {
+  std::uint64_t h;
+  if (isNumber(v)) {
+    // 0.0 for -0.0, which compares equal to it.
+    double d = asNumber(v) + 0.0;
+    std::memcpy(&h, &d, sizeof h);
+    h = mixHash(h);
+  } else if (is<LoxString>(v)) {
+    h = std::get<LoxString>(v).hash();
+  } else if (is<bool>(v)) {
+    h = asBool(v) ? 1 : 2;
+  } else if (isNil(v)) {
+    h = 0;
+  } else if (auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&v)) {
+    if (auto &method = (*instance)->klass->hashMethod)
+      return hashValue(method->call({v}));
+    h = mixHash(reinterpret_cast<std::uintptr_t>(instance->get()));
+  } else if (is<std::shared_ptr<LoxClass>>(v)) {
+    h = mixHash(reinterpret_cast<std::uintptr_t>(
+        std::get<std::shared_ptr<LoxClass>>(v).get()));
+  } else {
+    h = mixHash(reinterpret_cast<std::uintptr_t>(
+        std::get<std::shared_ptr<LoxCallable>>(v).get()));
+  }
+  return static_cast<std::int64_t>(h & (LOX_MAX_EXACT_INT - 1));
 }
 
 bool greater(const Value &a, const Value &b) {
+  if (bothInts(a, b))
+    return std::get<std::int64_t>(a) > std::get<std::int64_t>(b);
   return asNumber(a) > asNumber(b);
 }
 
 bool greater_equal(const Value &a, const Value &b) {
+  if (bothInts(a, b))
+    return std::get<std::int64_t>(a) >= std::get<std::int64_t>(b);
   return asNumber(a) >= asNumber(b);
 }
 
-bool less(const Value &a, const Value &b) { return asNumber(a) < asNumber(b); }
+bool less(const Value &a, const Value &b) {
+  if (bothInts(a, b))
+    return std::get<std::int64_t>(a) < std::get<std::int64_t>(b);
+  return asNumber(a) < asNumber(b);
+}
 
 bool less_equal(const Value &a, const Value &b) {
+  if (bothInts(a, b))
+    return std::get<std::int64_t>(a) <= std::get<std::int64_t>(b);
   return asNumber(a) <= asNumber(b);
 }
 
 bool not_equal(const Value &a, const Value &b) { return !equal(a, b); }
 
 void print(const Value &v) {
-  if (is<double>(v))
+  if (isNumber(v))
     std::cout << asNumber(v);
-  else if (is<std::string>(v))
-    std::cout << asString(v);
+  else if (is<LoxString>(v))
+    std::cout << asString(v).view();
   else if (is<bool>(v))
     std::cout << (asBool(v) ? "true" : "false");
   else if (isNil(v))
@@ -120,35 +290,2141 @@ void print(const Value &v) {
   std::cout << std::endl;
 }
 
+// Position of `needle` in `haystack`, or npos. Single bytes go to memchr;
+// longer needles are filtered 16 positions at a time on their first and last
+// byte, and only the candidates that match both are compared in full.
+static size_t findBytes(std::string_view haystack, std::string_view needle) {
+  if (needle.empty())
+    return 0;
+  if (needle.size() > haystack.size())
+    return std::string_view::npos;
+  if (needle.size() == 1) {
+    const void *hit = std::memchr(haystack.data(), needle[0], haystack.size());
+    return hit ? static_cast<const char *>(hit) - haystack.data()
+               : std::string_view::npos;
+  }
+  size_t i = 0;
+#ifdef __SSE2__
+  const size_t last = needle.size() - 1;
+  const size_t starts = haystack.size() - last;
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i final = _mm_set1_epi8(needle[last]);
+  for (; i + 16 <= starts; i += 16) {
+    __m128i head = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(haystack.data() + i));
+    __m128i tail = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(haystack.data() + i + last));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, final))));
+    while (mask) {
+      size_t at = i + static_cast<size_t>(__builtin_ctz(mask));
+      if (std::memcmp(haystack.data() + at + 1, needle.data() + 1, last - 1) == 0)
+        return at;
+      mask &= mask - 1;
+    }
+  }
+#endif
+  size_t rest = haystack.substr(i).find(needle);
+  return rest == std::string_view::npos ? rest : i + rest;
+}
+
+// A string index in [0, limit], as a size_t.
+static size_t stringIndex(const Value &v, size_t limit) {
+  double i = asNumber(v);
+  if (i < 0 || i > static_cast<double>(limit) || i != std::floor(i))
+    throw std::runtime_error("String index out of range.");
+  return static_cast<size_t>(i);
+}
+
+Value stringLength(const Value &s) {
+  return static_cast<std::int64_t>(asString(s).size());
+}
+
+Value stringIndexOf(const Value &s, const Value &needle) {
+  size_t at = findBytes(asString(s).view(), asString(needle).view());
+  if (at == std::string_view::npos)
+    return std::int64_t(-1);
+  return static_cast<std::int64_t>(at);
+}
+
+Value stringStartsWith(const Value &s, const Value &prefix) {
+  std::string_view text = asString(s).view();
+  std::string_view head = asString(prefix).view();
+  return text.substr(0, head.size()) == head;
+}
+
+Value stringSubstring(const Value &s, const Value &start, const Value &end) {
+  const LoxString &text = asString(s);
+  size_t to = stringIndex(end, text.size());
+  size_t from = stringIndex(start, to);
+  return text.slice(from, to - from);
+}
+
+Value stringTrim(const Value &s) {
+  const LoxString &text = asString(s);
+  size_t from = 0, to = text.size();
+  while (from < to && std::isspace(static_cast<unsigned char>(text.data()[from])))
+    from++;
+  while (to > from && std::isspace(static_cast<unsigned char>(text.data()[to - 1])))
+    to--;
+  return text.slice(from, to - from);
+}
+
+Value stringCharAt(const Value &s, const Value &index) {
+  const LoxString &text = asString(s);
+  if (text.size() == 0)
+    throw std::runtime_error("String index out of range.");
+  return text.slice(stringIndex(index, text.size() - 1), 1);
+}
+
+Value stringSplit(const Value &s, const Value &separator) {
+  const LoxString &text = asString(s);
+  std::string_view sep = asString(separator).view();
+  if (sep.empty())
+    throw std::runtime_error("Separator must not be empty.");
+
+  auto list = std::make_shared<LoxList>(nativeClass("List"));
+  std::string_view rest = text.view();
+  size_t offset = 0;
+  for (size_t at; (at = findBytes(rest, sep)) != std::string_view::npos;) {
+    list->items.push_back(text.slice(offset, at));
+    rest.remove_prefix(at + sep.size());
+    offset += at + sep.size();
+  }
+  list->items.push_back(text.slice(offset, rest.size()));
+  return std::static_pointer_cast<LoxInstance>(list);
+}
+
+// Longest output: "-1.7976931348623157e+308".
+constexpr size_t kNumberChars = 32;
+
+static size_t formatNumber(char *out, const Value &number) {
+  std::to_chars_result result;
+  if (is<std::int64_t>(number)) {
+    result = std::to_chars(out, out + kNumberChars, std::get<std::int64_t>(number));
+  } else {
+    double d = asNumber(number);
+    if (d == std::floor(d) && std::fabs(d) <= LOX_MAX_EXACT_INT)
+      result = std::to_chars(out, out + kNumberChars, static_cast<std::int64_t>(d));
+    else
+      result = std::to_chars(out, out + kNumberChars, d);
+  }
+  return static_cast<size_t>(result.ptr - out);
+}
+
+// The number `text` spells as a plain decimal, or nil.
+static Value parseDecimal(std::string_view text) {
+  const char *first = text.data();
+  const char *last = first + text.size();
+  // from_chars also takes "inf" and "nan"; Lox numbers are plain decimals.
+  const char *digits = first != last && *first == '-' ? first + 1 : first;
+  if (digits == last || !(std::isdigit(static_cast<unsigned char>(*digits)) || *digits == '.'))
+    return nullptr;
+
+  double d;
+  auto result = std::from_chars(first, last, d);
+  if (result.ec != std::errc() || result.ptr != last)
+    return nullptr;
+  if (d == std::floor(d) && std::fabs(d) <= LOX_MAX_EXACT_INT && !(d == 0 && std::signbit(d)))
+    return static_cast<std::int64_t>(d);
+  return d;
+}
+
+Value parseNumber(const Value &text) { return parseDecimal(asString(text).view()); }
+
+Value numberToString(const Value &number) {
+  char buffer[kNumberChars];
+  return LoxString(std::string_view(buffer, formatNumber(buffer, number)));
+}
+
+Value concatNumber(const Value &prefix, const Value &number) {
+  const LoxString &head = asString(prefix);
+  LoxString result;
+  char *out = result.reserve(head.size() + kNumberChars);
+  std::memcpy(out, head.data(), head.size());
+  result.truncate(head.size() + formatNumber(out + head.size(), number));
+  return result;
+}
+
+Value numberConcat(const Value &number, const Value &suffix) {
+  const LoxString &tail = asString(suffix);
+  LoxString result;
+  char *out = result.reserve(kNumberChars + tail.size());
+  size_t length = formatNumber(out, number);
+  std::memcpy(out + length, tail.data(), tail.size());
+  result.truncate(length + tail.size());
+  return result;
+}
+
+namespace {
+
+// The automaton for `match`, built exactly as RegexDfa.kt builds it for the
+// interpreter and for literal patterns in the C++ emitter: a Thompson NFA
+// over bytes, then subset construction. `transitions[state * 256 + byte]`
+// is the next state, or -1 once no match is possible.
+struct Dfa {
+  std::vector<int> transitions;
+  std::vector<char> accepting;
+  bool anchoredEnd = false;
+};
+
+using ByteSet = std::bitset<256>;
+using StateSet = std::vector<bool>;
+
+struct Fragment {
+  int start, end;
+};
+
+class RegexCompiler {
+public:
+  RegexCompiler(std::string_view pattern) : p(pattern) {}
+
+  Dfa compile() {
+    size_t to = p.size();
+    bool anchoredStart = to > 0 && p[0] == '^';
+    if (anchoredStart)
+      pos = 1;
+    bool anchoredEnd = to > pos && p[to - 1] == '$' && !escaped(to - 1);
+    if (anchoredEnd)
+      to--;
+    end = to;
+
+    Fragment fragment = alternation();
+    if (pos != end)
+      invalid();
+    return determinize(fragment, anchoredStart, anchoredEnd);
+  }
+
+private:
+  static constexpr size_t kMaxStates = 4096;
+
+  std::string_view p;
+  size_t pos = 0, end = 0;
+  std::vector<ByteSet> bytes;
+  std::vector<bool> hasBytes;
+  std::vector<int> next;
+  std::vector<std::vector<int>> epsilons;
+
+  [[noreturn]] static void invalid() {
+    throw std::runtime_error("Invalid pattern.");
+  }
+
+  bool escaped(size_t index) const {
+    size_t count = 0;
+    while (index >= pos + count + 1 && p[index - count - 1] == '\\')
+      count++;
+    return count % 2 == 1;
+  }
+
+  int state() {
+    bytes.emplace_back();
+    hasBytes.push_back(false);
+    next.push_back(-1);
+    epsilons.emplace_back();
+    return static_cast<int>(next.size()) - 1;
+  }
+
+  Fragment empty() {
+    int s = state();
+    return {s, s};
+  }
+
+  Fragment set(const ByteSet &set) {
+    int start = state(), finish = state();
+    bytes[start] = set;
+    hasBytes[start] = true;
+    next[start] = finish;
+    return {start, finish};
+  }
+
+  Fragment concat(Fragment a, Fragment b) {
+    epsilons[a.end].push_back(b.start);
+    return {a.start, b.end};
+  }
+
+  Fragment alternate(Fragment a, Fragment b) {
+    int start = state(), finish = state();
+    epsilons[start].insert(epsilons[start].end(), {a.start, b.start});
+    epsilons[a.end].push_back(finish);
+    epsilons[b.end].push_back(finish);
+    return {start, finish};
+  }
+
+  Fragment star(Fragment a) {
+    int start = state(), finish = state();
+    epsilons[start].insert(epsilons[start].end(), {a.start, finish});
+    epsilons[a.end].insert(epsilons[a.end].end(), {a.start, finish});
+    return {start, finish};
+  }
+
+  Fragment plus(Fragment a) {
+    int finish = state();
+    epsilons[a.end].insert(epsilons[a.end].end(), {a.start, finish});
+    return {a.start, finish};
+  }
+
+  Fragment optional(Fragment a) {
+    int start = state(), finish = state();
+    epsilons[start].insert(epsilons[start].end(), {a.start, finish});
+    epsilons[a.end].push_back(finish);
+    return {start, finish};
+  }
+
+  bool peek(char c) const { return pos < end && p[pos] == c; }
+
+  Fragment alternation() {
+    Fragment fragment = concatenation();
+    while (peek('|')) {
+      pos++;
+      Fragment right = concatenation();
+      fragment = alternate(fragment, right);
+    }
+    return fragment;
+  }
+
+  Fragment concatenation() {
+    bool any = false;
+    Fragment fragment{};
+    while (pos < end && !peek('|') && !peek(')')) {
+      Fragment piece = repetition();
+      fragment = any ? concat(fragment, piece) : piece;
+      any = true;
+    }
+    return any ? fragment : empty();
+  }
+
+  Fragment repetition() {
+    Fragment fragment = atom();
+    for (;; pos++) {
+      if (peek('*'))
+        fragment = star(fragment);
+      else if (peek('+'))
+        fragment = plus(fragment);
+      else if (peek('?'))
+        fragment = optional(fragment);
+      else
+        return fragment;
+    }
+  }
+
+  Fragment atom() {
+    unsigned char c = static_cast<unsigned char>(p[pos++]);
+    switch (c) {
+    case '(': {
+      Fragment inner = alternation();
+      if (!peek(')'))
+        invalid();
+      pos++;
+      return inner;
+    }
+    case '[':
+      return set(charClass());
+    case '.':
+      return set(ByteSet().set().reset('\n'));
+    case '\\':
+      return set(escape());
+    case '*':
+    case '+':
+    case '?':
+      invalid();
+    default:
+      return set(ByteSet().set(c));
+    }
+  }
+
+  ByteSet charClass() {
+    ByteSet set;
+    bool negated = peek('^');
+    if (negated)
+      pos++;
+    for (bool first = true;; first = false) {
+      if (pos >= end)
+        invalid();
+      if (peek(']') && !first)
+        break;
+      if (peek('\\')) {
+        pos++;
+        set |= escape();
+        continue;
+      }
+      unsigned char low = static_cast<unsigned char>(p[pos++]);
+      if (peek('-') && pos + 1 < end && p[pos + 1] != ']') {
+        unsigned char high = static_cast<unsigned char>(p[pos + 1]);
+        if (high < low)
+          invalid();
+        for (int b = low; b <= high; b++)
+          set.set(b);
+        pos += 2;
+      } else {
+        set.set(low);
+      }
+    }
+    pos++;
+    return negated ? ~set : set;
+  }
+
+  ByteSet escape() {
+    if (pos >= end)
+      invalid();
+    unsigned char c = static_cast<unsigned char>(p[pos++]);
+    ByteSet set;
+    switch (std::tolower(c)) {
+    case 'd':
+      for (int b = '0'; b <= '9'; b++)
+        set.set(b);
+      break;
+    case 'w':
+      for (int b = 0; b < 256; b++)
+        if (std::isalnum(b) || b == '_')
+          set.set(b);
+      break;
+    case 's':
+      set.set(' ');
+      for (int b = '\t'; b <= '\r'; b++)
+        set.set(b);
+      break;
+    default:
+      return set.set(c == 'n' ? '\n' : c == 't' ? '\t' : c);
+    }
+    return std::isupper(c) ? ~set : set;
+  }
+
+  StateSet closure(StateSet states) const {
+    std::vector<int> stack;
+    for (size_t s = 0; s < states.size(); s++)
+      if (states[s])
+        stack.push_back(static_cast<int>(s));
+    while (!stack.empty()) {
+      int s = stack.back();
+      stack.pop_back();
+      for (int target : epsilons[s]) {
+        if (!states[target]) {
+          states[target] = true;
+          stack.push_back(target);
+        }
+      }
+    }
+    return states;
+  }
+
+  Dfa determinize(Fragment fragment, bool anchoredStart, bool anchoredEnd) {
+    StateSet initial(next.size());
+    initial[fragment.start] = true;
+    StateSet start = closure(initial);
+
+    std::vector<StateSet> sets = {start};
+    std::map<StateSet, int> index = {{start, 0}};
+    Dfa dfa;
+    dfa.anchoredEnd = anchoredEnd;
+
+    for (size_t current = 0; current < sets.size(); current++) {
+      StateSet set = sets[current];
+      bool accepts = set[fragment.end];
+      dfa.accepting.push_back(accepts);
+      for (int byte = 0; byte < 256; byte++) {
+        if (accepts && !anchoredEnd) {
+          dfa.transitions.push_back(-1);
+          continue;
+        }
+        StateSet moved(next.size());
+        bool any = false;
+        for (size_t s = 0; s < set.size(); s++) {
+          if (set[s] && hasBytes[s] && bytes[s][byte]) {
+            moved[next[s]] = true;
+            any = true;
+          }
+        }
+        StateSet target = any ? closure(moved) : moved;
+        if (!anchoredStart) {
+          for (size_t s = 0; s < target.size(); s++)
+            if (start[s])
+              target[s] = true;
+        }
+        if (std::find(target.begin(), target.end(), true) == target.end()) {
+          dfa.transitions.push_back(-1);
+          continue;
+        }
+        auto it = index.find(target);
+        if (it == index.end()) {
+          if (sets.size() == kMaxStates)
+            throw std::runtime_error("Pattern is too complex.");
+          it = index.emplace(target, static_cast<int>(sets.size())).first;
+          sets.push_back(target);
+        }
+        dfa.transitions.push_back(it->second);
+      }
+    }
+    return dfa;
+  }
+};
+
+bool runDfa(const Dfa &dfa, std::string_view text) {
+  const int *transitions = dfa.transitions.data();
+  const char *accepting = dfa.accepting.data();
+  int state = 0;
+  if (dfa.anchoredEnd) {
+    for (unsigned char byte : text) {
+      state = transitions[state * 256 + byte];
+      if (state < 0)
+        return false;
+    }
+    return accepting[state];
+  }
+  if (accepting[state])
+    return true;
+  for (unsigned char byte : text) {
+    state = transitions[state * 256 + byte];
+    if (state < 0)
+      return false;
+    if (accepting[state])
+      return true;
+  }
+  return false;
+}
+
+} // namespace
+
+Value matchPattern(const Value &pattern, const Value &text) {
+  static std::unordered_map<std::string, Dfa> compiled;
+  // Loops usually apply one pattern over and over; skip the lookup then.
+  static const std::pair<const std::string, Dfa> *last = nullptr;
+  std::string_view key = asString(pattern).view();
+  std::string_view subject = asString(text).view();
+  if (!last || last->first != key) {
+    auto it = compiled.find(std::string(key));
+    if (it == compiled.end())
+      it = compiled.emplace(key, RegexCompiler(key).compile()).first;
+    last = &*it;
+  }
+  return runDfa(last->second, subject);
+}
+
+ConcatPiece numberPiece(const Value &number) {
+  ConcatPiece piece(number);
+  piece.number = true;
+  return piece;
+}
+
+Value concatStrings(std::initializer_list<ConcatPiece> pieces) {
+  auto isText = [](const ConcatPiece &piece) {
+    return piece.isLiteral || piece.number || is<LoxString>(piece.value());
+  };
+  size_t bound = 0;
+  const ConcatPiece *first = pieces.begin();
+  for (const ConcatPiece &piece : pieces) {
+    if (piece.isLiteral) {
+      bound += piece.literal.size();
+    } else if (piece.number) {
+      if (!isNumber(piece.value()))
+        throw std::runtime_error("Operand must be a number.");
+      bound += kNumberChars;
+    } else if (is<LoxString>(piece.value())) {
+      bound += std::get<LoxString>(piece.value()).size();
+    }
+    // add(left, piece) checks both operands once the right one is evaluated.
+    if (&piece != first && (!isText(piece) || !isText(*first)))
+      throw std::runtime_error("Operands must be two numbers or two strings.");
+  }
+
+  LoxString result;
+  char *out = result.reserve(bound);
+  size_t length = 0;
+  for (const ConcatPiece &piece : pieces) {
+    if (piece.number) {
+      length += formatNumber(out + length, piece.value());
+      continue;
+    }
+    std::string_view text =
+        piece.isLiteral ? piece.literal : std::get<LoxString>(piece.value()).view();
+    std::memcpy(out + length, text.data(), text.size());
+    length += text.size();
+  }
+  result.truncate(length);
+  return result;
+}
+
+std::shared_ptr<LoxCallable> nativeFunction(const std::string &name) {
+  using Unary = double (*)(double);
+  using Binary = double (*)(double, double);
+  auto unary = [](Unary fn) {
+    return std::make_shared<LoxFunction>(1, [fn](const std::vector<Value> &args) -> Value {
+      return fn(asNumber(args[0]));
+    });
+  };
+  auto binary = [](Binary fn) {
+    return std::make_shared<LoxFunction>(2, [fn](const std::vector<Value> &args) -> Value {
+      return fn(asNumber(args[0]), asNumber(args[1]));
+    });
+  };
+
+  static const std::unordered_map<std::string, std::shared_ptr<LoxCallable>> natives = {
+      {"sqrt", unary(std::sqrt)},   {"floor", unary(std::floor)},
+      {"ceil", unary(std::ceil)},   {"abs", unary(std::fabs)},
+      {"min", binary(std::fmin)},   {"max", binary(std::fmax)},
+      {"pow", binary(std::pow)},    {"exp", unary(std::exp)},
+      {"log", unary(std::log)},     {"sin", unary(std::sin)},
+      {"cos", unary(std::cos)},     {"atan2", binary(std::atan2)},
+      {"fma", std::make_shared<LoxFunction>(3, [](const std::vector<Value> &args) -> Value {
+         return std::fma(asNumber(args[0]), asNumber(args[1]), asNumber(args[2]));
+       })},
+      {"parseNumber", std::make_shared<LoxFunction>(1, [](const std::vector<Value> &args) {
+         return parseNumber(args[0]);
+       })},
+      {"toString", std::make_shared<LoxFunction>(1, [](const std::vector<Value> &args) {
+         return numberToString(args[0]);
+       })},
+      {"hash", std::make_shared<LoxFunction>(1, [](const std::vector<Value> &args) -> Value {
+         return hashValue(args[0]);
+       })},
+      {"len", std::make_shared<LoxFunction>(1, [](const std::vector<Value> &args) {
+         return stringLength(args[0]);
+       })},
+      {"indexOf", std::make_shared<LoxFunction>(2, [](const std::vector<Value> &args) {
+         return stringIndexOf(args[0], args[1]);
+       })},
+      {"startsWith", std::make_shared<LoxFunction>(2, [](const std::vector<Value> &args) {
+         return stringStartsWith(args[0], args[1]);
+       })},
+      {"substring", std::make_shared<LoxFunction>(3, [](const std::vector<Value> &args) {
+         return stringSubstring(args[0], args[1], args[2]);
+       })},
+      {"trim", std::make_shared<LoxFunction>(1, [](const std::vector<Value> &args) {
+         return stringTrim(args[0]);
+       })},
+      {"charAt", std::make_shared<LoxFunction>(2, [](const std::vector<Value> &args) {
+         return stringCharAt(args[0], args[1]);
+       })},
+      {"split", std::make_shared<LoxFunction>(2, [](const std::vector<Value> &args) {
+         return stringSplit(args[0], args[1]);
+       })},
+      {"match", std::make_shared<LoxFunction>(2, [](const std::vector<Value> &args) {
+         return matchPattern(args[0], args[1]);
+       })},
+      {"writeValue", std::make_shared<LoxFunction>(2, [](const std::vector<Value> &args) {
+         return writeValue(args[0], args[1]);
+       })},
+      {"readValue", std::make_shared<LoxFunction>(1, [](const std::vector<Value> &args) {
+         return readValue(args[0]);
+       })},
+      {"buildTable", std::make_shared<LoxFunction>(3, [](const std::vector<Value> &args) {
+         return buildTable(args[0], args[1], args[2]);
+       })},
+  };
+
+  auto it = natives.find(name);
+  if (it == natives.end())
+    throw std::runtime_error("Undefined variable '" + name + "'.");
+  return it->second;
+}
+
 Value LoxInstance::get(const std::string &name) {
+  Value slot;
+  if (klass->fixedLayout && getSlot(name, slot))
+    return slot;
   auto it = fields.find(name);
   if (it != fields.end())
     return it->second;
-  auto methodIt = klass->methods.find(name);
-  if (methodIt != klass->methods.end()) {
-    auto bound =
-        std::make_shared<LoxBoundMethod>(methodIt->second, shared_from_this());
+  if (auto method = klass->findMethod(name)) {
+    auto bound = std::make_shared<LoxBoundMethod>(method, shared_from_this());
     return std::static_pointer_cast<LoxCallable>(bound);
   }
   throw std::runtime_error("Undefined property '" + name + "'.");
 }
 
 void LoxInstance::set(const std::string &name, const Value &value) {
-  fields[name] = value;
+  if (!klass->fixedLayout)
+    fields[name] = value;
+  else if (!setSlot(name, value))
+    throw std::runtime_error("Undefined field '" + name + "'.");
+}
+
+static std::unordered_map<std::string, LoxClass *> &classRegistry() {
+  // Never destroyed, so classes in other statics can still unregister.
+  static auto *registry = new std::unordered_map<std::string, LoxClass *>();
+  return *registry;
+}
+
+LoxClass::LoxClass(
+    const std::string &n, std::shared_ptr<LoxClass> sup,
+    const std::unordered_map<std::string, std::shared_ptr<LoxCallable>> &m)
+    : name(n), superclass(sup), methods(m),
+      fixedLayout(sup && sup->fixedLayout) {
+  equalsMethod = findMethod("equals");
+  hashMethod = findMethod("hash");
+  classRegistry()[name] = this;
+}
+
+LoxClass::~LoxClass() {
+  auto it = classRegistry().find(name);
+  if (it != classRegistry().end() && it->second == this)
+    classRegistry().erase(it);
+}
+
+std::shared_ptr<LoxClass> LoxClass::named(const std::string &name) {
+  auto it = classRegistry().find(name);
+  return it == classRegistry().end() ? nullptr : it->second->shared_from_this();
+}
+
+std::shared_ptr<LoxCallable>
+LoxClass::findMethod(const std::string &name) const {
+  for (const LoxClass *klass = this; klass; klass = klass->superclass.get()) {
+    auto it = klass->methods.find(name);
+    if (it != klass->methods.end())
+      return it->second;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<LoxBoundMethod>
+bindSuper(const std::shared_ptr<LoxClass> &superclass, const std::string &name,
+          const std::shared_ptr<LoxInstance> &self) {
+  auto method = superclass->findMethod(name);
+  if (!method)
+    throw std::runtime_error("Undefined property '" + name + "'.");
+  return std::make_shared<LoxBoundMethod>(method, self);
+}
+
+Value invokeMethod(const std::string &name, const LoxClass *klass,
+                   LoxFunction &method, std::vector<Value> args) {
+  auto instance = asInstance(args[0]);
+  if (instance->klass.get() == klass &&
+      (instance->fields.empty() || !instance->fields.count(name)))
+    return method.invoke(args);
+
+  args.erase(args.begin());
+  Value callee = instance->get(name);
+  auto *callable = std::get_if<std::shared_ptr<LoxCallable>>(&callee);
+  if (!callable)
+    throw std::runtime_error("Not callable: " + name);
+  return (*callable)->call(args);
 }
 
 int LoxClass::arity() const {
-  auto init = methods.find("init");
-  return (init != methods.end()) ? init->second->arity() : 0;
+  auto init = findMethod("init");
+  return init ? init->arity() : 0;
+}
+
+std::shared_ptr<LoxInstance>
+LoxClass::instantiate(const std::vector<Value> &) {
+  return allocate(shared_from_this());
+}
+
+std::shared_ptr<LoxInstance>
+LoxClass::allocate(const std::shared_ptr<LoxClass> &klass) {
+  return superclass ? superclass->allocate(klass)
+                    : std::make_shared<LoxInstance>(klass);
 }
 
 Value LoxClass::call(const std::vector<Value> &args) {
-  auto instance = std::make_shared<LoxInstance>(shared_from_this());
+  auto instance = instantiate(args);
 
-  auto init = methods.find("init");
-  if (init != methods.end()) {
-    auto boundInit = std::make_shared<LoxBoundMethod>(init->second, instance);
+  if (auto init = findMethod("init")) {
+    auto boundInit = std::make_shared<LoxBoundMethod>(init, instance);
     boundInit->call(args);
   }
   return Value(instance);
 }
+
+std::shared_ptr<LoxInstance>
+LoxNativeClass::instantiate(const std::vector<Value> &args) {
+  if (static_cast<int>(args.size()) != argCount)
+    throw std::runtime_error("Expected " + std::to_string(argCount) +
+                             " arguments but got " +
+                             std::to_string(args.size()) + ".");
+  return factory(shared_from_this(), args);
+}
+
+std::vector<std::shared_ptr<LoxInstance>>
+allocateSnapshot(const std::vector<std::shared_ptr<LoxClass>> &classes,
+                 const std::uint32_t *kinds, size_t count) {
+  static const auto listClass = nativeClass("List");
+  static const auto bufferClass = nativeClass("Buffer");
+
+  std::vector<std::shared_ptr<LoxInstance>> objects;
+  objects.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    const auto &klass = classes[kinds[i]];
+    if (klass == listClass)
+      objects.push_back(std::make_shared<LoxList>(klass));
+    else if (klass == bufferClass)
+      objects.push_back(std::make_shared<LoxBuffer>(klass, 0));
+    else
+      objects.push_back(klass->allocate(klass));
+  }
+  return objects;
+}
+
+static Value
+snapshotEntryValue(const SnapshotEntry &entry,
+                   const std::vector<std::shared_ptr<LoxInstance>> &objects,
+                   const std::vector<Value> &refs) {
+  switch (entry.kind) {
+  case 'b':
+    return entry.number != 0;
+  case 'i':
+    return static_cast<std::int64_t>(entry.number);
+  case 'd':
+    return entry.number;
+  case 's':
+    return LoxString(std::string_view(entry.text, entry.length));
+  case 'o':
+    return objects[static_cast<size_t>(entry.number)];
+  case 'r':
+    return refs[static_cast<size_t>(entry.number)];
+  default:
+    return nullptr;
+  }
+}
+
+void loadSnapshot(const std::vector<std::shared_ptr<LoxInstance>> &objects,
+                  const std::vector<Value> &refs,
+                  const SnapshotEntry *entries, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const SnapshotEntry &entry = entries[i];
+    LoxInstance &object = *objects[entry.object];
+    Value value = snapshotEntryValue(entry, objects, refs);
+    if (entry.field)
+      object.set(entry.field, value);
+    else if (auto *list = dynamic_cast<LoxList *>(&object))
+      list->items.push_back(std::move(value));
+    else
+      static_cast<LoxBuffer &>(object).data.push_back(asNumber(value));
+  }
+}
+
+// ---------- Random ----------
+
+// Four interleaved xoshiro256** lanes, stored word-major so fill() can step
+// all lanes at once with SIMD. Sample i always comes from lane i % 4, so
+// fill() and next() produce the same stream, matching the interpreter.
+namespace {
+
+constexpr int kLanes = 4;
+
+struct LoxRandom : LoxInstance {
+  alignas(32) std::uint64_t s[4][kLanes];
+  int lane = 0;
+
+  using LoxInstance::LoxInstance;
+};
+
+inline std::uint64_t rotl(std::uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+inline std::uint64_t step(std::uint64_t (&s)[4][kLanes], int l) {
+  std::uint64_t result = rotl(s[1][l] * 5, 7) * 9;
+  std::uint64_t t = s[1][l] << 17;
+  s[2][l] ^= s[0][l];
+  s[3][l] ^= s[1][l];
+  s[1][l] ^= s[2][l];
+  s[0][l] ^= s[3][l];
+  s[2][l] ^= t;
+  s[3][l] = rotl(s[3][l], 45);
+  return result;
+}
+
+// 52 random mantissa bits under the exponent of 1.0 give [1, 2).
+inline double toUnit(std::uint64_t bits) {
+  std::uint64_t pattern = (bits >> 12) | 0x3ff0000000000000ull;
+  double d;
+  std::memcpy(&d, &pattern, sizeof d);
+  return d - 1.0;
+}
+
+double nextRandom(LoxRandom &r) {
+  double d = toUnit(step(r.s, r.lane));
+  r.lane = (r.lane + 1) % kLanes;
+  return d;
+}
+
+void fillRandom(LoxRandom &r, double *out, size_t n) {
+  size_t i = 0;
+  while (i < n && r.lane != 0)
+    out[i++] = nextRandom(r);
+  for (; i + kLanes <= n; i += kLanes) {
+    for (int l = 0; l < kLanes; l++)
+      out[i + l] = toUnit(step(r.s, l));
+  }
+  while (i < n)
+    out[i++] = nextRandom(r);
+}
+
+// The child continues this stream; the parent jumps 2^128 steps on every lane.
+std::shared_ptr<LoxRandom> splitRandom(LoxRandom &r) {
+  static const std::uint64_t jump[] = {0x180ec6d33cfd0abaull,
+                                       0xd5a61266f0c9392cull,
+                                       0xa9582618e03fc9aaull,
+                                       0x39abdc4529b1661cull};
+  auto child = std::make_shared<LoxRandom>(r.klass);
+  std::memcpy(child->s, r.s, sizeof r.s);
+  child->lane = r.lane;
+
+  for (int l = 0; l < kLanes; l++) {
+    std::uint64_t jumped[4] = {0, 0, 0, 0};
+    for (std::uint64_t word : jump) {
+      for (int bit = 0; bit < 64; bit++) {
+        if (word & (std::uint64_t(1) << bit)) {
+          for (int w = 0; w < 4; w++)
+            jumped[w] ^= r.s[w][l];
+        }
+        step(r.s, l);
+      }
+    }
+    for (int w = 0; w < 4; w++)
+      r.s[w][l] = jumped[w];
+  }
+  return child;
+}
+
+std::shared_ptr<LoxRandom> seededRandom(std::shared_ptr<LoxClass> klass,
+                                        std::int64_t seed) {
+  auto random = std::make_shared<LoxRandom>(klass);
+  std::uint64_t x = static_cast<std::uint64_t>(seed);
+  for (int l = 0; l < kLanes; l++) {
+    for (int w = 0; w < 4; w++) {
+      std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      random->s[w][l] = z ^ (z >> 31);
+    }
+  }
+  return random;
+}
+
+template <typename T> T &receiver(const std::vector<Value> &args) {
+  return static_cast<T &>(*std::get<std::shared_ptr<LoxInstance>>(args[0]));
+}
+
+LoxBuffer &bufferArgument(const Value &v) {
+  auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&v);
+  auto *buffer = instance ? dynamic_cast<LoxBuffer *>(instance->get()) : nullptr;
+  if (!buffer)
+    throw std::runtime_error("Argument must be a Buffer.");
+  return *buffer;
+}
+
+size_t listIndex(const Value &v, size_t size) {
+  double i = asNumber(v);
+  if (i < 0 || i >= static_cast<double>(size) || i != std::floor(i))
+    throw std::runtime_error("List index out of range.");
+  return static_cast<size_t>(i);
+}
+
+size_t bufferIndex(const Value &v, size_t size) {
+  double i = asNumber(v);
+  if (i < 0 || i >= static_cast<double>(size) || i != std::floor(i))
+    throw std::runtime_error("Buffer index out of range.");
+  return static_cast<size_t>(i);
+}
+
+using Body = std::function<Value(const std::vector<Value> &)>;
+
+std::shared_ptr<LoxCallable> method(int arity, Body body) {
+  return std::make_shared<LoxFunction>(arity + 1, std::move(body));
+}
+
+} // namespace
+
+// ---------- CSV ----------
+
+// CsvReader(path, columns) walks a file one record per next() call. The file
+// is mapped once and shared with every field longer than LoxString::kSmall,
+// so those are slices of the mapping; shorter fields are copied inline.
+// Unquoted fields that read as plain decimals become numbers.
+namespace {
+
+struct MappedFile : LoxString::Buffer {
+  const char *data = nullptr;
+  size_t size = 0;
+};
+
+void destroyMappedFile(LoxString::Buffer *buffer) {
+  auto *file = static_cast<MappedFile *>(buffer);
+  if (file->size > 0) {
+#ifdef LOX_HAVE_MMAP
+    munmap(const_cast<char *>(file->data), file->size);
+#elif defined(_WIN32)
+    UnmapViewOfFile(file->data);
+#else
+    delete[] file->data;
+#endif
+  }
+  delete file;
+}
+
+MappedFile *mapFile(const std::string &path) {
+  auto *file = new MappedFile();
+  file->refs = 1;
+  file->destroy = destroyMappedFile;
+  bool ok = false;
+#ifdef LOX_HAVE_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd >= 0 && fstat(fd, &info) == 0) {
+    file->size = static_cast<size_t>(info.st_size);
+    ok = true;
+    if (file->size > 0) {
+      void *data = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        file->size = 0;
+        ok = false;
+      } else {
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = static_cast<const char *>(data);
+      }
+    }
+  }
+  if (fd >= 0)
+    close(fd);
+#elif defined(_WIN32)
+  HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  LARGE_INTEGER info;
+  if (handle != INVALID_HANDLE_VALUE && GetFileSizeEx(handle, &info)) {
+    file->size = static_cast<size_t>(info.QuadPart);
+    ok = true;
+    if (file->size > 0) {
+      // The view keeps the file mapped once both handles are closed.
+      HANDLE mapping =
+          CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      void *data =
+          mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+      if (mapping)
+        CloseHandle(mapping);
+      if (!data) {
+        file->size = 0;
+        ok = false;
+      } else {
+        file->data = static_cast<const char *>(data);
+      }
+    }
+  }
+  if (handle != INVALID_HANDLE_VALUE)
+    CloseHandle(handle);
+#else
+  if (std::FILE *in = std::fopen(path.c_str(), "rb")) {
+    std::fseek(in, 0, SEEK_END);
+    long size = std::ftell(in);
+    std::fseek(in, 0, SEEK_SET);
+    if (size >= 0) {
+      char *data = new char[size > 0 ? size : 1];
+      ok = std::fread(data, 1, size, in) == static_cast<size_t>(size);
+      file->data = data;
+      file->size = ok ? static_cast<size_t>(size) : 0;
+      if (!ok)
+        delete[] data;
+    }
+    std::fclose(in);
+  }
+#endif
+  if (!ok) {
+    destroyMappedFile(file);
+    throw std::runtime_error("Could not open file '" + path + "'.");
+  }
+  return file;
+}
+
+struct LoxCsvReader : LoxInstance {
+  MappedFile *file;
+  size_t offset = 0;
+  // Output position of each column, or -1 to skip it. Empty reads them all.
+  std::vector<int> slots;
+  size_t width = 0;
+
+  LoxCsvReader(std::shared_ptr<LoxClass> k, MappedFile *f)
+      : LoxInstance(k), file(f) {}
+  ~LoxCsvReader() override {
+    if (--file->refs == 0)
+      file->destroy(file);
+  }
+};
+
+// First ',', '"', '\n' or '\r' at or after `p`, sixteen bytes per step.
+const char *nextSpecial(const char *p, const char *end) {
+#ifdef __SSE2__
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i hits =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma),
+                                  _mm_cmpeq_epi8(chunk, quote)),
+                     _mm_or_si128(_mm_cmpeq_epi8(chunk, lf),
+                                  _mm_cmpeq_epi8(chunk, cr)));
+    if (int mask = _mm_movemask_epi8(hits))
+      return p + __builtin_ctz(static_cast<unsigned>(mask));
+  }
+#endif
+  while (p < end && *p != ',' && *p != '"' && *p != '\n' && *p != '\r')
+    p++;
+  return p;
+}
+
+// Reads the field at `p`, leaving `p` on the delimiter or line break after
+// it. The value is only built when `wanted`.
+Value readField(MappedFile *file, const char *&p, const char *end,
+                bool wanted) {
+  if (p == end || *p != '"') {
+    const char *start = p;
+    // A quote inside an unquoted field is an ordinary character.
+    p = nextSpecial(p, end);
+    while (p < end && *p == '"')
+      p = nextSpecial(p + 1, end);
+    if (!wanted)
+      return nullptr;
+    std::string_view text(start, p - start);
+    Value number = parseDecimal(text);
+    return isNil(number) ? Value(LoxString::shared(file, text)) : number;
+  }
+
+  const char *start = ++p;
+  bool escaped = false;
+  const char *close;
+  for (;;) {
+    close = static_cast<const char *>(std::memchr(p, '"', end - p));
+    if (!close)
+      throw std::runtime_error("Unterminated quoted field.");
+    p = close + 1;
+    if (p == end || *p != '"')
+      break;
+    escaped = true;
+    p++;
+  }
+  // Anything between the closing quote and the delimiter is dropped.
+  while (p < end && *p != ',' && *p != '\n' && *p != '\r')
+    p++;
+  if (!wanted)
+    return nullptr;
+  std::string_view text(start, close - start);
+  if (!escaped)
+    return LoxString::shared(file, text);
+  LoxString result;
+  char *out = result.reserve(text.size());
+  size_t length = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    out[length++] = text[i];
+    if (text[i] == '"')
+      i++;
+  }
+  result.truncate(length);
+  return result;
+}
+
+Value readRecord(LoxCsvReader &reader) {
+  const char *begin = reader.file->data;
+  const char *end = begin + reader.file->size;
+  const char *p = begin + reader.offset;
+  while (p < end && (*p == '\n' || *p == '\r'))
+    p++;
+  if (p == end) {
+    reader.offset = reader.file->size;
+    return nullptr;
+  }
+
+  static const auto listClass = nativeClass("List");
+  auto record = std::make_shared<LoxList>(listClass);
+  auto &items = record->items;
+  items.resize(reader.width, nullptr);
+  for (size_t column = 0;; column++) {
+    if (reader.slots.empty()) {
+      items.push_back(readField(reader.file, p, end, true));
+    } else {
+      int slot = column < reader.slots.size() ? reader.slots[column] : -1;
+      Value field = readField(reader.file, p, end, slot >= 0);
+      if (slot >= 0)
+        items[slot] = std::move(field);
+    }
+    if (p == end || *p != ',')
+      break;
+    p++;
+  }
+  if (p < end && *p == '\r')
+    p++;
+  if (p < end && *p == '\n')
+    p++;
+  reader.offset = static_cast<size_t>(p - begin);
+  return std::static_pointer_cast<LoxInstance>(record);
+}
+
+std::shared_ptr<LoxInstance> openCsv(std::shared_ptr<LoxClass> klass,
+                                     const Value &path, const Value &columns) {
+  std::vector<int> slots;
+  size_t width = 0;
+  if (!isNil(columns)) {
+    auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&columns);
+    auto *list = instance ? dynamic_cast<LoxList *>(instance->get()) : nullptr;
+    if (!list)
+      throw std::runtime_error("Columns must be a List or nil.");
+    width = list->items.size();
+    for (size_t i = 0; i < width; i++) {
+      double column = asNumber(list->items[i]);
+      if (column < 0 || column != std::floor(column) || column > 1e6)
+        throw std::runtime_error("Column index must be a non-negative integer.");
+      size_t index = static_cast<size_t>(column);
+      if (index >= slots.size())
+        slots.resize(index + 1, -1);
+      if (slots[index] >= 0)
+        throw std::runtime_error("Duplicate column index.");
+      slots[index] = static_cast<int>(i);
+    }
+  }
+  std::string file(asString(path).view());
+  auto reader = std::make_shared<LoxCsvReader>(std::move(klass), mapFile(file));
+  reader->slots = std::move(slots);
+  reader->width = width;
+  return reader;
+}
+
+} // namespace
+
+// ---------- Serialization ----------
+
+// A value file is "LOXV", a version byte, then one value. All integers are
+// little endian; counts and lengths are LEB128 varints.
+//
+//   0 nil   1 false   2 true
+//   3 number: 8-byte IEEE double
+//   4 integral number within +/-2^53: zigzag varint
+//   5 string: length, bytes
+//   6 instance: class name symbol, field count, (field name symbol, value)*
+//   7 List: count, values
+//   8 Buffer: count, 8-byte doubles
+//   9 class: name symbol
+//  10 reference: index of an earlier instance, List or Buffer, counted in
+//     the order they first appear
+//
+// A symbol is a varint n: odd n starts a new symbol of n >> 1 bytes, even n
+// repeats symbol n >> 1. Objects are numbered before their contents are
+// written, so references can point back into an object that is still being
+// read, which is how cycles round-trip. Everything is written in one forward
+// pass, and readers only ever move forward through the bytes.
+namespace {
+
+enum Tag : unsigned char {
+  kNil,
+  kFalse,
+  kTrue,
+  kDouble,
+  kInteger,
+  kString,
+  kInstance,
+  kList,
+  kBuffer,
+  kClass,
+  kReference,
+};
+
+constexpr char kMagic[] = {'L', 'O', 'X', 'V', 1};
+
+// Both directions keep their own stack instead of recursing, so long linked
+// structures don't overflow the native one.
+class ValueWriter {
+public:
+  std::string out{kMagic, sizeof kMagic};
+
+  void write(const Value &root) {
+    pending.push_back({&root, nullptr});
+    while (!pending.empty()) {
+      Pending next = pending.back();
+      pending.pop_back();
+      if (next.field)
+        writeSymbol(*next.field);
+      writeOne(*next.value);
+    }
+  }
+
+private:
+  // A value still to write, preceded by its field name inside an instance.
+  struct Pending {
+    const Value *value;
+    const std::string *field;
+  };
+
+  std::vector<Pending> pending;
+  std::deque<std::pair<std::string, Value>> copies;
+  std::unordered_map<const LoxInstance *, size_t> objects;
+  std::unordered_map<std::string, size_t> symbols;
+
+  void writeOne(const Value &value) {
+    if (isNil(value)) {
+      out += char(kNil);
+    } else if (is<bool>(value)) {
+      out += char(std::get<bool>(value) ? kTrue : kFalse);
+    } else if (is<std::int64_t>(value)) {
+      writeInteger(std::get<std::int64_t>(value));
+    } else if (is<double>(value)) {
+      double d = std::get<double>(value);
+      if (d == std::floor(d) && std::fabs(d) <= LOX_MAX_EXACT_INT && !(d == 0 && std::signbit(d))) {
+        writeInteger(static_cast<std::int64_t>(d));
+      } else {
+        out += char(kDouble);
+        writeDouble(d);
+      }
+    } else if (is<LoxString>(value)) {
+      std::string_view text = std::get<LoxString>(value).view();
+      out += char(kString);
+      writeVarint(text.size());
+      out.append(text);
+    } else if (auto *klass = std::get_if<std::shared_ptr<LoxClass>>(&value)) {
+      out += char(kClass);
+      writeSymbol((*klass)->name);
+    } else if (auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&value)) {
+      writeInstance(**instance);
+    } else {
+      throw std::runtime_error("Cannot serialize a function.");
+    }
+  }
+
+  void writeVarint(std::uint64_t n) {
+    for (; n >= 0x80; n >>= 7)
+      out += char(n | 0x80);
+    out += char(n);
+  }
+
+  void writeInteger(std::int64_t n) {
+    out += char(kInteger);
+    writeVarint((static_cast<std::uint64_t>(n) << 1) ^ static_cast<std::uint64_t>(n >> 63));
+  }
+
+  void writeDouble(double d) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &d, sizeof bits);
+    for (int i = 0; i < 8; i++)
+      out += char(bits >> (8 * i));
+  }
+
+  void writeSymbol(const std::string &symbol) {
+    auto it = symbols.find(symbol);
+    if (it != symbols.end()) {
+      writeVarint(it->second << 1);
+      return;
+    }
+    symbols.emplace(symbol, symbols.size());
+    writeVarint(symbol.size() << 1 | 1);
+    out += symbol;
+  }
+
+  void writeInstance(const LoxInstance &instance) {
+    auto [it, added] = objects.emplace(&instance, objects.size());
+    if (!added) {
+      out += char(kReference);
+      writeVarint(it->second);
+      return;
+    }
+    if (auto *list = dynamic_cast<const LoxList *>(&instance)) {
+      out += char(kList);
+      writeVarint(list->items.size());
+      for (auto item = list->items.rbegin(); item != list->items.rend(); ++item)
+        pending.push_back({&*item, nullptr});
+    } else if (auto *buffer = dynamic_cast<const LoxBuffer *>(&instance)) {
+      out += char(kBuffer);
+      writeVarint(buffer->data.size());
+      for (double d : buffer->data)
+        writeDouble(d);
+    } else if (dynamic_cast<const LoxNativeClass *>(instance.klass.get())) {
+      throw std::runtime_error("Cannot serialize a " + instance.klass->name + " instance.");
+    } else if (instance.klass->fixedLayout) {
+      // Declared fields are copied out of their members to be written.
+      std::vector<std::pair<std::string, Value>> declared;
+      instance.slots(declared);
+      out += char(kInstance);
+      writeSymbol(instance.klass->name);
+      writeVarint(declared.size());
+      for (auto &slot : declared) {
+        copies.push_back(std::move(slot));
+        pending.push_back({&copies.back().second, &copies.back().first});
+      }
+    } else {
+      out += char(kInstance);
+      writeSymbol(instance.klass->name);
+      writeVarint(instance.fields.size());
+      for (const auto &[name, field] : instance.fields)
+        pending.push_back({&field, &name});
+    }
+  }
+};
+
+class ValueReader {
+public:
+  ValueReader(MappedFile *file)
+      : file(file), p(file->data), end(file->data + file->size) {}
+
+  Value readFile() {
+    if (static_cast<size_t>(end - p) < sizeof kMagic ||
+        std::memcmp(p, kMagic, sizeof kMagic) != 0)
+      malformed();
+    p += sizeof kMagic;
+
+    Value root;
+    do {
+      Frame *parent = frames.empty() ? nullptr : &frames.back();
+      size_t field = parent && !parent->list ? readSymbol() : 0;
+      Frame child{};
+      Value value = readOne(child);
+      if (!parent) {
+        root = std::move(value);
+      } else {
+        parent->remaining--;
+        if (parent->list)
+          parent->list->items.push_back(std::move(value));
+        else
+          parent->object->set(symbols[field], value);
+      }
+      if (child.remaining > 0)
+        frames.push_back(std::move(child));
+      while (!frames.empty() && frames.back().remaining == 0)
+        frames.pop_back();
+    } while (!frames.empty());
+
+    if (p != end)
+      malformed();
+    return root;
+  }
+
+private:
+  // An instance or List whose contents are still being read.
+  struct Frame {
+    std::shared_ptr<LoxInstance> object;
+    LoxList *list;
+    size_t remaining;
+  };
+
+  MappedFile *file;
+  const char *p;
+  const char *end;
+  std::vector<Frame> frames;
+  std::vector<std::shared_ptr<LoxInstance>> objects;
+  std::vector<std::string> symbols;
+  // Classes looked up so far, by symbol index.
+  std::vector<std::shared_ptr<LoxClass>> classes;
+
+  [[noreturn]] static void malformed() {
+    throw std::runtime_error("Malformed value file.");
+  }
+
+  const char *take(std::uint64_t size) {
+    if (size > static_cast<std::uint64_t>(end - p))
+      malformed();
+    const char *at = p;
+    p += size;
+    return at;
+  }
+
+  std::uint64_t readVarint() {
+    std::uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      auto byte = static_cast<unsigned char>(*take(1));
+      n |= std::uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return n;
+    }
+    malformed();
+  }
+
+  // A count of items that each take at least `itemSize` more bytes.
+  size_t readCount(size_t itemSize) {
+    std::uint64_t n = readVarint();
+    if (n > static_cast<std::uint64_t>(end - p) / itemSize)
+      malformed();
+    return static_cast<size_t>(n);
+  }
+
+  double readDouble() {
+    const char *at = take(8);
+    std::uint64_t bits = 0;
+    for (int i = 0; i < 8; i++)
+      bits |= std::uint64_t(static_cast<unsigned char>(at[i])) << (8 * i);
+    double d;
+    std::memcpy(&d, &bits, sizeof d);
+    return d;
+  }
+
+  // The index of the symbol read into `symbols`.
+  size_t readSymbol() {
+    std::uint64_t n = readVarint();
+    if (n & 1) {
+      std::uint64_t size = n >> 1;
+      symbols.emplace_back(take(size), size);
+      return symbols.size() - 1;
+    }
+    if ((n >> 1) >= symbols.size())
+      malformed();
+    return static_cast<size_t>(n >> 1);
+  }
+
+  std::shared_ptr<LoxClass> readClass() {
+    size_t symbol = readSymbol();
+    if (symbol >= classes.size())
+      classes.resize(symbol + 1);
+    if (!classes[symbol]) {
+      classes[symbol] = LoxClass::named(symbols[symbol]);
+      if (!classes[symbol])
+        throw std::runtime_error("Undefined class '" + symbols[symbol] + "'.");
+    }
+    return classes[symbol];
+  }
+
+  // Reads one value. Instances and Lists come back empty, with `child` set
+  // up to receive their contents.
+  Value readOne(Frame &child) {
+    switch (static_cast<unsigned char>(*take(1))) {
+    case kNil:
+      return nullptr;
+    case kFalse:
+      return false;
+    case kTrue:
+      return true;
+    case kDouble:
+      return readDouble();
+    case kInteger: {
+      std::uint64_t n = readVarint();
+      auto i = static_cast<std::int64_t>(n >> 1) ^ -static_cast<std::int64_t>(n & 1);
+      if (i > LOX_MAX_EXACT_INT || i < -LOX_MAX_EXACT_INT)
+        malformed();
+      return i;
+    }
+    case kString: {
+      size_t size = readCount(1);
+      return LoxString::shared(file, std::string_view(take(size), size));
+    }
+    case kClass:
+      return readClass();
+    case kInstance: {
+      auto klass = readClass();
+      if (dynamic_cast<LoxNativeClass *>(klass.get()))
+        malformed();
+      auto instance = klass->allocate(klass);
+      objects.push_back(instance);
+      // Each field takes at least a symbol byte and a tag byte.
+      child = Frame{instance, nullptr, readCount(2)};
+      return instance;
+    }
+    case kList: {
+      static const auto listClass = nativeClass("List");
+      auto list = std::make_shared<LoxList>(listClass);
+      objects.push_back(list);
+      child = Frame{list, list.get(), readCount(1)};
+      list->items.reserve(child.remaining);
+      return std::static_pointer_cast<LoxInstance>(list);
+    }
+    case kBuffer: {
+      static const auto bufferClass = nativeClass("Buffer");
+      auto buffer = std::make_shared<LoxBuffer>(bufferClass, readCount(8));
+      objects.push_back(buffer);
+      for (double &d : buffer->data)
+        d = readDouble();
+      return std::static_pointer_cast<LoxInstance>(buffer);
+    }
+    case kReference: {
+      std::uint64_t index = readVarint();
+      if (index >= objects.size())
+        malformed();
+      return objects[index];
+    }
+    default:
+      malformed();
+    }
+  }
+};
+
+} // namespace
+
+Value writeValue(const Value &path, const Value &value) {
+  std::string file(asString(path).view());
+  ValueWriter writer;
+  writer.write(value);
+  std::FILE *out = std::fopen(file.c_str(), "wb");
+  bool ok = out && std::fwrite(writer.out.data(), 1, writer.out.size(), out) ==
+                       writer.out.size();
+  if (out && std::fclose(out) != 0)
+    ok = false;
+  if (!ok)
+    throw std::runtime_error("Could not write file '" + file + "'.");
+  return nullptr;
+}
+
+Value readValue(const Value &path) {
+  MappedFile *file = mapFile(std::string(asString(path).view()));
+  try {
+    Value value = ValueReader(file).readFile();
+    if (--file->refs == 0)
+      file->destroy(file);
+    return value;
+  } catch (...) {
+    if (--file->refs == 0)
+      file->destroy(file);
+    throw;
+  }
+}
+
+// ---------- Tables ----------
+
+// A table file is built once and then only ever mapped, so opening one costs
+// the same whatever its size and a lookup touches just the pages it probes.
+// All integers are little endian:
+//
+//   header   "LOXT", u32 version 1, u64 entry count, u64 slot count
+//   slots    slot count x (u64 FNV-1a hash of the key, u64 entry offset),
+//            open addressed with linear probing; offset 0 marks an empty slot
+//   entries  u32 key length, key bytes, then a value tag from the value file
+//            format (nil, false, true, double, or string with a u32 length)
+//
+// The slot count is a power of two at least twice the entry count.
+namespace {
+
+constexpr char kTableMagic[] = {'L', 'O', 'X', 'T'};
+constexpr size_t kTableHeader = 24;
+
+std::uint64_t fnv1a(std::string_view bytes) {
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : bytes) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::uint64_t load64(const char *p) {
+  std::uint64_t n = 0;
+  for (int i = 0; i < 8; i++)
+    n |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+  return n;
+}
+
+std::uint32_t load32(const char *p) {
+  std::uint32_t n = 0;
+  for (int i = 0; i < 4; i++)
+    n |= std::uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+  return n;
+}
+
+void store64(std::string &out, std::uint64_t n) {
+  for (int i = 0; i < 8; i++)
+    out += char(n >> (8 * i));
+}
+
+void store32(std::string &out, std::uint32_t n) {
+  for (int i = 0; i < 4; i++)
+    out += char(n >> (8 * i));
+}
+
+struct LoxTableFile : LoxInstance {
+  MappedFile *file;
+  std::uint64_t count;
+  std::uint64_t mask;
+
+  LoxTableFile(std::shared_ptr<LoxClass> k, MappedFile *f)
+      : LoxInstance(k), file(f) {}
+  ~LoxTableFile() override {
+    if (--file->refs == 0)
+      file->destroy(file);
+  }
+};
+
+[[noreturn]] void malformedTable() {
+  throw std::runtime_error("Malformed table file.");
+}
+
+std::shared_ptr<LoxInstance> openTable(std::shared_ptr<LoxClass> klass,
+                                       const Value &path) {
+  auto table = std::make_shared<LoxTableFile>(
+      std::move(klass), mapFile(std::string(asString(path).view())));
+  const char *data = table->file->data;
+  size_t size = table->file->size;
+  if (size < kTableHeader || std::memcmp(data, kTableMagic, 4) != 0 ||
+      load32(data + 4) != 1)
+    malformedTable();
+  table->count = load64(data + 8);
+  std::uint64_t slots = load64(data + 16);
+  if (slots == 0 || (slots & (slots - 1)) != 0 || table->count >= slots ||
+      slots > (size - kTableHeader) / 16)
+    malformedTable();
+  table->mask = slots - 1;
+  return table;
+}
+
+// The entry's value bytes for `key`, or null if it isn't in the table.
+const char *findEntry(const LoxTableFile &table, std::string_view key) {
+  const char *data = table.file->data;
+  size_t size = table.file->size;
+  std::uint64_t hash = fnv1a(key);
+  std::uint64_t i = hash & table.mask;
+  // Bounded, so a corrupt file with no empty slot still terminates.
+  for (std::uint64_t probes = 0; probes <= table.mask; probes++) {
+    const char *slot = data + kTableHeader + i * 16;
+    std::uint64_t offset = load64(slot + 8);
+    if (offset == 0)
+      return nullptr;
+    if (load64(slot) == hash) {
+      if (offset > size - 4 || load32(data + offset) > size - offset - 4)
+        malformedTable();
+      std::uint32_t length = load32(data + offset);
+      if (std::string_view(data + offset + 4, length) == key)
+        return data + offset + 4 + length;
+    }
+    i = (i + 1) & table.mask;
+  }
+  return nullptr;
+}
+
+Value tableValue(const LoxTableFile &table, const char *at) {
+  const char *end = table.file->data + table.file->size;
+  if (at >= end)
+    malformedTable();
+  switch (static_cast<unsigned char>(*at)) {
+  case kNil:
+    return nullptr;
+  case kFalse:
+    return false;
+  case kTrue:
+    return true;
+  case kDouble: {
+    if (end - at < 9)
+      malformedTable();
+    std::uint64_t bits = load64(at + 1);
+    double d;
+    std::memcpy(&d, &bits, sizeof d);
+    return d;
+  }
+  case kString: {
+    if (end - at < 5 || load32(at + 1) > static_cast<size_t>(end - at - 5))
+      malformedTable();
+    return LoxString::shared(table.file, std::string_view(at + 5, load32(at + 1)));
+  }
+  default:
+    malformedTable();
+  }
+}
+
+LoxList &listArgument(const Value &v, const char *message) {
+  auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&v);
+  auto *list = instance ? dynamic_cast<LoxList *>(instance->get()) : nullptr;
+  if (!list)
+    throw std::runtime_error(message);
+  return *list;
+}
+
+} // namespace
+
+Value buildTable(const Value &path, const Value &keys, const Value &values) {
+  const char *message = "Keys and values must be Lists of the same length.";
+  auto &keyList = listArgument(keys, message).items;
+  auto &valueList = listArgument(values, message).items;
+  if (keyList.size() != valueList.size())
+    throw std::runtime_error(message);
+
+  size_t slots = 2;
+  while (slots < keyList.size() * 2)
+    slots *= 2;
+  std::vector<std::uint64_t> hashes(slots), offsets(slots);
+  std::string entries;
+  size_t entriesStart = kTableHeader + slots * 16;
+  size_t count = 0;
+
+  for (size_t k = 0; k < keyList.size(); k++) {
+    if (!is<LoxString>(keyList[k]))
+      throw std::runtime_error("Table keys must be strings.");
+    std::string_view key = std::get<LoxString>(keyList[k]).view();
+    const Value &value = valueList[k];
+    if (key.size() > UINT32_MAX)
+      throw std::runtime_error("Table key is too long.");
+
+    std::uint64_t offset = entriesStart + entries.size();
+    store32(entries, static_cast<std::uint32_t>(key.size()));
+    entries.append(key);
+    if (isNil(value)) {
+      entries += char(kNil);
+    } else if (is<bool>(value)) {
+      entries += char(std::get<bool>(value) ? kTrue : kFalse);
+    } else if (isNumber(value)) {
+      double d = asNumber(value);
+      std::uint64_t bits;
+      std::memcpy(&bits, &d, sizeof bits);
+      entries += char(kDouble);
+      store64(entries, bits);
+    } else if (is<LoxString>(value)) {
+      std::string_view text = std::get<LoxString>(value).view();
+      if (text.size() > UINT32_MAX)
+        throw std::runtime_error("Table value is too long.");
+      entries += char(kString);
+      store32(entries, static_cast<std::uint32_t>(text.size()));
+      entries.append(text);
+    } else {
+      throw std::runtime_error(
+          "Table values must be strings, numbers, booleans or nil.");
+    }
+
+    // A repeated key points its slot at the newer entry.
+    std::uint64_t hash = fnv1a(key);
+    size_t i = hash & (slots - 1);
+    for (; offsets[i] != 0; i = (i + 1) & (slots - 1)) {
+      const char *old = entries.data() + (offsets[i] - entriesStart);
+      if (hashes[i] == hash && std::string_view(old + 4, load32(old)) == key)
+        break;
+    }
+    if (offsets[i] == 0)
+      count++;
+    hashes[i] = hash;
+    offsets[i] = offset;
+  }
+
+  std::string out(kTableMagic, sizeof kTableMagic);
+  store32(out, 1);
+  store64(out, count);
+  store64(out, slots);
+  for (size_t i = 0; i < slots; i++) {
+    store64(out, hashes[i]);
+    store64(out, offsets[i]);
+  }
+  out += entries;
+
+  std::string file(asString(path).view());
+  std::FILE *stream = std::fopen(file.c_str(), "wb");
+  bool ok = stream && std::fwrite(out.data(), 1, out.size(), stream) == out.size();
+  if (stream && std::fclose(stream) != 0)
+    ok = false;
+  if (!ok)
+    throw std::runtime_error("Could not write file '" + file + "'.");
+  return nullptr;
+}
+
+// ---------- Columns ----------
+
+// Columns(klass) holds rows of a class with declared fields as one
+// contiguous column per field rather than one heap object per row, so a loop
+// over a field streams through memory instead of chasing pointers. `num`
+// fields are plain double arrays, which the bulk methods (sum, fill, scale,
+// addScaled) sweep in loops the compiler can vectorize. get(i) and add()
+// return a proxy of the class whose fields read and write row i in place.
+namespace {
+
+struct LoxColumns : LoxInstance {
+  struct Column {
+    std::string name;
+    bool numeric;
+    Value initial;
+    std::vector<double> numbers;
+    std::vector<Value> values;
+  };
+
+  std::shared_ptr<LoxClass> rowClass;
+  // An instance of rowClass that values stored through a proxy pass through
+  // first, so they are checked and converted like a real instance's.
+  std::shared_ptr<LoxInstance> scratch;
+  std::vector<Column> columns;
+  size_t length = 0;
+
+  LoxColumns(std::shared_ptr<LoxClass> k, std::shared_ptr<LoxClass> row)
+      : LoxInstance(std::move(k)), rowClass(std::move(row)),
+        scratch(rowClass->allocate(rowClass)) {
+    std::vector<std::pair<std::string, Value>> initial;
+    scratch->slots(initial);
+    for (auto &[name, value] : initial)
+      columns.push_back({name, is<double>(value), value, {}, {}});
+  }
+
+  const Column *find(const std::string &name) const {
+    for (const Column &column : columns)
+      if (column.name == name)
+        return &column;
+    return nullptr;
+  }
+
+  Column &column(const Value &name) {
+    std::string field(asString(name).view());
+    auto *column = find(field);
+    if (!column)
+      throw std::runtime_error("Undefined field '" + field + "'.");
+    return const_cast<Column &>(*column);
+  }
+
+  Column &numbers(const Value &name) {
+    Column &column = this->column(name);
+    if (!column.numeric)
+      throw std::runtime_error("Field '" + column.name + "' is not declared num.");
+    return column;
+  }
+
+  static Value read(const Column &column, size_t row) {
+    return column.numeric ? Value(column.numbers[row]) : column.values[row];
+  }
+
+  // `value` as the field `name` of an instance would hold it.
+  Value check(const std::string &name, const Value &value) {
+    Value checked;
+    if (!scratch->setSlot(name, value) || !scratch->getSlot(name, checked))
+      throw std::runtime_error("Undefined field '" + name + "'.");
+    return checked;
+  }
+
+  size_t append() {
+    for (Column &column : columns) {
+      if (column.numeric)
+        column.numbers.push_back(asNumber(column.initial));
+      else
+        column.values.push_back(column.initial);
+    }
+    return length++;
+  }
+};
+
+struct LoxColumnRow : LoxInstance {
+  std::shared_ptr<LoxColumns> owner;
+  size_t row;
+
+  LoxColumnRow(std::shared_ptr<LoxColumns> o, size_t r)
+      : LoxInstance(o->rowClass), owner(std::move(o)), row(r) {}
+
+  bool getSlot(const std::string &name, Value &out) const override {
+    auto *column = owner->find(name);
+    if (!column)
+      return false;
+    out = LoxColumns::read(*column, row);
+    return true;
+  }
+
+  bool setSlot(const std::string &name, const Value &value) override {
+    auto *column = const_cast<LoxColumns::Column *>(owner->find(name));
+    if (!column)
+      return false;
+    Value checked = owner->check(name, value);
+    if (column->numeric)
+      column->numbers[row] = asNumber(checked);
+    else
+      column->values[row] = checked;
+    return true;
+  }
+
+  void slots(std::vector<std::pair<std::string, Value>> &out) const override {
+    for (const auto &column : owner->columns)
+      out.emplace_back(column.name, LoxColumns::read(column, row));
+  }
+};
+
+std::shared_ptr<LoxColumns> columnsReceiver(const std::vector<Value> &args) {
+  return std::static_pointer_cast<LoxColumns>(
+      std::get<std::shared_ptr<LoxInstance>>(args[0]));
+}
+
+Value columnRow(std::shared_ptr<LoxColumns> columns, size_t row) {
+  return std::static_pointer_cast<LoxInstance>(
+      std::make_shared<LoxColumnRow>(std::move(columns), row));
+}
+
+size_t columnIndex(const Value &v, size_t size) {
+  double i = asNumber(v);
+  if (i < 0 || i >= static_cast<double>(size) || i != std::floor(i))
+    throw std::runtime_error("Columns index out of range.");
+  return static_cast<size_t>(i);
+}
+
+void pushRow(LoxColumns &columns, const Value &v) {
+  auto *instance = std::get_if<std::shared_ptr<LoxInstance>>(&v);
+  const LoxClass *klass = instance ? (*instance)->klass.get() : nullptr;
+  while (klass && klass != columns.rowClass.get())
+    klass = klass->superclass.get();
+  if (!klass)
+    throw std::runtime_error("Argument must be a " + columns.rowClass->name +
+                             " instance.");
+  size_t row = columns.append();
+  for (auto &column : columns.columns) {
+    Value field = (*instance)->get(column.name);
+    if (column.numeric)
+      column.numbers[row] = asNumber(field);
+    else
+      column.values[row] = field;
+  }
+}
+
+std::shared_ptr<LoxInstance> openColumns(std::shared_ptr<LoxClass> klass,
+                                         const Value &rowClass) {
+  auto *row = std::get_if<std::shared_ptr<LoxClass>>(&rowClass);
+  if (!row || !(*row)->fixedLayout)
+    throw std::runtime_error("Columns needs a class with declared fields.");
+  return std::make_shared<LoxColumns>(std::move(klass), *row);
+}
+
+} // namespace
+
+std::shared_ptr<LoxClass> nativeClass(const std::string &name) {
+  static const auto random = std::make_shared<LoxNativeClass>(
+      "Random", 1,
+      std::unordered_map<std::string, std::shared_ptr<LoxCallable>>{
+          {"next", method(0, [](const std::vector<Value> &args) -> Value {
+             return nextRandom(receiver<LoxRandom>(args));
+           })},
+          {"split", method(0, [](const std::vector<Value> &args) -> Value {
+             return std::static_pointer_cast<LoxInstance>(
+                 splitRandom(receiver<LoxRandom>(args)));
+           })},
+          {"fill", method(1, [](const std::vector<Value> &args) -> Value {
+             LoxBuffer &buffer = bufferArgument(args[1]);
+             fillRandom(receiver<LoxRandom>(args), buffer.data.data(),
+                        buffer.data.size());
+             return nullptr;
+           })},
+      },
+      [](std::shared_ptr<LoxClass> klass, const std::vector<Value> &args) {
+        return std::static_pointer_cast<LoxInstance>(seededRandom(
+            klass, static_cast<std::int64_t>(asNumber(args[0]))));
+      });
+
+  static const auto buffer = std::make_shared<LoxNativeClass>(
+      "Buffer", 1,
+      std::unordered_map<std::string, std::shared_ptr<LoxCallable>>{
+          {"length", method(0, [](const std::vector<Value> &args) -> Value {
+             return static_cast<std::int64_t>(
+                 receiver<LoxBuffer>(args).data.size());
+           })},
+          {"get", method(1, [](const std::vector<Value> &args) -> Value {
+             auto &data = receiver<LoxBuffer>(args).data;
+             return data[bufferIndex(args[1], data.size())];
+           })},
+          {"set", method(2, [](const std::vector<Value> &args) -> Value {
+             auto &data = receiver<LoxBuffer>(args).data;
+             data[bufferIndex(args[1], data.size())] = asNumber(args[2]);
+             return nullptr;
+           })},
+      },
+      [](std::shared_ptr<LoxClass> klass, const std::vector<Value> &args) {
+        double length = asNumber(args[0]);
+        if (length < 0 || length != std::floor(length))
+          throw std::runtime_error(
+              "Buffer length must be a non-negative integer.");
+        return std::static_pointer_cast<LoxInstance>(
+            std::make_shared<LoxBuffer>(klass, static_cast<size_t>(length)));
+      });
+
+  static const auto list = std::make_shared<LoxNativeClass>(
+      "List", 0,
+      std::unordered_map<std::string, std::shared_ptr<LoxCallable>>{
+          {"length", method(0, [](const std::vector<Value> &args) -> Value {
+             return static_cast<std::int64_t>(
+                 receiver<LoxList>(args).items.size());
+           })},
+          {"push", method(1, [](const std::vector<Value> &args) -> Value {
+             receiver<LoxList>(args).items.push_back(args[1]);
+             return nullptr;
+           })},
+          {"get", method(1, [](const std::vector<Value> &args) -> Value {
+             auto &items = receiver<LoxList>(args).items;
+             return items[listIndex(args[1], items.size())];
+           })},
+          {"set", method(2, [](const std::vector<Value> &args) -> Value {
+             auto &items = receiver<LoxList>(args).items;
+             items[listIndex(args[1], items.size())] = args[2];
+             return nullptr;
+           })},
+      },
+      [](std::shared_ptr<LoxClass> klass, const std::vector<Value> &) {
+        return std::static_pointer_cast<LoxInstance>(
+            std::make_shared<LoxList>(klass));
+      });
+
+  static const auto csvReader = std::make_shared<LoxNativeClass>(
+      "CsvReader", 2,
+      std::unordered_map<std::string, std::shared_ptr<LoxCallable>>{
+          {"next", method(0, [](const std::vector<Value> &args) -> Value {
+             return readRecord(receiver<LoxCsvReader>(args));
+           })},
+      },
+      [](std::shared_ptr<LoxClass> klass, const std::vector<Value> &args) {
+        return openCsv(std::move(klass), args[0], args[1]);
+      });
+
+  static const auto table = std::make_shared<LoxNativeClass>(
+      "Table", 1,
+      std::unordered_map<std::string, std::shared_ptr<LoxCallable>>{
+          {"get", method(1, [](const std::vector<Value> &args) -> Value {
+             auto &table = receiver<LoxTableFile>(args);
+             const char *entry = findEntry(table, asString(args[1]).view());
+             return entry ? tableValue(table, entry) : nullptr;
+           })},
+          {"has", method(1, [](const std::vector<Value> &args) -> Value {
+             return findEntry(receiver<LoxTableFile>(args),
+                              asString(args[1]).view()) != nullptr;
+           })},
+          {"length", method(0, [](const std::vector<Value> &args) -> Value {
+             return static_cast<std::int64_t>(receiver<LoxTableFile>(args).count);
+           })},
+      },
+      [](std::shared_ptr<LoxClass> klass, const std::vector<Value> &args) {
+        return openTable(std::move(klass), args[0]);
+      });
+
+  static const auto columns = std::make_shared<LoxNativeClass>(
+      "Columns", 1,
+      std::unordered_map<std::string, std::shared_ptr<LoxCallable>>{
+          {"length", method(0, [](const std::vector<Value> &args) -> Value {
+             return static_cast<std::int64_t>(receiver<LoxColumns>(args).length);
+           })},
+          {"add", method(0, [](const std::vector<Value> &args) -> Value {
+             auto columns = columnsReceiver(args);
+             size_t row = columns->append();
+             return columnRow(std::move(columns), row);
+           })},
+          {"push", method(1, [](const std::vector<Value> &args) -> Value {
+             pushRow(receiver<LoxColumns>(args), args[1]);
+             return nullptr;
+           })},
+          {"get", method(1, [](const std::vector<Value> &args) -> Value {
+             auto columns = columnsReceiver(args);
+             size_t row = columnIndex(args[1], columns->length);
+             return columnRow(std::move(columns), row);
+           })},
+          {"sum", method(1, [](const std::vector<Value> &args) -> Value {
+             double total = 0;
+             for (double d : receiver<LoxColumns>(args).numbers(args[1]).numbers)
+               total += d;
+             return total;
+           })},
+          {"fill", method(2, [](const std::vector<Value> &args) -> Value {
+             auto &columns = receiver<LoxColumns>(args);
+             auto &column = columns.column(args[1]);
+             Value value = columns.check(column.name, args[2]);
+             if (column.numeric)
+               std::fill(column.numbers.begin(), column.numbers.end(),
+                         asNumber(value));
+             else
+               std::fill(column.values.begin(), column.values.end(), value);
+             return nullptr;
+           })},
+          {"scale", method(2, [](const std::vector<Value> &args) -> Value {
+             auto &numbers = receiver<LoxColumns>(args).numbers(args[1]).numbers;
+             double k = asNumber(args[2]);
+             for (double &d : numbers)
+               d *= k;
+             return nullptr;
+           })},
+          {"addScaled", method(3, [](const std::vector<Value> &args) -> Value {
+             auto &columns = receiver<LoxColumns>(args);
+             double *target = columns.numbers(args[1]).numbers.data();
+             double k = asNumber(args[2]);
+             const double *source = columns.numbers(args[3]).numbers.data();
+             for (size_t i = 0; i < columns.length; i++)
+               target[i] += k * source[i];
+             return nullptr;
+           })},
+      },
+      [](std::shared_ptr<LoxClass> klass, const std::vector<Value> &args) {
+        return openColumns(std::move(klass), args[0]);
+      });
+
+  if (name == "Random")
+    return random;
+  if (name == "List")
+    return list;
+  if (name == "Buffer")
+    return buffer;
+  if (name == "CsvReader")
+    return csvReader;
+  if (name == "Table")
+    return table;
+  if (name == "Columns")
+    return columns;
+  throw std::runtime_error("Undefined variable '" + name + "'.");
+}
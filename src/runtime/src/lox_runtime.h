@@ -2,10 +2,16 @@
 #define LOX_RUNTIME_H
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -14,27 +20,236 @@ struct LoxCallable;
 struct LoxInstance;
 struct LoxClass;
 
+// Immutable string value. Strings of up to kSmall bytes live inline, zero
+// padded, so they never allocate and compare as a few integer words. Longer
+// strings point into a reference-counted buffer allocated together with its
+// count (Lox is single threaded, so the count is a plain integer). Slices of
+// them share their parent's buffer, long literals point straight at static
+// storage, and natives can hand out views of memory they own (such as a
+// mapped file) through an external buffer with its own destroy hook. Only the
+// C++ emitter passes char arrays, and only literals.
+class LoxString {
+public:
+  static constexpr size_t kSmall = 24;
+
+  LoxString() : size_(0) { std::memset(small_, 0, kSmall); }
+  template <size_t N> LoxString(const char (&literal)[N]) : LoxString() {
+    if (N - 1 <= kSmall) {
+      std::memcpy(reserve(N - 1), literal, N - 1);
+    } else {
+      size_ = N - 1;
+      ref_ = Ref{nullptr, literal, 0};
+    }
+  }
+  explicit LoxString(std::string_view text) : LoxString() {
+    std::memcpy(reserve(text.size()), text.data(), text.size());
+  }
+  LoxString(const std::string &text) : LoxString(std::string_view(text)) {}
+
+  struct Buffer {
+    size_t refs;
+    // Frees an external buffer; null for the ones reserve() allocates.
+    void (*destroy)(Buffer *);
+  };
+
+  // A view of bytes that `owner` keeps alive, copied instead when it fits
+  // inline.
+  static LoxString shared(Buffer *owner, std::string_view text) {
+    if (text.size() <= kSmall)
+      return LoxString(text);
+    LoxString result;
+    result.size_ = text.size();
+    result.ref_ = Ref{owner, text.data(), 0};
+    owner->refs++;
+    return result;
+  }
+
+  LoxString(const LoxString &other) : size_(other.size_) {
+    if (isSmall()) {
+      std::memcpy(small_, other.small_, kSmall);
+    } else {
+      ref_ = other.ref_;
+      if (ref_.owner)
+        ref_.owner->refs++;
+    }
+  }
+  LoxString(LoxString &&other) noexcept : size_(other.size_) {
+    std::memcpy(small_, other.small_, kSmall);
+    other.size_ = 0;
+    std::memset(other.small_, 0, kSmall);
+  }
+  LoxString &operator=(const LoxString &other) {
+    if (this != &other) {
+      this->~LoxString();
+      new (this) LoxString(other);
+    }
+    return *this;
+  }
+  LoxString &operator=(LoxString &&other) noexcept {
+    if (this != &other) {
+      this->~LoxString();
+      new (this) LoxString(std::move(other));
+    }
+    return *this;
+  }
+  ~LoxString() { release(); }
+
+  const char *data() const { return isSmall() ? small_ : ref_.data; }
+  size_t size() const { return size_; }
+  std::string_view view() const { return {data(), size_}; }
+
+  LoxString slice(size_t start, size_t length) const {
+    if (length <= kSmall)
+      return LoxString(view().substr(start, length));
+    LoxString part = *this;
+    part.ref_.data += start;
+    part.ref_.hash = 0;
+    part.size_ = length;
+    return part;
+  }
+
+  // Makes this a string of `size` unwritten bytes and returns them, for
+  // building a result in place. truncate() then trims it to what was used.
+  char *reserve(size_t size) {
+    release();
+    size_ = size;
+    if (isSmall()) {
+      std::memset(small_, 0, kSmall);
+      return small_;
+    }
+    auto *buffer = static_cast<Buffer *>(::operator new(sizeof(Buffer) + size));
+    buffer->refs = 1;
+    buffer->destroy = nullptr;
+    char *chars = reinterpret_cast<char *>(buffer + 1);
+    ref_ = Ref{buffer, chars, 0};
+    return chars;
+  }
+
+  void truncate(size_t length) {
+    if (!isSmall() && length <= kSmall) {
+      char chars[kSmall];
+      std::memcpy(chars, ref_.data, length);
+      std::memcpy(reserve(length), chars, length);
+      return;
+    }
+    if (isSmall())
+      std::memset(small_ + length, 0, kSmall - length);
+    else
+      ref_.hash = 0;
+    size_ = length;
+  }
+
+  // `a + b` with a single allocation, or none when the result fits inline.
+  static LoxString concat(std::string_view a, std::string_view b) {
+    LoxString result;
+    char *out = result.reserve(a.size() + b.size());
+    std::memcpy(out, a.data(), a.size());
+    std::memcpy(out + a.size(), b.data(), b.size());
+    return result;
+  }
+
+  // Mixes the inline words of short strings; long ones hash their bytes
+  // once and keep the result.
+  size_t hash() const;
+
+  friend bool operator==(const LoxString &a, const LoxString &b) {
+    if (a.size_ != b.size_)
+      return false;
+    if (a.isSmall())
+      return std::memcmp(a.small_, b.small_, kSmall) == 0;
+    return a.view() == b.view();
+  }
+
+private:
+  struct Ref {
+    Buffer *owner;
+    const char *data;
+    // The cached hash(), odd once computed; 0 until then.
+    mutable size_t hash;
+  };
+
+  bool isSmall() const { return size_ <= kSmall; }
+
+  void release() {
+    if (isSmall() || !ref_.owner || --ref_.owner->refs != 0)
+      return;
+    if (ref_.owner->destroy)
+      ref_.owner->destroy(ref_.owner);
+    else
+      ::operator delete(ref_.owner);
+  }
+
+  union {
+    Ref ref_;
+    char small_[kSmall];
+  };
+  size_t size_;
+};
+
+// Lox has a single number type. Integral numbers are carried as int64_t while
+// they stay within +/-2^53, where doubles are exact, and promote to double on
+// overflow, so the split is never observable from Lox.
 using Value =
-    std::variant<double, std::string, bool, std::nullptr_t,
+    std::variant<double, LoxString, bool, std::nullptr_t,
                  std::shared_ptr<LoxCallable>, std::shared_ptr<LoxInstance>,
-                 std::shared_ptr<LoxClass>>;
+                 std::shared_ptr<LoxClass>, std::int64_t>;
+
+constexpr std::int64_t LOX_MAX_EXACT_INT = std::int64_t(1) << 53;
 
 template <typename T> bool is(const Value &v) {
   return std::holds_alternative<T>(v);
 }
 
+// The instance a receiver holds, borrowed rather than copied; throws
+// std::bad_variant_access for anything else.
+inline const std::shared_ptr<LoxInstance> &asInstance(const Value &v) {
+  return std::get<std::shared_ptr<LoxInstance>>(v);
+}
+
+bool isNumber(const Value &v);
 double asNumber(const Value &v);
-std::string asString(const Value &v);
+const LoxString &asString(const Value &v);
 bool asBool(const Value &v);
 bool isNil(const Value &v);
 bool isTruthy(const Value &v);
 
+// Type annotations. A Value stored into an annotated local, parameter or
+// return is checked once, here, and the local then holds it unboxed.
+[[noreturn]] void annotationError(const char *type, const Value &v);
+inline double expectNumber(const Value &v) {
+  if (!isNumber(v))
+    annotationError("num", v);
+  return asNumber(v);
+}
+inline bool expectBool(const Value &v) {
+  if (!is<bool>(v))
+    annotationError("bool", v);
+  return std::get<bool>(v);
+}
+inline const LoxString &expectString(const Value &v) {
+  if (!is<LoxString>(v))
+    annotationError("str", v);
+  return std::get<LoxString>(v);
+}
+// An instance of `className` or one of its subclasses.
+std::shared_ptr<LoxInstance> expectInstance(const Value &v,
+                                            const char *className);
+
 Value add(const Value &a, const Value &b);
+
+// `/` in code the emitter has typed as numbers.
+inline double divideNumbers(double a, double b) {
+  if (b == 0)
+    throw std::runtime_error("Division by zero.");
+  return a / b;
+}
 Value subtract(const Value &a, const Value &b);
 Value multiply(const Value &a, const Value &b);
 Value divide(const Value &a, const Value &b);
 Value negate(const Value &v);
 Value notOp(const Value &v);
+// Instances, classes and functions are equal only to themselves, unless the
+// left operand is an instance whose class defines `equals`, which decides.
 bool equal(const Value &a, const Value &b);
 bool greater(const Value &a, const Value &b);
 bool less(const Value &a, const Value &b);
@@ -44,6 +259,88 @@ bool less_equal(const Value &a, const Value &b);
 
 void print(const Value &v);
 
+// A hash consistent with equal(), as a non-negative integer below 2^53:
+// numbers by value, strings by content, instances of a class defining `hash`
+// by whatever it returns, and other objects by address.
+std::int64_t hashValue(const Value &v);
+
+// String natives. Results that are part of the input (substring, trim,
+// charAt, the pieces from split) are slices of it rather than copies.
+Value stringLength(const Value &s);
+Value stringIndexOf(const Value &s, const Value &needle);
+Value stringStartsWith(const Value &s, const Value &prefix);
+Value stringSubstring(const Value &s, const Value &start, const Value &end);
+Value stringTrim(const Value &s);
+Value stringCharAt(const Value &s, const Value &index);
+Value stringSplit(const Value &s, const Value &separator);
+
+// Whether `pattern` matches anywhere in `text` (see RegexDfa.kt for the
+// syntax). Dynamic patterns are compiled to a DFA once and cached; the C++
+// emitter compiles literal patterns ahead of time instead.
+Value matchPattern(const Value &pattern, const Value &text);
+
+// writeValue(path, value) stores `value` and every instance reachable from it
+// in a compact binary file, keeping shared references and cycles; readValue
+// maps such a file back in, finding classes by name. The format is described
+// next to the implementation.
+Value writeValue(const Value &path, const Value &value);
+Value readValue(const Value &path);
+
+// buildTable(path, keys, values) writes a read-only hash table file from two
+// Lists; Table(path) maps it and looks keys up in place.
+Value buildTable(const Value &path, const Value &keys, const Value &values);
+
+// Number <-> text conversion on std::from_chars / std::to_chars. Numbers are
+// written as integers when integral, otherwise as the shortest text that
+// parses back to the same double. parseNumber returns nil for anything that
+// isn't a complete decimal number.
+Value parseNumber(const Value &text);
+Value numberToString(const Value &number);
+
+// `prefix + toString(n)` and `toString(n) + suffix`, formatting the number
+// straight into the result instead of through a temporary string.
+Value concatNumber(const Value &prefix, const Value &number);
+Value numberConcat(const Value &number, const Value &suffix);
+
+// One operand of a lowered `a + ":" + b + ...` chain: a value that must be a
+// string, a string literal, or the number of a `toString(n)` operand, which
+// is formatted in place. Values are referenced, not copied; other operand
+// types (classes, functions) are converted to an owned Value.
+struct ConcatPiece {
+  const Value *ref = nullptr;
+  Value owned;
+  std::string_view literal;
+  bool isLiteral = false;
+  bool number = false;
+
+  ConcatPiece(const Value &v) : ref(&v) {}
+  template <size_t N>
+  ConcatPiece(const char (&s)[N]) : literal(s, N - 1), isLiteral(true) {}
+  template <typename T,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<T>, Value> &&
+                !std::is_same_v<std::decay_t<T>, ConcatPiece> &&
+                !std::is_array_v<std::remove_reference_t<T>>>>
+  ConcatPiece(T &&v) : owned(std::forward<T>(v)) {}
+
+  const Value &value() const { return ref ? *ref : owned; }
+};
+
+ConcatPiece numberPiece(const Value &number);
+
+// The whole chain with one allocation. Operands are checked in the order
+// the nested add() calls would check them, with the same errors.
+Value concatStrings(std::initializer_list<ConcatPiece> pieces);
+
+// The native global functions (math, strings, conversion) as callables.
+// The C++ emitter calls the underlying functions directly wherever the name
+// isn't shadowed; this is for the remaining uses, such as passing `sqrt`
+// around as a value.
+std::shared_ptr<LoxCallable> nativeFunction(const std::string &name);
+
+// Built-in classes implemented in C++ (Random, Buffer, List).
+std::shared_ptr<LoxClass> nativeClass(const std::string &name);
+
 struct LoxCallable {
   virtual ~LoxCallable() = default;
   virtual int arity() const = 0;
@@ -55,8 +352,21 @@ struct LoxInstance : std::enable_shared_from_this<LoxInstance> {
   std::unordered_map<std::string, Value> fields;
 
   LoxInstance(std::shared_ptr<LoxClass> k) : klass(k) {}
+  virtual ~LoxInstance() = default;
   Value get(const std::string &name);
   void set(const std::string &name, const Value &value);
+
+  // Declared fields live in members of the struct the emitter generates for
+  // their class rather than in `fields`; these reach them by name and return
+  // false for names the class doesn't declare. setSlot checks annotations.
+  virtual bool getSlot(const std::string &, Value &) const {
+    return false;
+  }
+  virtual bool setSlot(const std::string &, const Value &) {
+    return false;
+  }
+  virtual void
+  slots(std::vector<std::pair<std::string, Value>> &) const {}
 };
 
 struct LoxClass : public LoxCallable,
@@ -64,14 +374,83 @@ struct LoxClass : public LoxCallable,
   std::string name;
   std::shared_ptr<LoxClass> superclass;
   std::unordered_map<std::string, std::shared_ptr<LoxCallable>> methods;
+  // Whether the class or a superclass declares its fields, so instances
+  // take no others.
+  bool fixedLayout = false;
+  // `equals` and `hash`, defined here or inherited, looked up once for
+  // equal() and hashValue(); null when the class has none.
+  std::shared_ptr<LoxCallable> equalsMethod;
+  std::shared_ptr<LoxCallable> hashMethod;
 
   LoxClass(
       const std::string &n, std::shared_ptr<LoxClass> sup,
-      const std::unordered_map<std::string, std::shared_ptr<LoxCallable>> &m)
-      : name(n), superclass(sup), methods(m) {}
+      const std::unordered_map<std::string, std::shared_ptr<LoxCallable>> &m);
+  ~LoxClass() override;
+
+  // The most recently defined live class called `name`, or null.
+  static std::shared_ptr<LoxClass> named(const std::string &name);
+
+  // The method `name` defined here or inherited, or null.
+  std::shared_ptr<LoxCallable> findMethod(const std::string &name) const;
 
   int arity() const override;
   Value call(const std::vector<Value> &args) override;
+  virtual std::shared_ptr<LoxInstance>
+  instantiate(const std::vector<Value> &args);
+  // An empty instance of `klass`, this class or a subclass, laid out as the
+  // nearest class up the chain that declares fields says.
+  virtual std::shared_ptr<LoxInstance>
+  allocate(const std::shared_ptr<LoxClass> &klass);
+};
+
+// A class that declares its fields; its instances are `Fields`, the struct
+// the emitter generated with a member per field.
+template <typename Fields> struct LoxFixedClass : LoxClass {
+  LoxFixedClass(
+      const std::string &n, std::shared_ptr<LoxClass> sup,
+      const std::unordered_map<std::string, std::shared_ptr<LoxCallable>> &m)
+      : LoxClass(n, std::move(sup), m) {
+    fixedLayout = true;
+  }
+
+  std::shared_ptr<LoxInstance>
+  allocate(const std::shared_ptr<LoxClass> &klass) override {
+    return std::make_shared<Fields>(klass);
+  }
+};
+
+// A class implemented in C++. Its methods are LoxFunctions that receive the
+// instance in args[0], like compiled methods, and `factory` builds instances
+// that carry native state.
+struct LoxNativeClass : LoxClass {
+  using Factory = std::function<std::shared_ptr<LoxInstance>(
+      std::shared_ptr<LoxClass>, const std::vector<Value> &)>;
+
+  int argCount;
+  Factory factory;
+
+  LoxNativeClass(
+      const std::string &n, int ac,
+      const std::unordered_map<std::string, std::shared_ptr<LoxCallable>> &m,
+      Factory f)
+      : LoxClass(n, nullptr, m), argCount(ac), factory(std::move(f)) {}
+
+  int arity() const override { return argCount; }
+  std::shared_ptr<LoxInstance>
+  instantiate(const std::vector<Value> &args) override;
+};
+
+struct LoxList : LoxInstance {
+  std::vector<Value> items;
+
+  using LoxInstance::LoxInstance;
+};
+
+struct LoxBuffer : LoxInstance {
+  std::vector<double> data;
+
+  LoxBuffer(std::shared_ptr<LoxClass> k, size_t length)
+      : LoxInstance(k), data(length) {}
 };
 
 struct LoxBoundMethod : LoxCallable {
@@ -90,6 +469,11 @@ struct LoxBoundMethod : LoxCallable {
   }
 };
 
+// `super.name` bound to `self`, for a superclass the emitter couldn't see.
+std::shared_ptr<LoxBoundMethod>
+bindSuper(const std::shared_ptr<LoxClass> &superclass, const std::string &name,
+          const std::shared_ptr<LoxInstance> &self);
+
 struct LoxFunction : LoxCallable {
   std::function<Value(const std::vector<Value> &)> body;
   int argCount;
@@ -103,10 +487,52 @@ struct LoxFunction : LoxCallable {
       throw std::runtime_error("Wrong arity.");
     return body(args);
   }
+
+  // The unchecked entry, for call sites whose argument count the compiler
+  // has already matched against the declaration.
+  Value invoke(const std::vector<Value> &args) { return body(args); }
 };
 
-#define DEFINE_CLASS(name, superclass) \
-    auto name = std::make_shared<LoxClass>(#name, superclass, name##_methods);
+// `instance.name(...)`, guessing that `instance` is exactly `klass` so the
+// call can go straight to `method`; anything else takes the generic lookup.
+// `args` starts with the receiver, which is read back from there so the
+// guard sees the object that was actually evaluated, even when a later
+// argument moves or reassigns the variable it came from.
+Value invokeMethod(const std::string &name, const LoxClass *klass,
+                   LoxFunction &method, std::vector<Value> args);
+
+// One field or element of an instance rebuilt from a heap snapshot. The
+// emitter writes these as static tables, so a big heap costs data rather
+// than a statement per value.
+struct SnapshotEntry {
+  std::uint32_t object;
+  // The field to set, or null to append to a List or Buffer.
+  const char *field;
+  // 'n'il, 'b'ool, 'i'nteger, 'd'ouble, 's'tring, or an index into the
+  // snapshot's 'o'bjects or 'r'efs.
+  char kind;
+  double number;
+  const char *text;
+  size_t length;
+};
+
+// Empty instances of `classes[kinds[i]]`, made without running init.
+std::vector<std::shared_ptr<LoxInstance>>
+allocateSnapshot(const std::vector<std::shared_ptr<LoxClass>> &classes,
+                 const std::uint32_t *kinds, size_t count);
+void loadSnapshot(const std::vector<std::shared_ptr<LoxInstance>> &objects,
+                  const std::vector<Value> &refs,
+                  const SnapshotEntry *entries, size_t count);
+
+#define DEFINE_CLASS(var, name, superclass) \
+    auto var = std::make_shared<LoxClass>(name, superclass, var##_methods);
+
+#define DEFINE_FIXED_CLASS(var, name, superclass, fields) \
+    std::shared_ptr<LoxClass> var = \
+        std::make_shared<LoxFixedClass<fields>>(name, superclass, var##_methods);
+
+// The generated struct behind an instance known to be of a fixed class.
+#define FIELDS(inst, fields) static_cast<fields *>((inst).get())
 
 #define METHOD(class_name, lexeme, var) \
     class_name##_methods[lexeme] = var;
@@ -138,7 +564,4 @@ struct LoxFunction : LoxCallable {
 
 #define SELF std::get<std::shared_ptr<LoxInstance>>(args[0])
 
-#define CHECK_ARITY(n) \
-    if (args.size() != n) throw std::runtime_error("Expected " #n " arguments");
-
 #endif
\ No newline at end of file
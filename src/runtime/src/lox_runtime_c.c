@@ -0,0 +1,2904 @@
+// madvise() and MADV_SEQUENTIAL are outside ISO C; ask glibc to declare them
+// even under -std=c11.
+#define _DEFAULT_SOURCE
+#include "lox_runtime_c.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOX_HAVE_MMAP 1
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#endif
+
+#define LOX_MAX_ARGS 256
+#define TABLE_MAX_LOAD 0.75
+
+void lox_runtime_error(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  fputs("Runtime Error: ", stderr);
+  vfprintf(stderr, format, args);
+  fputs("\n", stderr);
+  va_end(args);
+  fflush(stdout);
+  exit(70);
+}
+
+static void *allocate(size_t size) {
+  void *memory = malloc(size);
+  if (memory == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(70);
+  }
+  return memory;
+}
+
+static Obj *allocate_obj(size_t size, ObjType type) {
+  Obj *obj = (Obj *)allocate(size);
+  obj->type = type;
+  return obj;
+}
+
+static bool is_obj_type(Value v, ObjType type) {
+  return v.type == VAL_OBJ && v.as.obj->type == type;
+}
+
+// ---------- Tables ----------
+
+static uint32_t hash_key(const char *key) {
+  uint32_t hash = 2166136261u;
+  for (; *key; key++) {
+    hash ^= (uint8_t)*key;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static LoxTableEntry *find_entry(LoxTableEntry *entries, int capacity,
+                                 const char *key) {
+  uint32_t index = hash_key(key) & (uint32_t)(capacity - 1);
+  for (;;) {
+    LoxTableEntry *entry = &entries[index];
+    if (entry->key == NULL || entry->key == key || strcmp(entry->key, key) == 0)
+      return entry;
+    index = (index + 1) & (uint32_t)(capacity - 1);
+  }
+}
+
+static void table_init(LoxTable *table) {
+  table->count = 0;
+  table->capacity = 0;
+  table->entries = NULL;
+}
+
+static bool table_get(LoxTable *table, const char *key, Value *value) {
+  if (table->count == 0)
+    return false;
+  LoxTableEntry *entry = find_entry(table->entries, table->capacity, key);
+  if (entry->key == NULL)
+    return false;
+  *value = entry->value;
+  return true;
+}
+
+static void table_grow(LoxTable *table) {
+  int capacity = table->capacity < 8 ? 8 : table->capacity * 2;
+  LoxTableEntry *entries =
+      (LoxTableEntry *)allocate(sizeof(LoxTableEntry) * (size_t)capacity);
+  for (int i = 0; i < capacity; i++)
+    entries[i].key = NULL;
+
+  for (int i = 0; i < table->capacity; i++) {
+    LoxTableEntry *entry = &table->entries[i];
+    if (entry->key == NULL)
+      continue;
+    LoxTableEntry *dest = find_entry(entries, capacity, entry->key);
+    *dest = *entry;
+  }
+
+  free(table->entries);
+  table->entries = entries;
+  table->capacity = capacity;
+}
+
+static void table_set(LoxTable *table, const char *key, Value value) {
+  if (table->count + 1 > table->capacity * TABLE_MAX_LOAD)
+    table_grow(table);
+  LoxTableEntry *entry = find_entry(table->entries, table->capacity, key);
+  if (entry->key == NULL)
+    table->count++;
+  entry->key = key;
+  entry->value = value;
+}
+
+// ---------- Objects ----------
+
+Value lox_copy_string(const char *chars, size_t length) {
+  LoxString *string =
+      (LoxString *)allocate_obj(sizeof(LoxString) + length + 1, OBJ_STRING);
+  string->length = length;
+  string->hash = 0;
+  memcpy(string->chars, chars, length);
+  string->chars[length] = '\0';
+  return lox_obj(&string->obj);
+}
+
+Value *lox_new_cell(Value initial) {
+  Value *cell = (Value *)allocate(sizeof(Value));
+  *cell = initial;
+  return cell;
+}
+
+Value lox_new_closure(LoxFn fn, int arity, const char *name, int cellCount,
+                      Value **cells) {
+  LoxClosure *closure =
+      (LoxClosure *)allocate_obj(sizeof(LoxClosure), OBJ_CLOSURE);
+  closure->fn = fn;
+  closure->arity = arity;
+  closure->name = name;
+  closure->cellCount = cellCount;
+  closure->cells = NULL;
+  if (cellCount > 0) {
+    closure->cells = (Value **)allocate(sizeof(Value *) * (size_t)cellCount);
+    memcpy(closure->cells, cells, sizeof(Value *) * (size_t)cellCount);
+  }
+  return lox_obj(&closure->obj);
+}
+
+/* Every class by name, the latest definition winning, for readValue. */
+static LoxTable class_registry;
+
+Value lox_new_class(const char *name, Value superclass) {
+  if (superclass.type != VAL_NIL && !is_obj_type(superclass, OBJ_CLASS))
+    lox_runtime_error("Superclass must be a class.");
+
+  LoxClass *klass = (LoxClass *)allocate_obj(sizeof(LoxClass), OBJ_CLASS);
+  klass->name = name;
+  klass->superclass =
+      superclass.type == VAL_NIL ? NULL : (LoxClass *)superclass.as.obj;
+  table_init(&klass->methods);
+  table_init(&klass->layout);
+  klass->fixed = klass->superclass != NULL && klass->superclass->fixed;
+  if (klass->fixed) {
+    LoxTable *inherited = &klass->superclass->layout;
+    for (int i = 0; i < inherited->capacity; i++)
+      if (inherited->entries[i].key != NULL)
+        table_set(&klass->layout, inherited->entries[i].key,
+                  inherited->entries[i].value);
+  }
+  klass->equals = klass->superclass != NULL ? klass->superclass->equals : NULL;
+  klass->hash = klass->superclass != NULL ? klass->superclass->hash : NULL;
+  klass->construct = NULL;
+  klass->arity = 0;
+  table_set(&class_registry, name, lox_obj(&klass->obj));
+  return lox_obj(&klass->obj);
+}
+
+void lox_class_add_method(Value klass, const char *name, Value method) {
+  LoxClass *target = (LoxClass *)klass.as.obj;
+  table_set(&target->methods, name, method);
+  if (strcmp(name, "equals") == 0)
+    target->equals = (LoxClosure *)method.as.obj;
+  else if (strcmp(name, "hash") == 0)
+    target->hash = (LoxClosure *)method.as.obj;
+}
+
+/* Called in declaration order, after lox_new_class and before any instance. */
+void lox_class_add_field(Value klass, const char *name, const char *type) {
+  LoxClass *target = (LoxClass *)klass.as.obj;
+  Value existing;
+  if (target->superclass != NULL && !target->superclass->fixed)
+    lox_runtime_error(
+        "Superclass of a class with declared fields must declare its fields.");
+  if (target->superclass != NULL &&
+      table_get(&target->superclass->layout, name, &existing))
+    lox_runtime_error("Field '%s' is already declared by a superclass.", name);
+  target->fixed = true;
+  table_set(&target->layout, name,
+            type == NULL ? lox_nil() : lox_copy_string(type, strlen(type)));
+}
+
+static LoxClosure *find_method(LoxClass *klass, const char *name) {
+  for (; klass != NULL; klass = klass->superclass) {
+    Value method;
+    if (table_get(&klass->methods, name, &method))
+      return (LoxClosure *)method.as.obj;
+  }
+  return NULL;
+}
+
+/* Declared fields start out as nil, or 0, false or "" if annotated so. */
+static Value initial_value(Value type) {
+  if (type.type != VAL_OBJ)
+    return lox_nil();
+  const char *name = ((LoxString *)type.as.obj)->chars;
+  if (strcmp(name, "num") == 0)
+    return lox_number(0);
+  if (strcmp(name, "bool") == 0)
+    return lox_bool(false);
+  if (strcmp(name, "str") == 0)
+    return lox_copy_string("", 0);
+  return lox_nil();
+}
+
+static Value new_instance(LoxClass *klass) {
+  LoxInstance *instance =
+      (LoxInstance *)allocate_obj(sizeof(LoxInstance), OBJ_INSTANCE);
+  instance->klass = klass;
+  table_init(&instance->fields);
+  instance->native = NULL;
+
+  for (int i = 0; i < klass->layout.capacity; i++) {
+    LoxTableEntry *entry = &klass->layout.entries[i];
+    if (entry->key != NULL)
+      table_set(&instance->fields, entry->key, initial_value(entry->value));
+  }
+  return lox_obj(&instance->obj);
+}
+
+static Value new_bound_method(Value receiver, LoxClosure *method) {
+  LoxBoundMethod *bound =
+      (LoxBoundMethod *)allocate_obj(sizeof(LoxBoundMethod), OBJ_BOUND_METHOD);
+  bound->receiver = receiver;
+  bound->method = method;
+  return lox_obj(&bound->obj);
+}
+
+// ---------- Operators ----------
+
+static double as_number(Value v) {
+  if (v.type != VAL_NUMBER)
+    lox_runtime_error("Operand must be a number.");
+  return v.as.number;
+}
+
+Value lox_add(Value a, Value b) {
+  if (a.type == VAL_NUMBER && b.type == VAL_NUMBER)
+    return lox_number(a.as.number + b.as.number);
+
+  if (is_obj_type(a, OBJ_STRING) && is_obj_type(b, OBJ_STRING)) {
+    LoxString *left = (LoxString *)a.as.obj;
+    LoxString *right = (LoxString *)b.as.obj;
+    size_t length = left->length + right->length;
+    LoxString *result =
+        (LoxString *)allocate_obj(sizeof(LoxString) + length + 1, OBJ_STRING);
+    result->length = length;
+    result->hash = 0;
+    memcpy(result->chars, left->chars, left->length);
+    memcpy(result->chars + left->length, right->chars, right->length);
+    result->chars[length] = '\0';
+    return lox_obj(&result->obj);
+  }
+
+  lox_runtime_error("Operands must be two numbers or two strings.");
+  return lox_nil();
+}
+
+Value lox_subtract(Value a, Value b) {
+  return lox_number(as_number(a) - as_number(b));
+}
+
+Value lox_multiply(Value a, Value b) {
+  return lox_number(as_number(a) * as_number(b));
+}
+
+Value lox_divide(Value a, Value b) {
+  double divisor = as_number(b);
+  double dividend = as_number(a);
+  if (divisor == 0)
+    lox_runtime_error("Division by zero.");
+  return lox_number(dividend / divisor);
+}
+
+Value lox_negate(Value v) { return lox_number(-as_number(v)); }
+
+Value lox_not(Value v) { return lox_bool(!lox_is_truthy(v)); }
+
+static Value call_method(LoxClosure *method, Value receiver, int argc,
+                         Value *args);
+
+/* Objects are equal only to themselves, unless the left operand is an
+ * instance whose class defines `equals`, which decides. */
+static bool values_equal(Value a, Value b) {
+  if (is_obj_type(a, OBJ_INSTANCE)) {
+    LoxClosure *equals = ((LoxInstance *)a.as.obj)->klass->equals;
+    if (equals != NULL)
+      return lox_is_truthy(call_method(equals, a, 1, &b));
+  }
+  if (a.type != b.type)
+    return false;
+  switch (a.type) {
+  case VAL_NIL:
+    return true;
+  case VAL_BOOL:
+    return a.as.boolean == b.as.boolean;
+  case VAL_NUMBER:
+    return a.as.number == b.as.number;
+  case VAL_OBJ:
+    if (is_obj_type(a, OBJ_STRING) && is_obj_type(b, OBJ_STRING)) {
+      LoxString *left = (LoxString *)a.as.obj;
+      LoxString *right = (LoxString *)b.as.obj;
+      return left->length == right->length &&
+             memcmp(left->chars, right->chars, left->length) == 0;
+    }
+    return a.as.obj == b.as.obj;
+  }
+  return false;
+}
+
+Value lox_equal(Value a, Value b) { return lox_bool(values_equal(a, b)); }
+
+Value lox_not_equal(Value a, Value b) { return lox_bool(!values_equal(a, b)); }
+
+Value lox_greater(Value a, Value b) {
+  return lox_bool(as_number(a) > as_number(b));
+}
+
+Value lox_greater_equal(Value a, Value b) {
+  return lox_bool(as_number(a) >= as_number(b));
+}
+
+Value lox_less(Value a, Value b) {
+  return lox_bool(as_number(a) < as_number(b));
+}
+
+Value lox_less_equal(Value a, Value b) {
+  return lox_bool(as_number(a) <= as_number(b));
+}
+
+// ---------- Calls and properties ----------
+
+static void check_arity(int expected, int argc) {
+  if (argc != expected)
+    lox_runtime_error("Expected %d arguments but got %d.", expected, argc);
+}
+
+static Value call_method(LoxClosure *method, Value receiver, int argc,
+                         Value *args) {
+  check_arity(method->arity, argc);
+  Value bound[LOX_MAX_ARGS + 1];
+  bound[0] = receiver;
+  for (int i = 0; i < argc; i++)
+    bound[i + 1] = args[i];
+  return method->fn(method, argc + 1, bound);
+}
+
+Value lox_call(Value callee, int argc, Value *args) {
+  if (callee.type == VAL_OBJ) {
+    switch (callee.as.obj->type) {
+    case OBJ_CLOSURE: {
+      LoxClosure *closure = (LoxClosure *)callee.as.obj;
+      check_arity(closure->arity, argc);
+      return closure->fn(closure, argc, args);
+    }
+    case OBJ_BOUND_METHOD: {
+      LoxBoundMethod *bound = (LoxBoundMethod *)callee.as.obj;
+      return call_method(bound->method, bound->receiver, argc, args);
+    }
+    case OBJ_CLASS: {
+      LoxClass *klass = (LoxClass *)callee.as.obj;
+      if (klass->construct != NULL) {
+        check_arity(klass->arity, argc);
+        return klass->construct(klass, argc, args);
+      }
+      Value instance = new_instance(klass);
+      LoxClosure *init = find_method(klass, "init");
+      if (init != NULL)
+        call_method(init, instance, argc, args);
+      else
+        check_arity(0, argc);
+      return instance;
+    }
+    default:
+      break;
+    }
+  }
+  lox_runtime_error("Can only call functions and classes.");
+  return lox_nil();
+}
+
+/* Row proxies of a Columns keep their fields in its columns. */
+static bool row_get(LoxInstance *instance, const char *name, Value *out);
+static bool row_set(LoxInstance *instance, const char *name, Value value);
+
+static LoxInstance *as_instance(Value v, const char *message) {
+  if (!is_obj_type(v, OBJ_INSTANCE))
+    lox_runtime_error("%s", message);
+  return (LoxInstance *)v.as.obj;
+}
+
+Value lox_invoke(Value receiver, const char *name, int argc, Value *args) {
+  LoxInstance *instance =
+      as_instance(receiver, "Only instances have properties.");
+
+  Value field;
+  if (row_get(instance, name, &field) ||
+      table_get(&instance->fields, name, &field))
+    return lox_call(field, argc, args);
+
+  LoxClosure *method = find_method(instance->klass, name);
+  if (method == NULL)
+    lox_runtime_error("Undefined property '%s'.", name);
+  return call_method(method, receiver, argc, args);
+}
+
+Value lox_get_property(Value receiver, const char *name) {
+  LoxInstance *instance =
+      as_instance(receiver, "Only instances have properties.");
+
+  Value field;
+  if (row_get(instance, name, &field) ||
+      table_get(&instance->fields, name, &field))
+    return field;
+
+  LoxClosure *method = find_method(instance->klass, name);
+  if (method == NULL)
+    lox_runtime_error("Undefined property '%s'.", name);
+  return new_bound_method(receiver, method);
+}
+
+Value lox_set_property(Value receiver, const char *name, Value value) {
+  LoxInstance *instance = as_instance(receiver, "Only instances have fields.");
+  if (instance->klass->fixed) {
+    Value type;
+    if (!table_get(&instance->klass->layout, name, &type))
+      lox_runtime_error("Undefined field '%s'.", name);
+    if (type.type == VAL_OBJ)
+      value = lox_check_type(value, ((LoxString *)type.as.obj)->chars);
+  }
+  if (!row_set(instance, name, value))
+    table_set(&instance->fields, name, value);
+  return value;
+}
+
+Value lox_super_bind(Value superclass, const char *name, Value receiver) {
+  LoxClosure *method = find_method((LoxClass *)superclass.as.obj, name);
+  if (method == NULL)
+    lox_runtime_error("Undefined property '%s'.", name);
+  return new_bound_method(receiver, method);
+}
+
+Value lox_super_invoke(Value superclass, const char *name, Value receiver,
+                       int argc, Value *args) {
+  LoxClosure *method = find_method((LoxClass *)superclass.as.obj, name);
+  if (method == NULL)
+    lox_runtime_error("Undefined property '%s'.", name);
+  return call_method(method, receiver, argc, args);
+}
+
+// ---------- Type annotations ----------
+
+static bool matches_type(Value v, const char *type) {
+  if (strcmp(type, "num") == 0)
+    return v.type == VAL_NUMBER;
+  if (strcmp(type, "bool") == 0)
+    return v.type == VAL_BOOL;
+  if (strcmp(type, "str") == 0)
+    return is_obj_type(v, OBJ_STRING);
+  if (!is_obj_type(v, OBJ_INSTANCE))
+    return false;
+  for (LoxClass *klass = ((LoxInstance *)v.as.obj)->klass; klass != NULL;
+       klass = klass->superclass) {
+    if (strcmp(klass->name, type) == 0)
+      return true;
+  }
+  return false;
+}
+
+Value lox_check_type(Value v, const char *type) {
+  if (matches_type(v, type))
+    return v;
+  if (is_obj_type(v, OBJ_INSTANCE))
+    lox_runtime_error("Expected %s but got %s instance.", type,
+                      ((LoxInstance *)v.as.obj)->klass->name);
+  const char *got = "function";
+  if (v.type == VAL_NIL)
+    got = "nil";
+  else if (v.type == VAL_BOOL)
+    got = "bool";
+  else if (v.type == VAL_NUMBER)
+    got = "num";
+  else if (is_obj_type(v, OBJ_STRING))
+    got = "str";
+  else if (is_obj_type(v, OBJ_CLASS))
+    got = "class";
+  lox_runtime_error("Expected %s but got %s.", type, got);
+  return v;
+}
+
+// ---------- Printing ----------
+
+void lox_print(Value v) {
+  switch (v.type) {
+  case VAL_NIL:
+    printf("nil\n");
+    return;
+  case VAL_BOOL:
+    printf(v.as.boolean ? "true\n" : "false\n");
+    return;
+  case VAL_NUMBER:
+    printf("%g\n", v.as.number);
+    return;
+  case VAL_OBJ:
+    break;
+  }
+
+  switch (v.as.obj->type) {
+  case OBJ_STRING: {
+    LoxString *string = (LoxString *)v.as.obj;
+    fwrite(string->chars, 1, string->length, stdout);
+    fputc('\n', stdout);
+    break;
+  }
+  case OBJ_CLOSURE:
+  case OBJ_BOUND_METHOD:
+    printf("<fn>\n");
+    break;
+  case OBJ_CLASS:
+    printf("%s\n", ((LoxClass *)v.as.obj)->name);
+    break;
+  case OBJ_INSTANCE:
+    printf("%s instance\n", ((LoxInstance *)v.as.obj)->klass->name);
+    break;
+  }
+}
+
+// ---------- Math natives ----------
+
+#define LOX_MATH_1(name, expr)                                                 \
+  static Value native_##name(LoxClosure *closure, int argc, Value *args) {     \
+    (void)closure;                                                             \
+    (void)argc;                                                                \
+    double a = as_number(args[0]);                                             \
+    return lox_number(expr);                                                   \
+  }
+
+#define LOX_MATH_2(name, expr)                                                 \
+  static Value native_##name(LoxClosure *closure, int argc, Value *args) {     \
+    (void)closure;                                                             \
+    (void)argc;                                                                \
+    double a = as_number(args[0]);                                             \
+    double b = as_number(args[1]);                                             \
+    return lox_number(expr);                                                   \
+  }
+
+LOX_MATH_1(sqrt, sqrt(a))
+LOX_MATH_1(floor, floor(a))
+LOX_MATH_1(ceil, ceil(a))
+LOX_MATH_1(abs, fabs(a))
+LOX_MATH_2(min, fmin(a, b))
+LOX_MATH_2(max, fmax(a, b))
+LOX_MATH_2(pow, pow(a, b))
+LOX_MATH_1(exp, exp(a))
+LOX_MATH_1(log, log(a))
+LOX_MATH_1(sin, sin(a))
+LOX_MATH_1(cos, cos(a))
+LOX_MATH_2(atan2, atan2(a, b))
+
+static Value native_fma(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number(
+      fma(as_number(args[0]), as_number(args[1]), as_number(args[2])));
+}
+
+// ---------- Number conversion ----------
+
+/*
+ * Integral numbers print as integers. Others use the shortest round-trip
+ * digits in whichever of fixed or scientific notation is shorter, fixed on a
+ * tie, the way the interpreter and std::to_chars write them.
+ */
+static int format_number(char *out, size_t size, double d) {
+  if (isnan(d))
+    return snprintf(out, size, "nan");
+  if (isinf(d))
+    return snprintf(out, size, d < 0 ? "-inf" : "inf");
+  if (d == floor(d) && fabs(d) <= 9007199254740992.0)
+    return snprintf(out, size, "%lld", (long long)d);
+
+  /* Seventeen significant digits always round-trip. */
+  char scientific[32];
+  for (int precision = 0; precision <= 16; precision++) {
+    snprintf(scientific, sizeof scientific, "%.*e", precision, d);
+    if (strtod(scientific, NULL) == d)
+      break;
+  }
+
+  char digits[20];
+  int count = 0;
+  const char *c = scientific + (d < 0);
+  for (; *c != 'e'; c++)
+    if (*c != '.')
+      digits[count++] = *c;
+  int exponent = atoi(c + 1);
+
+  int sign = d < 0;
+  int fixed_length = sign + (exponent >= count - 1 ? exponent + 1
+                             : exponent >= 0      ? count + 1
+                                                  : count + 1 - exponent);
+  if (fixed_length > (int)strlen(scientific))
+    return snprintf(out, size, "%s", scientific);
+
+  char *p = out;
+  if (sign)
+    *p++ = '-';
+  if (exponent < 0) {
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = -1; i > exponent; i--)
+      *p++ = '0';
+    memcpy(p, digits, (size_t)count);
+    p += count;
+  } else {
+    for (int i = 0; i < count || i <= exponent; i++) {
+      if (i == exponent + 1)
+        *p++ = '.';
+      *p++ = i < count ? digits[i] : '0';
+    }
+  }
+  *p = '\0';
+  return (int)(p - out);
+}
+
+static Value native_to_string(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  char buffer[32];
+  int length = format_number(buffer, sizeof buffer, as_number(args[0]));
+  return lox_copy_string(buffer, (size_t)length);
+}
+
+/*
+ * Only complete plain decimals parse; strtod alone would take "inf" or hex.
+ * `chars` must be NUL terminated at `length`.
+ */
+static bool parse_decimal(const char *chars, size_t length, double *out) {
+  const char *digits = chars[0] == '-' ? chars + 1 : chars;
+  if (!((*digits >= '0' && *digits <= '9') || *digits == '.'))
+    return false;
+
+  char *end;
+  *out = strtod(chars, &end);
+  return end == chars + length && strpbrk(chars, "xXpP") == NULL;
+}
+
+static Value native_parse_number(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  if (!is_obj_type(args[0], OBJ_STRING))
+    lox_runtime_error("Operand must be a string.");
+
+  LoxString *text = (LoxString *)args[0].as.obj;
+  double d;
+  return parse_decimal(text->chars, text->length, &d) ? lox_number(d)
+                                                      : lox_nil();
+}
+
+// ---------- Strings ----------
+
+static LoxString *string_argument(Value v) {
+  if (!is_obj_type(v, OBJ_STRING))
+    lox_runtime_error("Operand must be a string.");
+  return (LoxString *)v.as.obj;
+}
+
+/* A string index in [0, limit]. */
+static size_t string_index(Value v, size_t limit) {
+  double i = as_number(v);
+  if (i < 0 || i > (double)limit || i != floor(i))
+    lox_runtime_error("String index out of range.");
+  return (size_t)i;
+}
+
+/* memchr finds each candidate first byte; memcmp checks the rest. */
+static const char *find_bytes(const char *haystack, size_t length,
+                              const char *needle, size_t needle_length) {
+  if (needle_length == 0)
+    return haystack;
+  const char *end = haystack + length;
+  while ((size_t)(end - haystack) >= needle_length) {
+    const char *hit = (const char *)memchr(
+        haystack, needle[0], (size_t)(end - haystack) - needle_length + 1);
+    if (hit == NULL)
+      return NULL;
+    if (memcmp(hit + 1, needle + 1, needle_length - 1) == 0)
+      return hit;
+    haystack = hit + 1;
+  }
+  return NULL;
+}
+
+static Value native_len(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number((double)string_argument(args[0])->length);
+}
+
+static Value native_index_of(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *text = string_argument(args[0]);
+  LoxString *needle = string_argument(args[1]);
+  const char *hit =
+      find_bytes(text->chars, text->length, needle->chars, needle->length);
+  return lox_number(hit ? (double)(hit - text->chars) : -1);
+}
+
+static Value native_starts_with(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *text = string_argument(args[0]);
+  LoxString *prefix = string_argument(args[1]);
+  return lox_bool(prefix->length <= text->length &&
+                  memcmp(text->chars, prefix->chars, prefix->length) == 0);
+}
+
+static Value native_substring(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *text = string_argument(args[0]);
+  size_t end = string_index(args[2], text->length);
+  size_t start = string_index(args[1], end);
+  return lox_copy_string(text->chars + start, end - start);
+}
+
+static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+static Value native_trim(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *text = string_argument(args[0]);
+  size_t start = 0, end = text->length;
+  while (start < end && is_space(text->chars[start]))
+    start++;
+  while (end > start && is_space(text->chars[end - 1]))
+    end--;
+  return lox_copy_string(text->chars + start, end - start);
+}
+
+static Value native_char_at(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *text = string_argument(args[0]);
+  if (text->length == 0)
+    lox_runtime_error("String index out of range.");
+  return lox_copy_string(text->chars + string_index(args[1], text->length - 1),
+                         1);
+}
+
+static Value list_new(void);
+static void list_push(Value list, Value item);
+
+static Value native_split(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *text = string_argument(args[0]);
+  LoxString *separator = string_argument(args[1]);
+  if (separator->length == 0)
+    lox_runtime_error("Separator must not be empty.");
+
+  Value list = list_new();
+  const char *start = text->chars;
+  const char *end = text->chars + text->length;
+  const char *hit;
+  while ((hit = find_bytes(start, (size_t)(end - start), separator->chars,
+                           separator->length)) != NULL) {
+    list_push(list, lox_copy_string(start, (size_t)(hit - start)));
+    start = hit + separator->length;
+  }
+  list_push(list, lox_copy_string(start, (size_t)(end - start)));
+  return list;
+}
+
+// ---------- match ----------
+
+/*
+ * `match(pattern, text)` builds the same DFA as RegexDfa.kt: a Thompson NFA
+ * over bytes, then subset construction, with `transitions[state * 256 + b]`
+ * the next state or -1 once no match is possible. Automata are cached per
+ * pattern and never freed, like every other runtime object.
+ */
+#define REGEX_MAX_STATES 4096
+
+typedef struct {
+  uint64_t bits[4];
+} ByteSet;
+
+typedef struct {
+  int start, end;
+} Fragment;
+
+typedef struct {
+  const char *p;
+  size_t pos, end;
+  int count, capacity;
+  ByteSet *bytes;
+  bool *has_bytes;
+  int *next;
+  int (*epsilons)[2];
+  int *epsilon_count;
+} RegexCompiler;
+
+typedef struct Dfa {
+  char *pattern;
+  size_t pattern_length;
+  int *transitions;
+  bool *accepting;
+  bool anchored_end;
+  struct Dfa *next_cached;
+} Dfa;
+
+static void byte_set_add(ByteSet *set, int b) {
+  set->bits[b >> 6] |= (uint64_t)1 << (b & 63);
+}
+
+static bool byte_set_has(const ByteSet *set, int b) {
+  return (set->bits[b >> 6] >> (b & 63)) & 1;
+}
+
+static ByteSet byte_set_invert(ByteSet set) {
+  for (int i = 0; i < 4; i++)
+    set.bits[i] = ~set.bits[i];
+  return set;
+}
+
+static void invalid_pattern(void) { lox_runtime_error("Invalid pattern."); }
+
+static int nfa_state(RegexCompiler *c) {
+  if (c->count == c->capacity) {
+    c->capacity = c->capacity < 16 ? 16 : c->capacity * 2;
+    size_t n = (size_t)c->capacity;
+    c->bytes = (ByteSet *)realloc(c->bytes, sizeof(ByteSet) * n);
+    c->has_bytes = (bool *)realloc(c->has_bytes, sizeof(bool) * n);
+    c->next = (int *)realloc(c->next, sizeof(int) * n);
+    c->epsilons = (int(*)[2])realloc(c->epsilons, sizeof(int[2]) * n);
+    c->epsilon_count = (int *)realloc(c->epsilon_count, sizeof(int) * n);
+    if (!c->bytes || !c->has_bytes || !c->next || !c->epsilons ||
+        !c->epsilon_count)
+      lox_runtime_error("Out of memory.");
+  }
+  int s = c->count++;
+  c->has_bytes[s] = false;
+  c->next[s] = -1;
+  c->epsilon_count[s] = 0;
+  return s;
+}
+
+/* Thompson construction adds at most two epsilon edges to any state. */
+static void nfa_epsilon(RegexCompiler *c, int from, int to) {
+  c->epsilons[from][c->epsilon_count[from]++] = to;
+}
+
+static Fragment nfa_set(RegexCompiler *c, ByteSet set) {
+  Fragment f = {nfa_state(c), nfa_state(c)};
+  c->bytes[f.start] = set;
+  c->has_bytes[f.start] = true;
+  c->next[f.start] = f.end;
+  return f;
+}
+
+static bool regex_peek(RegexCompiler *c, char ch) {
+  return c->pos < c->end && c->p[c->pos] == ch;
+}
+
+static ByteSet regex_escape(RegexCompiler *c) {
+  if (c->pos >= c->end)
+    invalid_pattern();
+  unsigned char ch = (unsigned char)c->p[c->pos++];
+  ByteSet set = {{0, 0, 0, 0}};
+  int lower = ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+  if (lower == 'd') {
+    for (int b = '0'; b <= '9'; b++)
+      byte_set_add(&set, b);
+  } else if (lower == 'w') {
+    for (int b = 0; b < 256; b++)
+      if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') ||
+          (b >= '0' && b <= '9') || b == '_')
+        byte_set_add(&set, b);
+  } else if (lower == 's') {
+    byte_set_add(&set, ' ');
+    for (int b = '\t'; b <= '\r'; b++)
+      byte_set_add(&set, b);
+  } else {
+    byte_set_add(&set, ch == 'n' ? '\n' : ch == 't' ? '\t' : ch);
+    return set;
+  }
+  return ch >= 'A' && ch <= 'Z' ? byte_set_invert(set) : set;
+}
+
+static ByteSet regex_class(RegexCompiler *c) {
+  ByteSet set = {{0, 0, 0, 0}};
+  bool negated = regex_peek(c, '^');
+  if (negated)
+    c->pos++;
+  for (bool first = true;; first = false) {
+    if (c->pos >= c->end)
+      invalid_pattern();
+    if (regex_peek(c, ']') && !first)
+      break;
+    if (regex_peek(c, '\\')) {
+      c->pos++;
+      ByteSet escaped = regex_escape(c);
+      for (int i = 0; i < 4; i++)
+        set.bits[i] |= escaped.bits[i];
+      continue;
+    }
+    unsigned char low = (unsigned char)c->p[c->pos++];
+    if (regex_peek(c, '-') && c->pos + 1 < c->end && c->p[c->pos + 1] != ']') {
+      unsigned char high = (unsigned char)c->p[c->pos + 1];
+      if (high < low)
+        invalid_pattern();
+      for (int b = low; b <= high; b++)
+        byte_set_add(&set, b);
+      c->pos += 2;
+    } else {
+      byte_set_add(&set, low);
+    }
+  }
+  c->pos++;
+  return negated ? byte_set_invert(set) : set;
+}
+
+static Fragment regex_alternation(RegexCompiler *c);
+
+static Fragment regex_atom(RegexCompiler *c) {
+  unsigned char ch = (unsigned char)c->p[c->pos++];
+  ByteSet set = {{0, 0, 0, 0}};
+  switch (ch) {
+  case '(': {
+    Fragment inner = regex_alternation(c);
+    if (!regex_peek(c, ')'))
+      invalid_pattern();
+    c->pos++;
+    return inner;
+  }
+  case '[':
+    return nfa_set(c, regex_class(c));
+  case '.':
+    byte_set_add(&set, '\n');
+    return nfa_set(c, byte_set_invert(set));
+  case '\\':
+    return nfa_set(c, regex_escape(c));
+  case '*':
+  case '+':
+  case '?':
+    invalid_pattern();
+    return nfa_set(c, set);
+  default:
+    byte_set_add(&set, ch);
+    return nfa_set(c, set);
+  }
+}
+
+static Fragment regex_repetition(RegexCompiler *c) {
+  Fragment f = regex_atom(c);
+  for (;; c->pos++) {
+    if (regex_peek(c, '*')) {
+      Fragment star = {nfa_state(c), nfa_state(c)};
+      nfa_epsilon(c, star.start, f.start);
+      nfa_epsilon(c, star.start, star.end);
+      nfa_epsilon(c, f.end, f.start);
+      nfa_epsilon(c, f.end, star.end);
+      f = star;
+    } else if (regex_peek(c, '+')) {
+      int end = nfa_state(c);
+      nfa_epsilon(c, f.end, f.start);
+      nfa_epsilon(c, f.end, end);
+      f.end = end;
+    } else if (regex_peek(c, '?')) {
+      Fragment optional = {nfa_state(c), nfa_state(c)};
+      nfa_epsilon(c, optional.start, f.start);
+      nfa_epsilon(c, optional.start, optional.end);
+      nfa_epsilon(c, f.end, optional.end);
+      f = optional;
+    } else {
+      return f;
+    }
+  }
+}
+
+static Fragment regex_concatenation(RegexCompiler *c) {
+  bool any = false;
+  Fragment f = {0, 0};
+  while (c->pos < c->end && !regex_peek(c, '|') && !regex_peek(c, ')')) {
+    Fragment piece = regex_repetition(c);
+    if (any) {
+      nfa_epsilon(c, f.end, piece.start);
+      f.end = piece.end;
+    } else {
+      f = piece;
+      any = true;
+    }
+  }
+  if (!any) {
+    f.start = f.end = nfa_state(c);
+  }
+  return f;
+}
+
+static Fragment regex_alternation(RegexCompiler *c) {
+  Fragment f = regex_concatenation(c);
+  while (regex_peek(c, '|')) {
+    c->pos++;
+    Fragment right = regex_concatenation(c);
+    Fragment alt = {nfa_state(c), nfa_state(c)};
+    nfa_epsilon(c, alt.start, f.start);
+    nfa_epsilon(c, alt.start, right.start);
+    nfa_epsilon(c, f.end, alt.end);
+    nfa_epsilon(c, right.end, alt.end);
+    f = alt;
+  }
+  return f;
+}
+
+static void nfa_closure(RegexCompiler *c, uint64_t *set, int *stack) {
+  int top = 0;
+  for (int s = 0; s < c->count; s++)
+    if ((set[s >> 6] >> (s & 63)) & 1)
+      stack[top++] = s;
+  while (top > 0) {
+    int s = stack[--top];
+    for (int i = 0; i < c->epsilon_count[s]; i++) {
+      int t = c->epsilons[s][i];
+      if (!((set[t >> 6] >> (t & 63)) & 1)) {
+        set[t >> 6] |= (uint64_t)1 << (t & 63);
+        stack[top++] = t;
+      }
+    }
+  }
+}
+
+/* DFA states under construction: NFA state sets of `words` words each,
+   found through an open-addressed hash table of their indices. */
+typedef struct {
+  size_t words;
+  uint64_t *sets;
+  int count, capacity;
+  int *table;
+  int buckets;
+  int *transitions;
+  bool *accepting;
+} SubsetBuilder;
+
+static int subset_slot(SubsetBuilder *b, const uint64_t *set) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t w = 0; w < b->words; w++)
+    hash = (hash ^ set[w]) * 1099511628211ull;
+  int i = (int)(hash & (uint64_t)(b->buckets - 1));
+  while (b->table[i] >= 0 &&
+         memcmp(b->sets + (size_t)b->table[i] * b->words, set,
+                sizeof(uint64_t) * b->words) != 0)
+    i = (i + 1) & (b->buckets - 1);
+  return i;
+}
+
+static int subset_intern(SubsetBuilder *b, const uint64_t *set) {
+  int slot = subset_slot(b, set);
+  if (b->table[slot] >= 0)
+    return b->table[slot];
+  if (b->count == REGEX_MAX_STATES)
+    lox_runtime_error("Pattern is too complex.");
+
+  if (b->count == b->capacity) {
+    b->capacity = b->capacity < 8 ? 8 : b->capacity * 2;
+    size_t n = (size_t)b->capacity;
+    b->sets = (uint64_t *)realloc(b->sets, sizeof(uint64_t) * b->words * n);
+    b->transitions = (int *)realloc(b->transitions, sizeof(int) * 256 * n);
+    b->accepting = (bool *)realloc(b->accepting, sizeof(bool) * n);
+    if (!b->sets || !b->transitions || !b->accepting)
+      lox_runtime_error("Out of memory.");
+  }
+  int index = b->count++;
+  memcpy(b->sets + (size_t)index * b->words, set,
+         sizeof(uint64_t) * b->words);
+  b->table[slot] = index;
+
+  if (b->count * 2 > b->buckets) {
+    free(b->table);
+    b->buckets *= 2;
+    b->table = (int *)allocate(sizeof(int) * (size_t)b->buckets);
+    for (int i = 0; i < b->buckets; i++)
+      b->table[i] = -1;
+    for (int k = 0; k < b->count; k++)
+      b->table[subset_slot(b, b->sets + (size_t)k * b->words)] = k;
+  }
+  return index;
+}
+
+static bool bit_set(const uint64_t *set, int s) {
+  return (set[s >> 6] >> (s & 63)) & 1;
+}
+
+static Dfa *regex_compile(const char *pattern, size_t length) {
+  RegexCompiler c;
+  memset(&c, 0, sizeof c);
+  c.p = pattern;
+  size_t to = length;
+  bool anchored_start = to > 0 && pattern[0] == '^';
+  if (anchored_start)
+    c.pos = 1;
+  bool anchored_end = false;
+  if (to > c.pos && pattern[to - 1] == '$') {
+    size_t backslashes = 0;
+    while (to - 1 >= c.pos + backslashes + 1 &&
+           pattern[to - 2 - backslashes] == '\\')
+      backslashes++;
+    anchored_end = backslashes % 2 == 0;
+  }
+  if (anchored_end)
+    to--;
+  c.end = to;
+
+  Fragment f = regex_alternation(&c);
+  if (c.pos != c.end)
+    invalid_pattern();
+
+  SubsetBuilder b;
+  memset(&b, 0, sizeof b);
+  b.words = (size_t)c.count / 64 + 1;
+  b.buckets = 16;
+  b.table = (int *)allocate(sizeof(int) * (size_t)b.buckets);
+  for (int i = 0; i < b.buckets; i++)
+    b.table[i] = -1;
+  int *stack = (int *)allocate(sizeof(int) * (size_t)c.count);
+  uint64_t *start = (uint64_t *)calloc(b.words, sizeof(uint64_t));
+  uint64_t *target = (uint64_t *)calloc(b.words, sizeof(uint64_t));
+  if (start == NULL || target == NULL)
+    lox_runtime_error("Out of memory.");
+  start[f.start >> 6] |= (uint64_t)1 << (f.start & 63);
+  nfa_closure(&c, start, stack);
+  subset_intern(&b, start);
+
+  for (int current = 0; current < b.count; current++) {
+    bool accepts = bit_set(b.sets + (size_t)current * b.words, f.end);
+    b.accepting[current] = accepts;
+    for (int byte = 0; byte < 256; byte++) {
+      /* Interning may move `sets`, so index it afresh for every byte. */
+      const uint64_t *set = b.sets + (size_t)current * b.words;
+      b.transitions[current * 256 + byte] = -1;
+      if (accepts && !anchored_end)
+        continue;
+      memset(target, 0, sizeof(uint64_t) * b.words);
+      for (int s = 0; s < c.count; s++) {
+        if (bit_set(set, s) && c.has_bytes[s] && byte_set_has(&c.bytes[s], byte))
+          target[c.next[s] >> 6] |= (uint64_t)1 << (c.next[s] & 63);
+      }
+      nfa_closure(&c, target, stack);
+      bool empty = true;
+      for (size_t w = 0; w < b.words; w++) {
+        if (!anchored_start)
+          target[w] |= start[w];
+        empty = empty && target[w] == 0;
+      }
+      if (!empty) {
+        int next = subset_intern(&b, target);
+        b.transitions[current * 256 + byte] = next;
+      }
+    }
+  }
+
+  Dfa *dfa = (Dfa *)allocate(sizeof(Dfa));
+  dfa->transitions = b.transitions;
+  dfa->accepting = b.accepting;
+  dfa->anchored_end = anchored_end;
+  free(b.sets);
+  free(b.table);
+  free(stack);
+  free(start);
+  free(target);
+  free(c.bytes);
+  free(c.has_bytes);
+  free(c.next);
+  free(c.epsilons);
+  free(c.epsilon_count);
+  return dfa;
+}
+
+static Value native_match(LoxClosure *closure, int argc, Value *args) {
+  static Dfa *cache = NULL;
+  (void)closure;
+  (void)argc;
+  LoxString *pattern = string_argument(args[0]);
+  LoxString *text = string_argument(args[1]);
+
+  Dfa *dfa = cache;
+  while (dfa != NULL && (dfa->pattern_length != pattern->length ||
+                         memcmp(dfa->pattern, pattern->chars, pattern->length) != 0))
+    dfa = dfa->next_cached;
+  if (dfa == NULL) {
+    dfa = regex_compile(pattern->chars, pattern->length);
+    dfa->pattern = (char *)allocate(pattern->length + 1);
+    memcpy(dfa->pattern, pattern->chars, pattern->length + 1);
+    dfa->pattern_length = pattern->length;
+    dfa->next_cached = cache;
+    cache = dfa;
+  }
+
+  int state = 0;
+  for (size_t i = 0; i < text->length; i++) {
+    if (dfa->accepting[state] && !dfa->anchored_end)
+      return lox_bool(true);
+    state = dfa->transitions[state * 256 + (unsigned char)text->chars[i]];
+    if (state < 0)
+      return lox_bool(false);
+  }
+  return lox_bool(dfa->accepting[state]);
+}
+
+/* The splitmix64 finalizer, so nearby inputs land far apart. */
+static uint64_t mix_hash(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return h ^ (h >> 31);
+}
+
+/*
+ * A hash consistent with ==, as a non-negative integer below 2^53: numbers
+ * by value, strings by content (cached in the string), instances of a class
+ * defining `hash` by whatever it returns, and other objects by address.
+ */
+static Value hash_value(Value v) {
+  uint64_t h = 0;
+  if (v.type == VAL_BOOL) {
+    h = v.as.boolean ? 1 : 2;
+  } else if (v.type == VAL_NUMBER) {
+    /* 0.0 for -0.0, which compares equal to it. */
+    double d = v.as.number + 0.0;
+    memcpy(&h, &d, sizeof h);
+    h = mix_hash(h);
+  } else if (is_obj_type(v, OBJ_STRING)) {
+    LoxString *string = (LoxString *)v.as.obj;
+    if (string->hash == 0) {
+      uint64_t fnv = 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < string->length; i++)
+        fnv = (fnv ^ (unsigned char)string->chars[i]) * 0x100000001b3ull;
+      string->hash = mix_hash(fnv) | 1;
+    }
+    h = string->hash;
+  } else if (is_obj_type(v, OBJ_INSTANCE) &&
+             ((LoxInstance *)v.as.obj)->klass->hash != NULL) {
+    return hash_value(
+        call_method(((LoxInstance *)v.as.obj)->klass->hash, v, 0, NULL));
+  } else if (v.type == VAL_OBJ) {
+    h = mix_hash((uint64_t)(uintptr_t)v.as.obj);
+  }
+  return lox_number((double)(h & ((UINT64_C(1) << 53) - 1)));
+}
+
+static Value native_hash(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return hash_value(args[0]);
+}
+
+static Value native_write_value(LoxClosure *closure, int argc, Value *args);
+static Value native_read_value(LoxClosure *closure, int argc, Value *args);
+static Value native_build_table(LoxClosure *closure, int argc, Value *args);
+
+Value lox_native_function(const char *name) {
+  static const struct {
+    const char *name;
+    LoxFn fn;
+    int arity;
+  } natives[] = {
+      {"sqrt", native_sqrt, 1}, {"floor", native_floor, 1},
+      {"ceil", native_ceil, 1}, {"abs", native_abs, 1},
+      {"min", native_min, 2},   {"max", native_max, 2},
+      {"pow", native_pow, 2},   {"exp", native_exp, 1},
+      {"log", native_log, 1},   {"sin", native_sin, 1},
+      {"cos", native_cos, 1},   {"atan2", native_atan2, 2},
+      {"fma", native_fma, 3},
+      {"parseNumber", native_parse_number, 1},
+      {"toString", native_to_string, 1},
+      {"hash", native_hash, 1},
+      {"len", native_len, 1},
+      {"indexOf", native_index_of, 2},
+      {"startsWith", native_starts_with, 2},
+      {"substring", native_substring, 3},
+      {"trim", native_trim, 1},
+      {"charAt", native_char_at, 2},
+      {"split", native_split, 2},
+      {"match", native_match, 2},
+      {"writeValue", native_write_value, 2},
+      {"readValue", native_read_value, 1},
+      {"buildTable", native_build_table, 3},
+  };
+
+  for (size_t i = 0; i < sizeof(natives) / sizeof(natives[0]); i++) {
+    if (strcmp(natives[i].name, name) == 0)
+      return lox_new_closure(natives[i].fn, natives[i].arity, natives[i].name,
+                             0, NULL);
+  }
+  return lox_nil();
+}
+
+// ---------- Random ----------
+
+/*
+ * Four interleaved xoshiro256** lanes stored word-major, so fill() can step
+ * all lanes at once and the compiler can vectorize it. Sample i always comes
+ * from lane i % 4, so fill() and next() produce the same stream, matching
+ * the interpreter and the C++ runtime.
+ */
+#define RANDOM_LANES 4
+
+typedef struct {
+  uint64_t s[4][RANDOM_LANES];
+  int lane;
+} RandomState;
+
+typedef struct {
+  size_t length;
+  double *data;
+} BufferState;
+
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t random_step(RandomState *r, int l) {
+  uint64_t result = rotl(r->s[1][l] * 5, 7) * 9;
+  uint64_t t = r->s[1][l] << 17;
+  r->s[2][l] ^= r->s[0][l];
+  r->s[3][l] ^= r->s[1][l];
+  r->s[1][l] ^= r->s[2][l];
+  r->s[0][l] ^= r->s[3][l];
+  r->s[2][l] ^= t;
+  r->s[3][l] = rotl(r->s[3][l], 45);
+  return result;
+}
+
+/* 52 random mantissa bits under the exponent of 1.0 give [1, 2). */
+static inline double random_unit(uint64_t bits) {
+  uint64_t pattern = (bits >> 12) | 0x3ff0000000000000ull;
+  double d;
+  memcpy(&d, &pattern, sizeof d);
+  return d - 1.0;
+}
+
+static double random_next(RandomState *r) {
+  double d = random_unit(random_step(r, r->lane));
+  r->lane = (r->lane + 1) % RANDOM_LANES;
+  return d;
+}
+
+static void *native_state(Value receiver) {
+  return ((LoxInstance *)receiver.as.obj)->native;
+}
+
+static BufferState *buffer_argument(Value v);
+
+static Value random_new(LoxClass *klass, RandomState *state) {
+  Value instance = new_instance(klass);
+  ((LoxInstance *)instance.as.obj)->native = state;
+  return instance;
+}
+
+static Value native_random_construct(LoxClass *klass, int argc, Value *args) {
+  (void)argc;
+  RandomState *r = (RandomState *)allocate(sizeof(RandomState));
+  uint64_t x = (uint64_t)(int64_t)as_number(args[0]);
+  for (int l = 0; l < RANDOM_LANES; l++) {
+    for (int w = 0; w < 4; w++) {
+      uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      r->s[w][l] = z ^ (z >> 31);
+    }
+  }
+  r->lane = 0;
+  return random_new(klass, r);
+}
+
+static Value native_random_next(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number(random_next((RandomState *)native_state(args[0])));
+}
+
+static Value native_random_fill(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  RandomState *r = (RandomState *)native_state(args[0]);
+  BufferState *buffer = buffer_argument(args[1]);
+  double *out = buffer->data;
+  size_t n = buffer->length;
+
+  size_t i = 0;
+  while (i < n && r->lane != 0)
+    out[i++] = random_next(r);
+  for (; i + RANDOM_LANES <= n; i += RANDOM_LANES) {
+    for (int l = 0; l < RANDOM_LANES; l++)
+      out[i + l] = random_unit(random_step(r, l));
+  }
+  while (i < n)
+    out[i++] = random_next(r);
+  return lox_nil();
+}
+
+/* The child continues this stream; the parent jumps 2^128 steps per lane. */
+static Value native_random_split(LoxClosure *closure, int argc, Value *args) {
+  static const uint64_t jump[] = {0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull,
+                                  0xa9582618e03fc9aaull, 0x39abdc4529b1661cull};
+  (void)closure;
+  (void)argc;
+  RandomState *r = (RandomState *)native_state(args[0]);
+  RandomState *child = (RandomState *)allocate(sizeof(RandomState));
+  *child = *r;
+
+  for (int l = 0; l < RANDOM_LANES; l++) {
+    uint64_t jumped[4] = {0, 0, 0, 0};
+    for (int j = 0; j < 4; j++) {
+      for (int bit = 0; bit < 64; bit++) {
+        if (jump[j] & ((uint64_t)1 << bit)) {
+          for (int w = 0; w < 4; w++)
+            jumped[w] ^= r->s[w][l];
+        }
+        random_step(r, l);
+      }
+    }
+    for (int w = 0; w < 4; w++)
+      r->s[w][l] = jumped[w];
+  }
+  return random_new(((LoxInstance *)args[0].as.obj)->klass, child);
+}
+
+// ---------- Buffer ----------
+
+static LoxClass *buffer_class;
+
+static BufferState *buffer_argument(Value v) {
+  if (!is_obj_type(v, OBJ_INSTANCE) ||
+      ((LoxInstance *)v.as.obj)->klass != buffer_class)
+    lox_runtime_error("Argument must be a Buffer.");
+  return (BufferState *)native_state(v);
+}
+
+static size_t buffer_index(BufferState *buffer, Value v) {
+  double i = as_number(v);
+  if (i < 0 || i >= (double)buffer->length || i != floor(i))
+    lox_runtime_error("Buffer index out of range.");
+  return (size_t)i;
+}
+
+static Value native_buffer_construct(LoxClass *klass, int argc, Value *args) {
+  (void)argc;
+  double length = as_number(args[0]);
+  if (length < 0 || length != floor(length))
+    lox_runtime_error("Buffer length must be a non-negative integer.");
+
+  BufferState *buffer = (BufferState *)allocate(sizeof(BufferState));
+  buffer->length = (size_t)length;
+  buffer->data = (double *)calloc(buffer->length ? buffer->length : 1,
+                                  sizeof(double));
+  if (buffer->data == NULL)
+    lox_runtime_error("Out of memory.");
+
+  Value instance = new_instance(klass);
+  ((LoxInstance *)instance.as.obj)->native = buffer;
+  return instance;
+}
+
+static Value native_buffer_length(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number((double)((BufferState *)native_state(args[0]))->length);
+}
+
+static Value native_buffer_get(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  BufferState *buffer = (BufferState *)native_state(args[0]);
+  return lox_number(buffer->data[buffer_index(buffer, args[1])]);
+}
+
+static Value native_buffer_set(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  BufferState *buffer = (BufferState *)native_state(args[0]);
+  buffer->data[buffer_index(buffer, args[1])] = as_number(args[2]);
+  return lox_nil();
+}
+
+// ---------- List ----------
+
+typedef struct {
+  size_t count;
+  size_t capacity;
+  Value *items;
+} ListState;
+
+static Value native_list_construct(LoxClass *klass, int argc, Value *args) {
+  (void)argc;
+  (void)args;
+  ListState *list = (ListState *)allocate(sizeof(ListState));
+  list->count = 0;
+  list->capacity = 0;
+  list->items = NULL;
+
+  Value instance = new_instance(klass);
+  ((LoxInstance *)instance.as.obj)->native = list;
+  return instance;
+}
+
+static Value list_new(void) {
+  return native_list_construct(
+      (LoxClass *)lox_native_class("List").as.obj, 0, NULL);
+}
+
+static void list_push(Value list, Value item) {
+  ListState *state = (ListState *)native_state(list);
+  if (state->count == state->capacity) {
+    state->capacity = state->capacity < 8 ? 8 : state->capacity * 2;
+    state->items = (Value *)realloc(state->items,
+                                    sizeof(Value) * state->capacity);
+    if (state->items == NULL)
+      lox_runtime_error("Out of memory.");
+  }
+  state->items[state->count++] = item;
+}
+
+static size_t list_index(ListState *list, Value v) {
+  double i = as_number(v);
+  if (i < 0 || i >= (double)list->count || i != floor(i))
+    lox_runtime_error("List index out of range.");
+  return (size_t)i;
+}
+
+static Value native_list_length(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number((double)((ListState *)native_state(args[0]))->count);
+}
+
+static Value native_list_push(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  list_push(args[0], args[1]);
+  return lox_nil();
+}
+
+static Value native_list_get(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ListState *list = (ListState *)native_state(args[0]);
+  return list->items[list_index(list, args[1])];
+}
+
+static Value native_list_set(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ListState *list = (ListState *)native_state(args[0]);
+  list->items[list_index(list, args[1])] = args[2];
+  return lox_nil();
+}
+
+// ---------- Columns ----------
+
+/*
+ * Columns(klass) keeps rows of a class with declared fields as one array per
+ * field; `num` fields are plain double arrays that the bulk methods sweep. A
+ * row proxy is an instance of the class whose `native` points at its
+ * RowState, so its fields read and write the columns rather than its table.
+ */
+
+typedef struct {
+  const char *name;
+  Value type;
+  bool numeric;
+  double *numbers;
+  Value *values;
+} Column;
+
+typedef struct {
+  LoxClass *row_class;
+  int count;
+  Column *columns;
+  size_t length;
+  size_t capacity;
+} ColumnsState;
+
+typedef struct {
+  ColumnsState *columns;
+  size_t row;
+} RowState;
+
+static RowState *row_state(LoxInstance *instance) {
+  if (instance->native == NULL || instance->klass->construct != NULL)
+    return NULL;
+  return (RowState *)instance->native;
+}
+
+static Column *find_column(ColumnsState *columns, const char *name) {
+  for (int i = 0; i < columns->count; i++)
+    if (strcmp(columns->columns[i].name, name) == 0)
+      return &columns->columns[i];
+  return NULL;
+}
+
+static Value column_read(Column *column, size_t row) {
+  return column->numeric ? lox_number(column->numbers[row])
+                         : column->values[row];
+}
+
+static void column_write(Column *column, size_t row, Value value) {
+  if (column->numeric)
+    column->numbers[row] = value.as.number;
+  else
+    column->values[row] = value;
+}
+
+static bool row_get(LoxInstance *instance, const char *name, Value *out) {
+  RowState *row = row_state(instance);
+  Column *column = row == NULL ? NULL : find_column(row->columns, name);
+  if (column == NULL)
+    return false;
+  *out = column_read(column, row->row);
+  return true;
+}
+
+static bool row_set(LoxInstance *instance, const char *name, Value value) {
+  RowState *row = row_state(instance);
+  Column *column = row == NULL ? NULL : find_column(row->columns, name);
+  if (column == NULL)
+    return false;
+  column_write(column, row->row, value);
+  return true;
+}
+
+static void row_fields(RowState *row, LoxTable *out) {
+  for (int i = 0; i < row->columns->count; i++) {
+    Column *column = &row->columns->columns[i];
+    table_set(out, column->name, column_read(column, row->row));
+  }
+}
+
+static Value new_row(ColumnsState *columns, size_t row) {
+  LoxInstance *instance =
+      (LoxInstance *)allocate_obj(sizeof(LoxInstance), OBJ_INSTANCE);
+  instance->klass = columns->row_class;
+  table_init(&instance->fields);
+  RowState *state = (RowState *)allocate(sizeof(RowState));
+  state->columns = columns;
+  state->row = row;
+  instance->native = state;
+  return lox_obj(&instance->obj);
+}
+
+static size_t columns_append(ColumnsState *columns) {
+  if (columns->length == columns->capacity) {
+    columns->capacity = columns->capacity < 8 ? 8 : columns->capacity * 2;
+    for (int i = 0; i < columns->count; i++) {
+      Column *column = &columns->columns[i];
+      if (column->numeric)
+        column->numbers = (double *)realloc(
+            column->numbers, sizeof(double) * columns->capacity);
+      else
+        column->values = (Value *)realloc(column->values,
+                                          sizeof(Value) * columns->capacity);
+      if (column->numbers == NULL && column->values == NULL)
+        lox_runtime_error("Out of memory.");
+    }
+  }
+  size_t row = columns->length++;
+  for (int i = 0; i < columns->count; i++)
+    column_write(&columns->columns[i], row,
+                 initial_value(columns->columns[i].type));
+  return row;
+}
+
+static Value native_columns_construct(LoxClass *klass, int argc, Value *args) {
+  (void)argc;
+  if (!is_obj_type(args[0], OBJ_CLASS) || !((LoxClass *)args[0].as.obj)->fixed)
+    lox_runtime_error("Columns needs a class with declared fields.");
+  LoxClass *row_class = (LoxClass *)args[0].as.obj;
+  ColumnsState *columns = (ColumnsState *)allocate(sizeof(ColumnsState));
+  columns->row_class = row_class;
+  columns->count = 0;
+  columns->columns =
+      (Column *)allocate(sizeof(Column) * (size_t)row_class->layout.count);
+  columns->length = 0;
+  columns->capacity = 0;
+  for (int i = 0; i < row_class->layout.capacity; i++) {
+    LoxTableEntry *entry = &row_class->layout.entries[i];
+    if (entry->key == NULL)
+      continue;
+    Column *column = &columns->columns[columns->count++];
+    column->name = entry->key;
+    column->type = entry->value;
+    column->numeric = entry->value.type == VAL_OBJ &&
+                      strcmp(((LoxString *)entry->value.as.obj)->chars, "num") == 0;
+    column->numbers = NULL;
+    column->values = NULL;
+  }
+
+  Value instance = new_instance(klass);
+  ((LoxInstance *)instance.as.obj)->native = columns;
+  return instance;
+}
+
+static Column *column_argument(ColumnsState *columns, Value name) {
+  if (!is_obj_type(name, OBJ_STRING))
+    lox_runtime_error("Operand must be a string.");
+  const char *chars = ((LoxString *)name.as.obj)->chars;
+  Column *column = find_column(columns, chars);
+  if (column == NULL)
+    lox_runtime_error("Undefined field '%s'.", chars);
+  return column;
+}
+
+static double *number_column(ColumnsState *columns, Value name) {
+  Column *column = column_argument(columns, name);
+  if (!column->numeric)
+    lox_runtime_error("Field '%s' is not declared num.", column->name);
+  return column->numbers;
+}
+
+static Value native_columns_length(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number((double)((ColumnsState *)native_state(args[0]))->length);
+}
+
+static Value native_columns_add(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  return new_row(columns, columns_append(columns));
+}
+
+static Value native_columns_push(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  LoxClass *klass = is_obj_type(args[1], OBJ_INSTANCE)
+                        ? ((LoxInstance *)args[1].as.obj)->klass
+                        : NULL;
+  while (klass != NULL && klass != columns->row_class)
+    klass = klass->superclass;
+  if (klass == NULL)
+    lox_runtime_error("Argument must be a %s instance.",
+                      columns->row_class->name);
+  size_t row = columns_append(columns);
+  for (int i = 0; i < columns->count; i++)
+    column_write(&columns->columns[i], row,
+                 lox_get_property(args[1], columns->columns[i].name));
+  return lox_nil();
+}
+
+static Value native_columns_get(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  double i = as_number(args[1]);
+  if (i < 0 || i >= (double)columns->length || i != floor(i))
+    lox_runtime_error("Columns index out of range.");
+  return new_row(columns, (size_t)i);
+}
+
+static Value native_columns_sum(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  double *numbers = number_column(columns, args[1]);
+  double total = 0;
+  for (size_t i = 0; i < columns->length; i++)
+    total += numbers[i];
+  return lox_number(total);
+}
+
+static Value native_columns_fill(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  Column *column = column_argument(columns, args[1]);
+  Value value = args[2];
+  if (column->type.type == VAL_OBJ)
+    value = lox_check_type(value, ((LoxString *)column->type.as.obj)->chars);
+  for (size_t i = 0; i < columns->length; i++)
+    column_write(column, i, value);
+  return lox_nil();
+}
+
+static Value native_columns_scale(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  double *numbers = number_column(columns, args[1]);
+  double k = as_number(args[2]);
+  for (size_t i = 0; i < columns->length; i++)
+    numbers[i] *= k;
+  return lox_nil();
+}
+
+static Value native_columns_add_scaled(LoxClosure *closure, int argc,
+                                       Value *args) {
+  (void)closure;
+  (void)argc;
+  ColumnsState *columns = (ColumnsState *)native_state(args[0]);
+  double *target = number_column(columns, args[1]);
+  double k = as_number(args[2]);
+  double *source = number_column(columns, args[3]);
+  for (size_t i = 0; i < columns->length; i++)
+    target[i] += k * source[i];
+  return lox_nil();
+}
+
+// ---------- CSV ----------
+
+/*
+ * CsvReader(path, columns): one record per next() as a List of the requested
+ * columns (all of them when `columns` is nil). The file is mapped read-only;
+ * C strings carry their characters inline, so fields are copied out of it.
+ */
+typedef struct {
+  const char *data;
+  size_t size;
+  size_t offset;
+  int *slots; /* output position per column, -1 to skip */
+  size_t slot_count;
+  size_t width; /* 0 reads every column */
+} CsvState;
+
+/* Maps `path` read-only; an empty file maps to NULL and 0. */
+static bool map_file(const char *path, const char **out, size_t *out_size) {
+  *out = NULL;
+  *out_size = 0;
+#ifdef LOX_HAVE_MMAP
+  int fd = open(path, O_RDONLY);
+  struct stat info;
+  if (fd < 0)
+    return false;
+  bool ok = fstat(fd, &info) == 0;
+  if (ok && info.st_size > 0) {
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ok = data != MAP_FAILED;
+    if (ok) {
+      madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+      *out = (const char *)data;
+      *out_size = (size_t)info.st_size;
+    }
+  }
+  close(fd);
+  return ok;
+#elif defined(_WIN32)
+  HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  LARGE_INTEGER info;
+  if (handle == INVALID_HANDLE_VALUE)
+    return false;
+  bool ok = GetFileSizeEx(handle, &info) != 0;
+  if (ok && info.QuadPart > 0) {
+    /* The view keeps the file mapped once both handles are closed. */
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping)
+      CloseHandle(mapping);
+    ok = data != NULL;
+    if (ok) {
+      *out = (const char *)data;
+      *out_size = (size_t)info.QuadPart;
+    }
+  }
+  CloseHandle(handle);
+  return ok;
+#else
+  FILE *in = fopen(path, "rb");
+  if (in == NULL)
+    return false;
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  bool ok = size >= 0;
+  if (ok && size > 0) {
+    char *data = (char *)allocate((size_t)size);
+    ok = fread(data, 1, (size_t)size, in) == (size_t)size;
+    *out = data;
+    *out_size = ok ? (size_t)size : 0;
+  }
+  fclose(in);
+  return ok;
+#endif
+}
+
+static void unmap_file(const char *data, size_t size) {
+  if (size == 0)
+    return;
+#ifdef LOX_HAVE_MMAP
+  munmap((void *)data, size);
+#elif defined(_WIN32)
+  UnmapViewOfFile(data);
+#else
+  free((void *)data);
+#endif
+}
+
+static bool is_csv_special(char c) {
+  return c == ',' || c == '"' || c == '\n' || c == '\r';
+}
+
+static Value csv_unquoted(const char *chars, size_t length) {
+  char small[64];
+  char *copy = length < sizeof small ? small : (char *)allocate(length + 1);
+  memcpy(copy, chars, length);
+  copy[length] = '\0';
+  double d;
+  bool number = length > 0 && parse_decimal(copy, length, &d);
+  if (copy != small)
+    free(copy);
+  return number ? lox_number(d) : lox_copy_string(chars, length);
+}
+
+/* Reads the field at *p and leaves *p on the delimiter or line break after it. */
+static Value csv_field(const char **p, const char *end, bool wanted) {
+  const char *start = *p;
+  if (start == end || *start != '"') {
+    const char *q = start;
+    while (q < end && (!is_csv_special(*q) || *q == '"'))
+      q++;
+    *p = q;
+    return wanted ? csv_unquoted(start, (size_t)(q - start)) : lox_nil();
+  }
+
+  start++;
+  const char *q = start;
+  bool escaped = false;
+  const char *close;
+  for (;;) {
+    close = (const char *)memchr(q, '"', (size_t)(end - q));
+    if (close == NULL)
+      lox_runtime_error("Unterminated quoted field.");
+    q = close + 1;
+    if (q == end || *q != '"')
+      break;
+    escaped = true;
+    q++;
+  }
+  while (q < end && *q != ',' && *q != '\n' && *q != '\r')
+    q++;
+  *p = q;
+  if (!wanted)
+    return lox_nil();
+  if (!escaped)
+    return lox_copy_string(start, (size_t)(close - start));
+
+  Value result = lox_copy_string(start, (size_t)(close - start));
+  LoxString *string = (LoxString *)result.as.obj;
+  size_t length = 0;
+  for (size_t i = 0; i < string->length; i++) {
+    string->chars[length++] = string->chars[i];
+    if (string->chars[i] == '"')
+      i++;
+  }
+  string->chars[length] = '\0';
+  string->length = length;
+  return result;
+}
+
+static Value native_csv_construct(LoxClass *klass, int argc, Value *args) {
+  (void)argc;
+  CsvState *csv = (CsvState *)allocate(sizeof(CsvState));
+  csv->offset = 0;
+  csv->slots = NULL;
+  csv->slot_count = 0;
+  csv->width = 0;
+
+  if (args[1].type != VAL_NIL) {
+    LoxClass *list_class = (LoxClass *)lox_native_class("List").as.obj;
+    if (!is_obj_type(args[1], OBJ_INSTANCE) ||
+        ((LoxInstance *)args[1].as.obj)->klass != list_class)
+      lox_runtime_error("Columns must be a List or nil.");
+    ListState *columns = (ListState *)native_state(args[1]);
+    csv->width = columns->count;
+    for (size_t i = 0; i < columns->count; i++) {
+      double column = as_number(columns->items[i]);
+      if (column < 0 || column != floor(column) || column > 1e6)
+        lox_runtime_error("Column index must be a non-negative integer.");
+      size_t index = (size_t)column;
+      if (index >= csv->slot_count) {
+        csv->slots = (int *)realloc(csv->slots, sizeof(int) * (index + 1));
+        if (csv->slots == NULL)
+          lox_runtime_error("Out of memory.");
+        for (size_t j = csv->slot_count; j <= index; j++)
+          csv->slots[j] = -1;
+        csv->slot_count = index + 1;
+      }
+      if (csv->slots[index] >= 0)
+        lox_runtime_error("Duplicate column index.");
+      csv->slots[index] = (int)i;
+    }
+  }
+
+  LoxString *path = string_argument(args[0]);
+  if (!map_file(path->chars, &csv->data, &csv->size))
+    lox_runtime_error("Could not open file '%s'.", path->chars);
+
+  Value instance = new_instance(klass);
+  ((LoxInstance *)instance.as.obj)->native = csv;
+  return instance;
+}
+
+static Value native_csv_next(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  CsvState *csv = (CsvState *)native_state(args[0]);
+  const char *begin = csv->data;
+  const char *end = begin + csv->size;
+  const char *p = begin + csv->offset;
+  while (p < end && (*p == '\n' || *p == '\r'))
+    p++;
+  if (p == end) {
+    csv->offset = csv->size;
+    return lox_nil();
+  }
+
+  Value record = list_new();
+  for (size_t i = 0; i < csv->width; i++)
+    list_push(record, lox_nil());
+  ListState *items = (ListState *)native_state(record);
+  for (size_t column = 0;; column++) {
+    if (csv->width == 0) {
+      list_push(record, csv_field(&p, end, true));
+    } else {
+      int slot = column < csv->slot_count ? csv->slots[column] : -1;
+      Value field = csv_field(&p, end, slot >= 0);
+      if (slot >= 0)
+        items->items[slot] = field;
+    }
+    if (p == end || *p != ',')
+      break;
+    p++;
+  }
+  if (p < end && *p == '\r')
+    p++;
+  if (p < end && *p == '\n')
+    p++;
+  csv->offset = (size_t)(p - begin);
+  return record;
+}
+
+// ---------- Serialization ----------
+
+/*
+ * writeValue(path, value) and readValue(path), in the value file format
+ * documented in lox_runtime.cpp, so either runtime reads the other's files.
+ * Both directions keep an explicit stack instead of recursing.
+ */
+enum {
+  TAG_NIL,
+  TAG_FALSE,
+  TAG_TRUE,
+  TAG_DOUBLE,
+  TAG_INTEGER,
+  TAG_STRING,
+  TAG_INSTANCE,
+  TAG_LIST,
+  TAG_BUFFER,
+  TAG_CLASS,
+  TAG_REFERENCE
+};
+
+static const char value_magic[] = {'L', 'O', 'X', 'V', 1};
+
+typedef struct {
+  char *bytes;
+  size_t length;
+  size_t capacity;
+} ByteBuffer;
+
+static void bytes_put(ByteBuffer *b, const void *data, size_t length) {
+  if (b->length + length > b->capacity) {
+    while (b->length + length > b->capacity)
+      b->capacity = b->capacity < 256 ? 256 : b->capacity * 2;
+    b->bytes = (char *)realloc(b->bytes, b->capacity);
+    if (b->bytes == NULL)
+      lox_runtime_error("Out of memory.");
+  }
+  memcpy(b->bytes + b->length, data, length);
+  b->length += length;
+}
+
+static void bytes_byte(ByteBuffer *b, int byte) {
+  char c = (char)byte;
+  bytes_put(b, &c, 1);
+}
+
+static void bytes_varint(ByteBuffer *b, uint64_t n) {
+  char out[10];
+  size_t length = 0;
+  for (; n >= 0x80; n >>= 7)
+    out[length++] = (char)(n | 0x80);
+  out[length++] = (char)n;
+  bytes_put(b, out, length);
+}
+
+static void bytes_double(ByteBuffer *b, double d) {
+  uint64_t bits;
+  char out[8];
+  memcpy(&bits, &d, sizeof bits);
+  for (int i = 0; i < 8; i++)
+    out[i] = (char)(bits >> (8 * i));
+  bytes_put(b, out, 8);
+}
+
+typedef struct {
+  const Value *value;
+  const char *field; /* set inside instances */
+} PendingValue;
+
+typedef struct {
+  const Obj *key;
+  size_t id;
+} ObjectId;
+
+typedef struct {
+  ByteBuffer out;
+  PendingValue *pending;
+  size_t pending_count;
+  size_t pending_capacity;
+  /* Object pointer -> index, open addressed with a power-of-two capacity. */
+  ObjectId *objects;
+  size_t object_count;
+  size_t object_capacity;
+  LoxTable symbols; /* name -> index as a number */
+} ValueWriter;
+
+static void writer_push(ValueWriter *w, const Value *value, const char *field) {
+  if (w->pending_count == w->pending_capacity) {
+    w->pending_capacity = w->pending_capacity < 64 ? 64 : w->pending_capacity * 2;
+    w->pending = (PendingValue *)realloc(
+        w->pending, sizeof(PendingValue) * w->pending_capacity);
+    if (w->pending == NULL)
+      lox_runtime_error("Out of memory.");
+  }
+  w->pending[w->pending_count].value = value;
+  w->pending[w->pending_count].field = field;
+  w->pending_count++;
+}
+
+static ObjectId *object_slot(ObjectId *objects, size_t capacity,
+                             const Obj *obj) {
+  uint64_t h = (uint64_t)(uintptr_t)obj * 0x9e3779b97f4a7c15ull;
+  size_t i = (size_t)(h ^ (h >> 32)) & (capacity - 1);
+  while (objects[i].key != NULL && objects[i].key != obj)
+    i = (i + 1) & (capacity - 1);
+  return &objects[i];
+}
+
+/* Numbers `obj` on first sight; returns false with its index if seen before. */
+static bool writer_new_object(ValueWriter *w, const Obj *obj, size_t *id) {
+  if ((w->object_count + 1) * 4 > w->object_capacity * 3) {
+    size_t capacity = w->object_capacity < 64 ? 64 : w->object_capacity * 2;
+    ObjectId *objects = (ObjectId *)calloc(capacity, sizeof(ObjectId));
+    if (objects == NULL)
+      lox_runtime_error("Out of memory.");
+    for (size_t i = 0; i < w->object_capacity; i++) {
+      if (w->objects[i].key != NULL)
+        *object_slot(objects, capacity, w->objects[i].key) = w->objects[i];
+    }
+    free(w->objects);
+    w->objects = objects;
+    w->object_capacity = capacity;
+  }
+  ObjectId *slot = object_slot(w->objects, w->object_capacity, obj);
+  if (slot->key != NULL) {
+    *id = slot->id;
+    return false;
+  }
+  slot->key = obj;
+  slot->id = w->object_count++;
+  return true;
+}
+
+static void writer_symbol(ValueWriter *w, const char *symbol) {
+  Value index;
+  if (table_get(&w->symbols, symbol, &index)) {
+    bytes_varint(&w->out, (uint64_t)index.as.number << 1);
+    return;
+  }
+  table_set(&w->symbols, symbol, lox_number((double)w->symbols.count));
+  size_t length = strlen(symbol);
+  bytes_varint(&w->out, (uint64_t)length << 1 | 1);
+  bytes_put(&w->out, symbol, length);
+}
+
+static void writer_instance(ValueWriter *w, LoxInstance *instance) {
+  size_t id;
+  if (!writer_new_object(w, &instance->obj, &id)) {
+    bytes_byte(&w->out, TAG_REFERENCE);
+    bytes_varint(&w->out, id);
+    return;
+  }
+  LoxClass *klass = instance->klass;
+  if (klass == (LoxClass *)lox_native_class("List").as.obj) {
+    ListState *list = (ListState *)instance->native;
+    bytes_byte(&w->out, TAG_LIST);
+    bytes_varint(&w->out, list->count);
+    for (size_t i = list->count; i > 0; i--)
+      writer_push(w, &list->items[i - 1], NULL);
+  } else if (klass == (LoxClass *)lox_native_class("Buffer").as.obj) {
+    BufferState *buffer = (BufferState *)instance->native;
+    bytes_byte(&w->out, TAG_BUFFER);
+    bytes_varint(&w->out, buffer->length);
+    for (size_t i = 0; i < buffer->length; i++)
+      bytes_double(&w->out, buffer->data[i]);
+  } else if (klass->construct != NULL) {
+    lox_runtime_error("Cannot serialize a %s instance.", klass->name);
+  } else {
+    /* A row proxy's fields are copied out of its columns to be written. */
+    LoxTable *fields = &instance->fields;
+    RowState *row = row_state(instance);
+    if (row != NULL) {
+      fields = (LoxTable *)allocate(sizeof(LoxTable));
+      table_init(fields);
+      row_fields(row, fields);
+    }
+    bytes_byte(&w->out, TAG_INSTANCE);
+    writer_symbol(w, klass->name);
+    bytes_varint(&w->out, (uint64_t)fields->count);
+    for (int i = 0; i < fields->capacity; i++) {
+      LoxTableEntry *entry = &fields->entries[i];
+      if (entry->key != NULL)
+        writer_push(w, &entry->value, entry->key);
+    }
+  }
+}
+
+static void writer_value(ValueWriter *w, Value value) {
+  switch (value.type) {
+  case VAL_NIL:
+    bytes_byte(&w->out, TAG_NIL);
+    return;
+  case VAL_BOOL:
+    bytes_byte(&w->out, value.as.boolean ? TAG_TRUE : TAG_FALSE);
+    return;
+  case VAL_NUMBER: {
+    double d = value.as.number;
+    if (d == floor(d) && fabs(d) <= 9007199254740992.0 && !(d == 0 && signbit(d))) {
+      int64_t n = (int64_t)d;
+      bytes_byte(&w->out, TAG_INTEGER);
+      bytes_varint(&w->out, ((uint64_t)n << 1) ^ (uint64_t)(n >> 63));
+    } else {
+      bytes_byte(&w->out, TAG_DOUBLE);
+      bytes_double(&w->out, d);
+    }
+    return;
+  }
+  case VAL_OBJ:
+    break;
+  }
+  switch (value.as.obj->type) {
+  case OBJ_STRING: {
+    LoxString *string = (LoxString *)value.as.obj;
+    bytes_byte(&w->out, TAG_STRING);
+    bytes_varint(&w->out, string->length);
+    bytes_put(&w->out, string->chars, string->length);
+    return;
+  }
+  case OBJ_CLASS:
+    bytes_byte(&w->out, TAG_CLASS);
+    writer_symbol(w, ((LoxClass *)value.as.obj)->name);
+    return;
+  case OBJ_INSTANCE:
+    writer_instance(w, (LoxInstance *)value.as.obj);
+    return;
+  default:
+    lox_runtime_error("Cannot serialize a function.");
+  }
+}
+
+static Value native_write_value(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *path = string_argument(args[0]);
+  ValueWriter w;
+  memset(&w, 0, sizeof w);
+  bytes_put(&w.out, value_magic, sizeof value_magic);
+  writer_push(&w, &args[1], NULL);
+  while (w.pending_count > 0) {
+    PendingValue next = w.pending[--w.pending_count];
+    if (next.field != NULL)
+      writer_symbol(&w, next.field);
+    writer_value(&w, *next.value);
+  }
+
+  FILE *out = fopen(path->chars, "wb");
+  bool ok = out != NULL && fwrite(w.out.bytes, 1, w.out.length, out) == w.out.length;
+  if (out != NULL && fclose(out) != 0)
+    ok = false;
+  if (!ok)
+    lox_runtime_error("Could not write file '%s'.", path->chars);
+  free(w.out.bytes);
+  free(w.pending);
+  free(w.objects);
+  free(w.symbols.entries);
+  return lox_nil();
+}
+
+typedef struct {
+  LoxInstance *object;
+  ListState *list; /* set when the object is a List */
+  size_t remaining;
+} ReadFrame;
+
+typedef struct {
+  const char *p;
+  const char *end;
+  ReadFrame *frames;
+  size_t frame_count;
+  size_t frame_capacity;
+  Value *objects;
+  size_t object_count;
+  size_t object_capacity;
+  LoxString **symbols; /* also the field keys, so never freed */
+  LoxClass **classes;  /* looked up lazily, by symbol index */
+  size_t symbol_count;
+  size_t symbol_capacity;
+} ValueReader;
+
+static void malformed_value_file(void) {
+  lox_runtime_error("Malformed value file.");
+}
+
+static const char *reader_take(ValueReader *r, uint64_t size) {
+  if (size > (uint64_t)(r->end - r->p))
+    malformed_value_file();
+  const char *at = r->p;
+  r->p += size;
+  return at;
+}
+
+static uint64_t reader_varint(ValueReader *r) {
+  uint64_t n = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    unsigned char byte = (unsigned char)*reader_take(r, 1);
+    n |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return n;
+  }
+  malformed_value_file();
+  return 0;
+}
+
+/* A count of items that each take at least `item_size` more bytes. */
+static size_t reader_count(ValueReader *r, size_t item_size) {
+  uint64_t n = reader_varint(r);
+  if (n > (uint64_t)(r->end - r->p) / item_size)
+    malformed_value_file();
+  return (size_t)n;
+}
+
+static double reader_double(ValueReader *r) {
+  const char *at = reader_take(r, 8);
+  uint64_t bits = 0;
+  for (int i = 0; i < 8; i++)
+    bits |= (uint64_t)(unsigned char)at[i] << (8 * i);
+  double d;
+  memcpy(&d, &bits, sizeof d);
+  return d;
+}
+
+static size_t reader_symbol(ValueReader *r) {
+  uint64_t n = reader_varint(r);
+  if (!(n & 1)) {
+    if ((n >> 1) >= r->symbol_count)
+      malformed_value_file();
+    return (size_t)(n >> 1);
+  }
+  uint64_t size = n >> 1;
+  const char *chars = reader_take(r, size);
+  if (r->symbol_count == r->symbol_capacity) {
+    r->symbol_capacity = r->symbol_capacity < 16 ? 16 : r->symbol_capacity * 2;
+    r->symbols = (LoxString **)realloc(r->symbols,
+                                       sizeof(LoxString *) * r->symbol_capacity);
+    r->classes = (LoxClass **)realloc(r->classes,
+                                      sizeof(LoxClass *) * r->symbol_capacity);
+    if (r->symbols == NULL || r->classes == NULL)
+      lox_runtime_error("Out of memory.");
+  }
+  r->symbols[r->symbol_count] =
+      (LoxString *)lox_copy_string(chars, (size_t)size).as.obj;
+  r->classes[r->symbol_count] = NULL;
+  return r->symbol_count++;
+}
+
+static LoxClass *reader_class(ValueReader *r) {
+  size_t symbol = reader_symbol(r);
+  if (r->classes[symbol] == NULL) {
+    Value klass;
+    const char *name = r->symbols[symbol]->chars;
+    if (!table_get(&class_registry, name, &klass))
+      lox_runtime_error("Undefined class '%s'.", name);
+    r->classes[symbol] = (LoxClass *)klass.as.obj;
+  }
+  return r->classes[symbol];
+}
+
+static void reader_add_object(ValueReader *r, Value object) {
+  if (r->object_count == r->object_capacity) {
+    r->object_capacity = r->object_capacity < 64 ? 64 : r->object_capacity * 2;
+    r->objects = (Value *)realloc(r->objects, sizeof(Value) * r->object_capacity);
+    if (r->objects == NULL)
+      lox_runtime_error("Out of memory.");
+  }
+  r->objects[r->object_count++] = object;
+}
+
+/* Reads one value. Instances and Lists come back empty, with `child` set up
+ * to receive their contents. */
+static Value reader_value(ValueReader *r, ReadFrame *child) {
+  switch ((unsigned char)*reader_take(r, 1)) {
+  case TAG_NIL:
+    return lox_nil();
+  case TAG_FALSE:
+    return lox_bool(false);
+  case TAG_TRUE:
+    return lox_bool(true);
+  case TAG_DOUBLE:
+    return lox_number(reader_double(r));
+  case TAG_INTEGER: {
+    uint64_t n = reader_varint(r);
+    int64_t i = (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+    if (i > 9007199254740992LL || i < -9007199254740992LL)
+      malformed_value_file();
+    return lox_number((double)i);
+  }
+  case TAG_STRING: {
+    size_t size = reader_count(r, 1);
+    return lox_copy_string(reader_take(r, size), size);
+  }
+  case TAG_CLASS:
+    return lox_obj(&reader_class(r)->obj);
+  case TAG_INSTANCE: {
+    LoxClass *klass = reader_class(r);
+    if (klass->construct != NULL)
+      malformed_value_file();
+    Value instance = new_instance(klass);
+    reader_add_object(r, instance);
+    child->object = (LoxInstance *)instance.as.obj;
+    child->list = NULL;
+    /* Each field takes at least a symbol byte and a tag byte. */
+    child->remaining = reader_count(r, 2);
+    return instance;
+  }
+  case TAG_LIST: {
+    Value list = list_new();
+    reader_add_object(r, list);
+    child->object = (LoxInstance *)list.as.obj;
+    child->list = (ListState *)child->object->native;
+    child->remaining = reader_count(r, 1);
+    return list;
+  }
+  case TAG_BUFFER: {
+    Value length = lox_number((double)reader_count(r, 8));
+    Value buffer = native_buffer_construct(
+        (LoxClass *)lox_native_class("Buffer").as.obj, 1, &length);
+    reader_add_object(r, buffer);
+    BufferState *state = (BufferState *)native_state(buffer);
+    for (size_t i = 0; i < state->length; i++)
+      state->data[i] = reader_double(r);
+    return buffer;
+  }
+  case TAG_REFERENCE: {
+    uint64_t index = reader_varint(r);
+    if (index >= r->object_count)
+      malformed_value_file();
+    return r->objects[index];
+  }
+  default:
+    malformed_value_file();
+    return lox_nil();
+  }
+}
+
+static Value native_read_value(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  LoxString *path = string_argument(args[0]);
+  const char *data;
+  size_t size;
+  if (!map_file(path->chars, &data, &size))
+    lox_runtime_error("Could not open file '%s'.", path->chars);
+
+  ValueReader r;
+  memset(&r, 0, sizeof r);
+  r.p = data;
+  r.end = data + size;
+  if (size < sizeof value_magic ||
+      memcmp(data, value_magic, sizeof value_magic) != 0)
+    malformed_value_file();
+  r.p += sizeof value_magic;
+
+  Value root = lox_nil();
+  do {
+    ReadFrame *parent = r.frame_count > 0 ? &r.frames[r.frame_count - 1] : NULL;
+    size_t field = parent != NULL && parent->list == NULL ? reader_symbol(&r) : 0;
+    ReadFrame child = {NULL, NULL, 0};
+    Value value = reader_value(&r, &child);
+    if (parent == NULL) {
+      root = value;
+    } else {
+      parent->remaining--;
+      if (parent->list != NULL)
+        list_push(lox_obj(&parent->object->obj), value);
+      else
+        table_set(&parent->object->fields, r.symbols[field]->chars, value);
+    }
+    if (child.remaining > 0) {
+      if (r.frame_count == r.frame_capacity) {
+        r.frame_capacity = r.frame_capacity < 16 ? 16 : r.frame_capacity * 2;
+        r.frames = (ReadFrame *)realloc(r.frames,
+                                        sizeof(ReadFrame) * r.frame_capacity);
+        if (r.frames == NULL)
+          lox_runtime_error("Out of memory.");
+      }
+      r.frames[r.frame_count++] = child;
+    }
+    while (r.frame_count > 0 && r.frames[r.frame_count - 1].remaining == 0)
+      r.frame_count--;
+  } while (r.frame_count > 0);
+
+  if (r.p != r.end)
+    malformed_value_file();
+  unmap_file(data, size);
+  free(r.frames);
+  free(r.objects);
+  free(r.symbols);
+  free(r.classes);
+  return root;
+}
+
+// ---------- Tables ----------
+
+/*
+ * buildTable(path, keys, values) and Table(path), in the table file format
+ * documented in lox_runtime.cpp. Opening only maps the file; lookups probe
+ * the mapped slots and copy out the value they find.
+ */
+#define TABLE_HEADER 24
+
+typedef struct {
+  const char *data;
+  size_t size;
+  uint64_t count;
+  uint64_t mask;
+} TableState;
+
+static uint64_t fnv1a(const char *bytes, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static uint64_t load64(const char *p) {
+  uint64_t n = 0;
+  for (int i = 0; i < 8; i++)
+    n |= (uint64_t)(unsigned char)p[i] << (8 * i);
+  return n;
+}
+
+static uint32_t load32(const char *p) {
+  uint32_t n = 0;
+  for (int i = 0; i < 4; i++)
+    n |= (uint32_t)(unsigned char)p[i] << (8 * i);
+  return n;
+}
+
+static void bytes_u32(ByteBuffer *b, uint32_t n) {
+  char out[4];
+  for (int i = 0; i < 4; i++)
+    out[i] = (char)(n >> (8 * i));
+  bytes_put(b, out, 4);
+}
+
+static void bytes_u64(ByteBuffer *b, uint64_t n) {
+  char out[8];
+  for (int i = 0; i < 8; i++)
+    out[i] = (char)(n >> (8 * i));
+  bytes_put(b, out, 8);
+}
+
+static void malformed_table(void) { lox_runtime_error("Malformed table file."); }
+
+static ListState *list_argument(Value v, const char *message) {
+  LoxClass *list_class = (LoxClass *)lox_native_class("List").as.obj;
+  if (!is_obj_type(v, OBJ_INSTANCE) ||
+      ((LoxInstance *)v.as.obj)->klass != list_class)
+    lox_runtime_error(message);
+  return (ListState *)native_state(v);
+}
+
+static Value native_build_table(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  const char *message = "Keys and values must be Lists of the same length.";
+  LoxString *path = string_argument(args[0]);
+  ListState *keys = list_argument(args[1], message);
+  ListState *values = list_argument(args[2], message);
+  if (keys->count != values->count)
+    lox_runtime_error(message);
+
+  size_t slots = 2;
+  while (slots < keys->count * 2)
+    slots *= 2;
+  uint64_t *hashes = (uint64_t *)calloc(slots, sizeof(uint64_t));
+  uint64_t *offsets = (uint64_t *)calloc(slots, sizeof(uint64_t));
+  if (hashes == NULL || offsets == NULL)
+    lox_runtime_error("Out of memory.");
+  ByteBuffer entries = {NULL, 0, 0};
+  size_t entries_start = TABLE_HEADER + slots * 16;
+  uint64_t count = 0;
+
+  for (size_t k = 0; k < keys->count; k++) {
+    if (!is_obj_type(keys->items[k], OBJ_STRING))
+      lox_runtime_error("Table keys must be strings.");
+    LoxString *key = (LoxString *)keys->items[k].as.obj;
+    Value value = values->items[k];
+    if (key->length > UINT32_MAX)
+      lox_runtime_error("Table key is too long.");
+
+    uint64_t offset = entries_start + entries.length;
+    bytes_u32(&entries, (uint32_t)key->length);
+    bytes_put(&entries, key->chars, key->length);
+    if (value.type == VAL_NIL) {
+      bytes_byte(&entries, TAG_NIL);
+    } else if (value.type == VAL_BOOL) {
+      bytes_byte(&entries, value.as.boolean ? TAG_TRUE : TAG_FALSE);
+    } else if (value.type == VAL_NUMBER) {
+      bytes_byte(&entries, TAG_DOUBLE);
+      bytes_double(&entries, value.as.number);
+    } else if (is_obj_type(value, OBJ_STRING)) {
+      LoxString *text = (LoxString *)value.as.obj;
+      if (text->length > UINT32_MAX)
+        lox_runtime_error("Table value is too long.");
+      bytes_byte(&entries, TAG_STRING);
+      bytes_u32(&entries, (uint32_t)text->length);
+      bytes_put(&entries, text->chars, text->length);
+    } else {
+      lox_runtime_error("Table values must be strings, numbers, booleans or nil.");
+    }
+
+    /* A repeated key points its slot at the newer entry. */
+    uint64_t hash = fnv1a(key->chars, key->length);
+    size_t i = (size_t)hash & (slots - 1);
+    for (; offsets[i] != 0; i = (i + 1) & (slots - 1)) {
+      const char *old = entries.bytes + (offsets[i] - entries_start);
+      if (hashes[i] == hash && load32(old) == key->length &&
+          memcmp(old + 4, key->chars, key->length) == 0)
+        break;
+    }
+    if (offsets[i] == 0)
+      count++;
+    hashes[i] = hash;
+    offsets[i] = offset;
+  }
+
+  ByteBuffer out = {NULL, 0, 0};
+  bytes_put(&out, "LOXT", 4);
+  bytes_u32(&out, 1);
+  bytes_u64(&out, count);
+  bytes_u64(&out, slots);
+  for (size_t i = 0; i < slots; i++) {
+    bytes_u64(&out, hashes[i]);
+    bytes_u64(&out, offsets[i]);
+  }
+  bytes_put(&out, entries.bytes, entries.length);
+
+  FILE *stream = fopen(path->chars, "wb");
+  bool ok = stream != NULL && fwrite(out.bytes, 1, out.length, stream) == out.length;
+  if (stream != NULL && fclose(stream) != 0)
+    ok = false;
+  if (!ok)
+    lox_runtime_error("Could not write file '%s'.", path->chars);
+  free(hashes);
+  free(offsets);
+  free(entries.bytes);
+  free(out.bytes);
+  return lox_nil();
+}
+
+static Value native_table_construct(LoxClass *klass, int argc, Value *args) {
+  (void)argc;
+  LoxString *path = string_argument(args[0]);
+  TableState *table = (TableState *)allocate(sizeof(TableState));
+  if (!map_file(path->chars, &table->data, &table->size))
+    lox_runtime_error("Could not open file '%s'.", path->chars);
+  if (table->size < TABLE_HEADER || memcmp(table->data, "LOXT", 4) != 0 ||
+      load32(table->data + 4) != 1)
+    malformed_table();
+  table->count = load64(table->data + 8);
+  uint64_t slots = load64(table->data + 16);
+  if (slots == 0 || (slots & (slots - 1)) != 0 || table->count >= slots ||
+      slots > (table->size - TABLE_HEADER) / 16)
+    malformed_table();
+  table->mask = slots - 1;
+
+  Value instance = new_instance(klass);
+  ((LoxInstance *)instance.as.obj)->native = table;
+  return instance;
+}
+
+/* The entry's value bytes for `key`, or NULL if it isn't in the table. */
+static const char *table_find(TableState *table, Value key) {
+  LoxString *text = string_argument(key);
+  uint64_t hash = fnv1a(text->chars, text->length);
+  uint64_t i = hash & table->mask;
+  /* Bounded, so a corrupt file with no empty slot still terminates. */
+  for (uint64_t probes = 0; probes <= table->mask; probes++) {
+    const char *slot = table->data + TABLE_HEADER + i * 16;
+    uint64_t offset = load64(slot + 8);
+    if (offset == 0)
+      return NULL;
+    if (load64(slot) == hash) {
+      if (offset > table->size - 4 ||
+          load32(table->data + offset) > table->size - offset - 4)
+        malformed_table();
+      const char *entry = table->data + offset;
+      uint32_t length = load32(entry);
+      if (length == text->length && memcmp(entry + 4, text->chars, length) == 0)
+        return entry + 4 + length;
+    }
+    i = (i + 1) & table->mask;
+  }
+  return NULL;
+}
+
+static Value native_table_get(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  TableState *table = (TableState *)native_state(args[0]);
+  const char *at = table_find(table, args[1]);
+  if (at == NULL)
+    return lox_nil();
+  const char *end = table->data + table->size;
+  if (at >= end)
+    malformed_table();
+  switch ((unsigned char)*at) {
+  case TAG_NIL:
+    return lox_nil();
+  case TAG_FALSE:
+    return lox_bool(false);
+  case TAG_TRUE:
+    return lox_bool(true);
+  case TAG_DOUBLE: {
+    if (end - at < 9)
+      malformed_table();
+    uint64_t bits = load64(at + 1);
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return lox_number(d);
+  }
+  case TAG_STRING:
+    if (end - at < 5 || load32(at + 1) > (size_t)(end - at - 5))
+      malformed_table();
+    return lox_copy_string(at + 5, load32(at + 1));
+  default:
+    malformed_table();
+    return lox_nil();
+  }
+}
+
+static Value native_table_has(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_bool(table_find((TableState *)native_state(args[0]), args[1]) != NULL);
+}
+
+static Value native_table_length(LoxClosure *closure, int argc, Value *args) {
+  (void)closure;
+  (void)argc;
+  return lox_number((double)((TableState *)native_state(args[0]))->count);
+}
+
+static void add_native_method(Value klass, const char *name, LoxFn fn,
+                              int arity) {
+  lox_class_add_method(klass, name, lox_new_closure(fn, arity, name, 0, NULL));
+}
+
+Value lox_native_class(const char *name) {
+  static Value random_class;
+  static Value buffer_value;
+  static Value list_class;
+  static Value csv_class;
+  static Value table_class;
+  static Value columns_class;
+
+  if (strcmp(name, "Random") == 0) {
+    if (random_class.type != VAL_OBJ) {
+      random_class = lox_new_class("Random", lox_nil());
+      LoxClass *klass = (LoxClass *)random_class.as.obj;
+      klass->construct = native_random_construct;
+      klass->arity = 1;
+      add_native_method(random_class, "next", native_random_next, 0);
+      add_native_method(random_class, "split", native_random_split, 0);
+      add_native_method(random_class, "fill", native_random_fill, 1);
+    }
+    return random_class;
+  }
+
+  if (strcmp(name, "Buffer") == 0) {
+    if (buffer_value.type != VAL_OBJ) {
+      buffer_value = lox_new_class("Buffer", lox_nil());
+      buffer_class = (LoxClass *)buffer_value.as.obj;
+      buffer_class->construct = native_buffer_construct;
+      buffer_class->arity = 1;
+      add_native_method(buffer_value, "length", native_buffer_length, 0);
+      add_native_method(buffer_value, "get", native_buffer_get, 1);
+      add_native_method(buffer_value, "set", native_buffer_set, 2);
+    }
+    return buffer_value;
+  }
+
+  if (strcmp(name, "List") == 0) {
+    if (list_class.type != VAL_OBJ) {
+      list_class = lox_new_class("List", lox_nil());
+      LoxClass *klass = (LoxClass *)list_class.as.obj;
+      klass->construct = native_list_construct;
+      klass->arity = 0;
+      add_native_method(list_class, "length", native_list_length, 0);
+      add_native_method(list_class, "push", native_list_push, 1);
+      add_native_method(list_class, "get", native_list_get, 1);
+      add_native_method(list_class, "set", native_list_set, 2);
+    }
+    return list_class;
+  }
+
+  if (strcmp(name, "CsvReader") == 0) {
+    if (csv_class.type != VAL_OBJ) {
+      csv_class = lox_new_class("CsvReader", lox_nil());
+      LoxClass *klass = (LoxClass *)csv_class.as.obj;
+      klass->construct = native_csv_construct;
+      klass->arity = 2;
+      add_native_method(csv_class, "next", native_csv_next, 0);
+    }
+    return csv_class;
+  }
+
+  if (strcmp(name, "Table") == 0) {
+    if (table_class.type != VAL_OBJ) {
+      table_class = lox_new_class("Table", lox_nil());
+      LoxClass *klass = (LoxClass *)table_class.as.obj;
+      klass->construct = native_table_construct;
+      klass->arity = 1;
+      add_native_method(table_class, "get", native_table_get, 1);
+      add_native_method(table_class, "has", native_table_has, 1);
+      add_native_method(table_class, "length", native_table_length, 0);
+    }
+    return table_class;
+  }
+
+  if (strcmp(name, "Columns") == 0) {
+    if (columns_class.type != VAL_OBJ) {
+      columns_class = lox_new_class("Columns", lox_nil());
+      LoxClass *klass = (LoxClass *)columns_class.as.obj;
+      klass->construct = native_columns_construct;
+      klass->arity = 1;
+      add_native_method(columns_class, "length", native_columns_length, 0);
+      add_native_method(columns_class, "add", native_columns_add, 0);
+      add_native_method(columns_class, "push", native_columns_push, 1);
+      add_native_method(columns_class, "get", native_columns_get, 1);
+      add_native_method(columns_class, "sum", native_columns_sum, 1);
+      add_native_method(columns_class, "fill", native_columns_fill, 2);
+      add_native_method(columns_class, "scale", native_columns_scale, 2);
+      add_native_method(columns_class, "addScaled", native_columns_add_scaled,
+                        3);
+    }
+    return columns_class;
+  }
+
+  return lox_nil();
+}
@@ -0,0 +1,188 @@
+#ifndef LOX_RUNTIME_C_H
+#define LOX_RUNTIME_C_H
+
+/*
+ * Plain C runtime for the `--target c` backend. It mirrors lox_runtime.h with
+ * tagged unions, explicit function pointers and heap cells for captured
+ * variables, and only depends on the C standard library so it builds quickly
+ * with gcc, clang or tcc. Objects are never reclaimed.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { VAL_NIL, VAL_BOOL, VAL_NUMBER, VAL_OBJ } ValueType;
+
+typedef enum {
+  OBJ_STRING,
+  OBJ_CLOSURE,
+  OBJ_CLASS,
+  OBJ_INSTANCE,
+  OBJ_BOUND_METHOD
+} ObjType;
+
+typedef struct Obj {
+  ObjType type;
+} Obj;
+
+typedef struct {
+  ValueType type;
+  union {
+    bool boolean;
+    double number;
+    Obj *obj;
+  } as;
+} Value;
+
+typedef struct LoxClosure LoxClosure;
+typedef Value (*LoxFn)(LoxClosure *closure, int argc, Value *args);
+
+typedef struct {
+  Obj obj;
+  size_t length;
+  /* The string's hash(), odd once computed; 0 until then. */
+  uint64_t hash;
+  char chars[];
+} LoxString;
+
+struct LoxClosure {
+  Obj obj;
+  LoxFn fn;
+  int arity;
+  const char *name;
+  int cellCount;
+  Value **cells;
+};
+
+typedef struct {
+  const char *key;
+  Value value;
+} LoxTableEntry;
+
+typedef struct {
+  int count;
+  int capacity;
+  LoxTableEntry *entries;
+} LoxTable;
+
+typedef struct LoxClass {
+  Obj obj;
+  const char *name;
+  struct LoxClass *superclass;
+  LoxTable methods;
+  /*
+   * Declared fields, inherited ones included, each mapped to its annotation
+   * as a string or nil. Instances of a fixed class take no other fields.
+   */
+  LoxTable layout;
+  bool fixed;
+  /* `equals` and `hash`, defined here or inherited, for == and hash(). */
+  LoxClosure *equals;
+  LoxClosure *hash;
+  /* Set for classes implemented in C, which build their own instances. */
+  Value (*construct)(struct LoxClass *klass, int argc, Value *args);
+  int arity;
+} LoxClass;
+
+typedef struct {
+  Obj obj;
+  LoxClass *klass;
+  LoxTable fields;
+  void *native;
+} LoxInstance;
+
+typedef struct {
+  Obj obj;
+  Value receiver;
+  LoxClosure *method;
+} LoxBoundMethod;
+
+static inline Value lox_nil(void) {
+  Value v;
+  v.type = VAL_NIL;
+  v.as.number = 0;
+  return v;
+}
+
+static inline Value lox_bool(bool b) {
+  Value v;
+  v.type = VAL_BOOL;
+  v.as.boolean = b;
+  return v;
+}
+
+static inline Value lox_number(double n) {
+  Value v;
+  v.type = VAL_NUMBER;
+  v.as.number = n;
+  return v;
+}
+
+static inline Value lox_obj(Obj *o) {
+  Value v;
+  v.type = VAL_OBJ;
+  v.as.obj = o;
+  return v;
+}
+
+static inline bool lox_is_truthy(Value v) {
+  if (v.type == VAL_NIL)
+    return false;
+  if (v.type == VAL_BOOL)
+    return v.as.boolean;
+  return true;
+}
+
+void lox_runtime_error(const char *format, ...);
+
+Value lox_copy_string(const char *chars, size_t length);
+Value *lox_new_cell(Value initial);
+Value lox_new_closure(LoxFn fn, int arity, const char *name, int cellCount,
+                      Value **cells);
+Value lox_new_class(const char *name, Value superclass);
+void lox_class_add_method(Value klass, const char *name, Value method);
+void lox_class_add_field(Value klass, const char *name, const char *type);
+
+Value lox_add(Value a, Value b);
+Value lox_subtract(Value a, Value b);
+Value lox_multiply(Value a, Value b);
+Value lox_divide(Value a, Value b);
+Value lox_negate(Value v);
+Value lox_not(Value v);
+Value lox_equal(Value a, Value b);
+Value lox_not_equal(Value a, Value b);
+Value lox_greater(Value a, Value b);
+Value lox_greater_equal(Value a, Value b);
+Value lox_less(Value a, Value b);
+Value lox_less_equal(Value a, Value b);
+
+Value lox_call(Value callee, int argc, Value *args);
+Value lox_invoke(Value receiver, const char *name, int argc, Value *args);
+Value lox_get_property(Value receiver, const char *name);
+Value lox_set_property(Value receiver, const char *name, Value value);
+Value lox_super_bind(Value superclass, const char *name, Value receiver);
+Value lox_super_invoke(Value superclass, const char *name, Value receiver,
+                       int argc, Value *args);
+
+/*
+ * `v` if it matches the type annotation `type` (num, bool, str or a class
+ * name), else a runtime error.
+ */
+Value lox_check_type(Value v, const char *type);
+
+void lox_print(Value v);
+
+/*
+ * The native global functions (math, strings, match, parseNumber, toString,
+ * writeValue, readValue, buildTable) as closures, or nil if unknown.
+ */
+Value lox_native_function(const char *name);
+
+/*
+ * The built-in classes (Random, Buffer, List, CsvReader, Table), or nil if
+ * unknown.
+ */
+Value lox_native_class(const char *name);
+
+#endif
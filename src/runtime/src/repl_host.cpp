@@ -0,0 +1,43 @@
+#include "lox_runtime.h"
+#include <dlfcn.h>
+#include <exception>
+#include <string>
+
+// Long-lived process behind `repl --native`. Each line on stdin names a
+// compiled REPL unit as "<path>\t<entry symbol>". Units are opened with
+// RTLD_GLOBAL and never closed, so the globals they define stay alive and
+// later units bind to them directly. After every unit a NUL byte followed by
+// a status line is written so the front end knows the unit has finished.
+int main() {
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    auto tab = line.find('\t');
+    if (tab == std::string::npos) {
+      std::cout << '\0' << "error:Malformed unit request." << std::endl;
+      continue;
+    }
+
+    std::string path = line.substr(0, tab);
+    std::string symbol = line.substr(tab + 1);
+
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+    if (!handle) {
+      std::cout << '\0' << "error:" << dlerror() << std::endl;
+      continue;
+    }
+
+    auto entry = reinterpret_cast<void (*)()>(dlsym(handle, symbol.c_str()));
+    if (!entry) {
+      std::cout << '\0' << "error:" << dlerror() << std::endl;
+      continue;
+    }
+
+    try {
+      entry();
+      std::cout << '\0' << "ok" << std::endl;
+    } catch (const std::exception &e) {
+      std::cout << '\0' << "error:" << e.what() << std::endl;
+    }
+  }
+  return 0;
+}
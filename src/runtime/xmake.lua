@@ -10,3 +10,9 @@ target("runtime")
 set_kind("binary")
 add_deps("lox_runtime")
 add_files("src/main.cpp")
+
+target("repl_host")
+set_kind("binary")
+add_files("src/repl_host.cpp", "src/lox_runtime.cpp")
+add_ldflags("-rdynamic")
+add_syslinks("dl")
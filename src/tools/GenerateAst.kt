@@ -25,13 +25,13 @@ fun main(args: Array<String>) {
 
     defineAst(outputDir, "Stmt", listOf(
         "Block      : List<Stmt> statements",
-        "Class      : Token name, Expr.Variable? superclass, List<Stmt.Function> methods",
+        "Class      : Token name, Expr.Variable? superclass, List<Stmt.Var> fields, List<Stmt.Function> methods",
         "Expression : Expr expression",
-        "Function   : Token name, List<Token> params, List<Stmt> body",
+        "Function   : Token name, List<Token> params, List<Token?> paramTypes, Token? returnType, List<Stmt> body",
         "If         : Expr condition, Stmt thenBranch, Stmt? elseBranch",
         "Print      : Expr expression",
         "Return     : Token keyword, Expr? value",
-        "Var        : Token name, Expr initializer",
+        "Var        : Token name, Token? type, Expr initializer",
         "While      : Expr condition, Stmt body"
     ))
 }
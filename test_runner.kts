@@ -1,17 +1,19 @@
-#!/usr/bin/env kotlin
+﻿#!/usr/bin/env kotlin
 
 import java.io.File
 import java.util.concurrent.TimeUnit
 import kotlin.system.exitProcess
 
 // -------------------- MODE --------------------
-enum class Mode { RUN, COMPILE }
+enum class Mode { RUN, JVM, COMPILE, C }
 
 val mode = when (args.firstOrNull()?.lowercase()) {
     "run" -> Mode.RUN
+    "jvm" -> Mode.JVM
     "compile" -> Mode.COMPILE
+    "c" -> Mode.C
     else -> {
-        println("Usage: kotlin test_runner.kts [run|compile]")
+        println("Usage: kotlin test_runner.kts [run|jvm|compile|c]")
         exitProcess(1)
     }
 }
@@ -74,7 +76,13 @@ for (file in testFiles) {
     println("\nTesting ${file.name} (${mode.name.lowercase()})")
 
     // Run Kotlin interpreter/compiler
-    val (ok, output) = runCommand(listOf("java", "-jar", outJar.path, mode.name.lowercase(), file.path))
+    val command = when (mode) {
+        Mode.RUN -> listOf("run", file.path)
+        Mode.JVM -> listOf("run", file.path, "--compiled")
+        Mode.COMPILE -> listOf("compile", file.path)
+        Mode.C -> listOf("compile", file.path, "--target", "c")
+    }
+    val (ok, output) = runCommand(listOf("java", "-jar", outJar.path) + command)
 
     // Front-end failure
     if (!ok) {
@@ -84,20 +92,34 @@ for (file in testFiles) {
     }
 
     // C++ compilation failure detection
-    if (mode == Mode.COMPILE && output.contains("C++ compilation failed")) {
+    if (mode != Mode.RUN && mode != Mode.JVM && output.contains("compilation failed")) {
         results += TestResult(file.name, false, output)
         println("Failed (C++ compile)")
         continue
     }
 
     // Run exe if compile mode
-    if (mode == Mode.COMPILE) {
+    var programOutput = output
+    if (mode == Mode.COMPILE || mode == Mode.C) {
         val (exeOk, exeOut) = runCommand(listOf(exeFile.path))
         if (!exeOk) {
             results += TestResult(file.name, false, exeOut)
             println("Failed (runtime)")
             continue
         }
+        programOutput = exeOut
+    }
+
+    // Compare against <name>.expected when the test has one
+    val expectedFile = File(testDir, file.nameWithoutExtension + ".expected")
+    if (expectedFile.exists()) {
+        val expected = expectedFile.readText(Charsets.UTF_8).trimStart('\uFEFF').trim().lines()
+        val actual = programOutput.lines()
+        if (actual != expected) {
+            results += TestResult(file.name, false, "Expected:\n${expected.joinToString("\n")}\nGot:\n$programOutput")
+            println("Failed (output)")
+            continue
+        }
     }
 
     results += TestResult(file.name, true)